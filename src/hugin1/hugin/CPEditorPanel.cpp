@@ -1196,6 +1196,7 @@ vigra_ext::CorrelationResult PointFineTuneProjectionAware(const HuginBase::SrcPa
     cfg->Read(wxT("/Finetune/RotationStopAngle"), &stopAngle, HUGIN_FT_ROTATION_STOP_ANGLE);
     stopAngle = DEG_TO_RAD(stopAngle);
     int nSteps = cfg->Read(wxT("/Finetune/RotationSteps"), HUGIN_FT_ROTATION_STEPS);
+    const bool estimateRotation = cfg->Read(wxT("/Finetune/RotationEstimate"), HUGIN_FT_ROTATION_ESTIMATE) == 1;
     // if both images have the same projection and the angle does not differ to much use normal point fine-tune
     if (templ.getProjection() == search.getProjection()
         && templ.getHFOV() < 65 && search.getHFOV() < 65
@@ -1205,7 +1206,7 @@ vigra_ext::CorrelationResult PointFineTuneProjectionAware(const HuginBase::SrcPa
         if (rotatingFinetune)
         {
             res = vigra_ext::PointFineTuneRotSearch(templImg, templPos, templSize,
-                searchImg, searchPos, sWidth, startAngle, stopAngle, nSteps);
+                searchImg, searchPos, sWidth, startAngle, stopAngle, nSteps, estimateRotation);
         }
         else
         {
@@ -1276,7 +1277,7 @@ vigra_ext::CorrelationResult PointFineTuneProjectionAware(const HuginBase::SrcPa
     // we are always using the rotate fine-tune algorithm, because for this case
     // often a rotation is involved
     res = vigra_ext::PointFineTuneRotSearch(templImgMod, templPointInt, templSize,
-        searchImgMod, vigra::Diff2D(hugin_utils::roundi(searchX), hugin_utils::roundi(searchY)), sWidth, startAngle, stopAngle, nSteps);
+        searchImgMod, vigra::Diff2D(hugin_utils::roundi(searchX), hugin_utils::roundi(searchY)), sWidth, startAngle, stopAngle, nSteps, estimateRotation);
     // we transfer also the new found template position back to the original image
     transform.createTransform(templMod, opts);
     transform.transformImgCoord(res.corrPos.x, res.corrPos.y, templPointInt.x + 0.00001, templPointInt.y + 0.00001);
@@ -919,7 +919,8 @@ void CPImageCtrl::setImage(const std::string & file, ImageRotation imgRot)
             rescaleImage();
         } else {
             // load the image in the background.
-            m_imgRequest = ImageCache::getInstance().requestAsyncImage(imageFilename);
+            // the image is visible, so load it before other requested images
+            m_imgRequest = ImageCache::getInstance().requestAsyncImage(imageFilename, 1);
             m_imgRequest->ready.push_back(
                 std::bind(&CPImageCtrl::OnImageLoaded, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
                 );
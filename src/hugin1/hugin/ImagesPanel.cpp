@@ -467,7 +467,7 @@ void ImagesPanel::UpdatePreviewImage()
         // later. Then the user can switch between images in the list quickly,
         // even when not all images previews are in the cache.
         thumbnail_request = ImageCache::getInstance().requestAsyncSmallImage(
-                m_pano->getImage(m_showImgNr).getFilename());
+                m_pano->getImage(m_showImgNr).getFilename(), 1);
         // When the image is ready, try this function again.
         thumbnail_request->ready.push_back(
             std::bind(&ImagesPanel::UpdatePreviewImage, this)
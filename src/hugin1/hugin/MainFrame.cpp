@@ -61,6 +61,7 @@
 #include "base_wx/MyProgressDialog.h"
 #include "base_wx/RunStitchPanel.h"
 #include "base_wx/wxImageCache.h"
+#include "huginapp/ImageDiskCache.h"
 #include "base_wx/PTWXDlg.h"
 #include "base_wx/MyExternalCmdExecDialog.h"
 #include "base_wx/AssistantExecutor.h"
@@ -697,6 +698,16 @@ MainFrame::MainFrame(wxWindow* parent, HuginBase::Panorama & pano)
 #else
     ImageCache::getInstance().SetUpperLimit(wxConfigBase::Get()->Read(wxT("/ImageCache/UpperBound"), HUGIN_IMGCACHE_UPPERBOUND));
 #endif
+    // keep the small images between the sessions
+    if (wxConfigBase::Get()->Read(wxT("/ImageCache/DiskCache"), HUGIN_IMGCACHE_DISKCACHE) != 0)
+    {
+        const std::string cacheDir = HuginBase::ImageDiskCache::GetDefaultDirectory();
+        if (!cacheDir.empty())
+        {
+            const unsigned long long cacheSize = wxConfigBase::Get()->Read(wxT("/ImageCache/DiskCacheSize"), HUGIN_IMGCACHE_DISKCACHESIZE);
+            ImageCache::getInstance().setDiskCache(std::make_shared<HuginBase::ImageDiskCache>(cacheDir, cacheSize << 20));
+        };
+    };
 
     if(splash) {
         splash->Close();
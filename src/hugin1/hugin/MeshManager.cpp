@@ -72,14 +72,15 @@ void MeshManager::CheckUpdate()
         delete (meshes[meshes.size()-1]);
         meshes.pop_back();
     }
-    // check each existing image individualy.
+    // check each existing image individualy, only changed images are recalculated.
+    std::vector<MeshInfo*> changed_meshes;
     for (unsigned int i = 0; i < meshes.size(); i++)
     {
         if (visualization_state->RequireRecalculateMesh(i))
         {
             DEBUG_DEBUG("Update mesh for " << i);
             meshes[i]->SetSrcImage(visualization_state->GetSrcImage(i));
-            meshes[i]->Update();
+            changed_meshes.push_back(meshes[i]);
         }
     }
     // add any new images.
@@ -88,6 +89,24 @@ void MeshManager::CheckUpdate()
         DEBUG_INFO("Making new mesh remapper for image " << i << ".");
         //use the virtual method to get the right subclass for the MeshInfo
         meshes.push_back(this->ObtainMeshInfo(visualization_state->GetSrcImage(i), layout_mode_on));
+        changed_meshes.push_back(meshes.back());
+    }
+    UpdateMeshes(changed_meshes);
+}
+
+void MeshManager::UpdateMeshes(const std::vector<MeshInfo*> & update_meshes)
+{
+    // the remappers only read the shared panorama and visualization state,
+    // so the meshes of the different images can be calculated in parallel
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(update_meshes.size()); i++)
+    {
+        update_meshes[i]->CalculateMesh();
+    }
+    // OpenGL calls are only allowed in the GL thread
+    for (std::vector<MeshInfo*>::const_iterator it = update_meshes.begin(); it != update_meshes.end(); ++it)
+    {
+        (*it)->CompileList();
     }
 }
 
@@ -123,6 +142,7 @@ void MeshManager::SetLayoutScale(double scale)
 {
     for(unsigned int i=0;i<meshes.size();i++)
         meshes[i]->SetScaleFactor(scale);
+    UpdateMeshes(meshes);
 };
 
 
@@ -164,6 +184,13 @@ MeshManager::MeshInfo::~MeshInfo()
 
 void MeshManager::MeshInfo::Update()
 {
+    CalculateMesh();
+    CompileList();
+}
+
+void MeshManager::MeshInfo::CalculateMesh()
+{
+    DEBUG_ASSERT(remap);
     if (layout_mode_on)
     {
         /** @todo Maybe we should find the scale once, instead of for each
@@ -175,7 +202,19 @@ void MeshManager::MeshInfo::Update()
         LayoutRemapper &r = dynamic_cast<LayoutRemapper &>(remapper_ref);
         r.setScale(scale);
     }
-    this->CompileList();
+    faces.clear();
+
+    this->BeforeCompile();
+
+    remap->UpdateAndResetIndex();
+    // get each face's coordinates from the remapper
+    MeshRemapper::Coords coords;
+    while (remap->GetNextFaceCoordinates(&coords))
+    {
+        faces.push_back(m_visualization_state->GetMeshManager()->GetMeshCoords3D(coords));
+    }
+
+    this->AfterCompile();
 }
 
 MeshManager::MeshInfo::MeshCoords3D::MeshCoords3D(const MeshRemapper::Coords & coords)
@@ -194,7 +233,6 @@ MeshManager::MeshInfo::MeshCoords3D::MeshCoords3D(const MeshRemapper::Coords & c
 void MeshManager::MeshInfo::SetScaleFactor(double scale)
 {
     scale_factor=scale;
-    Update();
 };
 
 void MeshManager::MeshInfo::CallList() const
@@ -207,17 +245,13 @@ void MeshManager::MeshInfo::CompileList()
     // build the display list from the coordinates generated by the remapper
 //    DEBUG_INFO("Preparing to compile a display list for overview for " << image_number
 //              << ".");
-    DEBUG_ASSERT(remap);
     bool multiTexture=m_visualization_state->getViewState()->GetSupportMultiTexture();
     unsigned int number_of_faces = 0;
 
     DEBUG_DEBUG("mesh update compile pano");
 
-    this->BeforeCompile();
-
     glNewList(display_list_number, GL_COMPILE);
 
-        remap->UpdateAndResetIndex();
         DEBUG_INFO("Specifying faces in display list.");
 
         glPushMatrix();
@@ -227,11 +261,10 @@ void MeshManager::MeshInfo::CompileList()
         #ifndef WIREFRAME
         glBegin(GL_QUADS);
         #endif
-            // get each face's coordinates from the remapper
-            MeshRemapper::Coords coords;
-            while (remap->GetNextFaceCoordinates(&coords))
+            // use the faces calculated by CalculateMesh
+            for (std::vector<MeshCoords3D>::const_iterator face = faces.begin(); face != faces.end(); ++face)
             {
-                MeshCoords3D coords3d = m_visualization_state->GetMeshManager()->GetMeshCoords3D(coords);
+                const MeshCoords3D & coords3d = *face;
 //                DEBUG_DEBUG("mesh update " << coords3d.vertex_coords[0][0][0] << " " << coords3d.vertex_coords[0][0][1] << " " << coords3d.vertex_coords[0][0][2]);
                 number_of_faces++;
                 // go in an anticlockwise direction
@@ -282,8 +315,8 @@ void MeshManager::MeshInfo::CompileList()
 
     glEndList();
 
-
-    this->AfterCompile();
+    // the faces are stored in the display list, free the memory
+    std::vector<MeshCoords3D>().swap(faces);
 //    DEBUG_INFO("Prepared a display list for " << image_number << ", using "
 //              << number_of_faces << " face(s).");
     DEBUG_DEBUG("after compile mesh");
@@ -83,7 +83,15 @@ public:
         void CallList() const;
         /// Recreate the mesh when the image or panorama it represents changes.
         void Update();
+        /** Calculate the faces of the mesh with the remapper. No OpenGL calls
+         * are made, so the meshes of several images can be calculated in
+         * parallel. CompileList must be called afterwards in the GL thread.
+         */
+        void CalculateMesh();
+        /// Create the display list from the faces found by CalculateMesh.
+        void CompileList();
         unsigned int display_list_number;
+        /// Set the scale for the layout mode, it is used by the next update of the mesh.
         void SetScaleFactor(double scale);
         void SetSrcImage(HuginBase::SrcPanoImage * image) {this->image = *image;}
 
@@ -122,8 +130,8 @@ public:
         VisualizationState *m_visualization_state;
         /// The ramapper we should use
         MeshRemapper * remap;
-        /// Use the remapper to create the display list.
-        void CompileList();
+        /// The faces calculated by CalculateMesh, cleared by CompileList.
+        std::vector<MeshCoords3D> faces;
         bool layout_mode_on;
     };
 
@@ -136,7 +144,6 @@ public:
     public:
         PreviewMeshInfo(HuginBase::Panorama * m_pano, HuginBase::SrcPanoImage * image,
                  VisualizationState * visualization_state, bool layout_mode_on) : MeshInfo(m_pano, image, visualization_state, layout_mode_on) {
-            Update();
         }
         PreviewMeshInfo(const PreviewMeshInfo & source) : MeshInfo((MeshInfo)source) {
             Update();
@@ -158,7 +165,6 @@ public:
                  VisualizationState * visualization_state, bool layout_mode_on)
             : MeshInfo(m_pano, image, visualization_state, layout_mode_on) {
                 scale_factor *= scale_diff;
-                Update();
             }
 
         PanosphereOverviewMeshInfo(const PanosphereOverviewMeshInfo & source)
@@ -196,7 +202,6 @@ public:
         PlaneOverviewMeshInfo(HuginBase::Panorama * m_pano, HuginBase::SrcPanoImage * image,
                  VisualizationState * visualization_state, bool layout_mode_on)
             : MeshInfo(m_pano, image, visualization_state, layout_mode_on) {
-                Update();
             }
 
         PlaneOverviewMeshInfo(const PlaneOverviewMeshInfo & source)
@@ -214,10 +219,17 @@ public:
     virtual MeshInfo::Coord3D GetCoord3D(hugin_utils::FDiff2D &) = 0;
     
 
+    /** create a MeshInfo of the right subclass for the image, the mesh itself
+     * is not calculated yet.
+     */
     virtual MeshInfo * ObtainMeshInfo(HuginBase::SrcPanoImage *, bool layout_mode_on) = 0;
 
 protected:
 
+    /** Recalculate the given meshes, the faces are calculated in parallel,
+     * the display lists are created afterwards in the calling (GL) thread.
+     */
+    static void UpdateMeshes(const std::vector<MeshInfo*> & update_meshes);
 
     HuginBase::Panorama  * m_pano;
     VisualizationState * visualization_state;
@@ -55,6 +55,7 @@ BEGIN_EVENT_TABLE(OptimizePanel, wxPanel)
     EVT_BUTTON(XRCID("optimize_panel_reset"), OptimizePanel::OnReset)
     EVT_CHECKBOX(XRCID("optimizer_panel_only_active_images"), OptimizePanel::OnCheckOnlyActiveImages)
     EVT_CHECKBOX(XRCID("optimizer_panel_ignore_line_cp"), OptimizePanel::OnCheckIgnoreLineCP)
+    EVT_CHECKBOX(XRCID("optimizer_panel_sparse"), OptimizePanel::OnCheckSparseOptimizer)
 END_EVENT_TABLE()
 
 
@@ -96,6 +97,9 @@ bool OptimizePanel::Create(wxWindow* parent, wxWindowID id , const wxPoint& pos,
 
     m_edit_cb = XRCCTRL(*this, "optimizer_panel_edit_script", wxCheckBox);
     DEBUG_ASSERT(m_edit_cb);
+    m_sparse_cb = XRCCTRL(*this, "optimizer_panel_sparse", wxCheckBox);
+    DEBUG_ASSERT(m_sparse_cb);
+    m_sparse_cb->SetValue(wxConfigBase::Get()->Read(wxT("/OptimizePanel/SparseOptimizer"), 0l) != 0);
 
     XRCCTRL(*this, "optimizer_panel_splitter", wxSplitterWindow)->SetSashGravity(0.66);
 
@@ -137,6 +141,10 @@ void OptimizePanel::panoramaChanged(HuginBase::Panorama & pano)
     m_images_tree_list->Enable(m_pano->getOptimizerSwitch()==0);
     m_lens_tree_list->Enable(m_pano->getOptimizerSwitch()==0);
     m_edit_cb->Enable(m_pano->getOptimizerSwitch()==0);
+    // the sparse optimizer handles only yaw, pitch and roll
+    const int mode = m_pano->getOptimizerSwitch();
+    m_sparse_cb->Enable(mode == HuginBase::OPT_PAIR || mode == HuginBase::OPT_POSITION ||
+        (mode == 0 && HuginBase::SparseOptimizer::optimizesPositionsOnly(m_pano->getOptimizeVector())));
 }
 
 void OptimizePanel::panoramaImagesChanged(HuginBase::Panorama &pano,
@@ -219,6 +227,7 @@ void OptimizePanel::runOptimizer(const HuginBase::UIntSet & imgs, const bool ign
     char *oldlocale = strdup(p);
     setlocale(LC_ALL,"C");
     HuginBase::CPVector originalCps;
+    const HuginBase::OptimizerBackend backend = (m_sparse_cb->IsEnabled() && m_sparse_cb->IsChecked()) ? HuginBase::OPTIMIZER_SPARSE : HuginBase::OPTIMIZER_PANOTOOLS;
 
     if (mode & HuginBase::OPT_PAIR )
     {
@@ -227,7 +236,7 @@ void OptimizePanel::runOptimizer(const HuginBase::UIntSet & imgs, const bool ign
         {
             wxBusyCursor bc;
             // run pairwise optimizer
-            HuginBase::AutoOptimise(optPano).run();
+            HuginBase::AutoOptimise::autoOptimise(optPano, true, backend);
         }
 #ifdef DEBUG
         // print optimized script to cout
@@ -237,7 +246,7 @@ void OptimizePanel::runOptimizer(const HuginBase::UIntSet & imgs, const bool ign
 
         registerPTWXDlgFcn();
         // do global optimisation
-        HuginBase::PTools::optimize(optPano);
+        HuginBase::OptimizeGeometric(optPano, backend);
 #ifdef DEBUG
         // print optimized script to cout
         DEBUG_DEBUG("panorama after optimise():");
@@ -300,7 +309,7 @@ void OptimizePanel::runOptimizer(const HuginBase::UIntSet & imgs, const bool ign
         }
         else
         {
-            HuginBase::PTools::optimize(optPano);
+            HuginBase::OptimizeGeometric(optPano, backend);
         }
 #ifdef DEBUG
         // print optimized script to cout
@@ -432,6 +441,11 @@ void OptimizePanel::SetIgnoreLineCP(const bool noLineCp)
     m_ignore_line_cp->SetValue(noLineCp);
 };
 
+void OptimizePanel::OnCheckSparseOptimizer(wxCommandEvent &e)
+{
+    wxConfigBase::Get()->Write(wxT("/OptimizePanel/SparseOptimizer"), m_sparse_cb->IsChecked());
+};
+
 IMPLEMENT_DYNAMIC_CLASS(OptimizePanel, wxPanel)
 
 
@@ -64,6 +64,8 @@ public:
     void OnCheckIgnoreLineCP(wxCommandEvent &e);
     /** for external setting of "ignore line cp" checkbox */
     void SetIgnoreLineCP(const bool noLineCp);
+    /** handle "use sparse optimizer" checkbox */
+    void OnCheckSparseOptimizer(wxCommandEvent &e);
     void SetGuiLevel(GuiLevel newGuiLevel);
 
 protected:
@@ -81,6 +83,7 @@ protected:
     wxCheckBox * m_only_active_images_cb;
     wxCheckBox * m_ignore_line_cp;
     wxCheckBox * m_edit_cb;
+    wxCheckBox * m_sparse_cb;
 
     HuginBase::Panorama * m_pano;
 private:
@@ -918,19 +918,30 @@ void PanoPanel::OnBlenderOptions(wxCommandEvent & e)
             }
             else
             {
-                verdandiBlendModeChoice->SetSelection(0);
+                if (opt.verdandiOptions.find("--seam=pyramid") != std::string::npos)
+                {
+                    verdandiBlendModeChoice->SetSelection(2);
+                }
+                else
+                {
+                    verdandiBlendModeChoice->SetSelection(0);
+                };
             };
             dlg.CentreOnParent();
 
             if (dlg.ShowModal() == wxID_OK)
             {
-                if (verdandiBlendModeChoice->GetSelection() == 1)
+                switch (verdandiBlendModeChoice->GetSelection())
                 {
-                    opt.verdandiOptions = "--seam=blend";
-                }
-                else
-                {
-                    opt.verdandiOptions = "";
+                    case 1:
+                        opt.verdandiOptions = "--seam=blend";
+                        break;
+                    case 2:
+                        opt.verdandiOptions = "--seam=pyramid";
+                        break;
+                    default:
+                        opt.verdandiOptions = "";
+                        break;
                 };
                 PanoCommand::GlobalCmdHist::getInstance().addCommand(new PanoCommand::SetPanoOptionsCmd(*pano, opt));
             };
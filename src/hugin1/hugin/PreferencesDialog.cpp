@@ -73,6 +73,7 @@ BEGIN_EVENT_TABLE(PreferencesDialog, wxDialog)
     EVT_BUTTON(XRCID("pref_exiftool_argfile2_edit"), PreferencesDialog::OnExifArgfile2Edit)
     EVT_CHECKBOX(XRCID("pref_exiftool_metadata"), PreferencesDialog::OnExifTool)
     EVT_CHECKBOX(XRCID("prefs_ft_RotationSearch"), PreferencesDialog::OnRotationCheckBox)
+    EVT_CHECKBOX(XRCID("prefs_cache_DiskCache"), PreferencesDialog::OnDiskCacheCheckBox)
     EVT_CHECKBOX(XRCID("prefs_enblend_Custom"), PreferencesDialog::OnCustomEnblend)
     EVT_CHECKBOX(XRCID("prefs_enblend_enfuseCustom"), PreferencesDialog::OnCustomEnfuse)
     EVT_BUTTON(XRCID("pref_cpdetector_new"), PreferencesDialog::OnCPDetectorAdd)
@@ -297,6 +298,11 @@ void PreferencesDialog::OnRotationCheckBox(wxCommandEvent& e)
     EnableRotationCtrls(e.IsChecked());
 }
 
+void PreferencesDialog::OnDiskCacheCheckBox(wxCommandEvent& e)
+{
+    XRCCTRL(*this, "prefs_cache_DiskCacheSize", wxSpinCtrl)->Enable(e.IsChecked());
+}
+
 void PreferencesDialog::OnEnblendExe(wxCommandEvent& e)
 {
     wxFileDialog dlg(this,_("Select Enblend"),
@@ -570,6 +576,7 @@ void PreferencesDialog::OnExifTool(wxCommandEvent & e)
 void PreferencesDialog::EnableRotationCtrls(bool enable)
 {
     XRCCTRL(*this, "prefs_ft_rot_panel", wxPanel)->Enable(enable);
+    XRCCTRL(*this, "prefs_ft_RotationEstimate", wxCheckBox)->Enable(enable);
 }
 
 void PreferencesDialog::UpdateDisplayData(int panel)
@@ -598,6 +605,11 @@ void PreferencesDialog::UpdateDisplayData(int panel)
         }
 #endif
         MY_SPIN_VAL("prefs_cache_UpperBound", mem >> 20);
+        // disk cache for the small images
+        t = cfg->Read(wxT("/ImageCache/DiskCache"), HUGIN_IMGCACHE_DISKCACHE) != 0;
+        MY_BOOL_VAL("prefs_cache_DiskCache", t);
+        MY_SPIN_VAL("prefs_cache_DiskCacheSize", cfg->Read(wxT("/ImageCache/DiskCacheSize"), HUGIN_IMGCACHE_DISKCACHESIZE));
+        XRCCTRL(*this, "prefs_cache_DiskCacheSize", wxSpinCtrl)->Enable(t);
 
         // language
         // check if current language is in list and activate it then.
@@ -719,6 +731,9 @@ void PreferencesDialog::UpdateDisplayData(int panel)
 
         MY_SPIN_VAL("prefs_ft_RotationSteps", cfg->Read(wxT("/Finetune/RotationSteps"),
                     HUGIN_FT_ROTATION_STEPS));
+
+        t = cfg->Read(wxT("/Finetune/RotationEstimate"), HUGIN_FT_ROTATION_ESTIMATE) == 1;
+        MY_BOOL_VAL("prefs_ft_RotationEstimate", t);
     }
 
     /////
@@ -753,7 +768,14 @@ void PreferencesDialog::UpdateDisplayData(int panel)
         }
         else
         {
-            XRCCTRL(*this, "pref_internal_blender_seam", wxChoice)->SetSelection(0);
+            if (defaultVerdandiArgs.Find(wxT("--seam=pyramid")) != wxNOT_FOUND)
+            {
+                XRCCTRL(*this, "pref_internal_blender_seam", wxChoice)->SetSelection(2);
+            }
+            else
+            {
+                XRCCTRL(*this, "pref_internal_blender_seam", wxChoice)->SetSelection(0);
+            };
         };
         UpdateBlenderControls();
 
@@ -862,6 +884,8 @@ void PreferencesDialog::OnRestoreDefaults(wxCommandEvent& e)
             #endif
             */
             cfg->Write(wxT("/ImageCache/UpperBound"), HUGIN_IMGCACHE_UPPERBOUND);
+            cfg->Write(wxT("/ImageCache/DiskCache"), HUGIN_IMGCACHE_DISKCACHE);
+            cfg->Write(wxT("/ImageCache/DiskCacheSize"), HUGIN_IMGCACHE_DISKCACHESIZE);
             // locale
             cfg->Write(wxT("language"), int(HUGIN_LANGUAGE));
             // smart undo
@@ -907,6 +931,7 @@ void PreferencesDialog::OnRestoreDefaults(wxCommandEvent& e)
             cfg->Write(wxT("/Finetune/RotationStartAngle"), HUGIN_FT_ROTATION_START_ANGLE);
             cfg->Write(wxT("/Finetune/RotationStopAngle"), HUGIN_FT_ROTATION_STOP_ANGLE);
             cfg->Write(wxT("/Finetune/RotationSteps"), HUGIN_FT_ROTATION_STEPS);
+            cfg->Write(wxT("/Finetune/RotationEstimate"), HUGIN_FT_ROTATION_ESTIMATE);
         }
         if (noteb->GetSelection() == 4)
         {
@@ -1008,6 +1033,7 @@ void PreferencesDialog::UpdateConfigData()
     cfg->Write(wxT("/Finetune/RotationStartAngle"), (double) MY_G_SPIN_VAL("prefs_ft_RotationStartAngle"));
     cfg->Write(wxT("/Finetune/RotationStopAngle"), (double) MY_G_SPIN_VAL("prefs_ft_RotationStopAngle"));
     cfg->Write(wxT("/Finetune/RotationSteps"), MY_G_SPIN_VAL("prefs_ft_RotationSteps"));
+    cfg->Write(wxT("/Finetune/RotationEstimate"), MY_G_BOOL_VAL("prefs_ft_RotationEstimate"));
 
     /////
     /// MISC
@@ -1017,6 +1043,8 @@ void PreferencesDialog::UpdateConfigData()
     cfg->Write(wxT("/ImageCache/UpperBoundHigh"), (long) MY_G_SPIN_VAL("prefs_cache_UpperBound") >> 12);
 #endif
     cfg->Write(wxT("/ImageCache/UpperBound"), (long) MY_G_SPIN_VAL("prefs_cache_UpperBound") << 20);
+    cfg->Write(wxT("/ImageCache/DiskCache"), MY_G_BOOL_VAL("prefs_cache_DiskCache"));
+    cfg->Write(wxT("/ImageCache/DiskCacheSize"), (long) MY_G_SPIN_VAL("prefs_cache_DiskCacheSize"));
     // locale
     // language
     wxChoice* lang = XRCCTRL(*this, "prefs_gui_language", wxChoice);
@@ -1065,13 +1093,17 @@ void PreferencesDialog::UpdateConfigData()
     cfg->Write(wxT("/output/jpeg_quality"), MY_G_SPIN_VAL("pref_jpeg_quality"));
 
     cfg->Write(wxT("/default_blender"), static_cast<long>(GetSelectedValue(XRCCTRL(*this, "pref_default_blender", wxChoice))));
-    if (XRCCTRL(*this, "pref_internal_blender_seam", wxChoice)->GetSelection() == 1)
+    switch (XRCCTRL(*this, "pref_internal_blender_seam", wxChoice)->GetSelection())
     {
-        cfg->Write(wxT("/VerdandiDefaultArgs"), wxT("--seam=blend"));
-    }
-    else
-    {
-        cfg->Write(wxT("/VerdandiDefaultArgs"), wxEmptyString);
+        case 1:
+            cfg->Write(wxT("/VerdandiDefaultArgs"), wxT("--seam=blend"));
+            break;
+        case 2:
+            cfg->Write(wxT("/VerdandiDefaultArgs"), wxT("--seam=pyramid"));
+            break;
+        default:
+            cfg->Write(wxT("/VerdandiDefaultArgs"), wxEmptyString);
+            break;
     };
 
     /////
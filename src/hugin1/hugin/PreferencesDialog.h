@@ -60,6 +60,7 @@ protected:
     void OnHelp(wxCommandEvent & e);
     void OnCancel(wxCommandEvent & e);
     void OnRotationCheckBox(wxCommandEvent & e);
+    void OnDiskCacheCheckBox(wxCommandEvent & e);
     void OnEnblendExe(wxCommandEvent & e);
     void OnEnfuseExe(wxCommandEvent & e);
     void OnDcrawExe(wxCommandEvent & e);
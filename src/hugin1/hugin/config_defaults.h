@@ -53,10 +53,14 @@
 #define HUGIN_FT_ROTATION_START_ANGLE         -30.0
 #define HUGIN_FT_ROTATION_STOP_ANGLE           30.0
 #define HUGIN_FT_ROTATION_STEPS               12l
+#define HUGIN_FT_ROTATION_ESTIMATE            1l
 
 
 // Image cache defaults
 #define HUGIN_IMGCACHE_UPPERBOUND             268435456
+#define HUGIN_IMGCACHE_DISKCACHE              1l
+// size of the disk cache of the small images in MB
+#define HUGIN_IMGCACHE_DISKCACHESIZE          512l
 #define HUGIN_IMGCACHE_MAPPING_INTEGER        0l
 #define HUGIN_IMGCACHE_MAPPING_FLOAT          1l
 
@@ -287,8 +287,11 @@ void FindPanoDialog::OnButtonStart(wxCommandEvent& e)
             wxCommandEvent dummy;
             OnSelectPossiblePano(dummy);
             EnableButtons(false);
+            // the EXIF data of already scanned files are cached in the user data directory
+            const bool useCache = wxConfigBase::Get()->Read(wxT("/FindPanoDialog/UseMetadataCache"), true);
+            HuginBase::MetadataScanner scanner(useCache ? HuginBase::MetadataScanner::GetDefaultCacheFilename() : std::string());
             SearchInDir(m_start_dir,m_cb_subdir->GetValue(), m_cb_loadDistortion->GetValue(), m_cb_loadVignetting->GetValue(), 
-                m_sc_minNumberImages->GetValue(), m_sc_maxTimeDiff->GetValue());
+                m_sc_minNumberImages->GetValue(), m_sc_maxTimeDiff->GetValue(), scanner);
         }
         else
         {
@@ -481,7 +484,8 @@ int SortWxFilenames(const wxString& s1,const wxString& s2)
     return doj::alphanum_comp(std::string(s1.mb_str(wxConvLocal)),std::string(s2.mb_str(wxConvLocal)));
 };
 
-void FindPanoDialog::SearchInDir(wxString dirstring, const bool includeSubdir, const bool loadDistortion, const bool loadVignetting, const size_t minNumberImages, const size_t maxTimeDiff)
+void FindPanoDialog::SearchInDir(wxString dirstring, const bool includeSubdir, const bool loadDistortion, const bool loadVignetting, const size_t minNumberImages, const size_t maxTimeDiff,
+    HuginBase::MetadataScanner& scanner)
 {
     std::vector<PossiblePano*> newPanos;
     wxTimeSpan max_diff(0, 0, maxTimeDiff, 0); 
@@ -489,20 +493,38 @@ void FindPanoDialog::SearchInDir(wxString dirstring, const bool includeSubdir, c
     wxArrayString fileList;
     wxDir::GetAllFiles(dirstring,&fileList,wxEmptyString,wxDIR_FILES|wxDIR_HIDDEN);
     fileList.Sort(SortWxFilenames);
-    //map for caching projection information to prevent reading from database for each image
-    for(size_t j=0; j<fileList.size() && !m_stopped; j++)
-    {
-        m_statustext->SetLabel(wxString::Format(_("Reading file %s"),fileList[j].c_str()));
-        wxFileName file(fileList[j]);
-        file.MakeAbsolute();
-        wxString ext=file.GetExt();
-        if(ext.CmpNoCase(wxT("jpg"))==0 || ext.CmpNoCase(wxT("jpeg"))==0 ||
-                ext.CmpNoCase(wxT("tif"))==0 || ext.CmpNoCase(wxT("tiff"))==0)
+    // the EXIF data are read in blocks by several threads in parallel,
+    // between the blocks the dialog processes events, so it stays responsive
+    const size_t blockSize = 64;
+    for (size_t blockStart = 0; blockStart < fileList.size() && !m_stopped; blockStart += blockSize)
+    {
+        const size_t blockEnd = std::min(blockStart + blockSize, fileList.size());
+        m_statustext->SetLabel(wxString::Format(_("Reading file %s"),fileList[blockStart].c_str()));
+        wxGetApp().Yield(true);
+        std::vector<HuginBase::SrcPanoImage*> images;
+        for (size_t j = blockStart; j < blockEnd; j++)
         {
-            std::string filenamestr(file.GetFullPath().mb_str(HUGIN_CONV_FILENAME));
-            HuginBase::SrcPanoImage* img = new HuginBase::SrcPanoImage;
-            img->setFilename(filenamestr);
-            img->readEXIF();
+            wxFileName file(fileList[j]);
+            file.MakeAbsolute();
+            wxString ext=file.GetExt();
+            if(ext.CmpNoCase(wxT("jpg"))==0 || ext.CmpNoCase(wxT("jpeg"))==0 ||
+                    ext.CmpNoCase(wxT("tif"))==0 || ext.CmpNoCase(wxT("tiff"))==0)
+            {
+                std::string filenamestr(file.GetFullPath().mb_str(HUGIN_CONV_FILENAME));
+                HuginBase::SrcPanoImage* img = new HuginBase::SrcPanoImage;
+                img->setFilename(filenamestr);
+                images.push_back(img);
+            };
+        };
+        scanner.readEXIF(images);
+        for (size_t j = 0; j < images.size(); j++)
+        {
+            HuginBase::SrcPanoImage* img = images[j];
+            if (m_stopped)
+            {
+                delete img;
+                continue;
+            };
             // check for black/white images, if so skip
             const HuginBase::FileMetaData& metadata = img->getFileMetadata();
             HuginBase::FileMetaData::const_iterator it = metadata.find("pixeltype");
@@ -510,7 +532,7 @@ void FindPanoDialog::SearchInDir(wxString dirstring, const bool includeSubdir, c
             {
                 if (it->second == "BILEVEL")
                 { 
-                    wxGetApp().Yield(true);
+                    delete img;
                     continue;
                 };
             };
@@ -581,7 +603,7 @@ void FindPanoDialog::SearchInDir(wxString dirstring, const bool includeSubdir, c
         bool cont=dir.GetFirst(&filename,wxEmptyString,wxDIR_DIRS);
         while(cont && !m_stopped)
         {
-            SearchInDir(dir.GetName()+wxFileName::GetPathSeparator()+filename,includeSubdir, loadDistortion, loadVignetting, minNumberImages, maxTimeDiff);
+            SearchInDir(dir.GetName()+wxFileName::GetPathSeparator()+filename,includeSubdir, loadDistortion, loadVignetting, minNumberImages, maxTimeDiff, scanner);
             cont=dir.GetNext(&filename);
         }
     };
@@ -29,6 +29,7 @@
 #include <vector>
 #include "panoinc_WX.h"
 #include "panoinc.h"
+#include "panodata/MetadataScanner.h"
 #include "BatchFrame.h"
 
 extern "C"
@@ -105,7 +106,8 @@ private:
     TIFFErrorHandler m_oldtiffwarning;
 
     void EnableButtons(const bool state);
-    void SearchInDir(wxString dirstring, const bool includeSubdir, const bool loadDistortion, const bool loadVignetting, const size_t minNumberImages, const size_t maxTimeDiff);
+    void SearchInDir(wxString dirstring, const bool includeSubdir, const bool loadDistortion, const bool loadVignetting, const size_t minNumberImages, const size_t maxTimeDiff,
+        HuginBase::MetadataScanner& scanner);
     void CleanUpPanolist();
     DECLARE_EVENT_TABLE()
 };
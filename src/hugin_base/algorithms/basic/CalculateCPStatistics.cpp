@@ -27,6 +27,7 @@
 #include "CalculateCPStatistics.h"
 
 #include <math.h>
+#include <algorithm>
 #include <hugin_math/hugin_math.h>
 #include <panodata/PanoramaData.h>
 
@@ -35,6 +36,32 @@ namespace HuginBase {
 
     
     
+/** partial error statistics of a block of control points */
+struct CPErrorStats
+{
+    CPErrorStats() : n(0), mean(0), m2(0), min(1000000), max(0) {};
+    /** adds the statistics of the next block, uses the pairwise update of Chan et al. */
+    void add(const CPErrorStats& other)
+    {
+        if (other.n == 0)
+        {
+            return;
+        };
+        const size_t newN = n + other.n;
+        const double delta = other.mean - mean;
+        mean += delta * other.n / newN;
+        m2 += other.m2 + delta * delta * n * other.n / newN;
+        n = newN;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    };
+    size_t n;
+    double mean;
+    double m2;
+    double min;
+    double max;
+};
+
 void CalculateCPStatisticsError::calcCtrlPntsErrorStats(const PanoramaData& pano,
                                                         double & min, double & max, double & mean,
                                                         double & var,
@@ -44,39 +71,53 @@ void CalculateCPStatisticsError::calcCtrlPntsErrorStats(const PanoramaData& pano
 {
     const CPVector& cps = pano.getCtrlPoints();
     const UIntSet activeImgs(pano.getActiveImages());
-    max = 0;
-    min = 1000000;
-    mean = 0;
-    var = 0;
-    
-    int n=0;
-    CPVector::const_iterator it;
-    for (it = cps.begin() ; it != cps.end(); ++it) {
-        if (imgNr >= 0 && ((int)(*it).image1Nr != imgNr || (int)(*it).image2Nr != imgNr))
-        {
-            continue;
-        }
-        if (onlyActive && (!set_contains(activeImgs, it->image1Nr) || !set_contains(activeImgs, it->image2Nr)))
+    // the control points are processed in blocks of fixed size, the blocks are
+    // combined in order afterwards, so the result does not depend on the number of threads
+    const int blockSize = 4096;
+    const int nrBlocks = (cps.size() + blockSize - 1) / blockSize;
+    std::vector<CPErrorStats> blockStats(nrBlocks);
+#pragma omp parallel for schedule(dynamic)
+    for (int block = 0; block < nrBlocks; ++block)
+    {
+        CPErrorStats& stats = blockStats[block];
+        const size_t end = std::min<size_t>(cps.size(), (block + 1) * static_cast<size_t>(blockSize));
+        for (size_t i = block * static_cast<size_t>(blockSize); i < end; ++i)
         {
-            continue;
-        };
-        if (ignoreLineCp && it->mode != ControlPoint::X_Y)
-        {
-            continue;
+            const ControlPoint& cp = cps[i];
+            if (imgNr >= 0 && ((int)cp.image1Nr != imgNr || (int)cp.image2Nr != imgNr))
+            {
+                continue;
+            }
+            if (onlyActive && (!set_contains(activeImgs, cp.image1Nr) || !set_contains(activeImgs, cp.image2Nr)))
+            {
+                continue;
+            };
+            if (ignoreLineCp && cp.mode != ControlPoint::X_Y)
+            {
+                continue;
+            };
+            stats.n++;
+            const double x = cp.error;
+            const double delta = x - stats.mean;
+            stats.mean += delta / stats.n;
+            stats.m2 += delta*(x - stats.mean);
+            if (x > stats.max) {
+                stats.max = x;
+            }
+            if (x < stats.min) {
+                stats.min = x;
+            }
         };
-        n++;
-        double x = (*it).error;
-        double delta = x - mean;
-        mean += delta/n;
-        var += delta*(x - mean);
-        if (x > max) {
-            max= (*it).error;
-        }
-        if (x < min) {
-            min= (*it).error;
-        }
-    }
-    var = var/(n-1);
+    };
+    CPErrorStats result;
+    for (size_t i = 0; i < blockStats.size(); ++i)
+    {
+        result.add(blockStats[i]);
+    };
+    min = result.min;
+    max = result.max;
+    mean = result.mean;
+    var = result.m2 / (static_cast<double>(result.n) - 1);
 }    
 
 
@@ -54,12 +54,20 @@ bool CalculateOptimalROI::calcOptimalROI(PanoramaData& panorama)
         return false;
     };
 
+    // the transformation is evaluated for each pixel of the panorama,
+    // so use the interpolated meshes, shared with the cache of the panorama
+    PTools::TransformMeshCache* meshCache = panorama.getTransformMeshCache();
     for (UIntSet::const_iterator it=activeImages.begin(); it!=activeImages.end(); ++it)
     {
         const SrcPanoImage &img=panorama.getImage(*it);
-        PTools::Transform *transf=new PTools::Transform();
-        transf->createTransform(img,opt);
-        transfMap.insert(std::pair<unsigned int,PTools::Transform*>(*it,transf));
+        if (meshCache)
+        {
+            transfMap[*it] = meshCache->getMesh(*it, img, opt);
+        }
+        else
+        {
+            transfMap[*it].reset(new PTools::TransformMesh(img, opt));
+        };
     }
     
     if (!getProgressDisplay()->updateDisplay("Calculate the cropping region"))
@@ -80,10 +88,7 @@ bool CalculateOptimalROI::calcOptimalROI(PanoramaData& panorama)
 
 void CalculateOptimalROI::CleanUp()
 {
-    for (std::map<unsigned int, PTools::Transform*>::iterator it = transfMap.begin(); it != transfMap.end(); ++it)
-    {
-        delete (*it).second;
-    };
+    transfMap.clear();
 };
 
 //now you can do dynamic programming, look thinks up on fly
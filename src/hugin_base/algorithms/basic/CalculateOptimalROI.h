@@ -25,7 +25,7 @@
 #define _BASICALGORITHMS_CALCULATEOPTIMALROI_H
 
 #include <hugin_shared.h>
-#include <panotools/PanoToolsInterface.h>
+#include <panotools/TransformMesh.h>
 #include <algorithms/PanoramaAlgorithm.h>
 #include <panodata/PanoramaData.h>
 
@@ -91,7 +91,7 @@ class IMPEX CalculateOptimalROI : public TimeConsumingPanoramaAlgorithm
         bool intersection;
         std::vector<UIntSet> stacks;
         UIntSet activeImages;
-        std::map<unsigned int,PTools::Transform*> transfMap;
+        std::map<unsigned int, PTools::TransformMeshCache::MeshPtr> transfMap;
         //map for storing already tested pixels
         std::vector<bool> testedPixels;
         std::vector<bool> pixels;
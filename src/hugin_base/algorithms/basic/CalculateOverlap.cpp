@@ -27,9 +27,90 @@
  */
 
 #include "CalculateOverlap.h"
+#include <algorithm>
+#include <hugin_math/hugin_math.h>
 
 namespace HuginBase {
 
+/** cone on the panorama sphere, which contains the whole image */
+struct ImageCone
+{
+    /** direction of the image centre as unit vector */
+    double dir[3];
+    /** opening angle in radian, M_PI if the image can cover any direction */
+    double radius;
+};
+
+/** converts the coordinates of the 360x180 equirectangular panorama into a unit vector */
+static void EquirectToVector(const double x, const double y, double* v)
+{
+    const double lon = (x - 180.0) * M_PI / 180.0;
+    const double lat = (90.0 - y) * M_PI / 180.0;
+    v[0] = cos(lat) * cos(lon);
+    v[1] = cos(lat) * sin(lon);
+    v[2] = sin(lat);
+}
+
+static double AngleBetween(const double* v1, const double* v2)
+{
+    const double dot = v1[0] * v2[0] + v1[1] * v2[1] + v1[2] * v2[2];
+    return acos(std::max(-1.0, std::min(1.0, dot)));
+}
+
+/** calculates the cone of the image from the directions of the image centre and
+ *  points along the image border */
+static ImageCone GetImageCone(const SrcPanoImage& img)
+{
+    ImageCone cone;
+    cone.dir[0] = 1.0;
+    cone.dir[1] = 0.0;
+    cone.dir[2] = 0.0;
+    cone.radius = M_PI;
+    // with translation parameters the image is not a simple rotation on the sphere
+    if (img.getX() != 0.0 || img.getY() != 0.0 || img.getZ() != 0.0)
+    {
+        return cone;
+    };
+    PanoramaOptions opts;
+    opts.setProjection(PanoramaOptions::EQUIRECTANGULAR);
+    opts.setHFOV(360);
+    opts.setWidth(360);
+    opts.setHeight(180);
+    PTools::Transform transform;
+    transform.createInvTransform(img, opts);
+    const vigra::Size2D size = img.getSize();
+    double x, y;
+    if (!transform.transformImgCoord(x, y, 0.5 * size.x, 0.5 * size.y))
+    {
+        return cone;
+    };
+    EquirectToVector(x, y, cone.dir);
+    // test points along the border of the image, the border contains the
+    // points with the largest distance from the image centre
+    const int steps = 16;
+    double maxAngle = 0;
+    for (int i = 0; i <= steps; ++i)
+    {
+        const double t = double(i) / steps;
+        const double borderPoints[4][2] = { { t * size.x, 0 }, { t * size.x, size.y }, { 0, t * size.y }, { size.x, t * size.y } };
+        for (int k = 0; k < 4; ++k)
+        {
+            if (!transform.transformImgCoord(x, y, borderPoints[k][0], borderPoints[k][1]))
+            {
+                // point can not be transformed, e.g. fisheye lenses with more than 180 degree
+                return cone;
+            };
+            double v[3];
+            EquirectToVector(x, y, v);
+            maxAngle = std::max(maxAngle, AngleBetween(cone.dir, v));
+        };
+    };
+    // add a safety margin for the parts of the border between the test points
+    // and for lens distortions
+    cone.radius = std::min(M_PI, maxAngle * 1.05 + 5.0 * M_PI / 180.0);
+    return cone;
+}
+
 CalculateImageOverlap::CalculateImageOverlap(const HuginBase::PanoramaData *pano):m_pano(pano)
 {
     m_nrImg=pano->getNrOfImages();
@@ -38,14 +119,19 @@ CalculateImageOverlap::CalculateImageOverlap(const HuginBase::PanoramaData *pano
         m_overlap.resize(m_nrImg);
         PanoramaOptions opts=pano->getOptions();
         m_transform.resize(m_nrImg);
-        m_invTransform.resize(m_nrImg);
+        PTools::TransformMeshCache* meshCache = pano->getTransformMeshCache();
         for(unsigned int i=0;i<m_nrImg;i++)
         {
             m_overlap[i].resize(m_nrImg,0);
-            m_transform[i]=new PTools::Transform;
-            m_transform[i]->createTransform(*pano,i,opts);
-            m_invTransform[i]=new PTools::Transform;
-            m_invTransform[i]->createInvTransform(*pano,i,opts);
+            // reuse the meshes of unchanged images, if the panorama provides a cache
+            if (meshCache)
+            {
+                m_transform[i] = meshCache->getMesh(i, pano->getImage(i), opts);
+            }
+            else
+            {
+                m_transform[i].reset(new PTools::TransformMesh(pano->getImage(i), opts));
+            };
         };
         // per default we are testing all images
         for (unsigned int i = 0; i < m_nrImg; i++)
@@ -57,11 +143,6 @@ CalculateImageOverlap::CalculateImageOverlap(const HuginBase::PanoramaData *pano
 
 CalculateImageOverlap::~CalculateImageOverlap()
 {
-    for(unsigned int i=0;i<m_nrImg;i++)
-    {
-        delete m_transform[i];
-        delete m_invTransform[i];
-    };
 };
 
 void CalculateImageOverlap::calculate(unsigned int steps)
@@ -70,11 +151,27 @@ void CalculateImageOverlap::calculate(unsigned int steps)
     {
         return;
     };
+    // bounding cones of all images, only the image pairs with intersecting cones
+    // can overlap and need to be tested with the sample points
+    std::vector<ImageCone> cones(m_nrImg);
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < m_nrImg; ++i)
+    {
+        cones[i] = GetImageCone(m_pano->getImage(i));
+    };
 #pragma omp parallel for schedule(dynamic)
     for (int i = 0; i < m_testImages.size(); ++i)
     {
         unsigned int imgNr = m_testImages[i];
         const SrcPanoImage& img = m_pano->getImage(imgNr);
+        std::vector<unsigned int> candidates;
+        for (unsigned int j = 0; j < m_nrImg; ++j)
+        {
+            if (j != imgNr && AngleBetween(cones[imgNr].dir, cones[j].dir) <= cones[imgNr].radius + cones[j].radius)
+            {
+                candidates.push_back(j);
+            };
+        };
         vigra::Rect2D c=vigra::Rect2D(img.getSize());
         if(img.getCropMode()!=SrcPanoImage::NO_CROP)
         {
@@ -101,13 +198,12 @@ void CalculateImageOverlap::calculate(unsigned int steps)
                     pointCounter++;
                     //transform to panorama coordinates
                     double xi,yi;
-                    if (m_invTransform[imgNr]->transformImgCoord(xi, yi, xc, yc))
+                    if (m_transform[imgNr]->transformImgCoordInv(xi, yi, xc, yc))
                     {
                         //now, check if point is inside another image
-                        for(unsigned int j=0;j<m_nrImg;j++)
+                        for (std::vector<unsigned int>::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
                         {
-                            if (imgNr == j)
-                                continue;
+                            const unsigned int j = *it;
                             double xj,yj;
                             //transform to image coordinates
                             if(m_transform[j]->transformImgCoord(xj,yj,xi,yi))
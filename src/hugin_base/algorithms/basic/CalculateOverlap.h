@@ -33,7 +33,7 @@
 #include <hugin_shared.h>
 #include <panodata/PanoramaData.h>
 #include <panodata/Panorama.h>
-#include <panotools/PanoToolsInterface.h>
+#include <panotools/TransformMesh.h>
 
 namespace HuginBase 
 {
@@ -60,8 +60,8 @@ public:
 
 private:
     std::vector<std::vector<double> > m_overlap;
-    std::vector<PTools::Transform*> m_transform;
-    std::vector<PTools::Transform*> m_invTransform;
+    /** transformations of all images, shared with the cache of the panorama */
+    std::vector<PTools::TransformMeshCache::MeshPtr> m_transform;
     unsigned int m_nrImg;
     const PanoramaData* m_pano;
     std::vector<unsigned int> m_testImages;
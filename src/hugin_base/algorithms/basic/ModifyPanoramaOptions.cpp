@@ -0,0 +1,210 @@
+// -*- c-basic-offset: 4 -*-
+/** @file ModifyPanoramaOptions.cpp
+ *
+ *  @brief implementation of functions to parse and apply field of view, canvas size and crop
+ *         settings as used by pano_modify and hugin_server
+ *
+ */
+
+ /*  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ModifyPanoramaOptions.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <hugin_utils/stl_utils.h>
+#include <hugin_math/hugin_math.h>
+#include <appbase/ProgressDisplay.h>
+#include <algorithms/nona/FitPanorama.h>
+#include <algorithms/basic/CalculateOptimalScale.h>
+#include <algorithms/basic/CalculateOptimalROI.h>
+#include <algorithms/basic/LayerStacks.h>
+
+namespace HuginBase
+{
+
+bool ParseFieldOfView(const std::string& value, FieldOfViewSetting& fov, std::string& error)
+{
+    if (hugin_utils::toupper(value) == "AUTO")
+    {
+        fov.fit = true;
+        return true;
+    };
+    double hfov, vfov;
+    const int n = sscanf(value.c_str(), "%lfx%lf", &hfov, &vfov);
+    if (n == 1)
+    {
+        if (hfov > 0)
+        {
+            fov.hfov = hfov;
+            return true;
+        };
+        error = "Invalid field of view";
+        return false;
+    };
+    if (n == 2)
+    {
+        if (hfov > 0 && vfov > 0)
+        {
+            fov.hfov = hfov;
+            fov.vfov = vfov;
+            return true;
+        };
+        error = "Invalid field of view";
+        return false;
+    };
+    error = "Could not parse field of view";
+    return false;
+};
+
+bool ParseCanvasSize(const std::string& value, CanvasSetting& canvas, std::string& error)
+{
+    std::string param = hugin_utils::toupper(value);
+    if (param == "AUTO")
+    {
+        canvas.optimalSize = true;
+        return true;
+    };
+    const std::string::size_type pos = param.find("%");
+    if (pos != std::string::npos)
+    {
+        const int scale = atoi(param.substr(0, pos).c_str());
+        if (scale <= 0)
+        {
+            error = "No valid scale factor given.";
+            return false;
+        };
+        canvas.optimalSize = true;
+        canvas.scale = scale;
+        return true;
+    };
+    int width, height;
+    if (sscanf(param.c_str(), "%dX%d", &width, &height) != 2)
+    {
+        error = "Could not parse canvas size";
+        return false;
+    };
+    if (width <= 0 || height <= 0)
+    {
+        error = "Invalid canvas size";
+        return false;
+    };
+    canvas.width = width;
+    canvas.height = height;
+    return true;
+};
+
+bool ParseCrop(const std::string& value, CropSetting& crop, std::string& error)
+{
+    const std::string param = hugin_utils::toupper(value);
+    if (param == "AUTO" || param == "AUTOHDR")
+    {
+        crop.autocrop = true;
+        crop.autocropHDR = (param == "AUTOHDR");
+        return true;
+    };
+    int left, right, top, bottom;
+    if (sscanf(param.c_str(), "%d,%d,%d,%d", &left, &right, &top, &bottom) != 4)
+    {
+        error = "Could not parse crop values";
+        return false;
+    };
+    if (right <= left || bottom <= top || left < 0 || top < 0)
+    {
+        error = "Invalid crop area";
+        return false;
+    };
+    crop.roi = vigra::Rect2D(left, top, right, bottom);
+    return true;
+};
+
+void ApplyFieldOfView(Panorama& pano, const FieldOfViewSetting& fov)
+{
+    if (fov.fit)
+    {
+        PanoramaOptions opt = pano.getOptions();
+        CalculateFitPanorama fitPano(pano);
+        fitPano.run();
+        opt.setHFOV(fitPano.getResultHorizontalFOV());
+        opt.setHeight(hugin_utils::roundi(fitPano.getResultHeight()));
+        pano.setOptions(opt);
+    };
+    if (fov.hfov > 0)
+    {
+        PanoramaOptions opt = pano.getOptions();
+        opt.setHFOV(fov.hfov);
+        if (opt.fovCalcSupported(opt.getProjection()) && fov.vfov > 0)
+        {
+            opt.setVFOV(fov.vfov);
+        };
+        pano.setOptions(opt);
+    };
+};
+
+void ApplyCanvasSize(Panorama& pano, const CanvasSetting& canvas)
+{
+    if (canvas.optimalSize)
+    {
+        const double s = CalculateOptimalScale::calcOptimalScale(pano);
+        PanoramaOptions opt = pano.getOptions();
+        opt.setWidth(hugin_utils::roundi(opt.getWidth() * s * canvas.scale / 100), true);
+        pano.setOptions(opt);
+    };
+    if (canvas.width > 0 && canvas.height > 0)
+    {
+        PanoramaOptions opt = pano.getOptions();
+        opt.setWidth(canvas.width);
+        opt.setHeight(canvas.height);
+        pano.setOptions(opt);
+    };
+};
+
+bool ApplyCrop(Panorama& pano, const CropSetting& crop)
+{
+    bool success = true;
+    if (crop.autocrop)
+    {
+        AppBase::DummyProgressDisplay dummy;
+        CalculateOptimalROI cropPano(pano, &dummy);
+        if (crop.autocropHDR)
+        {
+            cropPano.setStacks(getHDRStacks(pano, pano.getActiveImages(), pano.getOptions()));
+        };
+        cropPano.run();
+        const vigra::Rect2D roi = cropPano.getResultOptimalROI();
+        //set the ROI - fail if the right/bottom is zero, meaning all zero
+        if (!roi.isEmpty())
+        {
+            PanoramaOptions opt = pano.getOptions();
+            opt.setROI(roi);
+            pano.setOptions(opt);
+        }
+        else
+        {
+            success = false;
+        };
+    };
+    if (crop.roi.right() != 0 && crop.roi.bottom() != 0)
+    {
+        PanoramaOptions opt = pano.getOptions();
+        opt.setROI(crop.roi);
+        pano.setOptions(opt);
+    };
+    return success;
+};
+
+}
@@ -0,0 +1,84 @@
+// -*- c-basic-offset: 4 -*-
+/** @file ModifyPanoramaOptions.h
+ *
+ *  @brief declaration of functions to parse and apply field of view, canvas size and crop
+ *         settings as used by pano_modify and hugin_server
+ *
+ */
+
+ /*  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _BASICALGORITHMS_MODIFYPANORAMAOPTIONS_H
+#define _BASICALGORITHMS_MODIFYPANORAMAOPTIONS_H
+
+#include <hugin_shared.h>
+#include <string>
+#include <panodata/Panorama.h>
+
+namespace HuginBase
+{
+/** field of view setting, AUTO or HFOV[xVFOV] */
+struct IMPEX FieldOfViewSetting
+{
+    FieldOfViewSetting() : fit(false), hfov(-1), vfov(-1) {};
+    /** fit the field of view to the images */
+    bool fit;
+    /** new horizontal and vertical field of view, ignored if not positive */
+    double hfov;
+    double vfov;
+};
+
+/** canvas size setting, AUTO, num% or WIDTHxHEIGHT */
+struct IMPEX CanvasSetting
+{
+    CanvasSetting() : optimalSize(false), scale(100), width(-1), height(-1) {};
+    /** calculate the optimal size, scaled by scale percent */
+    bool optimalSize;
+    int scale;
+    /** new canvas size, ignored if not positive */
+    int width;
+    int height;
+};
+
+/** crop setting, AUTO, AUTOHDR or left,right,top,bottom */
+struct IMPEX CropSetting
+{
+    CropSetting() : autocrop(false), autocropHDR(false), roi(0, 0, 0, 0) {};
+    /** search the best crop rectangle, for HDR panoramas only the area covered by all stacks */
+    bool autocrop;
+    bool autocropHDR;
+    /** new crop rectangle, ignored if empty */
+    vigra::Rect2D roi;
+};
+
+/** parses the field of view string, returns false and a message in error for invalid input */
+IMPEX bool ParseFieldOfView(const std::string& value, FieldOfViewSetting& fov, std::string& error);
+/** parses the canvas size string, returns false and a message in error for invalid input */
+IMPEX bool ParseCanvasSize(const std::string& value, CanvasSetting& canvas, std::string& error);
+/** parses the crop string, returns false and a message in error for invalid input */
+IMPEX bool ParseCrop(const std::string& value, CropSetting& crop, std::string& error);
+
+/** fits and/or sets the field of view of the panorama */
+IMPEX void ApplyFieldOfView(Panorama& pano, const FieldOfViewSetting& fov);
+/** calculates the optimal size and/or sets the canvas size of the panorama */
+IMPEX void ApplyCanvasSize(Panorama& pano, const CanvasSetting& canvas);
+/** searches the best crop rectangle and/or sets the crop of the panorama
+ *  @return false if the automatic crop could not find a crop rectangle */
+IMPEX bool ApplyCrop(Panorama& pano, const CropSetting& crop);
+}
+
+#endif /* _BASICALGORITHMS_MODIFYPANORAMAOPTIONS_H */
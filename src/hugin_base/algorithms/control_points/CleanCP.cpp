@@ -29,6 +29,7 @@
 
 #include "CleanCP.h"
 #include <algorithms/optimizer/PTOptimizer.h>
+#include <algorithms/optimizer/ImageGraph.h>
 #include "algorithms/basic/CalculateCPStatistics.h"
 #include "hugin_base/panotools/PanoToolsUtils.h"
 
@@ -183,6 +184,40 @@ UIntSet getCPoutsideLimit(Panorama pano, double n, bool skipOptimisation, bool i
     return CPtoRemove;
 };
 
+bool CleanControlPoints(Panorama& pano, double n, bool pairwise, bool wholePano, bool skipOptimisation, bool includeLineCp, size_t& removedPair, size_t& removedWhole)
+{
+    removedPair = 0;
+    removedWhole = 0;
+    // step 1 with pairwise optimisation
+    if (pairwise)
+    {
+        AppBase::DummyProgressDisplay dummy;
+        const UIntSet CPtoRemove = getCPoutsideLimit_pair(pano, dummy, n);
+        for (UIntSet::const_reverse_iterator it = CPtoRemove.rbegin(); it != CPtoRemove.rend(); ++it)
+        {
+            pano.removeCtrlPoint(*it);
+        };
+        removedPair = CPtoRemove.size();
+    };
+    // step 2 with optimisation of whole panorama
+    if (wholePano)
+    {
+        //check for unconnected images
+        HuginGraph::ImageGraph graph(pano);
+        if (!graph.IsConnected())
+        {
+            return false;
+        };
+        const UIntSet CPtoRemove = getCPoutsideLimit(pano, n, skipOptimisation, includeLineCp);
+        for (UIntSet::const_reverse_iterator it = CPtoRemove.rbegin(); it != CPtoRemove.rend(); ++it)
+        {
+            pano.removeCtrlPoint(*it);
+        };
+        removedWhole = CPtoRemove.size();
+    };
+    return true;
+};
+
 UIntSet getCPinMasks(HuginBase::Panorama pano)
 {
     HuginBase::UIntSet cps;
@@ -49,6 +49,18 @@ IMPEX UIntSet getCPoutsideLimit_pair(Panorama pano, AppBase::ProgressDisplay& pr
   @return set which contains control points with error > mean+n*sigma */
 IMPEX UIntSet getCPoutsideLimit(Panorama pano, double n = 2.0, bool skipOptimisation = false, bool includeLineCp = false);
 
+/** removes wrong control points in two steps, like cpclean does
+  @param pano panorama which should be cleaned, the control points are removed in place
+  @param n determines, how big the deviation from mean should be to determine wrong control points
+  @param pairwise run step 1, which checks every image pair with getCPoutsideLimit_pair
+  @param wholePano run step 2, which checks the whole panorama with getCPoutsideLimit
+  @param skipOptimisation skips the optimisation in step 2, the current position of the images is used
+  @param includeLineCp include also line control points in step 2
+  @param removedPair returns the number of control points removed in step 1
+  @param removedWhole returns the number of control points removed in step 2
+  @return false, if step 2 was skipped because the panorama contains unconnected images */
+IMPEX bool CleanControlPoints(Panorama& pano, double n, bool pairwise, bool wholePano, bool skipOptimisation, bool includeLineCp, size_t& removedPair, size_t& removedWhole);
+
 /** returns these control points, which are in masks */
 IMPEX UIntSet getCPinMasks(Panorama pano);
 
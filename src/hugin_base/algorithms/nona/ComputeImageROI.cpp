@@ -27,7 +27,7 @@
 
 #include <algorithm>
 #include <nona/RemappedPanoImage.h>
-#include <nona/RemappedPanoImage.h>
+#include <panotools/TransformMesh.h>
 
 
 
@@ -233,9 +233,19 @@ void estimateImageRect(const SrcPanoImage & src, const PanoramaOptions & dest,
     {
         vigra::Rect2D imageRect;
         SrcPanoImage srcImg = pano.getSrcImage(i);
-        PTools::Transform transf;
-        transf.createTransform(srcImg, opts);
-        estimateImageRect(srcImg, opts, transf, imageRect);
+        PTools::TransformMeshCache* meshCache = pano.getTransformMeshCache();
+        if (meshCache)
+        {
+            // use the cached mesh, the ROI is recalculated after each change of the panorama
+            PTools::TransformMeshCache::MeshPtr transf = meshCache->getMesh(i, srcImg, opts);
+            estimateImageRect(srcImg, opts, *transf, imageRect);
+        }
+        else
+        {
+            PTools::Transform transf;
+            transf.createTransform(srcImg, opts);
+            estimateImageRect(srcImg, opts, transf, imageRect);
+        };
         return imageRect;
     }
 
@@ -26,6 +26,7 @@
 
 #include "ImageGraph.h"
 #include <queue>
+#include <algorithm>
 
 namespace HuginGraph
 {
@@ -125,6 +126,127 @@ ImageGraph::Components ImageGraph::GetComponents()
     return comp;
 };
 
+/** disjoint sets of images, used to find the connected components */
+class ImageUnionFind
+{
+public:
+    explicit ImageUnionFind(const size_t nrImages) : m_parent(nrImages), m_rank(nrImages, 0)
+    {
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            m_parent[i] = i;
+        };
+    };
+    /** returns the representative of the set containing img */
+    size_t Find(size_t img)
+    {
+        while (m_parent[img] != img)
+        {
+            // path halving
+            m_parent[img] = m_parent[m_parent[img]];
+            img = m_parent[img];
+        };
+        return img;
+    };
+    /** joins the sets of both images */
+    void Union(const size_t img1, const size_t img2)
+    {
+        size_t root1 = Find(img1);
+        size_t root2 = Find(img2);
+        if (root1 == root2)
+        {
+            return;
+        };
+        if (m_rank[root1] < m_rank[root2])
+        {
+            std::swap(root1, root2);
+        };
+        m_parent[root2] = root1;
+        if (m_rank[root1] == m_rank[root2])
+        {
+            ++m_rank[root1];
+        };
+    };
+    /** returns the sets as components, the components are ordered by their smallest image number
+    *  as in ImageGraph::GetComponents */
+    ImageGraph::Components GetComponents()
+    {
+        ImageGraph::Components comp;
+        std::vector<size_t> compNr(m_parent.size(), m_parent.size());
+        for (size_t i = 0; i < m_parent.size(); ++i)
+        {
+            const size_t root = Find(i);
+            if (compNr[root] == m_parent.size())
+            {
+                compNr[root] = comp.size();
+                comp.push_back(HuginBase::UIntSet());
+            };
+            comp[compNr[root]].insert(comp[compNr[root]].end(), i);
+        };
+        return comp;
+    };
+private:
+    std::vector<size_t> m_parent;
+    std::vector<unsigned char> m_rank;
+};
+
+ImageGraph::Components ImageGraph::GetComponents(const HuginBase::PanoramaData& pano, bool ignoreLinkedPosition)
+{
+    ImageUnionFind sets(pano.getNrOfImages());
+    if (!ignoreLinkedPosition)
+    {
+        // links are transitive, so it is sufficient to join each image
+        // with the first image of its group
+        std::vector<size_t> firstImages;
+        for (size_t i = 0; i < pano.getNrOfImages(); ++i)
+        {
+            const HuginBase::SrcPanoImage& image = pano.getImage(i);
+            if (image.YawisLinked())
+            {
+                bool found = false;
+                for (size_t j = 0; j < firstImages.size() && !found; ++j)
+                {
+                    if (image.YawisLinkedWith(pano.getImage(firstImages[j])))
+                    {
+                        sets.Union(firstImages[j], i);
+                        found = true;
+                    };
+                };
+                if (!found)
+                {
+                    firstImages.push_back(i);
+                };
+            };
+        };
+    };
+    const HuginBase::CPVector& cps = pano.getCtrlPoints();
+    for (size_t i = 0; i < cps.size(); ++i)
+    {
+        if (cps[i].mode == HuginBase::ControlPoint::X_Y && cps[i].image1Nr != cps[i].image2Nr)
+        {
+            sets.Union(cps[i].image1Nr, cps[i].image2Nr);
+        };
+    };
+    return sets.GetComponents();
+};
+
+ImageGraph::Components ImageGraph::GetComponents(const HuginBase::CalculateImageOverlap& overlap)
+{
+    const unsigned int nrImages = overlap.getNrOfImages();
+    ImageUnionFind sets(nrImages);
+    for (unsigned int i = 0; i + 1 < nrImages; ++i)
+    {
+        for (unsigned int j = i + 1; j < nrImages; ++j)
+        {
+            if (overlap.getOverlap(i, j) > 0.001)
+            {
+                sets.Union(i, j);
+            };
+        };
+    };
+    return sets.GetComponents();
+};
+
 bool ImageGraph::IsConnected()
 {
     if (m_graph.empty())
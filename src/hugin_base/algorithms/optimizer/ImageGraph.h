@@ -57,6 +57,14 @@ public:
     *  if you want to know, if all images are connected
     *  use IsConnected() instead */
     Components GetComponents();
+    /** find all connected components directly from the control points and
+    *  the linked positions of the panorama, without building the graph.
+    *  It uses a union-find structure and returns the same components as
+    *  ImageGraph(pano, ignoreLinkedPosition).GetComponents() */
+    static Components GetComponents(const HuginBase::PanoramaData& pano, bool ignoreLinkedPosition = false);
+    /** find all connected components of the images with overlap,
+    *  returns the same components as ImageGraph(overlap).GetComponents() */
+    static Components GetComponents(const HuginBase::CalculateImageOverlap& overlap);
     /** check if all images are connected
     *  @returns true, if all images are connected, otherwise false
     *  it uses an optimized depth first search and breaks out if a
@@ -28,6 +28,8 @@
 #include "PTOptimizer.h"
 
 #include "ImageGraph.h"
+#include "SparseOptimizer.h"
+#include "ViewRays.h"
 #include "panodata/StandardImageVariableGroups.h"
 #include <panotools/PanoToolsOptimizerWrapper.h>
 #include <panotools/PanoToolsInterface.h>
@@ -137,8 +139,36 @@ public:
         m_initParams[i] = m_optvars[i].get(*m_localPano);
         DEBUG_DEBUG("get init var: " << m_optvars[i].m_name << ", " << m_optvars[i].m_img << ": " << m_initParams[i]);
     }
+
+    // when only the rotation is estimated, the view rays of all control points are
+    // calculated once and the rotation is fitted in closed form
+    m_rays1 = NULL;
+    m_rays2 = NULL;
+    m_closedForm = false;
+    if (!optHFOV && !optB)
+    {
+        m_rays1 = new ViewRays(m_localPano->getImage(m_li1));
+        m_rays2 = new ViewRays(m_localPano->getImage(m_li2));
+        m_closedForm = m_rays1->isValid() && m_rays2->isValid();
+    }
+    if (m_closedForm)
+    {
+        const SrcPanoImage& img1 = m_localPano->getImage(m_li1);
+        m_rotation1 = m_rays1->getRotation(img1.getYaw(), img1.getPitch(), img1.getRoll());
+        m_rays.resize(m_xy_cps.size());
+        for (size_t i = 0; i < m_xy_cps.size(); ++i)
+        {
+            m_rays[i].valid = calcRays(m_xy_cps[i], m_rays[i]);
+        }
+    }
 }
 
+    /** returns true, if estimate and agree can be called from several threads */
+    bool isReentrant() const
+    {
+        return m_closedForm;
+    }
+
     /** Perform exact estimate. 
      *
      *  This is actually a fake and just calles leastSquaresEstimate, as I don't know a
@@ -146,6 +176,19 @@ public:
      */
     bool estimate(const std::vector<const ControlPoint *> & points, std::vector<double> & p) const
     {
+	if (m_closedForm) {
+	    // closed form solution from 2 pairs of view rays
+	    if (points.size() < 2)
+		return false;
+	    RaysOfPoint rays1, rays2;
+	    if (!getRays(*points[0], rays1) || !getRays(*points[1], rays2))
+		return false;
+	    Matrix3 R;
+	    if (!ViewRays::EstimateRotation(rays1.camera, rays2.camera, rays1.world, rays2.world, R))
+		return false;
+	    setRotation(R, p);
+	    return true;
+	}
 	// reset to the initial parameters.
 	p.resize(m_initParams.size());
 	std::copy(m_initParams.begin(), m_initParams.end(), p.begin());
@@ -157,6 +200,22 @@ public:
 
     bool leastSquaresEstimate(const std::vector<const ControlPoint *> & points, std::vector<double> & p) const 
     {
+	if (m_closedForm) {
+	    // refine the rotation with all points
+	    std::vector<Vector3> cameraRays;
+	    std::vector<Vector3> worldRays;
+	    for (size_t i = 0; i < points.size(); ++i) {
+		RaysOfPoint rays;
+		if (getRays(*points[i], rays)) {
+		    cameraRays.push_back(rays.camera);
+		    worldRays.push_back(rays.world);
+		}
+	    }
+	    Matrix3 R = getRotation(p);
+	    if (ViewRays::RefineRotation(cameraRays, worldRays, R))
+		setRotation(R, p);
+	    return true;
+	}
 	// copy points into panorama object
 	CPVector cpoints(points.size());	
 	for (size_t i=0; i < points.size(); i++) {
@@ -205,6 +264,16 @@ public:
 
     bool agree(std::vector<double> &p, const ControlPoint & cp) const
     {
+	if (m_closedForm) {
+	    RaysOfPoint rays;
+	    if (!getRays(cp, rays))
+		return false;
+	    // rotate the ray of the first image into the second image
+	    double x2t, y2t;
+	    if (!m_rays2->getImagePoint(getRotation(p).TransformVector(rays.world), x2t, y2t))
+		return false;
+	    return hypot(x2t - rays.x2, y2t - rays.y2) < m_maxError;
+	}
 	PanoramaData * pano = const_cast<PanoramaData *>(m_localPano);
 	// set parameters in pano object
     for (size_t i = 0; i < m_optvars.size(); ++i)
@@ -243,6 +312,8 @@ public:
 
     ~PTOptEstimator()
     {
+	delete m_rays1;
+	delete m_rays2;
 	delete m_localPano;
     }
 
@@ -257,6 +328,64 @@ public:
     std::vector<OptVarSpec> m_optvars;
 
 private:
+    /** view ray of the point in the first image (world coordinates) and in the second image (camera coordinates) */
+    struct RaysOfPoint
+    {
+	Vector3 world;
+	Vector3 camera;
+	double x2, y2;
+	bool valid;
+    };
+
+    /** calculates the rays of the control point */
+    bool calcRays(const ControlPoint & cp, RaysOfPoint & rays) const
+    {
+	double x1, y1;
+	if (cp.image1Nr == m_li1) {
+	    x1 = cp.x1;
+	    y1 = cp.y1;
+	    rays.x2 = cp.x2;
+	    rays.y2 = cp.y2;
+	} else {
+	    x1 = cp.x2;
+	    y1 = cp.y2;
+	    rays.x2 = cp.x1;
+	    rays.y2 = cp.y1;
+	}
+	Vector3 camera1;
+	if (!m_rays1->getRay(x1, y1, camera1) || !m_rays2->getRay(rays.x2, rays.y2, rays.camera))
+	    return false;
+	rays.world = ViewRays::Rotate(m_rotation1, camera1);
+	return true;
+    }
+
+    /** returns the rays of the control point, from the cache if the point is from m_xy_cps */
+    bool getRays(const ControlPoint & cp, RaysOfPoint & rays) const
+    {
+	if (!m_xy_cps.empty() && &cp >= &m_xy_cps.front() && &cp <= &m_xy_cps.back()) {
+	    rays = m_rays[&cp - &m_xy_cps.front()];
+	    return rays.valid;
+	}
+	return calcRays(cp, rays);
+    }
+
+    /** returns the rotation of the second image, p contains roll, pitch and yaw */
+    Matrix3 getRotation(const std::vector<double> & p) const
+    {
+	return m_rays2->getRotation(p[2], p[1], p[0]);
+    }
+
+    /** stores the rotation of the second image as roll, pitch and yaw */
+    void setRotation(const Matrix3 & R, std::vector<double> & p) const
+    {
+	double yaw, pitch, roll;
+	m_rays2->getAngles(R, yaw, pitch, roll);
+	p.resize(3);
+	p[0] = roll;
+	p[1] = pitch;
+	p[2] = yaw;
+    }
+
     int m_li1, m_li2;
     double m_maxError;
     PanoramaData * m_localPano;
@@ -264,6 +393,12 @@ private:
     std::vector<std::set<std::string> > m_opt_first_pass;
     std::vector<std::set<std::string> > m_opt_second_pass;
     int m_numForEstimate;
+    // data for the closed form estimation of the rotation
+    bool m_closedForm;
+    ViewRays * m_rays1;
+    ViewRays * m_rays2;
+    Matrix3 m_rotation1;
+    std::vector<RaysOfPoint> m_rays;
 };
 
 
@@ -291,7 +426,7 @@ std::vector<int> RANSACOptimizer::findInliers(PanoramaData & pano, int i1, int i
     std::copy(estimator.m_initParams.begin(),estimator.m_initParams.end(), parameters.begin());
     std::vector<int> inlier_idx;
     DEBUG_DEBUG("Number of control points: " << estimator.m_xy_cps.size() << " Initial parameter[0]" << parameters[0]);
-    std::vector<const ControlPoint *> inliers = Ransac::compute(parameters, inlier_idx, estimator, estimator.m_xy_cps, 0.999, 0.3);
+    std::vector<const ControlPoint *> inliers = Ransac::compute(parameters, inlier_idx, estimator, estimator.m_xy_cps, 0.999, 0.3, estimator.isReentrant());
     DEBUG_DEBUG("Number of inliers:" << inliers.size() << "optimized parameter[0]" << parameters[0]);
 
     // set parameters in pano object
@@ -307,6 +442,17 @@ std::vector<int> RANSACOptimizer::findInliers(PanoramaData & pano, int i1, int i
 }    
     
 
+bool RANSACOptimizer::isReentrant(const PanoramaData & pano, int i1, int i2, Mode mode)
+{
+    if (mode != AUTO && mode != RPY)
+    {
+        return false;
+    }
+    ViewRays rays1(pano.getImage(i1));
+    ViewRays rays2(pano.getImage(i2));
+    return rays1.isValid() && rays2.isValid();
+}
+
 bool RANSACOptimizer::runAlgorithm()
 {
     o_inliers = findInliers(o_panorama, o_i1, o_i2, o_maxError, o_mode);
@@ -316,8 +462,8 @@ bool RANSACOptimizer::runAlgorithm()
 class AutoOptimiseVisitor :public HuginGraph::BreadthFirstSearchVisitor
 {
 public:
-    explicit AutoOptimiseVisitor(PanoramaData* pano, const std::set<std::string>& optvec)
-        : m_opt(optvec), m_pano(pano)
+    explicit AutoOptimiseVisitor(PanoramaData* pano, const std::set<std::string>& optvec, const OptimizerBackend backend)
+        : m_opt(optvec), m_pano(pano), m_backend(backend)
     {};
     void Visit(const size_t vertex, const HuginBase::UIntSet& visitedNeighbors, const HuginBase::UIntSet& unvisitedNeighbors)
     {
@@ -344,7 +490,7 @@ public:
             OptimizeVector optvec(imgs.size());
             optvec[currImg] = m_opt;
             localPano->setOptimizeVector(optvec);
-            PTools::optimize(*localPano);
+            OptimizeGeometric(*localPano, m_backend);
             m_pano->updateVariables(vertex, localPano->getImageVariables(currImg));
             delete localPano;
         };
@@ -352,9 +498,10 @@ public:
 private:
     const std::set<std::string>& m_opt;
     PanoramaData* m_pano;
+    const OptimizerBackend m_backend;
 };
 
-void AutoOptimise::autoOptimise(PanoramaData& pano, bool optRoll)
+void AutoOptimise::autoOptimise(PanoramaData& pano, bool optRoll, const OptimizerBackend backend)
 {
     // remove all connected images, keep only a single image for each connected stack
     UIntSetVector imageGroups;
@@ -372,7 +519,7 @@ void AutoOptimise::autoOptimise(PanoramaData& pano, bool optRoll)
     // start a breadth first traversal of the graph, and optimize
     // the links found (every vertex just once.)
     HuginGraph::ImageGraph graph(*optPano);
-    AutoOptimiseVisitor visitor(optPano, optvars);
+    AutoOptimiseVisitor visitor(optPano, optvars, backend);
     graph.VisitAllImages(optPano->getOptions().optimizeReferenceImage, true, &visitor);
 
     // now translate to found positions to initial pano
@@ -384,7 +531,7 @@ void AutoOptimise::autoOptimise(PanoramaData& pano, bool optRoll)
 }
 
 
-void SmartOptimise::smartOptimize(PanoramaData& optPano)
+void SmartOptimise::smartOptimize(PanoramaData& optPano, const OptimizerBackend backend)
 {
     // use m-estimator with sigma 2
     PanoramaOptions opts = optPano.getOptions();
@@ -402,13 +549,13 @@ void SmartOptimise::smartOptimize(PanoramaData& optPano)
         }
     }
     optPano.setCtrlPoints(newCP);
-    AutoOptimise::autoOptimise(optPano);
+    AutoOptimise::autoOptimise(optPano, true, backend);
     
     // do global optimisation of position with all control points.
     optPano.setCtrlPoints(cps);
     OptimizeVector optvars = createOptVars(optPano, OPT_POS, optPano.getOptions().optimizeReferenceImage);
     optPano.setOptimizeVector(optvars);
-    PTools::optimize(optPano);
+    OptimizeGeometric(optPano, backend);
     
     //Find lenses.
     StandardImageVariableGroups variable_groups(optPano);
@@ -492,7 +639,7 @@ void SmartOptimise::smartOptimize(PanoramaData& optPano)
         DEBUG_DEBUG("oldVars[0].b: " << const_map_get(oldVars[0],"b").getValue());
         optvars = createOptVars(optPano, optmode, optPano.getOptions().optimizeReferenceImage);
         optPano.setOptimizeVector(optvars);
-        // global optimisation.
+        // global optimisation, the lens parameters are always optimised with panotools
         DEBUG_DEBUG("before opt 1: newVars[0].b: " << const_map_get(optPano.getVariables()[0],"b").getValue());
         PTools::optimize(optPano);
         // --------------------------------------------------------------
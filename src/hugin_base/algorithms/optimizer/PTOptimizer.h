@@ -34,6 +34,7 @@
 #include <set>
 #include <panodata/PanoramaData.h>
 #include <panotools/PanoToolsOptimizerWrapper.h>
+#include <algorithms/optimizer/SparseOptimizer.h>
 
 namespace HuginBase {
     
@@ -86,6 +87,10 @@ namespace HuginBase {
 
 	    static std::vector<int> findInliers(PanoramaData & pano, int i1, int i2, double maxError,
 						Mode mode=RPY);
+	    /** returns true, if findInliers estimates the rotation in closed form for the given
+	     *  images and mode. In this case the panotools optimizer is not used and findInliers
+	     *  can be called from several threads at the same time */
+	    static bool isReentrant(const PanoramaData & pano, int i1, int i2, Mode mode=RPY);
             
             /// calls PTools::optimize()
             virtual bool runAlgorithm();
@@ -114,8 +119,9 @@ namespace HuginBase {
             
         
         public:
-            ///
-            static void autoOptimise(PanoramaData& pano, bool optRoll=true);
+            /** optimises the positions pairwise, starting at the reference image
+             *  @param backend optimizer used for the pairwise optimisations */
+            static void autoOptimise(PanoramaData& pano, bool optRoll=true, const OptimizerBackend backend=OPTIMIZER_PANOTOOLS);
 
         public:
             ///
@@ -164,8 +170,9 @@ namespace HuginBase {
             {}
         
         public:
-            ///
-            static void smartOptimize(PanoramaData& pano);
+            /** runs the autooptimiser heuristics
+             *  @param backend optimizer used for the position only optimisations */
+            static void smartOptimize(PanoramaData& pano, const OptimizerBackend backend=OPTIMIZER_PANOTOOLS);
         
             
         public:
@@ -27,6 +27,8 @@
 #include <foreign/levmar/levmar.h>
 #include <photometric/ResponseTransform.h>
 #include <algorithms/basic/LayerStacks.h>
+#include <algorithms/basic/CalculateMeanExposure.h>
+#include <panodata/StandardImageVariableGroups.h>
 
 #ifdef DEBUG
 #define DEBUG_LOG_VIG 1
@@ -473,6 +475,48 @@ void SmartPhotometricOptimizer::smartOptimizePhotometric(PanoramaData & pano, Ph
     };
 }
 
+void SmartPhotometricOptimizer::optimizeProjectPhotometric(PanoramaData & pano,
+                                                           const std::vector<vigra_ext::PointPairRGB> & correspondences,
+                                                           const float imageStepSize,
+                                                           AppBase::ProgressDisplay* progress)
+{
+    // first, ensure that vignetting and response coefficients are linked
+    const ImageVariableGroup::ImageVariableEnum vars[] =
+    {
+        ImageVariableGroup::IVE_EMoRParams,
+        ImageVariableGroup::IVE_ResponseType,
+        ImageVariableGroup::IVE_VigCorrMode,
+        ImageVariableGroup::IVE_RadialVigCorrCoeff,
+        ImageVariableGroup::IVE_RadialVigCorrCenterShift
+    };
+    StandardImageVariableGroups variable_groups(pano);
+    ImageVariableGroup& lenses = variable_groups.getLenses();
+    for (size_t i = 0; i < lenses.getNumberOfParts(); i++)
+    {
+        for (size_t v = 0; v < sizeof(vars) / sizeof(vars[0]); v++)
+        {
+            if (!lenses.getVarLinkedInPart(vars[v], i))
+            {
+                lenses.linkVariablePart(vars[v], i);
+            };
+        };
+    };
+
+    PanoramaOptions opts = pano.getOptions();
+    PhotometricOptimizeMode optmode = OPT_PHOTOMETRIC_LDR_WB;
+    if (opts.outputMode == PanoramaOptions::OUTPUT_HDR || variable_groups.getStacks().getNumberOfParts() < pano.getNrOfImages())
+    {
+        // use HDR algorithm is HDR mode is selected or the project contains stacks
+        optmode = OPT_PHOTOMETRIC_HDR;
+    };
+    double error;
+    smartOptimizePhotometric(pano, optmode, correspondences, imageStepSize, progress, error);
+
+    // calculate the mean exposure.
+    opts = pano.getOptions();
+    opts.outputExposureValue = CalculateMeanExposure::calcMeanExposure(pano);
+    pano.setOptions(opts);
+}
 
 bool PhotometricOptimizer::runAlgorithm()
 {
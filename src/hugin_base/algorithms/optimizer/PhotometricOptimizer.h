@@ -165,6 +165,15 @@ namespace HuginBase
                                                  const float imageStepSize,
                                                  AppBase::ProgressDisplay* progress,
                                                  double & error);
+
+            /** photometric optimisation of a whole project, as done by autooptimiser -m.
+             *  Links the response and vignetting parameters of each lens, uses the HDR mode for
+             *  HDR output or projects with stacks and sets the output exposure to the mean exposure.
+             */
+            static void optimizeProjectPhotometric(PanoramaData & pano,
+                                                   const std::vector<vigra_ext::PointPairRGB> & correspondences,
+                                                   const float imageStepSize,
+                                                   AppBase::ProgressDisplay* progress);
             
             ///
             virtual bool runAlgorithm();
@@ -0,0 +1,568 @@
+// -*- c-basic-offset: 4 -*-
+/** @file hugin_base/algorithms/optimizer/SparseOptimizer.cpp
+ *
+ *  @brief implementation of the sparse optimizer for the image orientations
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "SparseOptimizer.h"
+#include "ViewRays.h"
+
+#include <map>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <hugin_math/hugin_math.h>
+#include <panotools/PanoToolsOptimizerWrapper.h>
+#include <panotools/PanoToolsUtils.h>
+
+namespace HuginBase {
+
+namespace
+{
+    /** adds factor * A to M */
+    void AddScaled(Matrix3& M, const Matrix3& A, const double factor)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                M.m[i][j] += factor * A.m[i][j];
+            };
+        };
+    };
+
+    /** a control point, converted to view rays in the camera coordinates */
+    struct RayPair
+    {
+        Vector3 ray1;
+        Vector3 ray2;
+        /** factor to convert angles into pixel */
+        double scale;
+    };
+
+    /** all control points between two orientation blocks */
+    struct BlockPair
+    {
+        unsigned int block1;
+        unsigned int block2;
+        std::vector<RayPair> rays;
+        // normal equations of this pair
+        Matrix3 H11, H22, H12;
+        Vector3 g1, g2;
+    };
+
+    /** weight of the Huber m-estimator for the given error */
+    double HuberWeight(const double error, const double sigma)
+    {
+        if (sigma <= 0 || error <= sigma)
+        {
+            return 1.0;
+        };
+        return sigma / error;
+    };
+
+    /** cost of the Huber m-estimator for the given error */
+    double HuberCost(const double error, const double sigma)
+    {
+        if (sigma <= 0 || error <= sigma)
+        {
+            return 0.5 * error * error;
+        };
+        return sigma * error - 0.5 * sigma * sigma;
+    };
+
+    /** the orientation problem, one block for each group of images with linked position */
+    class OrientationProblem
+    {
+    public:
+        OrientationProblem(const std::vector<Matrix3>& rotations, const std::vector<int>& variableIndex,
+            std::vector<BlockPair>& pairs, const double huberSigma)
+            : m_rotations(rotations), m_variableIndex(variableIndex), m_pairs(pairs), m_huberSigma(huberSigma)
+        {
+            m_nrOfVariables = 0;
+            for (size_t i = 0; i < m_variableIndex.size(); ++i)
+            {
+                if (m_variableIndex[i] >= 0)
+                {
+                    ++m_nrOfVariables;
+                };
+            };
+        };
+
+        /** returns the current rotations */
+        const std::vector<Matrix3>& GetRotations() const { return m_rotations; };
+
+        /** calculates the cost for the given rotations */
+        double GetCost(const std::vector<Matrix3>& rotations) const
+        {
+            double cost = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:cost)
+            for (int i = 0; i < m_pairs.size(); ++i)
+            {
+                const BlockPair& pair = m_pairs[i];
+                for (size_t j = 0; j < pair.rays.size(); ++j)
+                {
+                    const RayPair& ray = pair.rays[j];
+                    const double error = (ViewRays::Rotate(rotations[pair.block1], ray.ray1) - ViewRays::Rotate(rotations[pair.block2], ray.ray2)).Norm() * ray.scale;
+                    cost += HuberCost(error, m_huberSigma);
+                };
+            };
+            return cost;
+        };
+
+        /** runs the Levenberg-Marquardt iterations */
+        void Optimize(const int maxIterations)
+        {
+            double cost = GetCost(m_rotations);
+            double lambda = 1e-3;
+            for (int iteration = 0; iteration < maxIterations; ++iteration)
+            {
+                BuildNormalEquations();
+                bool accepted = false;
+                while (!accepted && lambda < 1e10)
+                {
+                    std::vector<Vector3> delta;
+                    SolveNormalEquations(lambda, delta);
+                    std::vector<Matrix3> newRotations(m_rotations);
+                    double maxStep = 0;
+                    for (size_t i = 0; i < m_variableIndex.size(); ++i)
+                    {
+                        if (m_variableIndex[i] >= 0)
+                        {
+                            const Vector3& d = delta[m_variableIndex[i]];
+                            maxStep = std::max(maxStep, d.Norm());
+                            newRotations[i] = ViewRays::RotationFromVector(d) * m_rotations[i];
+                        };
+                    };
+                    const double newCost = GetCost(newRotations);
+                    if (newCost < cost)
+                    {
+                        const double relativeChange = (cost - newCost) / std::max(cost, 1e-300);
+                        m_rotations.swap(newRotations);
+                        cost = newCost;
+                        lambda = std::max(lambda / 10.0, 1e-12);
+                        accepted = true;
+                        if (relativeChange < 1e-12 || maxStep < 1e-12)
+                        {
+                            return;
+                        };
+                    }
+                    else
+                    {
+                        if (maxStep < 1e-12)
+                        {
+                            // no progress possible anymore
+                            return;
+                        };
+                        lambda *= 10.0;
+                    };
+                };
+                if (!accepted)
+                {
+                    return;
+                };
+            };
+        };
+
+    private:
+        /** calculates the normal equations of all pairs, the Huber weights are
+         *  calculated from the current residuals */
+        void BuildNormalEquations()
+        {
+#pragma omp parallel for schedule(dynamic)
+            for (int i = 0; i < m_pairs.size(); ++i)
+            {
+                BlockPair& pair = m_pairs[i];
+                pair.H11 = Matrix3();
+                pair.H22 = Matrix3();
+                pair.H12 = Matrix3();
+                pair.g1 = Vector3(0, 0, 0);
+                pair.g2 = Vector3(0, 0, 0);
+                for (size_t j = 0; j < pair.rays.size(); ++j)
+                {
+                    const RayPair& ray = pair.rays[j];
+                    // residual r = R1 * c1 - R2 * c2, with the rotations updated by
+                    // R <- exp([d]x) R the derivatives are -[u]x and [v]x
+                    const Vector3 u = ViewRays::Rotate(m_rotations[pair.block1], ray.ray1);
+                    const Vector3 v = ViewRays::Rotate(m_rotations[pair.block2], ray.ray2);
+                    const Vector3 r = u - v;
+                    const double weight = HuberWeight(r.Norm() * ray.scale, m_huberSigma) * ray.scale * ray.scale;
+                    const Matrix3 U = ViewRays::CrossMatrix(u);
+                    const Matrix3 V = ViewRays::CrossMatrix(v);
+                    // J1^T J1 = [u]x^T [u]x, J2^T J2 = [v]x^T [v]x, J1^T J2 = [u]x [v]x
+                    AddScaled(pair.H11, ViewRays::Transposed(U) * U, weight);
+                    AddScaled(pair.H22, ViewRays::Transposed(V) * V, weight);
+                    AddScaled(pair.H12, U * V, weight);
+                    // J1^T r = u x r, J2^T r = -(v x r)
+                    pair.g1 += u.Cross(r) * weight;
+                    pair.g2 -= v.Cross(r) * weight;
+                };
+            };
+            // now assemble the block diagonal and the gradient
+            m_diagonal.assign(m_nrOfVariables, Matrix3());
+            m_gradient.assign(m_nrOfVariables, Vector3(0, 0, 0));
+            for (size_t i = 0; i < m_pairs.size(); ++i)
+            {
+                const BlockPair& pair = m_pairs[i];
+                const int index1 = m_variableIndex[pair.block1];
+                const int index2 = m_variableIndex[pair.block2];
+                if (index1 >= 0)
+                {
+                    AddScaled(m_diagonal[index1], pair.H11, 1.0);
+                    m_gradient[index1] += pair.g1;
+                };
+                if (index2 >= 0)
+                {
+                    AddScaled(m_diagonal[index2], pair.H22, 1.0);
+                    m_gradient[index2] += pair.g2;
+                };
+            };
+        };
+
+        /** returns y = (H + lambda * diag(H)) * x */
+        void MultiplySystem(const double lambda, const std::vector<Vector3>& x, std::vector<Vector3>& y) const
+        {
+            y.resize(x.size());
+            for (size_t i = 0; i < x.size(); ++i)
+            {
+                Matrix3 D(m_diagonal[i]);
+                for (int k = 0; k < 3; ++k)
+                {
+                    D.m[k][k] *= 1.0 + lambda;
+                };
+                y[i] = ViewRays::Rotate(D, x[i]);
+            };
+            for (size_t i = 0; i < m_pairs.size(); ++i)
+            {
+                const BlockPair& pair = m_pairs[i];
+                const int index1 = m_variableIndex[pair.block1];
+                const int index2 = m_variableIndex[pair.block2];
+                if (index1 >= 0 && index2 >= 0)
+                {
+                    y[index1] += ViewRays::Rotate(pair.H12, x[index2]);
+                    y[index2] += ViewRays::Rotate(ViewRays::Transposed(pair.H12), x[index1]);
+                };
+            };
+        };
+
+        /** solves (H + lambda * diag(H)) * delta = -g with a block-Jacobi preconditioned
+         *  conjugate gradient */
+        void SolveNormalEquations(const double lambda, std::vector<Vector3>& delta) const
+        {
+            const size_t n = m_nrOfVariables;
+            // preconditioner: inverse of the diagonal blocks
+            std::vector<Matrix3> precond(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                Matrix3 D(m_diagonal[i]);
+                for (int k = 0; k < 3; ++k)
+                {
+                    D.m[k][k] = D.m[k][k] * (1.0 + lambda) + 1e-12;
+                };
+                precond[i] = D.Inverse();
+            };
+            delta.assign(n, Vector3(0, 0, 0));
+            std::vector<Vector3> r(n), z(n), p(n), Ap;
+            double rz = 0;
+            double bNorm = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                r[i] = -m_gradient[i];
+                z[i] = ViewRays::Rotate(precond[i], r[i]);
+                p[i] = z[i];
+                rz += r[i].Dot(z[i]);
+                bNorm += r[i].NormSquared();
+            };
+            if (bNorm == 0)
+            {
+                return;
+            };
+            const int maxIterations = std::max<int>(100, 3 * n);
+            for (int iteration = 0; iteration < maxIterations; ++iteration)
+            {
+                MultiplySystem(lambda, p, Ap);
+                double pAp = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    pAp += p[i].Dot(Ap[i]);
+                };
+                if (pAp <= 0)
+                {
+                    break;
+                };
+                const double alpha = rz / pAp;
+                double rNorm = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    delta[i] += p[i] * alpha;
+                    r[i] -= Ap[i] * alpha;
+                    rNorm += r[i].NormSquared();
+                };
+                if (rNorm < 1e-20 * bNorm)
+                {
+                    break;
+                };
+                double rzNew = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    z[i] = ViewRays::Rotate(precond[i], r[i]);
+                    rzNew += r[i].Dot(z[i]);
+                };
+                const double beta = rzNew / rz;
+                rz = rzNew;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    p[i] = z[i] + p[i] * beta;
+                };
+            };
+        };
+
+        std::vector<Matrix3> m_rotations;
+        const std::vector<int>& m_variableIndex;
+        std::vector<BlockPair>& m_pairs;
+        const double m_huberSigma;
+        size_t m_nrOfVariables;
+        std::vector<Matrix3> m_diagonal;
+        std::vector<Vector3> m_gradient;
+    };
+
+    /** returns the orientation block of each image, images with linked yaw, pitch and roll
+     *  share the same block. Returns false if the position variables are only partially linked */
+    bool GetOrientationBlocks(const PanoramaData& pano, std::vector<unsigned int>& blockOfImage, std::vector<unsigned int>& representative)
+    {
+        blockOfImage.resize(pano.getNrOfImages());
+        representative.clear();
+        for (unsigned int i = 0; i < pano.getNrOfImages(); ++i)
+        {
+            const SrcPanoImage& img = pano.getImage(i);
+            bool found = false;
+            for (unsigned int j = 0; j < representative.size() && !found; ++j)
+            {
+                const SrcPanoImage& other = pano.getImage(representative[j]);
+                const bool yaw = img.YawisLinkedWith(other);
+                const bool pitch = img.PitchisLinkedWith(other);
+                const bool roll = img.RollisLinkedWith(other);
+                if (yaw != pitch || yaw != roll)
+                {
+                    return false;
+                };
+                if (yaw)
+                {
+                    blockOfImage[i] = j;
+                    found = true;
+                };
+            };
+            if (!found)
+            {
+                blockOfImage[i] = representative.size();
+                representative.push_back(i);
+            };
+        };
+        return true;
+    };
+}
+
+bool SparseOptimizer::canOptimize(const PanoramaData& pano)
+{
+    if (pano.getNrOfImages() < 2 || pano.getNrOfCtrlPoints() == 0)
+    {
+        return false;
+    };
+    const OptimizeVector& optvec = pano.getOptimizeVector();
+    if (optvec.size() != pano.getNrOfImages() || !optimizesPositionsOnly(optvec))
+    {
+        return false;
+    };
+    for (size_t i = 0; i < optvec.size(); ++i)
+    {
+        if (!optvec[i].empty() && optvec[i].size() != 3)
+        {
+            // yaw, pitch and roll can only be optimized together
+            return false;
+        };
+        const SrcPanoImage& img = pano.getImage(i);
+        if (img.getX() != 0.0 || img.getY() != 0.0 || img.getZ() != 0.0)
+        {
+            // parallax is not modelled
+            return false;
+        };
+    };
+    const CPVector& cps = pano.getCtrlPoints();
+    for (CPVector::const_iterator it = cps.begin(); it != cps.end(); ++it)
+    {
+        if (it->mode != ControlPoint::X_Y)
+        {
+            return false;
+        };
+    };
+    std::vector<unsigned int> blockOfImage, representative;
+    return GetOrientationBlocks(pano, blockOfImage, representative);
+}
+
+bool SparseOptimizer::optimizesPositionsOnly(const OptimizeVector& optvec)
+{
+    bool hasVariables = false;
+    for (size_t i = 0; i < optvec.size(); ++i)
+    {
+        for (std::set<std::string>::const_iterator it = optvec[i].begin(); it != optvec[i].end(); ++it)
+        {
+            if (*it != "y" && *it != "p" && *it != "r")
+            {
+                // lens, photometric or translation parameters
+                return false;
+            };
+        };
+        hasVariables |= !optvec[i].empty();
+    };
+    return hasVariables;
+}
+
+unsigned int SparseOptimizer::optimize(PanoramaData& pano)
+{
+    if (!canOptimize(pano))
+    {
+        return PTools::optimize(pano);
+    };
+    std::vector<unsigned int> blockOfImage, representative;
+    GetOrientationBlocks(pano, blockOfImage, representative);
+    // transformations of the images without rotation, used to calculate the view rays
+    std::vector<ViewRays*> viewRays(pano.getNrOfImages());
+    std::vector<double> pixelScale(pano.getNrOfImages());
+    bool validRays = true;
+    for (unsigned int i = 0; i < pano.getNrOfImages(); ++i)
+    {
+        const SrcPanoImage& img = pano.getImage(i);
+        viewRays[i] = new ViewRays(img);
+        validRays &= viewRays[i]->isValid();
+        // pixel per radian, to apply the m-estimator in pixel
+        pixelScale[i] = img.getWidth() / DEG_TO_RAD(std::max(img.getHFOV(), 1e-3));
+    };
+    if (!validRays)
+    {
+        DEBUG_ERROR("Could not determine view rays, using panotools optimizer");
+        for (size_t i = 0; i < viewRays.size(); ++i)
+        {
+            delete viewRays[i];
+        };
+        return PTools::optimize(pano);
+    };
+
+    // a block is variable if one of its images has yaw, pitch and roll in the optimize vector
+    const OptimizeVector& optvec = pano.getOptimizeVector();
+    std::vector<int> variableIndex(representative.size(), -1);
+    for (unsigned int i = 0; i < pano.getNrOfImages(); ++i)
+    {
+        if (set_contains(optvec[i], "y"))
+        {
+            variableIndex[blockOfImage[i]] = 0;
+        };
+    };
+    int nrOfVariables = 0;
+    for (size_t i = 0; i < variableIndex.size(); ++i)
+    {
+        if (variableIndex[i] >= 0)
+        {
+            variableIndex[i] = nrOfVariables++;
+        };
+    };
+
+    // the start values of the rotations
+    std::vector<Matrix3> rotations(representative.size());
+    for (size_t i = 0; i < representative.size(); ++i)
+    {
+        const SrcPanoImage& img = pano.getImage(representative[i]);
+        rotations[i] = viewRays[representative[i]]->getRotation(img.getYaw(), img.getPitch(), img.getRoll());
+    };
+
+    // convert all control points to view rays, grouped by pairs of blocks
+    const CPVector& cps = pano.getCtrlPoints();
+    std::vector<RayPair> rays(cps.size());
+    std::vector<char> validRay(cps.size(), 0);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < cps.size(); ++i)
+    {
+        const ControlPoint& cp = cps[i];
+        validRay[i] = viewRays[cp.image1Nr]->getRay(cp.x1, cp.y1, rays[i].ray1) &&
+            viewRays[cp.image2Nr]->getRay(cp.x2, cp.y2, rays[i].ray2);
+        rays[i].scale = 0.5 * (pixelScale[cp.image1Nr] + pixelScale[cp.image2Nr]);
+    };
+    std::map<std::pair<unsigned int, unsigned int>, size_t> pairIndex;
+    std::vector<BlockPair> pairs;
+    for (size_t i = 0; i < cps.size(); ++i)
+    {
+        unsigned int block1 = blockOfImage[cps[i].image1Nr];
+        unsigned int block2 = blockOfImage[cps[i].image2Nr];
+        if (!validRay[i] || block1 == block2 || (variableIndex[block1] < 0 && variableIndex[block2] < 0))
+        {
+            // the residual does not depend on the variables
+            continue;
+        };
+        RayPair ray = rays[i];
+        if (block1 > block2)
+        {
+            std::swap(block1, block2);
+            std::swap(ray.ray1, ray.ray2);
+        };
+        const std::pair<unsigned int, unsigned int> key(block1, block2);
+        std::map<std::pair<unsigned int, unsigned int>, size_t>::const_iterator it = pairIndex.find(key);
+        if (it == pairIndex.end())
+        {
+            it = pairIndex.insert(std::make_pair(key, pairs.size())).first;
+            pairs.push_back(BlockPair());
+            pairs.back().block1 = block1;
+            pairs.back().block2 = block2;
+        };
+        pairs[it->second].rays.push_back(ray);
+    };
+    if (!pairs.empty())
+    {
+        OrientationProblem problem(rotations, variableIndex, pairs, pano.getOptions().huberSigma);
+        problem.Optimize(100);
+
+        // write the result back
+        for (size_t i = 0; i < representative.size(); ++i)
+        {
+            if (variableIndex[i] < 0)
+            {
+                continue;
+            };
+            double yaw, pitch, roll;
+            viewRays[representative[i]]->getAngles(problem.GetRotations()[i], yaw, pitch, roll);
+            pano.updateVariable(representative[i], Variable("y", yaw));
+            pano.updateVariable(representative[i], Variable("p", pitch));
+            pano.updateVariable(representative[i], Variable("r", roll));
+        };
+    };
+    for (size_t i = 0; i < viewRays.size(); ++i)
+    {
+        delete viewRays[i];
+    };
+    PTools::calcCtrlPointErrors(pano);
+    return 0;
+}
+
+unsigned int OptimizeGeometric(PanoramaData& pano, const OptimizerBackend backend)
+{
+    if (backend == OPTIMIZER_SPARSE)
+    {
+        return SparseOptimizer::optimize(pano);
+    };
+    return PTools::optimize(pano);
+}
+
+} // namespace
@@ -0,0 +1,87 @@
+// -*- c-basic-offset: 4 -*-
+/** @file hugin_base/algorithms/optimizer/SparseOptimizer.h
+ *
+ *  @brief sparse optimizer for the image orientations of large projects
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _SPARSEOPTIMIZER_H
+#define _SPARSEOPTIMIZER_H
+
+#include <hugin_shared.h>
+#include <algorithms/PanoramaAlgorithm.h>
+#include <panodata/PanoramaData.h>
+
+namespace HuginBase {
+
+/** backend used for the geometric optimisation */
+enum OptimizerBackend
+{
+    /** dense Levenberg-Marquardt optimizer of libpano13 */
+    OPTIMIZER_PANOTOOLS = 0,
+    /** in-tree sparse optimizer, falls back to panotools for unsupported variables */
+    OPTIMIZER_SPARSE = 1
+};
+
+/** sparse optimizer for yaw, pitch and roll.
+ *
+ *  Each control point connects only two images, so the normal equations of the
+ *  orientation problem are block sparse: one 3x3 block for each image (or each group of
+ *  images with linked position) and one for each connected pair of images.
+ *  The residuals are the differences of the view rays of both points, the derivatives
+ *  are calculated analytically and each Levenberg-Marquardt step is solved with a
+ *  block-Jacobi preconditioned conjugate gradient. So the cost of an iteration grows
+ *  linear with the number of control points and image pairs instead of cubic with the
+ *  number of images.
+ *
+ *  The lens parameters are kept fixed. Projects which optimize other variables,
+ *  use camera translation or contain line control points are passed to the
+ *  panotools optimizer.
+ */
+class IMPEX SparseOptimizer : public PanoramaAlgorithm
+{
+public:
+    /** constructor */
+    explicit SparseOptimizer(PanoramaData& panorama) : PanoramaAlgorithm(panorama) {};
+    /** destructor */
+    virtual ~SparseOptimizer() {};
+
+    /** returns true, if the optimize vector and the control points of the panorama
+     *  can be handled by the sparse optimizer */
+    static bool canOptimize(const PanoramaData& pano);
+    /** returns true, if the optimize vector contains only yaw, pitch and roll.
+     *  Only these runs are offered to the sparse optimizer, all runs with lens
+     *  or photometric variables use the panotools optimizer directly */
+    static bool optimizesPositionsOnly(const OptimizeVector& optvec);
+    /** optimizes the panorama, uses the panotools optimizer if canOptimize returns false.
+     *  @return 0 on success, like PTools::optimize */
+    static unsigned int optimize(PanoramaData& pano);
+
+    virtual bool modifiesPanoramaData() const { return true; };
+    virtual bool runAlgorithm()
+    {
+        return optimize(o_panorama) == 0;
+    };
+};
+
+/** optimizes the geometric parameters of the panorama with the given backend
+ *  @return 0 on success, like PTools::optimize */
+IMPEX unsigned int OptimizeGeometric(PanoramaData& pano, const OptimizerBackend backend);
+
+} // namespace
+
+#endif // _SPARSEOPTIMIZER_H
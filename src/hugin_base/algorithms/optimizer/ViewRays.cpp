@@ -0,0 +1,298 @@
+// -*- c-basic-offset: 4 -*-
+/** @file hugin_base/algorithms/optimizer/ViewRays.cpp
+ *
+ *  @brief implementation of the conversion between image coordinates and view rays
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ViewRays.h"
+
+#include <cmath>
+#include <algorithm>
+#include <hugin_math/hugin_math.h>
+
+namespace HuginBase {
+
+namespace
+{
+    /** width of the equirectangular panorama used to calculate the view rays */
+    const double rayPanoWidth = 36000;
+
+    /** returns the options of the panorama used for calculating the view rays */
+    PanoramaOptions GetRayOptions()
+    {
+        PanoramaOptions opts;
+        opts.setProjection(PanoramaOptions::EQUIRECTANGULAR);
+        opts.setHFOV(360, false);
+        opts.setWidth(hugin_utils::roundi(rayPanoWidth), false);
+        opts.setHeight(hugin_utils::roundi(rayPanoWidth / 2));
+        return opts;
+    };
+
+    /** returns a copy of the image without rotation */
+    SrcPanoImage GetUnrotatedImage(const SrcPanoImage& image)
+    {
+        SrcPanoImage unrotated(image);
+        unrotated.setYaw(0);
+        unrotated.setPitch(0);
+        unrotated.setRoll(0);
+        return unrotated;
+    };
+}
+
+ViewRays::ViewRays(const SrcPanoImage& image) : m_signY(1), m_signZ(1), m_transpose(false), m_valid(false)
+{
+    const PanoramaOptions opts = GetRayOptions();
+    const SrcPanoImage unrotated = GetUnrotatedImage(image);
+    m_imageToPano.createInvTransform(unrotated, opts);
+    m_panoToImage.createTransform(unrotated, opts);
+    m_valid = FindConvention(unrotated);
+}
+
+Vector3 ViewRays::GetPanoRay(const double x, const double y) const
+{
+    const double distance = rayPanoWidth / (2.0 * M_PI);
+    const double lon = (x - (rayPanoWidth / 2.0 - 0.5)) / distance;
+    const double lat = -(y - (rayPanoWidth / 4.0 - 0.5)) / distance;
+    return Vector3(cos(lat) * cos(lon), m_signY * cos(lat) * sin(lon), m_signZ * sin(lat));
+}
+
+bool ViewRays::getRay(const double x, const double y, Vector3& ray) const
+{
+    double xPano, yPano;
+    if (!m_imageToPano.transformImgCoord(xPano, yPano, x, y))
+    {
+        return false;
+    };
+    ray = GetPanoRay(xPano, yPano);
+    return true;
+}
+
+bool ViewRays::getImagePoint(const Vector3& ray, double& x, double& y) const
+{
+    const double norm = ray.Norm();
+    if (norm < 1e-300)
+    {
+        return false;
+    };
+    const double distance = rayPanoWidth / (2.0 * M_PI);
+    const double lon = atan2(m_signY * ray.y, ray.x);
+    const double lat = asin(std::max(-1.0, std::min(1.0, m_signZ * ray.z / norm)));
+    return m_panoToImage.transformImgCoord(x, y, lon * distance + (rayPanoWidth / 2.0 - 0.5), -lat * distance + (rayPanoWidth / 4.0 - 0.5));
+}
+
+Matrix3 ViewRays::getRotation(const double yaw, const double pitch, const double roll) const
+{
+    Matrix3 M;
+    M.SetRotationPT(DEG_TO_RAD(yaw), DEG_TO_RAD(pitch), DEG_TO_RAD(roll));
+    return m_transpose ? Transposed(M) : M;
+}
+
+void ViewRays::getAngles(const Matrix3& R, double& yaw, double& pitch, double& roll) const
+{
+    Matrix3 M = m_transpose ? Transposed(R) : R;
+    M.GetRotationPT(yaw, pitch, roll);
+    yaw = RAD_TO_DEG(yaw);
+    pitch = RAD_TO_DEG(pitch);
+    roll = RAD_TO_DEG(roll);
+}
+
+bool ViewRays::FindConvention(const SrcPanoImage& unrotated)
+{
+    // Matrix3::SetRotationPT and the panotools transformations use different axis conventions,
+    // so compare all candidates with a transformation with an arbitrary rotation
+    const double testYaw = 37.0;
+    const double testPitch = -21.0;
+    const double testRoll = 13.0;
+    SrcPanoImage rotated(unrotated);
+    rotated.setYaw(testYaw);
+    rotated.setPitch(testPitch);
+    rotated.setRoll(testRoll);
+    PTools::Transform rotatedTransform;
+    rotatedTransform.createInvTransform(rotated, GetRayOptions());
+    const double w = unrotated.getWidth();
+    const double h = unrotated.getHeight();
+    const double testPoints[5][2] = { { 0.5, 0.5 }, { 0.3, 0.3 }, { 0.7, 0.3 }, { 0.3, 0.7 }, { 0.7, 0.6 } };
+    for (int signY = -1; signY <= 1; signY += 2)
+    {
+        for (int signZ = -1; signZ <= 1; signZ += 2)
+        {
+            for (int transpose = 0; transpose < 2; ++transpose)
+            {
+                m_signY = signY;
+                m_signZ = signZ;
+                m_transpose = transpose != 0;
+                const Matrix3 R = getRotation(testYaw, testPitch, testRoll);
+                bool matches = true;
+                for (int i = 0; i < 5 && matches; ++i)
+                {
+                    Vector3 cameraRay;
+                    double xPano, yPano;
+                    if (!getRay(testPoints[i][0] * w, testPoints[i][1] * h, cameraRay) ||
+                        !rotatedTransform.transformImgCoord(xPano, yPano, testPoints[i][0] * w, testPoints[i][1] * h))
+                    {
+                        return false;
+                    };
+                    matches = (Rotate(R, cameraRay) - GetPanoRay(xPano, yPano)).Norm() < 1e-6;
+                };
+                if (matches)
+                {
+                    return true;
+                };
+            };
+        };
+    };
+    return false;
+}
+
+Vector3 ViewRays::Rotate(const Matrix3& R, const Vector3& v)
+{
+    return Vector3(R.m[0][0] * v.x + R.m[0][1] * v.y + R.m[0][2] * v.z,
+                   R.m[1][0] * v.x + R.m[1][1] * v.y + R.m[1][2] * v.z,
+                   R.m[2][0] * v.x + R.m[2][1] * v.y + R.m[2][2] * v.z);
+}
+
+Matrix3 ViewRays::Transposed(const Matrix3& M)
+{
+    Matrix3 T;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            T.m[i][j] = M.m[j][i];
+        };
+    };
+    return T;
+}
+
+Matrix3 ViewRays::CrossMatrix(const Vector3& v)
+{
+    Matrix3 M;
+    M.m[0][1] = -v.z;
+    M.m[0][2] = v.y;
+    M.m[1][0] = v.z;
+    M.m[1][2] = -v.x;
+    M.m[2][0] = -v.y;
+    M.m[2][1] = v.x;
+    return M;
+}
+
+Matrix3 ViewRays::RotationFromVector(const Vector3& v)
+{
+    // Rodrigues formula
+    Matrix3 R;
+    R.SetIdentity();
+    const double angle = v.Norm();
+    if (angle < 1e-300)
+    {
+        return R;
+    };
+    const Matrix3 K = CrossMatrix(v / angle);
+    const Matrix3 K2 = K * K;
+    const double s = sin(angle);
+    const double c = 1.0 - cos(angle);
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            R.m[i][j] += s * K.m[i][j] + c * K2.m[i][j];
+        };
+    };
+    return R;
+}
+
+bool ViewRays::EstimateRotation(const Vector3& cameraRay1, const Vector3& cameraRay2,
+    const Vector3& worldRay1, const Vector3& worldRay2, Matrix3& R)
+{
+    // build an orthonormal base from both pairs of rays, R maps the camera base onto the world base
+    const Vector3 c1 = cameraRay1.GetNormalized();
+    Vector3 c2 = c1.Cross(cameraRay2);
+    const Vector3 w1 = worldRay1.GetNormalized();
+    Vector3 w2 = w1.Cross(worldRay2);
+    if (c2.Norm() < 1e-8 || w2.Norm() < 1e-8)
+    {
+        return false;
+    };
+    c2.Normalize();
+    w2.Normalize();
+    const Vector3 c3 = c1.Cross(c2);
+    const Vector3 w3 = w1.Cross(w2);
+    const Vector3 c[3] = { c1, c2, c3 };
+    const Vector3 w[3] = { w1, w2, w3 };
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            R.m[i][j] = 0;
+        };
+    };
+    for (int k = 0; k < 3; ++k)
+    {
+        const double cv[3] = { c[k].x, c[k].y, c[k].z };
+        const double wv[3] = { w[k].x, w[k].y, w[k].z };
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                R.m[i][j] += wv[i] * cv[j];
+            };
+        };
+    };
+    return true;
+}
+
+bool ViewRays::RefineRotation(const std::vector<Vector3>& cameraRays, const std::vector<Vector3>& worldRays, Matrix3& R)
+{
+    if (cameraRays.size() != worldRays.size() || cameraRays.size() < 2)
+    {
+        return false;
+    };
+    for (int iteration = 0; iteration < 20; ++iteration)
+    {
+        // residual r = R * c - w, the rotation is updated by R <- exp([d]x) R,
+        // so the derivative is -[u]x with u = R * c
+        Matrix3 H;
+        Vector3 g;
+        for (size_t i = 0; i < cameraRays.size(); ++i)
+        {
+            const Vector3 u = Rotate(R, cameraRays[i]);
+            const Matrix3 U = CrossMatrix(u);
+            const Matrix3 UU = Transposed(U) * U;
+            for (int j = 0; j < 3; ++j)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    H.m[j][k] += UU.m[j][k];
+                };
+            };
+            g += u.Cross(u - worldRays[i]);
+        };
+        if (fabs(H.Determinant()) < 1e-12)
+        {
+            return false;
+        };
+        const Vector3 delta = -Rotate(H.Inverse(), g);
+        R = RotationFromVector(delta) * R;
+        if (delta.Norm() < 1e-12)
+        {
+            break;
+        };
+    };
+    return true;
+}
+
+} // namespace
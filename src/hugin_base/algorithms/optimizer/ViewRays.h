@@ -0,0 +1,96 @@
+// -*- c-basic-offset: 4 -*-
+/** @file hugin_base/algorithms/optimizer/ViewRays.h
+ *
+ *  @brief conversion between image coordinates and view rays of an image
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _VIEWRAYS_H
+#define _VIEWRAYS_H
+
+#include <hugin_shared.h>
+#include <vector>
+#include <hugin_math/Matrix3.h>
+#include <panodata/SrcPanoImage.h>
+#include <panotools/PanoToolsInterface.h>
+
+namespace HuginBase {
+
+/** converts image coordinates into view rays in the camera coordinate system and back.
+ *
+ *  The lens model (projection, hfov, distortion, shift, shear) is handled by the panotools
+ *  transformation of the image without rotation, the rotation is applied as matrix. So the
+ *  orientation of an image can be estimated and optimized with vector algebra only.
+ *  All rotations are matrices R with world ray = R * camera ray, they are converted
+ *  to and from yaw, pitch and roll of the image with getRotation and getAngles.
+ */
+class IMPEX ViewRays
+{
+public:
+    /** creates the transformations for the given image, yaw, pitch and roll of the image are ignored */
+    explicit ViewRays(const SrcPanoImage& image);
+
+    /** returns true, if the transformations could be created */
+    bool isValid() const { return m_valid; };
+    /** calculates the view ray of image point (x,y) in camera coordinates */
+    bool getRay(const double x, const double y, Vector3& ray) const;
+    /** calculates the image point of the view ray in camera coordinates */
+    bool getImagePoint(const Vector3& ray, double& x, double& y) const;
+    /** returns the rotation for yaw, pitch and roll (in degrees) */
+    Matrix3 getRotation(const double yaw, const double pitch, const double roll) const;
+    /** converts the rotation to yaw, pitch and roll (in degrees) */
+    void getAngles(const Matrix3& R, double& yaw, double& pitch, double& roll) const;
+
+    /** returns R * v */
+    static Vector3 Rotate(const Matrix3& R, const Vector3& v);
+    /** returns the transposed matrix */
+    static Matrix3 Transposed(const Matrix3& M);
+    /** returns the cross product matrix [v]x, so that [v]x * w = v x w */
+    static Matrix3 CrossMatrix(const Vector3& v);
+    /** returns the rotation exp([v]x), a rotation around v by |v| radians */
+    static Matrix3 RotationFromVector(const Vector3& v);
+
+    /** calculates the rotation R with worldRay = R * cameraRay from two pairs of rays (TRIAD method)
+     *  @return false if the rays are (nearly) parallel */
+    static bool EstimateRotation(const Vector3& cameraRay1, const Vector3& cameraRay2,
+        const Vector3& worldRay1, const Vector3& worldRay2, Matrix3& R);
+    /** refines the rotation R with Gauss-Newton iterations, so that the sum of the squared
+     *  distances between R * cameraRays and worldRays is minimal
+     *  @return false if the system is singular */
+    static bool RefineRotation(const std::vector<Vector3>& cameraRays, const std::vector<Vector3>& worldRays, Matrix3& R);
+
+private:
+    // private, PTools::Transform can not be copied
+    ViewRays(const ViewRays&);
+    ViewRays& operator=(const ViewRays&);
+
+    /** converts coordinates in the equirectangular ray panorama into a view ray */
+    Vector3 GetPanoRay(const double x, const double y) const;
+    /** checks the axis conventions against a rotated panotools transformation */
+    bool FindConvention(const SrcPanoImage& image);
+
+    PTools::Transform m_imageToPano;
+    PTools::Transform m_panoToImage;
+    double m_signY;
+    double m_signZ;
+    bool m_transpose;
+    bool m_valid;
+};
+
+} // namespace
+
+#endif // _VIEWRAYS_H
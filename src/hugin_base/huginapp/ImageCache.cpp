@@ -25,6 +25,7 @@
  */
 
 #include "ImageCache.h"
+#include "ImageDiskCache.h"
 
 #include <iostream>
 #include "hugin_config.h"
@@ -37,6 +38,15 @@
 #include <vigra_ext/impexalpha.hxx>
 #include <vigra_ext/Pyramid.h>
 #include <vigra_ext/FunctorAccessor.h>
+#include <vigra_ext/TiffRegionImport.h>
+#include <vigra/resizeimage.hxx>
+#include <cstdio>
+#include <csetjmp>
+extern "C" {
+#include <jpeglib.h>
+}
+#include <exiv2/exiv2.hpp>
+#include <exiv2/preview.hpp>
 
 
 
@@ -121,6 +131,272 @@ ImageCache::ImageCacheRGB8Ptr ImageCache::Entry::get8BitImage()
 
 ImageCache * ImageCache::instance = NULL;
 
+namespace
+{
+/** error handler for libjpeg, which returns to the caller instead of exiting the program */
+struct JpegErrorManager
+{
+    jpeg_error_mgr pub;
+    jmp_buf setjmpBuffer;
+};
+
+void JpegErrorExit(j_common_ptr cinfo)
+{
+    JpegErrorManager* err = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    longjmp(err->setjmpBuffer, 1);
+}
+
+void JpegSilentMessage(j_common_ptr cinfo)
+{
+    // ignore warnings of libjpeg
+}
+
+/** decodes a jpeg image with DCT domain scaling, the image is read either from a file or from memory
+ *  @param scaleLevel the image is reduced by 2^scaleLevel, maximal 3
+ *  @param row buffer for a single line, must be allocated by the caller because of setjmp
+ *  @return true on success */
+bool DecodeScaledJpeg(FILE* file, const unsigned char* data, const size_t size, const int scaleLevel, vigra::BRGBImage& image, std::vector<JSAMPLE>& row)
+{
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager jerr;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = JpegErrorExit;
+    jerr.pub.output_message = JpegSilentMessage;
+    if (setjmp(jerr.setjmpBuffer))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    };
+    jpeg_create_decompress(&cinfo);
+    if (file)
+    {
+        jpeg_stdio_src(&cinfo, file);
+    }
+    else
+    {
+        jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), size);
+    };
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK)
+    {
+        // CMYK images are loaded by the full decoder
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    };
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1 << std::min(scaleLevel, 3);
+    jpeg_start_decompress(&cinfo);
+    image.resize(cinfo.output_width, cinfo.output_height);
+    row.resize(cinfo.output_width * 3);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW rowPointer = &row[0];
+        jpeg_read_scanlines(&cinfo, &rowPointer, 1);
+        vigra::BRGBImage::traverser::row_iterator it = (image.upperLeft() + vigra::Diff2D(0, cinfo.output_scanline - 1)).rowIterator();
+        for (size_t x = 0; x < cinfo.output_width; ++x, ++it)
+        {
+            *it = vigra::RGBValue<vigra::UInt8>(row[3 * x], row[3 * x + 1], row[3 * x + 2]);
+        };
+    };
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+/** returns the number of pyramid levels needed to reduce the image to the size of the small images */
+int GetSmallImageLevels(const size_t width, const size_t height)
+{
+    size_t sz = width * height;
+    const size_t smallImageSize = 800 * 800l;
+    int nLevel = 0;
+    while (sz > smallImageSize)
+    {
+        sz /= 4;
+        nLevel++;
+    };
+    return nLevel;
+}
+
+/** returns the size of the image after reducing it nLevel times */
+vigra::Size2D GetReducedSize(vigra::Size2D size, const int nLevel)
+{
+    for (int i = 0; i < nLevel; ++i)
+    {
+        size = vigra::Size2D((size.width() + 1) / 2, (size.height() + 1) / 2);
+    };
+    return size;
+}
+
+/** returns true, if the image can be scaled to targetSize without distortion and without enlarging */
+bool IsSuitableReducedImage(const vigra::Size2D& size, const vigra::Size2D& targetSize)
+{
+    if (size.width() < targetSize.width() || size.height() < targetSize.height())
+    {
+        return false;
+    };
+    // aspect ratio must match within one pixel of the target
+    const double scale = static_cast<double>(targetSize.width()) / size.width();
+    return fabs(size.height() * scale - targetSize.height()) <= 1.0;
+}
+
+/** scales the image to the given size, first with the pyramid and then by interpolation */
+void ScaleToSize(vigra::BRGBImage& image, vigra::BImage& mask, const vigra::Size2D& targetSize)
+{
+    int nLevel = 0;
+    while (GetReducedSize(image.size(), nLevel + 1).width() >= targetSize.width() &&
+        GetReducedSize(image.size(), nLevel + 1).height() >= targetSize.height())
+    {
+        ++nLevel;
+    };
+    if (nLevel > 0)
+    {
+        vigra::BRGBImage smallImage;
+        if (mask.width() > 0)
+        {
+            vigra::BImage smallMask;
+            vigra_ext::reduceNTimes(image, mask, smallImage, smallMask, nLevel);
+            mask = smallMask;
+        }
+        else
+        {
+            vigra_ext::reduceNTimes(image, smallImage, nLevel);
+        };
+        image = smallImage;
+    };
+    if (image.size() != targetSize)
+    {
+        vigra::BRGBImage scaledImage(targetSize);
+        vigra::resizeImageLinearInterpolation(vigra::srcImageRange(image), vigra::destImageRange(scaledImage));
+        image = scaledImage;
+        if (mask.width() > 0)
+        {
+            vigra::BImage scaledMask(targetSize);
+            vigra::resizeImageNoInterpolation(vigra::srcImageRange(mask), vigra::destImageRange(scaledMask));
+            mask = scaledMask;
+        };
+    };
+}
+
+/** reads a reduced resolution subfile of a tiff file
+ *  @return true, if a suitable subfile was found */
+bool ReadTiffReducedImage(const std::string& filename, const vigra::Size2D& targetSize, const bool hasAlpha, vigra::BRGBImage& image, vigra::BImage& mask)
+{
+    vigra_ext::detail::TiffReadFile tiff(filename.c_str());
+    if (!tiff.get())
+    {
+        return false;
+    };
+    // find the smallest reduced image which is still bigger than the target size
+    int bestDirectory = -1;
+    uint32 bestWidth = 0;
+    uint32 bestHeight = 0;
+    int directory = 0;
+    do
+    {
+        uint32 subfileType = 0;
+        uint32 width = 0;
+        uint32 height = 0;
+        TIFFGetFieldDefaulted(tiff.get(), TIFFTAG_SUBFILETYPE, &subfileType);
+        TIFFGetField(tiff.get(), TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tiff.get(), TIFFTAG_IMAGELENGTH, &height);
+        if ((subfileType & FILETYPE_REDUCEDIMAGE) != 0 && IsSuitableReducedImage(vigra::Size2D(width, height), targetSize) &&
+            (bestDirectory < 0 || width < bestWidth))
+        {
+            bestDirectory = directory;
+            bestWidth = width;
+            bestHeight = height;
+        };
+        ++directory;
+    } while (TIFFReadDirectory(tiff.get()));
+    if (bestDirectory < 0 || !TIFFSetDirectory(tiff.get(), bestDirectory))
+    {
+        return false;
+    };
+    uint16 extraSamples = 0;
+    uint16* sampleInfo = NULL;
+    TIFFGetFieldDefaulted(tiff.get(), TIFFTAG_EXTRASAMPLES, &extraSamples, &sampleInfo);
+    if (hasAlpha && extraSamples == 0)
+    {
+        // the mask would be missing
+        return false;
+    };
+    // let libtiff convert all supported layouts to 8 bit RGBA
+    std::vector<uint32> raster(static_cast<size_t>(bestWidth) * bestHeight);
+    if (!TIFFReadRGBAImageOriented(tiff.get(), bestWidth, bestHeight, &raster[0], ORIENTATION_TOPLEFT, 0))
+    {
+        return false;
+    };
+    image.resize(bestWidth, bestHeight);
+    if (hasAlpha)
+    {
+        mask.resize(bestWidth, bestHeight);
+    };
+    for (uint32 y = 0; y < bestHeight; ++y)
+    {
+        for (uint32 x = 0; x < bestWidth; ++x)
+        {
+            const uint32 pixel = raster[y * bestWidth + x];
+            image(x, y) = vigra::RGBValue<vigra::UInt8>(TIFFGetR(pixel), TIFFGetG(pixel), TIFFGetB(pixel));
+            if (hasAlpha)
+            {
+                mask(x, y) = TIFFGetA(pixel);
+            };
+        };
+    };
+    ScaleToSize(image, mask, targetSize);
+    return true;
+}
+
+/** reads the embedded jpeg preview of the image via exiv2
+ *  @return true, if a suitable preview was found */
+bool ReadEmbeddedPreview(const std::string& filename, const vigra::Size2D& targetSize, vigra::BRGBImage& image)
+{
+    try
+    {
+        Exiv2::Image::AutoPtr exivImage = Exiv2::ImageFactory::open(filename.c_str());
+        exivImage->readMetadata();
+        Exiv2::PreviewManager previews(*exivImage);
+        const Exiv2::PreviewPropertiesList list = previews.getPreviewProperties();
+        // the list is sorted by size, take the smallest suitable jpeg preview
+        for (Exiv2::PreviewPropertiesList::const_iterator it = list.begin(); it != list.end(); ++it)
+        {
+            if (it->mimeType_ == "image/jpeg" && IsSuitableReducedImage(vigra::Size2D(it->width_, it->height_), targetSize))
+            {
+                Exiv2::PreviewImage preview = previews.getPreviewImage(*it);
+                // decode already reduced, if the preview is much bigger than the target size
+                int scaleLevel = 0;
+                while (scaleLevel < 3 && GetReducedSize(vigra::Size2D(it->width_, it->height_), scaleLevel + 1).width() >= targetSize.width() &&
+                    GetReducedSize(vigra::Size2D(it->width_, it->height_), scaleLevel + 1).height() >= targetSize.height())
+                {
+                    ++scaleLevel;
+                };
+                std::vector<JSAMPLE> row;
+                if (!DecodeScaledJpeg(NULL, preview.pData(), preview.size(), scaleLevel, image, row))
+                {
+                    return false;
+                };
+                if (!IsSuitableReducedImage(image.size(), targetSize))
+                {
+                    // size in metadata was wrong
+                    return false;
+                };
+                vigra::BImage mask;
+                ScaleToSize(image, mask, targetSize);
+                return true;
+            };
+        };
+    }
+    catch (const Exiv2::Error& e)
+    {
+        DEBUG_DEBUG("Could not read preview of " << filename << ": " << e.what());
+    };
+    return false;
+}
+
+} // namespace
+
+
 
 void ImageCache::removeImage(const std::string & filename)
 {
@@ -652,9 +928,32 @@ ImageCache::EntryPtr ImageCache::getSmallImage(const std::string & filename)
             m_progress->setMessage("Scaling image:", hugin_utils::stripPath(filename));
         }
         DEBUG_DEBUG("creating small image " << name );
-        EntryPtr entry = getImage(filename);
-        
-        EntryPtr small_entry = loadSmallImageSafely(entry);
+        EntryPtr small_entry;
+        if (m_diskCache)
+        {
+            small_entry = m_diskCache->load(filename);
+        };
+        if (!small_entry.get())
+        {
+            EntryPtr entry = getImageIfAvailable(filename);
+            if (!entry.get())
+            {
+                // try to create the small image without decoding the full image
+                small_entry = loadSmallImageFromFileSafely(filename);
+                if (!small_entry.get())
+                {
+                    entry = getImage(filename);
+                };
+            };
+            if (!small_entry.get())
+            {
+                small_entry = loadSmallImageSafely(entry);
+            };
+            if (m_diskCache)
+            {
+                m_diskCache->store(filename, small_entry);
+            };
+        };
         small_entry->lastAccess = m_accessCounter;
         images[name] = small_entry;
         DEBUG_INFO ( "created small image: " << name);
@@ -683,14 +982,7 @@ ImageCache::EntryPtr ImageCache::loadSmallImageSafely(EntryPtr entry)
         vigra_fail("Could not load image");
     }
 
-    size_t sz = w*h;
-    size_t smallImageSize = 800 * 800l;
-
-    int nLevel=0;
-    while(sz > smallImageSize) {
-        sz /=4;
-        nLevel++;
-    }
+    const int nLevel = GetSmallImageLevels(w, h);
     EntryPtr e(new Entry);
     e->origType = entry->origType;
     // also copy icc profile
@@ -727,6 +1019,80 @@ ImageCache::EntryPtr ImageCache::loadSmallImageSafely(EntryPtr entry)
     return e;
 }
 
+ImageCache::EntryPtr ImageCache::loadSmallImageFromFileSafely(const std::string & filename)
+{
+    try
+    {
+        vigra::ImageImportInfo info(filename.c_str());
+        const int nLevel = GetSmallImageLevels(info.width(), info.height());
+        if (nLevel == 0)
+        {
+            // the image is small, nothing to gain
+            return EntryPtr();
+        };
+        // the small image has the same size as when created from the full image
+        const vigra::Size2D smallSize = GetReducedSize(info.size(), nLevel);
+        const std::string fileType(info.getFileType());
+        const std::string pixelType(info.getPixelType());
+        const bool hasAlpha = info.numExtraBands() == 1;
+        EntryPtr e(new Entry);
+        bool success = false;
+        if (fileType == "JPEG")
+        {
+            // scale in DCT domain by up to 1/8, the rest is done by the pyramid
+            FILE* file = fopen(filename.c_str(), "rb");
+            if (file)
+            {
+                vigra::BRGBImage scaledImage;
+                std::vector<JSAMPLE> row;
+                if (DecodeScaledJpeg(file, NULL, 0, nLevel, scaledImage, row))
+                {
+                    if (nLevel > 3)
+                    {
+                        vigra_ext::reduceNTimes(scaledImage, *(e->image8), nLevel - 3);
+                    }
+                    else
+                    {
+                        *(e->image8) = scaledImage;
+                    };
+                    success = (e->image8->size() == smallSize);
+                };
+                fclose(file);
+            };
+        }
+        else
+        {
+            // reduced resolution subfiles contain only 8 bit data, the preview of
+            // higher bit depth images would not match the full image
+            if (fileType == "TIFF" && pixelType == "UINT8")
+            {
+                success = ReadTiffReducedImage(filename, smallSize, hasAlpha, *(e->image8), *(e->mask));
+            };
+            if (!success && pixelType == "UINT8" && !hasAlpha)
+            {
+                success = ReadEmbeddedPreview(filename, smallSize, *(e->image8));
+            };
+        };
+        if (!success)
+        {
+            return EntryPtr();
+        };
+        e->origType = pixelType;
+        if (!info.getICCProfile().empty())
+        {
+            *(e->iccProfile) = info.getICCProfile();
+        };
+        DEBUG_DEBUG("created small image " << filename << " from reduced source");
+        return e;
+    }
+    catch (std::exception& e)
+    {
+        // use the full image
+        DEBUG_DEBUG("Could not create reduced small image: " << e.what());
+        return EntryPtr();
+    };
+}
+
 ImageCache::EntryPtr ImageCache::getSmallImageIfAvailable(const std::string & filename)
 {
     m_accessCounter++;
@@ -743,40 +1109,36 @@ ImageCache::EntryPtr ImageCache::getSmallImageIfAvailable(const std::string & fi
     }
 }
 
-ImageCache::RequestPtr ImageCache::requestAsyncImage(const std::string & filename)
+ImageCache::RequestPtr ImageCache::requestAsyncImage(const std::string & filename, int priority)
 {
     // see if we have a request already
     std::map<std::string, RequestPtr>::iterator it = m_requests.find(filename);
     if (it != m_requests.end()) {
         // return a copy of the existing request.
+        it->second->setPriority(std::max(it->second->getPriority(), priority));
         return it->second;
     } else {
-        bool need_thread = m_requests.empty() && m_smallRequests.empty();
         // Make a new request.
-        RequestPtr request = RequestPtr(new Request(filename, false));
+        RequestPtr request = RequestPtr(new Request(filename, false, priority, m_requestCounter++));
         m_requests[filename] = request;
-        if (need_thread) {
-            spawnAsyncThread();
-        }
+        spawnAsyncThread();
         return request;
     }
 }
 
-ImageCache::RequestPtr ImageCache::requestAsyncSmallImage(const std::string & filename)
+ImageCache::RequestPtr ImageCache::requestAsyncSmallImage(const std::string & filename, int priority)
 {
     // see if we have a request already
     std::map<std::string, RequestPtr>::iterator it = m_smallRequests.find(filename);
     if (it != m_smallRequests.end()) {
         // return a copy of the existing request.
+        it->second->setPriority(std::max(it->second->getPriority(), priority));
         return it->second;
     } else {
         // Make a new request.
-        bool need_thread = m_requests.empty() && m_smallRequests.empty();
-        RequestPtr request = RequestPtr(new Request(filename, true));
+        RequestPtr request = RequestPtr(new Request(filename, true, priority, m_requestCounter++));
         m_smallRequests[filename] = request;
-        if (need_thread) {
-            spawnAsyncThread();
-        }
+        spawnAsyncThread();
         return request;
     }
 }
@@ -791,8 +1153,10 @@ void ImageCache::postEvent(RequestPtr request, EntryPtr entry)
     if (is_small_request) {
         std::string name = filename+std::string(":small");
         images[name] = entry;
+        m_loadingRequests.erase(name);
     } else {
         images[filename] = entry;
+        m_loadingRequests.erase(filename);
     }
     entry->lastAccess = m_accessCounter;
     // Remove all the completed and no longer wanted requests from the queues.
@@ -846,15 +1210,21 @@ void ImageCache::postEvent(RequestPtr request, EntryPtr entry)
         }
         it = next_it;
     }
-    // If there are more images to load, start the thread again.
-    if (!(m_requests.empty() && m_smallRequests.empty())) {
-        // Start a background thread to load another image.
-        spawnAsyncThread();
-    }
+    // If there are more images to load, start the next threads.
+    spawnAsyncThread();
 }
 
 void ImageCache::removeRequest(RequestPtr request)
 {
+    // the thread for this request has finished
+    if (request->getIsSmall())
+    {
+        m_loadingRequests.erase(request->getFilename() + std::string(":small"));
+    }
+    else
+    {
+        m_loadingRequests.erase(request->getFilename());
+    };
     // Remove the no longer wanted requests from the queues.
     // We need to check everything, as images can be loaded synchronously after
     // an asynchronous request for it was made, and also something could have
@@ -907,67 +1277,189 @@ void ImageCache::removeRequest(RequestPtr request)
         }
         it = next_it;
     }
-    // If there are more images to load, start the thread again.
-    if (!(m_requests.empty() && m_smallRequests.empty()))
-    {
-        // Start a background thread to load another image.
-        spawnAsyncThread();
-    }
+    // If there are more images to load, start the next threads.
+    spawnAsyncThread();
 }
 
 void ImageCache::spawnAsyncThread()
 {
-    // Pick an image to load.
-    // Try the small images first.
-    std::map<std::string, RequestPtr>::iterator it = m_smallRequests.begin();
-    if (it == m_smallRequests.end()) {
-        it = m_requests.begin();
-        if (it == m_requests.end())
+    // This is called only from the main thread, so the request lists and the
+    // images need no mutex. The loading threads do not alter the ImageCache,
+    // they pass the loaded image back to the main thread by postEvent.
+    while (m_loadingRequests.size() < m_maxAsyncLoads)
+    {
+        // Pick the image to load: highest priority first, then small images
+        // before full size images, then the oldest request.
+        std::map<std::string, RequestPtr>* bestList = NULL;
+        std::map<std::string, RequestPtr>::iterator best;
+        std::map<std::string, RequestPtr>* lists[2] = { &m_smallRequests, &m_requests };
+        for (size_t i = 0; i < 2; ++i)
         {
-            DEBUG_DEBUG("Not staring a thread to load an image, since no images are wanted.");
-        } else {
-            std::thread thread(loadSafely, it->second, EntryPtr());
+            const bool isSmall = (i == 0);
+            for (std::map<std::string, RequestPtr>::iterator it = lists[i]->begin(); it != lists[i]->end();)
+            {
+                std::map<std::string, RequestPtr>::iterator next_it = it;
+                ++next_it;
+                const std::string name = isSmall ? it->first + std::string(":small") : it->first;
+                if (m_loadingRequests.find(name) == m_loadingRequests.end())
+                {
+                    if (it->second.unique())
+                    {
+                        // Nobody waits for this image anymore, forget it without loading.
+                        lists[i]->erase(it);
+                    }
+                    else
+                    {
+                        bool isBetter = (bestList == NULL);
+                        if (!isBetter)
+                        {
+                            const bool bestIsSmall = (bestList == &m_smallRequests);
+                            if (it->second->getPriority() != best->second->getPriority())
+                            {
+                                isBetter = it->second->getPriority() > best->second->getPriority();
+                            }
+                            else
+                            {
+                                if (isSmall != bestIsSmall)
+                                {
+                                    isBetter = isSmall;
+                                }
+                                else
+                                {
+                                    isBetter = it->second->getOrder() < best->second->getOrder();
+                                };
+                            };
+                        };
+                        if (isBetter)
+                        {
+                            bestList = lists[i];
+                            best = it;
+                        };
+                    };
+                };
+                it = next_it;
+            };
+        };
+        if (bestList == NULL)
+        {
+            DEBUG_DEBUG("Not starting a thread to load an image, since no further images are wanted.");
+            return;
+        };
+        RequestPtr request = best->second;
+        if (request->getIsSmall())
+        {
+            m_loadingRequests.insert(request->getFilename() + std::string(":small"));
+            // if the large image is already in the cache, the small image is created from it,
+            // otherwise the thread loads the file itself
+            std::thread thread(loadSafely, request, getImageIfAvailable(request->getFilename()));
             thread.detach();
         }
-    } else {
-        // got a small image request, check if its larger version has loaded.
-        const std::string & filename = it->second->getFilename();
-        EntryPtr large = getImageIfAvailable(filename);
-        if (large.get() == 0)
+        else
         {
-            // the larger one is needed to generate it.
-            RequestPtr request(new Request(filename, false));
+            m_loadingRequests.insert(request->getFilename());
             std::thread thread(loadSafely, request, EntryPtr());
             thread.detach();
-        } else {
-            // we have the large image.
-            std::thread thread(loadSafely, it->second, large);
-            thread.detach();
+        };
+    };
+}
+
+unsigned long long ImageCache::estimateImageMemory(const std::string & filename)
+{
+    try
+    {
+        vigra::ImageImportInfo info(filename.c_str());
+        unsigned long long bytesPerPixel;
+        const char* pixelType = info.getPixelType();
+        if (strcmp(pixelType, "UINT8") == 0)
+        {
+            bytesPerPixel = 3;
         }
+        else
+        {
+            if (strcmp(pixelType, "UINT16") == 0 || strcmp(pixelType, "INT16") == 0)
+            {
+                bytesPerPixel = 3 * 2;
+            }
+            else
+            {
+                bytesPerPixel = 3 * 4;
+            };
+        };
+        // add the mask
+        return static_cast<unsigned long long>(info.width()) * info.height() * (bytesPerPixel + 1);
     }
-    // thread should be processing the image asynchronously now.
-    // Only one image is done at a time, so very little can go wrong between the
-    // threads. The loading thread does not need to alter the ImageCache, and
-    // there is a time when we can safely pick Requests which haven't started
-    // loading, without giving images and lists mutexes.
+    catch (std::exception&)
+    {
+        // the error is reported when the image is loaded
+        return 0;
+    };
 }
 
 void ImageCache::loadSafely(ImageCache::RequestPtr request, EntryPtr large)
 {
+    ImageCache& cache = getInstance();
     // load the image
     EntryPtr new_entry;
+    bool fromDiskCache = false;
     if (large.get())
     {
         new_entry = loadSmallImageSafely(large);
     } else {
-        new_entry = loadImageSafely(request->getFilename());
+        if (request->getIsSmall() && cache.m_diskCache)
+        {
+            new_entry = cache.m_diskCache->load(request->getFilename());
+            fromDiskCache = new_entry.get() != NULL;
+        };
+        if (request->getIsSmall() && !new_entry.get())
+        {
+            // try to create the small image without decoding the full image
+            new_entry = loadSmallImageFromFileSafely(request->getFilename());
+        };
+        if (!new_entry.get())
+        {
+            // several images are loaded in parallel, wait until the decoded image fits
+            // into the memory limit of the cache. One image is always allowed.
+            const unsigned long long memory = estimateImageMemory(request->getFilename());
+            {
+                std::unique_lock<std::mutex> lock(cache.m_asyncMemoryMutex);
+                cache.m_asyncMemoryCondition.wait(lock, [&cache, memory]()
+                {
+                    return cache.m_asyncMemory == 0 || cache.m_asyncMemory + memory <= cache.upperBound;
+                });
+                cache.m_asyncMemory += memory;
+            }
+            new_entry = loadImageSafely(request->getFilename());
+            if (new_entry.get() && request->getIsSmall())
+            {
+                // small image requested, but large image was not in the cache
+                // create the small image directly, the large image is not kept
+                try
+                {
+                    new_entry = loadSmallImageSafely(new_entry);
+                }
+                catch (std::exception& e)
+                {
+                    DEBUG_ERROR("Error during creating small image: " << e.what());
+                    new_entry = EntryPtr();
+                };
+            };
+            {
+                std::lock_guard<std::mutex> lock(cache.m_asyncMemoryMutex);
+                cache.m_asyncMemory -= memory;
+            }
+            cache.m_asyncMemoryCondition.notify_all();
+        }
     }
+    if (request->getIsSmall() && new_entry.get() && cache.m_diskCache && !fromDiskCache)
+    {
+        cache.m_diskCache->store(request->getFilename(), new_entry);
+    };
     // pass an event with the load image and request, which can get picked up by
     // the main thread later. This could be a wxEvent for example.
     // Check if it exists, to avoid crashing in odd cases.
-    if (getInstance().asyncLoadCompleteSignal)
+    if (cache.asyncLoadCompleteSignal)
     {
-        (*getInstance().asyncLoadCompleteSignal)(request, new_entry);
+        (*cache.asyncLoadCompleteSignal)(request, new_entry);
     } else {
         DEBUG_ERROR("Please set HuginBase::ImageCache::getInstance().asyncLoadCompleteSignal to handle asynchronous image loads.");
     }
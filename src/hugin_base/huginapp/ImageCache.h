@@ -30,6 +30,11 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <set>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <vigra/stdimage.hxx>
 #include <vigra/imageinfo.hxx>
 #include <hugin_utils/utils.h>
@@ -40,6 +45,8 @@
 
 
 namespace HuginBase {
+
+class ImageDiskCache;
     
 /** This is a cache for all the images we use.
  *
@@ -117,8 +124,8 @@ class IMPEX ImageCache
         class Request
         {
             public:
-                Request(std::string filename, bool request_small)
-                    :m_filename(filename), m_isSmall(request_small)
+                Request(std::string filename, bool request_small, int priority = 0, unsigned long order = 0)
+                    :m_filename(filename), m_isSmall(request_small), m_priority(priority), m_order(order)
                     {};
                 /** Signal that fires when the image is loaded.
                  *  Function must return void and have three arguments: EntryPtr
@@ -133,9 +140,19 @@ class IMPEX ImageCache
                     {return m_isSmall;};
                 const std::string & getFilename() const
                     {return m_filename;};
+                /** requests with higher priority are loaded first */
+                int getPriority() const
+                    {return m_priority;};
+                void setPriority(int priority)
+                    {m_priority = priority;};
+                /** running number of the request, older requests are loaded first */
+                unsigned long getOrder() const
+                    {return m_order;};
             protected:
                 std::string m_filename;
                 bool m_isSmall;
+                int m_priority;
+                unsigned long m_order;
         };
         
         /** Reference counted request for an image to load.
@@ -154,7 +171,8 @@ class IMPEX ImageCache
         // ctor. private, nobody execpt us can create an instance.
         ImageCache()
             : asyncLoadCompleteSignal(0), upperBound(100*1024*1024ull),
-              m_progress(NULL), m_accessCounter(0)
+              m_asyncMemory(0), m_progress(NULL), m_accessCounter(0), m_requestCounter(0),
+              m_maxAsyncLoads(std::max(1u, std::min(4u, std::thread::hardware_concurrency())))
         {};
         
     public:
@@ -221,18 +239,22 @@ class IMPEX ImageCache
         /** Request an image be loaded.
          * This function returns quickly even when the image is not cached.
          *
+         * @param priority requests with higher priority are loaded first,
+         *        use a positive value for images which are currently visible
          * @return Object to keep while you want the image. Connect to its
          * ready signal to be notified when the image is ready.
          */
-        RequestPtr requestAsyncImage(const std::string & filename);
+        RequestPtr requestAsyncImage(const std::string & filename, int priority = 0);
         
         /** Request a small image be loaded.
          * This function returns quickly even when the image is not cached.
          *
+         * @param priority requests with higher priority are loaded first,
+         *        use a positive value for images which are currently visible
          * @return Object to keep while you want the image. Connect to its
          * ready signal to be notified when it is ready.
          */
-        RequestPtr requestAsyncSmallImage(const std::string & filename);
+        RequestPtr requestAsyncSmallImage(const std::string & filename, int priority = 0);
 
         /** remove a specific image (and dependant images)
          * from the cache 
@@ -254,6 +276,12 @@ class IMPEX ImageCache
 		/** sets the upper limit, which is used by softFlush() 
 		 */
 		void SetUpperLimit(const unsigned long long newUpperLimit) { upperBound=newUpperLimit; };
+        /** sets the maximal number of images, which are loaded in parallel
+         *  by the asynchronous requests */
+        void SetMaxAsyncLoads(const unsigned int maxLoads) { m_maxAsyncLoads = std::max(1u, maxLoads); };
+        /** sets the persistent cache for the small images, a 0 pointer disables it.
+         *  Set it before any image is requested, it is used by the background threads */
+        void setDiskCache(std::shared_ptr<ImageDiskCache> diskCache) { m_diskCache = diskCache; };
         
         /** Signal for when a asynchronous load completes.
          *  If you use the requestAsync functions, ensure there is something
@@ -285,6 +313,11 @@ class IMPEX ImageCache
 
     private:
         unsigned long long upperBound;
+        /** memory reserved by the running asynchronous loads,
+         *  guarded by m_asyncMemoryMutex */
+        unsigned long long m_asyncMemory;
+        std::mutex m_asyncMemoryMutex;
+        std::condition_variable m_asyncMemoryCondition;
 
         template <class SrcPixelType,
                   class DestIterator, class DestAccessor>
@@ -336,19 +369,40 @@ class IMPEX ImageCache
         
         // Requests for small images that need generating.
         std::map<std::string, RequestPtr> m_smallRequests;
-        
-        /// Start a background thread to load an image.
+
+        // Requests which are currently loaded by a background thread,
+        // small images are stored with the suffix ":small"
+        std::set<std::string> m_loadingRequests;
+
+        // running number for the requests
+        unsigned long m_requestCounter;
+
+        // maximal number of parallel background threads
+        unsigned int m_maxAsyncLoads;
+
+        // persistent cache of the small images, can be 0
+        std::shared_ptr<ImageDiskCache> m_diskCache;
+
+        /** Start background threads to load the requested images.
+         *  Starts threads for the pending requests with the highest priority,
+         *  until m_maxAsyncLoads images are loaded in parallel. Requests which
+         *  nobody waits for anymore are removed without loading.
+         */
         void spawnAsyncThread();
-        
+
         /** Load a requested image in a way that will work in parallel.
          *  When done, it sends an event with the newly created EntryPtr and
          *  request.
          *  @param RequestPtr request for the image to load.
          *  @param large EntryPtr for the large image when a small image is to
          *               be generated from it. Use a 0 pointer (the default) to
-         *               generate a full size image.
+         *               generate the image from the file.
          */
         static void loadSafely(RequestPtr request, EntryPtr large = EntryPtr());
+
+        /** returns the estimated memory needed to load the given file,
+         *  only the header of the file is read */
+        static unsigned long long estimateImageMemory(const std::string & filename);
         
         /** Load a full size image, in a way that will work in parallel.
          *  If the image cannot be loaded, the pointer returned is 0.
@@ -360,6 +414,14 @@ class IMPEX ImageCache
          * @param entry Large image to scale down.
          */
         static EntryPtr loadSmallImageSafely(EntryPtr entry);
+
+        /** Create a small image directly from a reduced resolution source:
+         *  JPEG images are scaled while decoding, for 8 bit images the reduced
+         *  resolution subfiles of TIFF files or the embedded previews are used.
+         *  Works in parallel. If no suitable source exists, the pointer returned
+         *  is 0 and the small image has to be created from the full size image.
+         */
+        static EntryPtr loadSmallImageFromFileSafely(const std::string & filename);
         
     public:
         /** get a pyramid image.
@@ -0,0 +1,510 @@
+// -*- c-basic-offset: 4 -*-
+/** @file ImageDiskCache.cpp
+ *
+ *  @brief implementation of the persistent cache of the small images
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ImageDiskCache.h"
+
+#include <hugin_config.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+#include <hugin_utils/utils.h>
+#include <hugin_utils/filesystem.h>
+
+namespace HuginBase
+{
+
+namespace
+{
+    /** identifies the cache files, change the version when the format changes */
+    const char cacheMagic[8] = { 'H', 'U', 'G', 'I', 'N', 'S', 'I', 'C' };
+    const uint32_t cacheVersion = 1;
+    const uint32_t byteOrderMark = 0x01020304;
+    const char* cacheExtension = ".hsic";
+    /** alignment of the pixel data inside the file */
+    const std::streamoff dataAlignment = 64;
+    /** number of bytes at the beginning and at the end of the image file used for the hash */
+    const std::streamoff hashBlockSize = 64 * 1024;
+
+    enum CacheImageFlags
+    {
+        CACHE_IMAGE8 = 1,
+        CACHE_IMAGE16 = 2,
+        CACHE_IMAGEFLOAT = 4,
+        CACHE_MASK = 8
+    };
+
+    /** header of the cache files, followed by the path, the original pixel type,
+     *  the icc profile and the aligned pixel data */
+    struct CacheFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        int64_t fileSize;
+        int64_t modTime;
+        uint64_t contentHash;
+        uint32_t width;
+        uint32_t height;
+        uint32_t flags;
+        uint32_t pathLength;
+        uint32_t origTypeLength;
+        uint32_t iccLength;
+    };
+
+    /** reads size and modification time of the file */
+    bool GetFileInfo(const std::string& filename, long long& fileSize, long long& modTime)
+    {
+        struct stat fileStat;
+        if (stat(filename.c_str(), &fileStat) != 0)
+        {
+            return false;
+        };
+        fileSize = static_cast<long long>(fileStat.st_size);
+        modTime = static_cast<long long>(fileStat.st_mtime);
+        return true;
+    };
+
+    /** FNV-1a hash */
+    uint64_t HashBytes(uint64_t hash, const char* data, const size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        };
+        return hash;
+    };
+
+    /** hashes the beginning and the end of the file, reading the whole file would be
+     *  as slow as decoding it */
+    uint64_t ContentHash(const std::string& filename, const long long fileSize)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        std::ifstream file(filename.c_str(), std::ios::binary);
+        if (!file.good())
+        {
+            return 0;
+        };
+        std::vector<char> buffer(static_cast<size_t>(std::min<long long>(hashBlockSize, fileSize)));
+        if (!buffer.empty())
+        {
+            file.read(&buffer[0], buffer.size());
+            hash = HashBytes(hash, &buffer[0], static_cast<size_t>(file.gcount()));
+            if (fileSize > hashBlockSize)
+            {
+                file.clear();
+                file.seekg(std::max<long long>(hashBlockSize, fileSize - hashBlockSize));
+                file.read(&buffer[0], buffer.size());
+                hash = HashBytes(hash, &buffer[0], static_cast<size_t>(file.gcount()));
+            };
+        };
+        return hash;
+    };
+
+    /** returns the next aligned position */
+    std::streamoff AlignOffset(const std::streamoff offset)
+    {
+        return (offset + dataAlignment - 1) / dataAlignment * dataAlignment;
+    };
+
+    /** reads the pixel data of an image at the next aligned position */
+    template <class ImageType>
+    bool ReadImageData(std::ifstream& file, std::streamoff& offset, ImageType& image, const int width, const int height)
+    {
+        offset = AlignOffset(offset);
+        image.resize(width, height);
+        const std::streamoff size = static_cast<std::streamoff>(width) * height * sizeof(typename ImageType::value_type);
+        file.seekg(offset);
+        file.read(reinterpret_cast<char*>(image.data()), size);
+        offset += size;
+        return file.good();
+    };
+
+    /** writes the pixel data of an image at the next aligned position */
+    template <class ImageType>
+    bool WriteImageData(std::ofstream& file, std::streamoff& offset, const ImageType& image)
+    {
+        const std::streamoff alignedOffset = AlignOffset(offset);
+        const std::vector<char> padding(static_cast<size_t>(alignedOffset - offset), 0);
+        if (!padding.empty())
+        {
+            file.write(&padding[0], padding.size());
+        };
+        const std::streamoff size = static_cast<std::streamoff>(image.width()) * image.height() * sizeof(typename ImageType::value_type);
+        file.write(reinterpret_cast<const char*>(image.data()), size);
+        offset = alignedOffset + size;
+        return file.good();
+    };
+
+    /** entry of the cache directory, used for trimming */
+    struct CacheFileInfo
+    {
+        long long modTime;
+        long long fileSize;
+        std::string filename;
+        bool operator<(const CacheFileInfo& other) const
+        {
+            return modTime < other.modTime;
+        };
+    };
+}
+
+ImageDiskCache::ImageDiskCache(const std::string& directory, const unsigned long long maxSize) :
+    m_directory(directory), m_maxSize(maxSize), m_currentSize(-1)
+{
+    try
+    {
+        if (!m_directory.empty() && !fs::exists(fs::path(m_directory)))
+        {
+            fs::create_directories(fs::path(m_directory));
+        };
+    }
+    catch (std::exception& e)
+    {
+        DEBUG_ERROR("Could not create image cache directory " << m_directory << ": " << e.what());
+        m_directory.clear();
+    };
+}
+
+std::string ImageDiskCache::GetDefaultDirectory()
+{
+    std::string directory = hugin_utils::GetUserAppDataDir();
+    if (directory.empty())
+    {
+        return directory;
+    };
+#if _WIN32
+    directory.append("\\");
+#else
+    directory.append("/");
+#endif
+    directory.append("imagecache");
+    return directory;
+}
+
+std::string ImageDiskCache::getCacheFilename(const std::string& filename) const
+{
+    std::ostringstream name;
+    name << m_directory;
+#if _WIN32
+    name << "\\";
+#else
+    name << "/";
+#endif
+    name << std::hex << std::setw(16) << std::setfill('0') << HashBytes(14695981039346656037ull, filename.c_str(), filename.size()) << cacheExtension;
+    return name.str();
+}
+
+ImageCache::EntryPtr ImageDiskCache::load(const std::string& filename)
+{
+    if (m_directory.empty())
+    {
+        return ImageCache::EntryPtr();
+    };
+    const std::string cacheFilename = getCacheFilename(filename);
+    std::ifstream file(cacheFilename.c_str(), std::ios::binary);
+    if (!file.good())
+    {
+        return ImageCache::EntryPtr();
+    };
+    CacheFileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+        header.version != cacheVersion || header.byteOrder != byteOrderMark)
+    {
+        return ImageCache::EntryPtr();
+    };
+    // first the cheap tests, if the image file has changed
+    long long fileSize;
+    long long modTime;
+    if (!GetFileInfo(filename, fileSize, modTime) || header.fileSize != fileSize || header.modTime != modTime)
+    {
+        return ImageCache::EntryPtr();
+    };
+    std::string path(header.pathLength, '\0');
+    std::string origType(header.origTypeLength, '\0');
+    if ((header.pathLength > 0 && !file.read(&path[0], header.pathLength)) ||
+        (header.origTypeLength > 0 && !file.read(&origType[0], header.origTypeLength)) ||
+        path != filename)
+    {
+        // other file with same hash of the path
+        return ImageCache::EntryPtr();
+    };
+    if (ContentHash(filename, fileSize) != header.contentHash)
+    {
+        return ImageCache::EntryPtr();
+    };
+    ImageCache::EntryPtr entry(new ImageCache::Entry);
+    entry->origType = origType;
+    if (header.iccLength > 0)
+    {
+        entry->iccProfile->resize(header.iccLength);
+        if (!file.read(reinterpret_cast<char*>(entry->iccProfile->begin()), header.iccLength))
+        {
+            return ImageCache::EntryPtr();
+        };
+    };
+    std::streamoff offset = sizeof(header) + header.pathLength + header.origTypeLength + header.iccLength;
+    try
+    {
+        if (((header.flags & CACHE_IMAGE8) && !ReadImageData(file, offset, *(entry->image8), header.width, header.height)) ||
+            ((header.flags & CACHE_IMAGE16) && !ReadImageData(file, offset, *(entry->image16), header.width, header.height)) ||
+            ((header.flags & CACHE_IMAGEFLOAT) && !ReadImageData(file, offset, *(entry->imageFloat), header.width, header.height)) ||
+            ((header.flags & CACHE_MASK) && !ReadImageData(file, offset, *(entry->mask), header.width, header.height)))
+        {
+            return ImageCache::EntryPtr();
+        };
+    }
+    catch (std::exception& e)
+    {
+        DEBUG_ERROR("Could not read cache file " << cacheFilename << ": " << e.what());
+        return ImageCache::EntryPtr();
+    };
+    file.close();
+    // mark as recently used
+#ifdef _WIN32
+    _utime(cacheFilename.c_str(), NULL);
+#else
+    utime(cacheFilename.c_str(), NULL);
+#endif
+    DEBUG_DEBUG("read small image of " << filename << " from disk cache");
+    return entry;
+}
+
+void ImageDiskCache::store(const std::string& filename, const ImageCache::EntryPtr& entry)
+{
+    if (m_directory.empty() || !entry.get())
+    {
+        return;
+    };
+    CacheFileHeader header;
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.byteOrder = byteOrderMark;
+    long long fileSize;
+    long long modTime;
+    if (!GetFileInfo(filename, fileSize, modTime))
+    {
+        return;
+    };
+    header.fileSize = fileSize;
+    header.modTime = modTime;
+    header.contentHash = ContentHash(filename, fileSize);
+    // all images of the entry must have the same size
+    vigra::Size2D size(0, 0);
+    header.flags = 0;
+    if (entry->image8 && entry->image8->width() > 0)
+    {
+        header.flags |= CACHE_IMAGE8;
+        size = entry->image8->size();
+    };
+    if (entry->image16 && entry->image16->width() > 0)
+    {
+        if (header.flags != 0 && size != entry->image16->size())
+        {
+            return;
+        };
+        header.flags |= CACHE_IMAGE16;
+        size = entry->image16->size();
+    };
+    if (entry->imageFloat && entry->imageFloat->width() > 0)
+    {
+        if (header.flags != 0 && size != entry->imageFloat->size())
+        {
+            return;
+        };
+        header.flags |= CACHE_IMAGEFLOAT;
+        size = entry->imageFloat->size();
+    };
+    if (header.flags == 0)
+    {
+        return;
+    };
+    if (entry->mask && entry->mask->width() > 0)
+    {
+        if (size != entry->mask->size())
+        {
+            return;
+        };
+        header.flags |= CACHE_MASK;
+    };
+    header.width = size.width();
+    header.height = size.height();
+    header.pathLength = filename.size();
+    header.origTypeLength = entry->origType.size();
+    header.iccLength = entry->iccProfile ? entry->iccProfile->size() : 0;
+    // write into a temporary file first, so other threads never read incomplete files
+    const std::string cacheFilename = getCacheFilename(filename);
+    std::ostringstream tempFilename;
+    tempFilename << cacheFilename << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+    std::streamoff offset = sizeof(header) + header.pathLength + header.origTypeLength + header.iccLength;
+    {
+        std::ofstream file(tempFilename.str().c_str(), std::ios::binary);
+        if (!file.good())
+        {
+            return;
+        };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(filename.c_str(), header.pathLength);
+        file.write(entry->origType.c_str(), header.origTypeLength);
+        if (header.iccLength > 0)
+        {
+            file.write(reinterpret_cast<const char*>(entry->iccProfile->begin()), header.iccLength);
+        };
+        bool success = file.good();
+        if (success && (header.flags & CACHE_IMAGE8))
+        {
+            success = WriteImageData(file, offset, *(entry->image8));
+        };
+        if (success && (header.flags & CACHE_IMAGE16))
+        {
+            success = WriteImageData(file, offset, *(entry->image16));
+        };
+        if (success && (header.flags & CACHE_IMAGEFLOAT))
+        {
+            success = WriteImageData(file, offset, *(entry->imageFloat));
+        };
+        if (success && (header.flags & CACHE_MASK))
+        {
+            success = WriteImageData(file, offset, *(entry->mask));
+        };
+        file.close();
+        if (!success || file.fail())
+        {
+            DEBUG_ERROR("Could not write cache file " << tempFilename.str());
+            std::remove(tempFilename.str().c_str());
+            return;
+        };
+    }
+    // rename does not overwrite existing files on all systems
+    std::remove(cacheFilename.c_str());
+    if (std::rename(tempFilename.str().c_str(), cacheFilename.c_str()) != 0)
+    {
+        std::remove(tempFilename.str().c_str());
+        return;
+    };
+    bool needsTrim;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_currentSize >= 0)
+        {
+            m_currentSize += offset;
+        };
+        needsTrim = m_currentSize < 0 || static_cast<unsigned long long>(m_currentSize) > m_maxSize;
+    }
+    if (needsTrim)
+    {
+        // scan the directory and remove old files
+        trim();
+    };
+}
+
+void ImageDiskCache::trim()
+{
+    if (m_directory.empty())
+    {
+        return;
+    };
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<CacheFileInfo> files;
+    long long totalSize = 0;
+    try
+    {
+        for (fs::directory_iterator it(fs::path(m_directory)); it != fs::directory_iterator(); ++it)
+        {
+            if (it->path().extension().string() == cacheExtension)
+            {
+                CacheFileInfo info;
+                info.filename = it->path().string();
+                if (GetFileInfo(info.filename, info.fileSize, info.modTime))
+                {
+                    files.push_back(info);
+                    totalSize += info.fileSize;
+                };
+            };
+        };
+    }
+    catch (std::exception& e)
+    {
+        DEBUG_ERROR("Could not read image cache directory " << m_directory << ": " << e.what());
+        return;
+    };
+    if (static_cast<unsigned long long>(totalSize) > m_maxSize)
+    {
+        // remove the least recently used files, leave some free space so that
+        // the directory needs not to be scanned on each new file
+        const unsigned long long targetSize = static_cast<unsigned long long>(0.9 * m_maxSize);
+        std::sort(files.begin(), files.end());
+        for (size_t i = 0; i < files.size() && static_cast<unsigned long long>(totalSize) > targetSize; ++i)
+        {
+            if (std::remove(files[i].filename.c_str()) == 0)
+            {
+                totalSize -= files[i].fileSize;
+            };
+        };
+    };
+    m_currentSize = totalSize;
+}
+
+void ImageDiskCache::clear()
+{
+    if (m_directory.empty())
+    {
+        return;
+    };
+    std::lock_guard<std::mutex> lock(m_mutex);
+    try
+    {
+        std::vector<std::string> files;
+        for (fs::directory_iterator it(fs::path(m_directory)); it != fs::directory_iterator(); ++it)
+        {
+            if (it->path().extension().string() == cacheExtension)
+            {
+                files.push_back(it->path().string());
+            };
+        };
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            std::remove(files[i].c_str());
+        };
+    }
+    catch (std::exception& e)
+    {
+        DEBUG_ERROR("Could not clear image cache directory " << m_directory << ": " << e.what());
+    };
+    m_currentSize = 0;
+}
+
+} //namespace
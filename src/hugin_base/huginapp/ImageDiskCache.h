@@ -0,0 +1,83 @@
+// -*- c-basic-offset: 4 -*-
+/** @file ImageDiskCache.h
+ *
+ *  @brief persistent cache of the small images on disk
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _HUGINAPP_IMAGEDISKCACHE_H
+#define _HUGINAPP_IMAGEDISKCACHE_H
+
+#include <hugin_shared.h>
+#include <string>
+#include <mutex>
+#include <huginapp/ImageCache.h>
+
+namespace HuginBase {
+
+/** stores the small images of the ImageCache on disk, so they need not to be
+ *  created again from the full images in the next session.
+ *
+ *  Each image is stored in its own file in the cache directory. The entries are
+ *  identified by the path, the size and the modification time of the image file
+ *  and a hash of the beginning and the end of the file. The pixel data are stored
+ *  uncompressed and aligned in the native byte order, so they can be read directly
+ *  into the images (or mapped into memory). If the cache grows beyond its maximal
+ *  size the least recently used entries are removed.
+ *
+ *  All functions can be called from several threads.
+ */
+class IMPEX ImageDiskCache
+{
+public:
+    /** constructor
+     *  @param directory directory for the cache files, it is created if necessary
+     *  @param maxSize maximal size of all cache files in bytes */
+    ImageDiskCache(const std::string& directory, const unsigned long long maxSize);
+
+    /** returns the default cache directory in the user data directory,
+     *  returns an empty string if the directory is unknown */
+    static std::string GetDefaultDirectory();
+
+    /** reads the small image of the given image file
+     *  @return the cached small image, or a 0 pointer if the image is not cached
+     *          or the image file has changed */
+    ImageCache::EntryPtr load(const std::string& filename);
+    /** stores the small image of the given image file */
+    void store(const std::string& filename, const ImageCache::EntryPtr& entry);
+    /** removes the least recently used files until the cache fits into the maximal size */
+    void trim();
+    /** removes all cache files */
+    void clear();
+
+private:
+    // private, no copy
+    ImageDiskCache(const ImageDiskCache&);
+    ImageDiskCache& operator=(const ImageDiskCache&);
+
+    /** returns the cache file for the given image */
+    std::string getCacheFilename(const std::string& filename) const;
+
+    std::string m_directory;
+    unsigned long long m_maxSize;
+    /** size of all cache files, -1 if not yet known */
+    long long m_currentSize;
+    std::mutex m_mutex;
+};
+
+} //namespace
+#endif // _HUGINAPP_IMAGEDISKCACHE_H
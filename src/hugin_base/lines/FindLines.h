@@ -29,6 +29,10 @@
 #include <hugin_shared.h>
 #include "LinesTypes.h"
 #include "vigra/stdimage.hxx"
+#include "vigra/inspectimage.hxx"
+#include "vigra/transformimage.hxx"
+#include "vigra/functorexpression.hxx"
+#include "vigra_ext/utils.h"
 #include "panodata/Panorama.h"
 
 namespace HuginLines
@@ -76,5 +80,61 @@ namespace HuginLines
      */
     IMPEX HuginBase::CPVector GetVerticalLines(const HuginBase::Panorama& pano, const unsigned int imgNr, vigra::UInt8RGBImage& image, vigra::BImage& mask, const unsigned int nrLines);
     IMPEX HuginBase::CPVector GetVerticalLines(const HuginBase::Panorama& pano, const unsigned int imgNr, vigra::BImage& image, vigra::BImage& mask, const unsigned int nrLines);
+
+    /** converts the given image to UInt8RGBImage
+     *  only this image is correctly processed by GetVerticalLines
+     *  @param src input image
+     *  @param origType pixel type of input image
+     *  @param dest converted image
+     */
+    // 2 versions: one for color images, the other for gray images
+    template <class SrcIMG>
+    void convertToUInt8(const SrcIMG& src, const std::string& origType, vigra::UInt8RGBImage& dest)
+    {
+        dest.resize(src.size());
+        long newMax = vigra_ext::getMaxValForPixelType("UINT8");
+        // float needs to be from min ... max.
+        if (origType == "FLOAT" || origType == "DOUBLE")
+        {
+            /** @TODO this convert routine scale the input values range into the full scale of UInt16
+             *  this is not fully correct
+             */
+            vigra::RGBToGrayAccessor<vigra::RGBValue<float> > ga;
+            vigra::FindMinMax<float> minmax;   // init functor
+            vigra::inspectImage(srcImageRange(src, ga), minmax);
+            double minVal = minmax.min;
+            double maxVal = minmax.max;
+            vigra_ext::applyMapping(srcImageRange(src), destImage(dest), minVal, maxVal, 0);
+        }
+        else
+        {
+            vigra::transformImage(srcImageRange(src), destImage(dest),
+                vigra::functor::Arg1()*vigra::functor::Param(newMax / vigra_ext::getMaxValForPixelType(origType)));
+        };
+    }
+
+    template <class SrcIMG>
+    void convertGrayToUInt8(const SrcIMG& src, const std::string& origType, vigra::BImage& dest)
+    {
+        dest.resize(src.size());
+        long newMax = vigra_ext::getMaxValForPixelType("UINT8");
+        // float needs to be from min ... max.
+        if (origType == "FLOAT" || origType == "DOUBLE")
+        {
+            /** @TODO this convert routine scale the input values range into the full scale of UInt16
+             *  this is not fully correct
+             */
+            vigra::FindMinMax<float> minmax;   // init functor
+            vigra::inspectImage(srcImageRange(src), minmax);
+            double minVal = minmax.min;
+            double maxVal = minmax.max;
+            vigra_ext::applyMapping(srcImageRange(src), destImage(dest), minVal, maxVal, 0);
+        }
+        else
+        {
+            vigra::transformImage(srcImageRange(src), destImage(dest),
+                vigra::functor::Arg1()*vigra::functor::Param(newMax / vigra_ext::getMaxValForPixelType(origType)));
+        };
+    }
 };
 #endif
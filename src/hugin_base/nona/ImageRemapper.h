@@ -31,6 +31,7 @@
 #include <panodata/PanoramaData.h>
 #include <nona/RemappedPanoImage.h>
 #include <vigra_ext/impexalpha.hxx>
+#include <vigra_ext/TiffRegionImport.h>
 
 namespace HuginBase {
 namespace Nona {
@@ -169,8 +170,24 @@ RemappedPanoImage<ImageType, AlphaType>*
     
     vigra::ImageImportInfo info(img.getFilename().c_str());
 
-    int width = info.width();
-    int height = info.height();
+    SrcPanoImage src = pano.getSrcImage(imgNr);
+
+    // for big tiff files decode only the part of the image which is needed for the output
+    vigra::Rect2D srcRegion(info.size());
+    if (!opts.remapUsingGPU && vigra_ext::canImportTiffRegion(info))
+    {
+        m_remapped->setPanoImage(src, opts, outputROI);
+        const vigra::Rect2D neededRegion = m_remapped->calcSourceRegion(opts.interpolator);
+        // reading the full image sequential is faster, when most of the image is needed
+        if (neededRegion.area() < 0.75 * srcRegion.area())
+        {
+            srcRegion = neededRegion;
+        };
+    };
+    const bool importRegion = srcRegion.size() != info.size();
+
+    int width = srcRegion.width();
+    int height = srcRegion.height();
 
     if (opts.remapUsingGPU) {
         // Extend image width to multiple of 8 for fast GPU transfers.
@@ -188,12 +205,17 @@ RemappedPanoImage<ImageType, AlphaType>*
     bool alpha = info.numExtraBands() > 0;
     std::string type = info.getPixelType();
     
-    SrcPanoImage src = pano.getSrcImage(imgNr);
-    
     // import the image
     progress->setMessage("loading", hugin_utils::stripPath(img.getFilename()));
     
-    if (alpha) {
+    if (importRegion) {
+        if (alpha) {
+            vigra_ext::importTiffRegionAlpha(info, srcRegion, vigra::destImage(srcImg),
+                                             vigra::destImage(srcAlpha));
+        } else {
+            vigra_ext::importTiffRegion(info, srcRegion, vigra::destImage(srcImg));
+        }
+    } else if (alpha) {
         vigra::importImageAlpha(info, vigra::destImage(srcImg),
                                 vigra::destImage(srcAlpha));
     } else {
@@ -223,7 +245,19 @@ RemappedPanoImage<ImageType, AlphaType>*
     }
     m_remapped->setAdvancedOptions(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions);
     // remap the image
-    
+    if (importRegion) {
+        // setPanoImage was already called for calculating the needed region
+        progress->setMessage("remapping", hugin_utils::stripPath(img.getFilename()));
+        m_remapped->setSourceRegion(srcRegion);
+        if (alpha) {
+            m_remapped->remapImage(vigra::srcImageRange(srcImg),
+                                   vigra::srcImage(srcAlpha), opts.interpolator,
+                                   progress);
+        } else {
+            m_remapped->remapImage(vigra::srcImageRange(srcImg), opts.interpolator, progress);
+        }
+        return m_remapped;
+    }
     remapImage(srcImg, srcAlpha, ffImg,
                pano.getSrcImage(imgNr), opts,
                outputROI,
@@ -27,6 +27,8 @@
 #ifndef _NONA_REMAPPEDPANOIMAGE_H
 #define _NONA_REMAPPEDPANOIMAGE_H
 
+#include <cfloat>
+#include <vector>
 #include <vigra/imageinfo.hxx>
 #include <vigra/initimage.hxx>
 #include <vigra/copyimage.hxx>
@@ -118,6 +120,20 @@ class RemappedPanoImage : public vigra_ext::ROIImage<RemapImage, AlphaImage>
             m_advancedOptions = advancedOptions;
         };
 
+        /** calculates the part of the source image which is needed to remap the image
+         *  with the given interpolator, this includes the neighbourhood of the interpolator.
+         *  Returns the full image for GPU remapping and when the image wraps around.
+         *
+         *  setPanoImage() has to be called before!
+         */
+        vigra::Rect2D calcSourceRegion(const vigra_ext::Interpolator interp) const;
+
+        /** the following calls of remapImage get only the given part of the source image
+         *  instead of the full image, region should be calculated with calcSourceRegion().
+         *  This is reset by setPanoImage(). Not supported for GPU remapping.
+         */
+        void setSourceRegion(const vigra::Rect2D& region);
+
     public:
         /** calculate distance map. pixels contain distance from image center
          *
@@ -161,6 +177,8 @@ class RemappedPanoImage : public vigra_ext::ROIImage<RemapImage, AlphaImage>
         PanoramaOptions m_destImg;
         PTools::Transform m_transf;
         AdvancedOptions m_advancedOptions;
+        /** part of the source image passed to remapImage */
+        vigra::Rect2D m_srcRegion;
 
 };
 
@@ -224,11 +242,152 @@ void RemappedPanoImage<RemapImage,AlphaImage>::setPanoImage(const SrcPanoImage &
 
     Base::resize(roi);
     m_transf.createTransform(src, dest);
+    m_srcRegion = vigra::Rect2D(m_srcImg.getSize());
 
     DEBUG_DEBUG("after resize: " << Base::m_region);
     DEBUG_DEBUG("m_srcImg size: " << m_srcImg.getSize());
 }
 
+template <class RemapImage, class AlphaImage>
+vigra::Rect2D RemappedPanoImage<RemapImage,AlphaImage>::calcSourceRegion(const vigra_ext::Interpolator interp) const
+{
+    const vigra::Rect2D imageRect(m_srcImg.getSize());
+    const vigra::Rect2D& bb = Base::boundingBox();
+    if (bb.isEmpty() || m_destImg.remapUsingGPU)
+    {
+        return imageRect;
+    };
+    // sample the transformation on a coarse grid, the last row and column are at the border
+    const int step = 8;
+    const int nx = (bb.width() - 1) / step + 2;
+    const int ny = (bb.height() - 1) / step + 2;
+    std::vector<hugin_utils::FDiff2D> points(nx * ny);
+    std::vector<char> valid(nx * ny, 0);
+#pragma omp parallel for schedule(dynamic)
+    for (int j = 0; j < ny; ++j)
+    {
+        const int y = std::min(bb.top() + j * step, bb.bottom() - 1);
+        for (int i = 0; i < nx; ++i)
+        {
+            const int x = std::min(bb.left() + i * step, bb.right() - 1);
+            double sx, sy;
+            if (m_transf.transformImgCoord(sx, sy, x, y))
+            {
+                points[j * nx + i] = hugin_utils::FDiff2D(sx, sy);
+                valid[j * nx + i] = 1;
+            };
+        };
+    };
+    // bounding box of all sample points and the biggest distance between neighbouring
+    // samples, the pixels between the samples are at most this distance away from the samples
+    const vigra::Rect2D extendedRect(-1, -1, imageRect.right() + 1, imageRect.bottom() + 1);
+    double minX = DBL_MAX;
+    double minY = DBL_MAX;
+    double maxX = -DBL_MAX;
+    double maxY = -DBL_MAX;
+    double maxDelta = 0;
+    bool foundInside = false;
+    for (int j = 0; j < ny; ++j)
+    {
+        for (int i = 0; i < nx; ++i)
+        {
+            const int index = j * nx + i;
+            if (!valid[index])
+            {
+                continue;
+            };
+            const hugin_utils::FDiff2D& p = points[index];
+            minX = std::min(minX, p.x);
+            minY = std::min(minY, p.y);
+            maxX = std::max(maxX, p.x);
+            maxY = std::max(maxY, p.y);
+            const bool inside = extendedRect.contains(vigra::Point2D(hugin_utils::roundi(p.x), hugin_utils::roundi(p.y)));
+            foundInside |= inside;
+            const int neighbours[2] = { i + 1 < nx ? index + 1 : -1, j + 1 < ny ? index + nx : -1 };
+            for (int k = 0; k < 2; ++k)
+            {
+                if (neighbours[k] >= 0 && valid[neighbours[k]])
+                {
+                    const hugin_utils::FDiff2D& q = points[neighbours[k]];
+                    if (inside || extendedRect.contains(vigra::Point2D(hugin_utils::roundi(q.x), hugin_utils::roundi(q.y))))
+                    {
+                        maxDelta = std::max(maxDelta, std::max(fabs(p.x - q.x), fabs(p.y - q.y)));
+                    };
+                };
+            };
+        };
+    };
+    if (!foundInside || maxDelta > std::max(imageRect.width(), imageRect.height()))
+    {
+        return imageRect;
+    };
+    const int margin = static_cast<int>(ceil(maxDelta)) + vigra_ext::getInterpolatorSize(interp) + 2;
+    vigra::Rect2D region(static_cast<int>(floor(std::max(minX, -1.0 * margin))) - margin,
+                         static_cast<int>(floor(std::max(minY, -1.0 * margin))) - margin,
+                         static_cast<int>(ceil(std::min(maxX, 1.0 * imageRect.right()))) + margin + 1,
+                         static_cast<int>(ceil(std::min(maxY, 1.0 * imageRect.bottom()))) + margin + 1);
+    region &= imageRect;
+    if (m_srcImg.horizontalWarpNeeded() && !region.isEmpty())
+    {
+        // the interpolator wraps around at the left and right border
+        region = vigra::Rect2D(0, region.top(), imageRect.right(), region.bottom());
+    };
+    return region.isEmpty() ? imageRect : region;
+}
+
+template <class RemapImage, class AlphaImage>
+void RemappedPanoImage<RemapImage,AlphaImage>::setSourceRegion(const vigra::Rect2D& region)
+{
+    vigra_precondition(!region.isEmpty() && (region & vigra::Rect2D(m_srcImg.getSize())) == region,
+                       "RemappedPanoImage<RemapImage,AlphaImage>::setSourceRegion(): region outside of image.");
+    vigra_precondition(!m_destImg.remapUsingGPU || region == vigra::Rect2D(m_srcImg.getSize()),
+                       "RemappedPanoImage<RemapImage,AlphaImage>::setSourceRegion(): not supported for GPU remapping.");
+    m_srcRegion = region;
+}
+
+/** transformation into a part of the source image, which starts at offset */
+template <class TRANSFORM>
+class SourceRegionTransform
+{
+public:
+    SourceRegionTransform(const TRANSFORM& transform, const vigra::Diff2D& offset) : m_transform(transform), m_offset(offset) {};
+    bool transformImgCoord(double& x_dest, double& y_dest, double x_src, double y_src) const
+    {
+        if (m_transform.transformImgCoord(x_dest, y_dest, x_src, y_src))
+        {
+            x_dest -= m_offset.x;
+            y_dest -= m_offset.y;
+            return true;
+        };
+        return false;
+    };
+private:
+    const TRANSFORM& m_transform;
+    const vigra::Diff2D m_offset;
+};
+
+/** photometric transformation of a part of the source image, converts the position
+ *  back to the full image for the vignetting correction */
+template <class PixelTransform>
+class SourceRegionPixelTransform
+{
+public:
+    SourceRegionPixelTransform(const PixelTransform& transform, const vigra::Diff2D& offset) : m_transform(transform), m_offset(offset.x, offset.y) {};
+    template <class T>
+    typename vigra::NumericTraits<T>::RealPromote operator()(T v, const hugin_utils::FDiff2D& pos) const
+    {
+        return m_transform(v, pos + m_offset);
+    };
+    template <class T, class A>
+    A hdrWeight(T v, A a) const
+    {
+        return m_transform.hdrWeight(v, a);
+    };
+private:
+    const PixelTransform& m_transform;
+    const hugin_utils::FDiff2D m_offset;
+};
+
 
 #if 0
 /** set a new image or panorama options
@@ -446,7 +605,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
 
     vigra::Diff2D srcImgSize = srcImg.second - srcImg.first;
 
-    vigra::Size2D expectedSize = m_srcImg.getSize();
+    vigra::Size2D expectedSize = m_srcRegion.size();
     if (useGPU)
     {
         const int r = expectedSize.width() % 8;
@@ -456,6 +615,9 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
     DEBUG_DEBUG("srcImgSize: " << srcImgSize << " m_srcImgSize: " << m_srcImg.getSize());
     vigra_precondition(srcImgSize == expectedSize, 
                        "RemappedPanoImage<RemapImage,AlphaImage>::remapImage(): image unexpectedly changed dimensions.");
+    // srcImg contains only the part m_srcRegion of the source image
+    const vigra::Diff2D srcOffset = m_srcRegion.upperLeft();
+    SourceRegionTransform<PTools::Transform> regionTransf(m_transf, srcOffset);
 
     typedef typename ImgAccessor::value_type input_value_type;
     typedef typename vigra_ext::ValueTypeTraits<input_value_type>::value_type input_component_type;
@@ -482,6 +644,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
     } else {
         invResponse.setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
     }
+    SourceRegionPixelTransform<Photometric::InvResponseTransform<input_component_type, double> > regionInvResponse(invResponse, srcOffset);
 
     if ((m_srcImg.hasActiveMasks()) || (m_srcImg.getCropMode() != SrcPanoImage::NO_CROP) || Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false))
     {
@@ -511,8 +674,8 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
         case SrcPanoImage::CROP_CIRCLE:
             {
                 vigra::Rect2D cR = m_srcImg.getCropRect();
-                hugin_utils::FDiff2D m( (cR.left() + cR.width()/2.0),
-                        (cR.top() + cR.height()/2.0) );
+                hugin_utils::FDiff2D m( (cR.left() + cR.width()/2.0 - srcOffset.x),
+                        (cR.top() + cR.height()/2.0 - srcOffset.y) );
 
                 double radius = std::min(cR.width(), cR.height())/2.0;
                 // Default the entire alpha channel to opaque..
@@ -527,6 +690,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                 // Default the entire alpha channel to transparent..
                 initImage(vigra::destImageRange(alpha),0);
                 // Make sure crop is inside the image..
+                cR.moveBy(-srcOffset);
                 cR &= vigra::Rect2D(0,0, srcImgSize.x, srcImgSize.y);
                 // Opaque only the area within the crop rectangle..
                 initImage(alpha.upperLeft()+cR.upperLeft(), 
@@ -538,7 +702,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
             break;
         }
         if(m_srcImg.hasActiveMasks())
-            vigra_ext::applyMask(vigra::destImageRange(alpha), m_srcImg.getActiveMasks());
+            vigra_ext::applyMask(vigra::destImageRange(alpha), m_srcImg.getActiveMasks(), srcOffset, std::max<int>(m_srcImg.getWidth(), srcImgSize.x));
         if (Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false))
         {
             const float lowerCutoff = Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposureLowerCutoff", NONA_DEFAULT_EXPOSURE_LOWER_CUTOFF);
@@ -571,8 +735,8 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                                 destImageRange(Base::m_image),
                                 destImage(Base::m_mask),
                                 Base::boundingBox().upperLeft(),
-                                m_transf,
-                                invResponse,
+                                regionTransf,
+                                regionInvResponse,
                                 m_srcImg.horizontalWarpNeeded(),
                                 interpol,
                                 progress,
@@ -624,8 +788,8 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                            destImageRange(Base::m_image),
                            destImage(Base::m_mask),
                            Base::boundingBox().upperLeft(),
-                           m_transf,
-                           invResponse,
+                           regionTransf,
+                           regionInvResponse,
                            m_srcImg.horizontalWarpNeeded(),
                            interpol,
                            progress,
@@ -654,7 +818,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
 
     vigra::Diff2D srcImgSize = srcImg.second - srcImg.first;
 
-    vigra::Size2D expectedSize = m_srcImg.getSize();
+    vigra::Size2D expectedSize = m_srcRegion.size();
     if (useGPU)
     {
         const int r = expectedSize.width() % 8;
@@ -662,6 +826,9 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
     }
     vigra_precondition(srcImgSize == expectedSize,
                        "RemappedPanoImage<RemapImage,AlphaImage>::remapImage(): image unexpectedly changed dimensions.");
+    // srcImg contains only the part m_srcRegion of the source image
+    const vigra::Diff2D srcOffset = m_srcRegion.upperLeft();
+    SourceRegionTransform<PTools::Transform> regionTransf(m_transf, srcOffset);
 
     typedef typename ImgAccessor::value_type input_value_type;
     typedef typename vigra_ext::ValueTypeTraits<input_value_type>::value_type input_component_type;
@@ -688,6 +855,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
     } else {
         invResponse.setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
     }
+    SourceRegionPixelTransform<Photometric::InvResponseTransform<input_component_type, double> > regionInvResponse(invResponse, srcOffset);
 
     if ((m_srcImg.hasActiveMasks()) || (m_srcImg.getCropMode() != SrcPanoImage::NO_CROP) || Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false)) {
         vigra::BImage alpha(srcImgSize);
@@ -707,8 +875,8 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                 vigra::copyImage(vigra::make_triple(alphaImg.first,
                         alphaImg.first + srcImgSize, alphaImg.second),
                         vigra::destImage(alpha));
-                hugin_utils::FDiff2D m( (cR.left() + cR.width()/2.0),
-                            (cR.top() + cR.height()/2.0) );
+                hugin_utils::FDiff2D m( (cR.left() + cR.width()/2.0 - srcOffset.x),
+                            (cR.top() + cR.height()/2.0 - srcOffset.y) );
                 double radius = std::min(cR.width(), cR.height())/2.0;
                 vigra_ext::circularCrop(vigra::destImageRange(alpha), m, radius);
                 break;
@@ -717,6 +885,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
             {
                 // Intersect the cropping rectangle with the one from the base
                 // image to ensure it fits inside.
+                cR.moveBy(-srcOffset);
                 cR &= vigra::Rect2D(0,0, srcImgSize.x, srcImgSize.y);
 
                 // Start with a blank alpha channel for the destination
@@ -733,7 +902,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                 break;
         }
         if(m_srcImg.hasActiveMasks())
-            vigra_ext::applyMask(vigra::destImageRange(alpha), m_srcImg.getActiveMasks());
+            vigra_ext::applyMask(vigra::destImageRange(alpha), m_srcImg.getActiveMasks(), srcOffset, std::max<int>(m_srcImg.getWidth(), srcImgSize.x));
         if (Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false))
         {
             const float lowerCutoff = Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposureLowerCutoff", NONA_DEFAULT_EXPOSURE_LOWER_CUTOFF);
@@ -766,8 +935,8 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                                            destImageRange(Base::m_image),
                                            destImage(Base::m_mask),
                                            Base::boundingBox().upperLeft(),
-                                           m_transf,
-                                           invResponse,
+                                           regionTransf,
+                                           regionInvResponse,
                                            m_srcImg.horizontalWarpNeeded(),
                                            interp,
                                            progress,
@@ -801,8 +970,8 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                                            destImageRange(Base::m_image),
                                            destImage(Base::m_mask),
                                            Base::boundingBox().upperLeft(),
-                                           m_transf,
-                                           invResponse,
+                                           regionTransf,
+                                           regionInvResponse,
                                            m_srcImg.horizontalWarpNeeded(),
                                            interp,
                                            progress,
@@ -479,8 +479,15 @@ public:
         const bool wrap = (opts.getHFOV() == 360.0) && (opts.getWidth()==opts.getROI().width());
         // remap each image and blend into main pano image
         const bool hardSeam = GetAdvancedOption(advOptions, "hardSeam", true);
+        // multiresolution blending along the hard seam, no intermediate files needed
+        const bool multiResolutionSeam = GetAdvancedOption(advOptions, "multiResolutionSeam", false);
+        vigra_ext::SeamBlendMode seamMode = hardSeam ? vigra_ext::SEAM_HARD : vigra_ext::SEAM_POISSON;
+        if (multiResolutionSeam)
+        {
+            seamMode = vigra_ext::SEAM_MULTIRESOLUTION;
+        };
         UIntVector images;
-        if(hardSeam)
+        if(seamMode != vigra_ext::SEAM_POISSON)
         { 
             std::copy(imgSet.begin(), imgSet.end(), std::back_inserter(images));
         }
@@ -520,7 +527,7 @@ public:
             Base::m_progress->setMessage("blending", hugin_utils::stripPath(Base::m_pano.getImage(*it).getFilename()));
             // add image to pano and panoalpha, adjusts panoROI as well.
             try {
-                vigra_ext::MergeImages<ImageType, AlphaType>(panoImage, alpha, remapped->m_image, remapped->m_mask, vigra::Diff2D(remapped->boundingBox().upperLeft()), wrap, hardSeam);
+                vigra_ext::MergeImages<ImageType, AlphaType>(panoImage, alpha, remapped->m_image, remapped->m_mask, vigra::Diff2D(remapped->boundingBox().upperLeft()), wrap, seamMode);
                 // update bounding box of the panorama
                 m_panoROI |= remapped->boundingBox();
             } catch (vigra::PreconditionViolation & e) {
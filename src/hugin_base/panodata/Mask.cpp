@@ -32,6 +32,7 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <panotools/PanoToolsInterface.h>
 #include <panodata/PTScriptParsing.h>
 
@@ -81,6 +82,105 @@ int MaskPolygon::getWindingNumber(const hugin_utils::FDiff2D p) const
     return wind;
 };
 
+namespace detail
+{
+    /** returns the first x in [xStart, xEnd) for which the edge from a to b changes the winding
+     *  number of point (x, y), or xEnd if there is no such x.
+     *  The comparisons are the same as in MaskPolygon::getWindingNumber, so the result is
+     *  identical. For a given row both sides are monotonic in x, so a bisection can be used */
+    int FindEdgeCrossing(const hugin_utils::FDiff2D& a, const hugin_utils::FDiff2D& b, const double y,
+        const bool upward, int xStart, int xEnd)
+    {
+        const double lhs = (b.x - a.x)*(y - a.y);
+        const double dy = b.y - a.y;
+        while (xStart < xEnd)
+        {
+            const int x = xStart + (xEnd - xStart) / 2;
+            const bool crossed = upward ? (lhs < (x - a.x)*dy) : (lhs > (x - a.x)*dy);
+            if (crossed)
+            {
+                xEnd = x;
+            }
+            else
+            {
+                xStart = x + 1;
+            };
+        };
+        return xStart;
+    };
+
+    /** sort criterion for edge crossings */
+    bool CompareCrossing(const std::pair<int, int>& a, const std::pair<int, int>& b)
+    {
+        return a.first < b.first;
+    };
+}
+
+void MaskPolygon::getInsideIntervals(const int y, const int width, RowIntervals& intervals) const
+{
+    if (m_polygon.size() < 3)
+        return;
+    // isInside checks the bounding box first, pixel outside are never inside
+    if (y < m_boundingBox.top() || y >= m_boundingBox.bottom())
+        return;
+    const int xStart = std::max(0, m_boundingBox.left());
+    const int xEnd = std::min(width, m_boundingBox.right());
+    if (xStart >= xEnd)
+        return;
+    // each edge which crosses the row changes the winding number for all pixels
+    // right of the crossing, store position and change of winding number
+    std::vector<std::pair<int, int> > crossings;
+    const double py = y;
+    hugin_utils::FDiff2D a = m_polygon[m_polygon.size() - 1];
+    for (unsigned int i = 0; i < m_polygon.size(); i++)
+    {
+        const hugin_utils::FDiff2D b = m_polygon[i];
+        if (a.y <= py)
+        {
+            if (b.y > py)
+            {
+                crossings.push_back(std::make_pair(detail::FindEdgeCrossing(a, b, py, true, xStart, xEnd), 1));
+            };
+        }
+        else
+        {
+            if (b.y <= py)
+            {
+                crossings.push_back(std::make_pair(detail::FindEdgeCrossing(a, b, py, false, xStart, xEnd), -1));
+            };
+        };
+        a = b;
+    };
+    std::sort(crossings.begin(), crossings.end(), detail::CompareCrossing);
+    // now sweep over the row and fill the spans
+    int wind = 0;
+    int x = xStart;
+    size_t i = 0;
+    while (x < xEnd)
+    {
+        // apply all crossings at the current position
+        while (i < crossings.size() && crossings[i].first <= x)
+        {
+            wind += crossings[i].second;
+            ++i;
+        };
+        const int nextX = (i < crossings.size()) ? crossings[i].first : xEnd;
+        const bool inside = m_invert ? (wind == 0) : (wind != 0);
+        if (inside)
+        {
+            if (!intervals.empty() && intervals.back().second == x)
+            {
+                intervals.back().second = nextX;
+            }
+            else
+            {
+                intervals.push_back(std::make_pair(x, nextX));
+            };
+        };
+        x = nextX;
+    };
+};
+
 int MaskPolygon::getTotalWindingNumber() const
 {
     if(m_polygon.size()<2)
@@ -28,6 +28,7 @@
 #define _PANODATA_MASK_H
 
 #include <hugin_shared.h>
+#include <algorithm>
 #include "hugin_utils/utils.h"
 #include "hugin_math/hugin_math.h"
 
@@ -38,6 +39,9 @@ namespace PTools { class Transform; }
 /** vector, which stores coordinates of one polygon */
 typedef std::vector<hugin_utils::FDiff2D> VectorPolygon;
 
+/** vector of pixel intervals [first, second) of one image row */
+typedef std::vector<std::pair<int, int> > RowIntervals;
+
 /** polygon can exceed the image maximal maskOffset pixels in each direction
  *  bigger polygons will be clipped after loading 
  */
@@ -69,6 +73,10 @@ public:
     int getWindingNumber(const hugin_utils::FDiff2D p) const;
     /** returns the total winding number of the polygon*/
     int getTotalWindingNumber() const;
+    /** appends the intervals [first, second) of row y, with x in [0, width), which are inside
+     *  of the polygon to intervals. The result is identical to calling isInside for each pixel
+     *  of the row, but each edge of the polygon is processed only once per row */
+    void getInsideIntervals(const int y, const int width, RowIntervals& intervals) const;
 
     // access functions
     /** returns mask type */
@@ -156,35 +164,53 @@ IMPEX void SaveMaskToStream(std::ostream& stream, vigra::Size2D imageSize, MaskP
 namespace vigra_ext 
 {
 
+/** applies the masks to a part of an image
+ *  @param img part of the image, its upper left corner is at offset in the full image
+ *  @param masks masks in the coordinates of the full image
+ *  @param offset position of img in the full image
+ *  @param imageWidth width of the full image
+ */
 template <class SrcImageIterator, class SrcAccessor>
-void applyMask(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> img, HuginBase::MaskPolygonVector masks)
+void applyMask(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> img, const HuginBase::MaskPolygonVector& masks,
+    const vigra::Diff2D offset, const int imageWidth)
 {
     const vigra::Diff2D imgSize = img.second - img.first;
 
     if(masks.empty())
         return;
-    // loop over the image and transform
+    // loop over the image rows, the masks are rasterized row by row
 #pragma omp parallel for schedule(dynamic)
     for(int y=0; y < imgSize.y; ++y)
     {
+        HuginBase::RowIntervals intervals;
+        for (size_t i = 0; i < masks.size(); ++i)
+        {
+            masks[i].getInsideIntervals(y + offset.y, imageWidth, intervals);
+        };
         // create x iterators
         SrcImageIterator xd(img.first);
         xd.y += y;
-        for(int x=0; x < imgSize.x; ++x, ++xd.x)
+        for (size_t i = 0; i < intervals.size(); ++i)
         {
-            hugin_utils::FDiff2D newPoint(x,y);
-            bool insideMasks=false;
-            unsigned int i=0;
-            while(!insideMasks && (i<masks.size()))
+            // clip the interval to the part of the image
+            const int xStart = std::max(intervals[i].first - offset.x, 0);
+            const int xEnd = std::min(intervals[i].second - offset.x, imgSize.x);
+            SrcImageIterator xs(xd);
+            xs.x += xStart;
+            for (int x = xStart; x < xEnd; ++x, ++xs.x)
             {
-                insideMasks=masks[i].isInside(newPoint);
-                i++;
+                *xs = 0;
             };
-            if(insideMasks)
-                *xd=0;
-        }
+        };
     }
 }
 
+template <class SrcImageIterator, class SrcAccessor>
+void applyMask(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> img, HuginBase::MaskPolygonVector masks)
+{
+    const vigra::Diff2D imgSize = img.second - img.first;
+    applyMask(img, masks, vigra::Diff2D(0, 0), imgSize.x);
+}
+
 } //namespace
 #endif // _PANODATA_MASK_H
@@ -0,0 +1,407 @@
+// -*- c-basic-offset: 4 -*-
+/** @file MetadataScanner.cpp
+ *
+ *  @brief implementation of the parallel EXIF reader
+ *
+ */
+
+/*
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "MetadataScanner.h"
+
+#include <hugin_config.h>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <locale>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+#include <exiv2/image.hpp>
+#include <hugin_utils/utils.h>
+
+namespace HuginBase
+{
+
+namespace
+{
+    /** first line of the cache file, change the version when the content changes */
+    const char* cacheHeader = "# hugin metadata cache, version 1";
+
+    /** reads size and modification time of the file */
+    bool GetFileInfo(const std::string& filename, long long& fileSize, long long& modTime)
+    {
+        struct stat fileStat;
+        if (stat(filename.c_str(), &fileStat) != 0)
+        {
+            return false;
+        };
+        fileSize = static_cast<long long>(fileStat.st_size);
+        modTime = static_cast<long long>(fileStat.st_mtime);
+        return true;
+    };
+
+    /** copies the values set by SrcPanoImage::readEXIF */
+    void CopyEXIFValues(const SrcPanoImage& from, SrcPanoImage& to)
+    {
+        to.setSize(from.getSize());
+        to.setFileMetadata(from.getFileMetadata());
+        to.setExifExposureTime(from.getExifExposureTime());
+        to.setExifAperture(from.getExifAperture());
+        to.setExifExposureMode(from.getExifExposureMode());
+        to.setExifISO(from.getExifISO());
+        to.setExifMake(from.getExifMake());
+        to.setExifModel(from.getExifModel());
+        to.setExifLens(from.getExifLens());
+        to.setExifOrientation(from.getExifOrientation());
+        to.setExifFocalLength(from.getExifFocalLength());
+        to.setExifFocalLength35(from.getExifFocalLength35());
+        to.setExifCropFactor(from.getExifCropFactor());
+        to.setExifDistance(from.getExifDistance());
+        to.setExifDate(from.getExifDate());
+        to.setExifRedBalance(from.getExifRedBalance());
+        to.setExifBlueBalance(from.getExifBlueBalance());
+    };
+
+    /** escapes tabulators and line breaks */
+    std::string EscapeString(const std::string& s)
+    {
+        std::string escaped;
+        escaped.reserve(s.size());
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            switch (s[i])
+            {
+                case '\\':
+                    escaped.append("\\\\");
+                    break;
+                case '\t':
+                    escaped.append("\\t");
+                    break;
+                case '\n':
+                    escaped.append("\\n");
+                    break;
+                case '\r':
+                    escaped.append("\\r");
+                    break;
+                default:
+                    escaped.push_back(s[i]);
+            };
+        };
+        return escaped;
+    };
+
+    /** reverts EscapeString */
+    std::string UnescapeString(const std::string& s)
+    {
+        std::string unescaped;
+        unescaped.reserve(s.size());
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] == '\\' && i + 1 < s.size())
+            {
+                ++i;
+                switch (s[i])
+                {
+                    case 't':
+                        unescaped.push_back('\t');
+                        break;
+                    case 'n':
+                        unescaped.push_back('\n');
+                        break;
+                    case 'r':
+                        unescaped.push_back('\r');
+                        break;
+                    default:
+                        unescaped.push_back(s[i]);
+                };
+            }
+            else
+            {
+                unescaped.push_back(s[i]);
+            };
+        };
+        return unescaped;
+    };
+
+    /** splits the line at the tabulators */
+    std::vector<std::string> SplitLine(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        while (true)
+        {
+            const size_t pos = line.find('\t', start);
+            if (pos == std::string::npos)
+            {
+                fields.push_back(line.substr(start));
+                break;
+            };
+            fields.push_back(line.substr(start, pos - start));
+            start = pos + 1;
+        };
+        return fields;
+    };
+
+    /** number of fixed fields in each line of the cache file */
+    const size_t fixedFields = 21;
+}
+
+MetadataScanner::MetadataScanner(const std::string& cacheFilename) : m_cacheFilename(cacheFilename), m_modified(false), m_maxThreads(0)
+{
+    load();
+}
+
+MetadataScanner::~MetadataScanner()
+{
+    save();
+}
+
+std::string MetadataScanner::GetDefaultCacheFilename()
+{
+    std::string filename = hugin_utils::GetUserAppDataDir();
+    if (filename.empty())
+    {
+        return filename;
+    };
+#if _WIN32
+    filename.append("\\");
+#else
+    filename.append("/");
+#endif
+    filename.append("metadata_cache.txt");
+    return filename;
+}
+
+void MetadataScanner::load()
+{
+    if (m_cacheFilename.empty())
+    {
+        return;
+    };
+    std::ifstream cacheFile(m_cacheFilename.c_str());
+    if (!cacheFile.good())
+    {
+        return;
+    };
+    std::string line;
+    std::getline(cacheFile, line);
+    if (line != cacheHeader)
+    {
+        // unknown format, the cache will be rebuilt
+        m_modified = true;
+        return;
+    };
+    while (std::getline(cacheFile, line))
+    {
+        const std::vector<std::string> fields = SplitLine(line);
+        if (fields.size() < fixedFields || (fields.size() - fixedFields) % 2 != 0)
+        {
+            continue;
+        };
+        std::istringstream numbers;
+        numbers.imbue(std::locale::classic());
+        // all numeric fields are parsed with one stream, separated by spaces
+        std::string numberString;
+        const size_t numberFields[] = { 1, 2, 3, 4, 5, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20 };
+        for (size_t i = 0; i < sizeof(numberFields) / sizeof(size_t); ++i)
+        {
+            numberString.append(fields[numberFields[i]]);
+            numberString.push_back(' ');
+        };
+        numbers.str(numberString);
+        CacheEntry entry;
+        int result, width, height, exposureMode;
+        double exposureTime, aperture, iso, orientation, focalLength, focalLength35, cropFactor, distance, redBalance, blueBalance;
+        numbers >> entry.fileSize >> entry.modTime >> result >> width >> height
+            >> exposureTime >> aperture >> exposureMode >> iso >> orientation
+            >> focalLength >> focalLength35 >> cropFactor >> distance >> redBalance >> blueBalance;
+        if (numbers.fail())
+        {
+            continue;
+        };
+        entry.result = result != 0;
+        entry.image.setSize(vigra::Size2D(width, height));
+        entry.image.setExifMake(UnescapeString(fields[6]));
+        entry.image.setExifModel(UnescapeString(fields[7]));
+        entry.image.setExifLens(UnescapeString(fields[8]));
+        entry.image.setExifDate(UnescapeString(fields[9]));
+        entry.image.setExifExposureTime(exposureTime);
+        entry.image.setExifAperture(aperture);
+        entry.image.setExifExposureMode(exposureMode);
+        entry.image.setExifISO(iso);
+        entry.image.setExifOrientation(orientation);
+        entry.image.setExifFocalLength(focalLength);
+        entry.image.setExifFocalLength35(focalLength35);
+        entry.image.setExifCropFactor(cropFactor);
+        entry.image.setExifDistance(distance);
+        entry.image.setExifRedBalance(redBalance);
+        entry.image.setExifBlueBalance(blueBalance);
+        FileMetaData metaData;
+        for (size_t i = fixedFields; i + 1 < fields.size(); i += 2)
+        {
+            metaData[UnescapeString(fields[i])] = UnescapeString(fields[i + 1]);
+        };
+        entry.image.setFileMetadata(metaData);
+        m_cache[UnescapeString(fields[0])] = entry;
+    };
+}
+
+bool MetadataScanner::save()
+{
+    if (m_cacheFilename.empty() || !m_modified)
+    {
+        return true;
+    };
+    // write into a temporary file first, so that a concurrent reader never sees a partial file
+    const std::string tempFilename = m_cacheFilename + ".tmp";
+    {
+        std::ofstream cacheFile(tempFilename.c_str());
+        if (!cacheFile.good())
+        {
+            return false;
+        };
+        cacheFile.imbue(std::locale::classic());
+        cacheFile.precision(17);
+        cacheFile << cacheHeader << std::endl;
+        for (CacheMap::const_iterator it = m_cache.begin(); it != m_cache.end(); ++it)
+        {
+            const SrcPanoImage& img = it->second.image;
+            // the order of the fields has to match the order in load
+            cacheFile << EscapeString(it->first) << "\t"
+                << it->second.fileSize << "\t"
+                << it->second.modTime << "\t"
+                << (it->second.result ? 1 : 0) << "\t"
+                << img.getWidth() << "\t"
+                << img.getHeight() << "\t"
+                << EscapeString(img.getExifMake()) << "\t"
+                << EscapeString(img.getExifModel()) << "\t"
+                << EscapeString(img.getExifLens()) << "\t"
+                << EscapeString(img.getExifDate()) << "\t"
+                << img.getExifExposureTime() << "\t"
+                << img.getExifAperture() << "\t"
+                << img.getExifExposureMode() << "\t"
+                << img.getExifISO() << "\t"
+                << img.getExifOrientation() << "\t"
+                << img.getExifFocalLength() << "\t"
+                << img.getExifFocalLength35() << "\t"
+                << img.getExifCropFactor() << "\t"
+                << img.getExifDistance() << "\t"
+                << img.getExifRedBalance() << "\t"
+                << img.getExifBlueBalance();
+            const FileMetaData metaData = img.getFileMetadata();
+            for (FileMetaData::const_iterator itMeta = metaData.begin(); itMeta != metaData.end(); ++itMeta)
+            {
+                cacheFile << "\t" << EscapeString(itMeta->first) << "\t" << EscapeString(itMeta->second);
+            };
+            cacheFile << std::endl;
+        };
+        if (!cacheFile.good())
+        {
+            return false;
+        };
+    }
+    std::remove(m_cacheFilename.c_str());
+    if (std::rename(tempFilename.c_str(), m_cacheFilename.c_str()) != 0)
+    {
+        return false;
+    };
+    m_modified = false;
+    return true;
+}
+
+bool MetadataScanner::readImage(SrcPanoImage& image, bool& result, CacheEntry& newEntry) const
+{
+    const std::string filename = image.getFilename();
+    long long fileSize = 0;
+    long long modTime = 0;
+    const bool fileInfoKnown = !m_cacheFilename.empty() && GetFileInfo(filename, fileSize, modTime);
+    if (fileInfoKnown)
+    {
+        CacheMap::const_iterator it = m_cache.find(filename);
+        // the result of readEXIF depends on the image size, if it was already set
+        if (it != m_cache.end() && it->second.fileSize == fileSize && it->second.modTime == modTime &&
+            (image.getWidth() <= 0 || image.getHeight() <= 0 || image.getSize() == it->second.image.getSize()))
+        {
+            CopyEXIFValues(it->second.image, image);
+            result = it->second.result;
+            return false;
+        };
+    };
+    result = image.readEXIF();
+    if (fileInfoKnown)
+    {
+        newEntry.fileSize = fileSize;
+        newEntry.modTime = modTime;
+        newEntry.result = result;
+        CopyEXIFValues(image, newEntry.image);
+        return true;
+    };
+    return false;
+}
+
+std::vector<bool> MetadataScanner::readEXIF(std::vector<SrcPanoImage*>& images)
+{
+    std::vector<bool> results(images.size(), false);
+    if (images.empty())
+    {
+        return results;
+    };
+    // initialize the xmp parser before it is used by several threads
+    Exiv2::XmpParser::initialize();
+    std::vector<char> imageResults(images.size(), 0);
+    std::vector<char> hasNewEntry(images.size(), 0);
+    std::vector<CacheEntry> newEntries(images.size());
+#ifdef HAVE_OPENMP
+    const int nrThreads = (m_maxThreads > 0) ? m_maxThreads : omp_get_max_threads();
+#else
+    const int nrThreads = 1;
+#endif
+    // the cache is only read inside the loop, new entries are merged afterwards
+#pragma omp parallel for schedule(dynamic) num_threads(nrThreads)
+    for (int i = 0; i < static_cast<int>(images.size()); ++i)
+    {
+        bool result = false;
+        hasNewEntry[i] = readImage(*images[i], result, newEntries[i]) ? 1 : 0;
+        imageResults[i] = result ? 1 : 0;
+    };
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        results[i] = imageResults[i] != 0;
+        if (hasNewEntry[i])
+        {
+            m_cache[images[i]->getFilename()] = newEntries[i];
+            m_modified = true;
+        };
+    };
+    return results;
+}
+
+std::vector<bool> MetadataScanner::readEXIF(std::vector<SrcPanoImage>& images)
+{
+    std::vector<SrcPanoImage*> imagePointers(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        imagePointers[i] = &images[i];
+    };
+    return readEXIF(imagePointers);
+}
+
+} // namespace
@@ -0,0 +1,102 @@
+// -*- c-basic-offset: 4 -*-
+/** @file MetadataScanner.h
+ *
+ *  @brief reads the EXIF data of many images in parallel, with optional persistent cache
+ *
+ */
+
+/*
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _PANODATA_METADATASCANNER_H
+#define _PANODATA_METADATASCANNER_H
+
+#include <hugin_shared.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <panodata/SrcPanoImage.h>
+
+namespace HuginBase
+{
+
+/** reads the image size and the EXIF data of many images in parallel.
+ *
+ *  Reading the metadata is dominated by the latency of opening the files, so the files
+ *  are processed by several threads. Optionally the results are stored in a cache file,
+ *  the entries are identified by filename, file size and modification time. So unchanged
+ *  files need not to be opened again when the same folder is scanned again.
+ */
+class IMPEX MetadataScanner
+{
+public:
+    /** constructor
+     *  @param cacheFilename file for the persistent cache, if empty no cache is used */
+    explicit MetadataScanner(const std::string& cacheFilename = std::string());
+    /** destructor, saves the cache if it was modified */
+    ~MetadataScanner();
+
+    /** returns the default location of the cache file in the user data directory,
+     *  returns an empty string if the directory is unknown */
+    static std::string GetDefaultCacheFilename();
+
+    /** sets the maximal number of threads, 0 uses the OpenMP default */
+    void setMaxThreads(const int maxThreads) { m_maxThreads = maxThreads; };
+
+    /** reads the EXIF data of all images, the result is the same as calling
+     *  SrcPanoImage::readEXIF for each image. The filenames of the images have to be set.
+     *  @return the return values of SrcPanoImage::readEXIF */
+    std::vector<bool> readEXIF(std::vector<SrcPanoImage>& images);
+    /** @copydoc readEXIF(std::vector<SrcPanoImage>&) */
+    std::vector<bool> readEXIF(std::vector<SrcPanoImage*>& images);
+
+    /** writes the cache file, if it was modified
+     *  @return true on success */
+    bool save();
+
+private:
+    // private, no copy
+    MetadataScanner(const MetadataScanner&);
+    MetadataScanner& operator=(const MetadataScanner&);
+
+    /** entry of the cache */
+    struct CacheEntry
+    {
+        long long fileSize;
+        long long modTime;
+        bool result;
+        /** contains only size, EXIF values and file metadata */
+        SrcPanoImage image;
+    };
+    typedef std::map<std::string, CacheEntry> CacheMap;
+
+    /** reads the cache file */
+    void load();
+    /** reads the EXIF data of one image, uses the cache if possible
+     *  @param newEntry filled with the new cache entry, if the image was not found in the cache
+     *  @return true, if newEntry was filled */
+    bool readImage(SrcPanoImage& image, bool& result, CacheEntry& newEntry) const;
+
+    std::string m_cacheFilename;
+    CacheMap m_cache;
+    bool m_modified;
+    int m_maxThreads;
+};
+
+} // namespace
+
+#endif // _PANODATA_METADATASCANNER_H
@@ -26,6 +26,8 @@
 
 #include <hugin_utils/utils.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 namespace HuginBase {
@@ -183,6 +185,213 @@ bool getPTDoubleParam(double & value, int & link,
     return true;
 }
 
+namespace
+{
+    inline bool isSeparator(const char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    /** copies the value into a zero terminated buffer for strtod/strtol,
+     *  kommas are replaced with points like in hugin_utils::stringToDouble */
+    bool copyNumber(char * buffer, const size_t bufferSize, const char * value, const size_t length)
+    {
+        if (length == 0 || length >= bufferSize)
+        {
+            return false;
+        };
+        for (size_t i = 0; i < length; ++i)
+        {
+            buffer[i] = (value[i] == ',') ? '.' : value[i];
+        };
+        buffer[length] = 0;
+        return true;
+    }
+
+    /** parses a double, the caller is responsible for setting the numeric locale to C */
+    bool parseDouble(const char * value, const size_t length, double & d)
+    {
+        char buffer[64];
+        if (!copyNumber(buffer, sizeof(buffer), value, length))
+        {
+            if (length == 0)
+            {
+                return false;
+            };
+            // very long value, use the slow path
+            return hugin_utils::stringToDouble(std::string(value, length), d);
+        };
+        char * end = NULL;
+        const double res = strtod(buffer, &end);
+        if (end == buffer)
+        {
+            return false;
+        };
+        d = res;
+        return true;
+    }
+
+    bool parseLong(const char * value, const size_t length, long & l)
+    {
+        char buffer[32];
+        if (!copyNumber(buffer, sizeof(buffer), value, length))
+        {
+            return false;
+        };
+        char * end = NULL;
+        const long res = strtol(buffer, &end, 10);
+        if (end == buffer)
+        {
+            return false;
+        };
+        l = res;
+        return true;
+    }
+} // namespace
+
+void ScriptLine::setLine(const std::string & line)
+{
+    m_tokens.clear();
+    const char * p = line.c_str();
+    const char * end = p + line.size();
+    bool firstToken = true;
+    while (p < end)
+    {
+        while (p < end && isSeparator(*p))
+        {
+            ++p;
+        };
+        if (p == end)
+        {
+            break;
+        };
+        const char * start = p;
+        while (p < end && !isSeparator(*p))
+        {
+            if (*p == '"')
+            {
+                // string parameter, can contain spaces, skip to closing "
+                const char * close = static_cast<const char *>(memchr(p + 1, '"', end - p - 1));
+                if (close == NULL)
+                {
+                    // unclosed string, take remainder of line
+                    p = end;
+                    break;
+                };
+                p = close;
+            };
+            ++p;
+        };
+        // the first token is the line type itself
+        if (firstToken)
+        {
+            firstToken = false;
+        }
+        else
+        {
+            m_tokens.push_back(Token(start, p - start));
+        };
+    };
+}
+
+bool ScriptLine::getValue(const char *& value, size_t & length, const char * name) const
+{
+    const size_t nameLength = strlen(name);
+    for (std::vector<Token>::const_iterator it = m_tokens.begin(); it != m_tokens.end(); ++it)
+    {
+        if (it->length >= nameLength && memcmp(it->begin, name, nameLength) == 0)
+        {
+            value = it->begin + nameLength;
+            length = it->length - nameLength;
+            if (length > 0 && *value == '"')
+            {
+                // string parameter, strip the quotes
+                const char * close = static_cast<const char *>(memchr(value + 1, '"', length - 1));
+                if (close == NULL)
+                {
+                    // unclosed string found
+                    return false;
+                };
+                ++value;
+                length = close - value;
+            };
+            return true;
+        };
+    };
+    return false;
+}
+
+bool ScriptLine::getParam(std::string & output, const char * name) const
+{
+    const char * value;
+    size_t length;
+    if (!getValue(value, length, name))
+    {
+        return false;
+    };
+    output.assign(value, length);
+    return true;
+}
+
+bool ScriptLine::getInt(int & value, const char * name) const
+{
+    const char * s;
+    size_t length;
+    if (!getValue(s, length, name))
+    {
+        return false;
+    };
+    // like getIntParam a parameter without valid number gives 0
+    long l = 0;
+    parseLong(s, length, l);
+    value = static_cast<int>(l);
+    return true;
+}
+
+bool ScriptLine::getInt(unsigned int & value, const char * name) const
+{
+    int i;
+    if (!getInt(i, name))
+    {
+        return false;
+    };
+    value = static_cast<unsigned int>(i);
+    return true;
+}
+
+bool ScriptLine::getDouble(double & value, const char * name) const
+{
+    const char * s;
+    size_t length;
+    if (!getValue(s, length, name))
+    {
+        return false;
+    };
+    return parseDouble(s, length, value);
+}
+
+bool ScriptLine::getDoubleOrLink(double & value, int & link, const char * name) const
+{
+    const char * s;
+    size_t length;
+    if (!getValue(s, length, name))
+    {
+        return false;
+    };
+    if (length > 0 && *s == '=')
+    {
+        long l;
+        if (!parseLong(s + 1, length - 1, l))
+        {
+            return false;
+        };
+        link = static_cast<int>(l);
+        return true;
+    };
+    link = -1;
+    return parseDouble(s, length, value);
+}
+
 bool readVar(Variable & var, int & link, const std::string & line)
 {
     std::string val;
@@ -245,26 +454,32 @@ void ImgInfo:: init()
 
 
 void ImgInfo::parse(const std::string & line)
+{
+    parse(ScriptLine(line));
+}
+
+void ImgInfo::parse(const ScriptLine & line)
 {
     double * val = defaultValues;
     for (const char ** v = varnames; *v; v++, val++) {
-        vars[*v] = *val;
-        links[*v] = -1;
-        std::string name;
-        name = *v;
-        getPTDoubleParam(vars[*v], links[*v], line, name);
+        const std::string name(*v);
+        double & value = vars[name];
+        int & link = links[name];
+        value = *val;
+        link = -1;
+        line.getDoubleOrLink(value, link, *v);
     }
     
     // getIntParam(blend_radius, line, "u");
     
     // read lens type and hfov
-    getIntParam(f, line, "f");
+    line.getInt(f, "f");
     
-    getPTParam(filename,line,"n");
-    getIntParam(width, line, "w");
-    getIntParam(height, line, "h");
+    line.getParam(filename, "n");
+    line.getInt(width, "w");
+    line.getInt(height, "h");
     
-    getIntParam(vigcorrMode, line, "Vm");
+    line.getInt(vigcorrMode, "Vm");
     // HACK: force Va1, for all images that use the a polynomial vig correction mode.
     // reset to vignetting correction by division.
     if (vigcorrMode != 5) {
@@ -275,11 +490,11 @@ void ImgInfo::parse(const std::string & line)
         vars["Vd"] = 0.0;
     }
     
-    getIntParam(responseType, line, "Rt");
-    getPTParam(flatfieldname,line,"Vf");
+    line.getInt(responseType, "Rt");
+    line.getParam(flatfieldname, "Vf");
     
     std::string crop_str;
-    if ( getPTParam(crop_str, line, "C") ) {
+    if ( line.getParam(crop_str, "C") ) {
         int left, right, top, bottom;
         int n = sscanf(crop_str.c_str(), "%d,%d,%d,%d", &left, &right, &top, &bottom);
         if (n == 4) {
@@ -288,7 +503,7 @@ void ImgInfo::parse(const std::string & line)
             DEBUG_WARN("Could not parse crop string: " << crop_str);
         }
     }
-    if ( getPTParam(crop_str, line, "S") ) {
+    if ( line.getParam(crop_str, "S") ) {
         int left, right, top, bottom;
         int n = sscanf(crop_str.c_str(), "%d,%d,%d,%d", &left, &right, &top, &bottom);
         if (n == 4) {
@@ -27,6 +27,7 @@
 
 #include <hugin_shared.h>
 #include <string>
+#include <vector>
 #include <vigra/diff2d.hxx>
 
 #include <panodata/PanoramaVariable.h>
@@ -60,6 +61,40 @@ namespace PTScriptParsing {
 
     bool getPTDoubleParam(double & value, int & link,
                           const std::string & line, const std::string & var);
+
+    /** splits a script line once into its parameters.
+     *  The get* functions behave like the free functions above, but they
+     *  don't rescan the whole line for each requested parameter and don't
+     *  create temporary strings for the numeric values. This is used for
+     *  the i, o and c lines, which make up the bulk of big project files.
+     *  The line given to setLine must outlive the ScriptLine object and
+     *  the numeric locale must be set to C by the caller.
+     */
+    class IMPEX ScriptLine
+    {
+    public:
+        ScriptLine() {};
+        explicit ScriptLine(const std::string & line) { setLine(line); };
+        /** tokenizes the given line, the memory of the previous line is reused */
+        void setLine(const std::string & line);
+
+        /** finds the value of the given parameter, returns false if not found */
+        bool getValue(const char *& value, size_t & length, const char * name) const;
+        bool getParam(std::string & output, const char * name) const;
+        bool getInt(int & value, const char * name) const;
+        bool getInt(unsigned int & value, const char * name) const;
+        bool getDouble(double & value, const char * name) const;
+        bool getDoubleOrLink(double & value, int & link, const char * name) const;
+
+    private:
+        struct Token
+        {
+            Token(const char * b, size_t l) : begin(b), length(l) {};
+            const char * begin;
+            size_t length;
+        };
+        std::vector<Token> m_tokens;
+    };
     ///
     struct ImgInfo
     {        
@@ -95,6 +130,7 @@ namespace PTScriptParsing {
 
     public:
         void parse(const std::string & line);
+        void parse(const ScriptLine & line);
 
     public:
         static const char *varnames[];
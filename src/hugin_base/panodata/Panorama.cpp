@@ -29,6 +29,7 @@
 #include "ImageVariableTranslate.h"
 #include "StandardImageVariableGroups.h"
 #include <panotools/PanoToolsInterface.h>
+#include <panotools/TransformMesh.h>
 #include <algorithms/basic/CalculateOverlap.h>
 #include <algorithms/basic/LayerStacks.h>
 #include <panodata/OptimizerSwitches.h>
@@ -38,7 +39,7 @@
 
 namespace HuginBase {
 
-Panorama::Panorama() : dirty(false), m_forceImagesUpdate(false)
+Panorama::Panorama() : dirty(false), m_forceImagesUpdate(false), m_meshCache(new PTools::TransformMeshCache())
 {
     // init map with ptoptimizer variables.
     m_ptoptimizerVarNames.insert("a");
@@ -59,6 +60,32 @@ Panorama::Panorama() : dirty(false), m_forceImagesUpdate(false)
     m_ptoptimizerVarNames.insert("Tpp");
 }
 
+Panorama::Panorama(const Panorama& other) : ManagedPanoramaData(other), AppBase::DocumentData(other),
+    imgFilePrefix(other.imgFilePrefix), dirty(other.dirty), state(other.state), observers(other.observers),
+    changedImages(other.changedImages), m_forceImagesUpdate(other.m_forceImagesUpdate),
+    m_ptoptimizerVarNames(other.m_ptoptimizerVarNames), m_meshCache(new PTools::TransformMeshCache())
+{
+}
+
+Panorama& Panorama::operator=(const Panorama& other)
+{
+    if (this != &other)
+    {
+        ManagedPanoramaData::operator=(other);
+        AppBase::DocumentData::operator=(other);
+        imgFilePrefix = other.imgFilePrefix;
+        dirty = other.dirty;
+        state = other.state;
+        observers = other.observers;
+        changedImages = other.changedImages;
+        m_forceImagesUpdate = other.m_forceImagesUpdate;
+        m_ptoptimizerVarNames = other.m_ptoptimizerVarNames;
+        // the meshes of the other panorama are not valid for this panorama
+        m_meshCache.reset(new PTools::TransformMeshCache());
+    };
+    return *this;
+}
+
 Panorama::~Panorama()
 {
     DEBUG_TRACE("dtor");
@@ -78,6 +105,7 @@ void Panorama::reset()
     state.needsOptimization = false;
     AppBase::DocumentData::setDirty(false);
     dirty=false;
+    m_meshCache->clear();
 }
 
 std::vector<unsigned int> Panorama::getCtrlPointsForImage(unsigned int imgNr) const
@@ -406,26 +434,27 @@ void Panorama::removeCtrlPoint(unsigned int pNr)
 void Panorama::removeDuplicateCtrlPoints()
 {
     std::set<std::string> listOfCPs;
-    std::set<unsigned int> duplicateCPs;
-    for(unsigned int i=0; i<state.ctrlPoints.size();i++)
+    CPVector uniqueCPs;
+    uniqueCPs.reserve(state.ctrlPoints.size());
+    // copy only the first occurrence of each control point, this avoids
+    // erasing the duplicates one by one from the vector
+    for (CPVector::const_iterator it = state.ctrlPoints.begin(); it != state.ctrlPoints.end(); ++it)
     {
-        std::string s=state.ctrlPoints[i].getCPString();
-        std::pair<std::set<std::string>::iterator,bool> it=listOfCPs.insert(s);
-        if(it.second==false)
+        if (listOfCPs.insert(it->getCPString()).second)
+        {
+            uniqueCPs.push_back(*it);
+        }
+        else
         {
-            duplicateCPs.insert(i);
+            //duplicate control point, mark affected images as changed
+            imageChanged(it->image1Nr);
+            imageChanged(it->image2Nr);
         };
     }
-    //now remove duplicate control points, mark affected images as changed
-    if(!duplicateCPs.empty())
+    if (uniqueCPs.size() != state.ctrlPoints.size())
     {
-        for(std::set<unsigned int>::reverse_iterator it=duplicateCPs.rbegin();it!=duplicateCPs.rend();++it)
-        {
-            ControlPoint cp=state.ctrlPoints[*it];
-            imageChanged(cp.image1Nr);
-            imageChanged(cp.image2Nr);
-            removeCtrlPoint(*it);
-        };
+        state.ctrlPoints.swap(uniqueCPs);
+        state.needsOptimization = true;
     };
     updateLineCtrlPoints();
 }
@@ -676,13 +705,28 @@ void Panorama::printPanoramaScript(std::ostream & o,
     
     o << std::endl << std::endl
       << "# control points" << std::endl;
-    for (CPVector::const_iterator it = state.ctrlPoints.begin(); it != state.ctrlPoints.end(); ++it) {
-		if (set_contains(imgs, it->image1Nr) && set_contains(imgs, it->image2Nr)) {
-	        o << "c n" << imageNrMap[it->image1Nr]
-		      << " N" << imageNrMap[it->image2Nr]
-			  << " x" << it->x1 << " y" << it->y1
-        	  << " X" << it->x2 << " Y" << it->y2
-              << " t" << it->mode << std::endl;
+    {
+        // format the control point lines into a buffer, this is much faster
+        // than the stream operators and endl for projects with many cps
+        // the output is identical to the default stream formatting
+        const int precision = static_cast<int>(o.precision());
+        char buffer[256];
+        for (CPVector::const_iterator it = state.ctrlPoints.begin(); it != state.ctrlPoints.end(); ++it) {
+            if (set_contains(imgs, it->image1Nr) && set_contains(imgs, it->image2Nr)) {
+                const int length = snprintf(buffer, sizeof(buffer), "c n%u N%u x%.*g y%.*g X%.*g Y%.*g t%d\n",
+                    imageNrMap[it->image1Nr], imageNrMap[it->image2Nr],
+                    precision, it->x1, precision, it->y1,
+                    precision, it->x2, precision, it->y2, it->mode);
+                if (length > 0 && length < static_cast<int>(sizeof(buffer))) {
+                    o.write(buffer, length);
+                } else {
+                    o << "c n" << imageNrMap[it->image1Nr]
+                      << " N" << imageNrMap[it->image2Nr]
+                      << " x" << it->x1 << " y" << it->y1
+                      << " X" << it->x2 << " Y" << it->y2
+                      << " t" << it->mode << "\n";
+                }
+            }
         }
     }
     o << std::endl;
@@ -1678,6 +1722,11 @@ void Panorama::setOptions(const PanoramaOptions & opt)
     state.options = opt;
 }
 
+PTools::TransformMeshCache* Panorama::getTransformMeshCache() const
+{
+    return m_meshCache.get();
+}
+
 void Panorama::addObserver(PanoramaObserver * o)
 {
     observers.push_back(o);
@@ -1705,6 +1754,7 @@ void Panorama::imageChanged(unsigned int imgNr)
 //    DEBUG_TRACE("adding image " << imgNr);
     changedImages.insert(imgNr);
     assert(changedImages.find(imgNr) != changedImages.end());
+    m_meshCache->invalidate(imgNr);
 }
 
 void Panorama::activateImage(unsigned int imgNr, bool active)
@@ -1991,154 +2041,202 @@ PanoramaData* Panorama::getUnlinkedSubset(UIntSetVector& imageGroups) const
 
 void Panorama::mergePanorama(const Panorama &newPano)
 {
-    if(newPano.getNrOfImages()>0)
+    mergePanoramas(std::vector<const Panorama*>(1, &newPano));
+};
+
+void Panorama::mergePanoramas(const std::vector<const Panorama*>& newPanos)
+{
+    // hash the filenames of the existing images only once for all merged panoramas
+    std::unordered_map<std::string, unsigned int> filenameIndex;
+    filenameIndex.reserve(getNrOfImages());
+    for (unsigned int i = 0; i < getNrOfImages(); ++i)
     {
-        std::vector<unsigned int> new_image_nr(newPano.getNrOfImages());
-        HuginBase::OptimizeVector optVec=getOptimizeVector();
-        HuginBase::OptimizeVector optVecNew=newPano.getOptimizeVector();
-        const size_t oldImgNumber = getNrOfImages();
-        HuginBase::UIntSet imgsAlreadyInPano;
-        HuginBase::UIntSet imgsCheckLens;
-        //add only new images
-        for(unsigned int i=0;i<newPano.getNrOfImages();i++)
+        // keep the first image, when a filename is used several times
+        filenameIndex.emplace(getImage(i).getFilename(), i);
+    };
+    size_t nrOfCPs = state.ctrlPoints.size();
+    for (size_t i = 0; i < newPanos.size(); ++i)
+    {
+        if (newPanos[i] != NULL)
         {
-            std::string filename=newPano.getImage(i).getFilename();
-            bool found=false;
-            for(unsigned int j=0;j<getNrOfImages();j++)
+            nrOfCPs += newPanos[i]->getNrOfCtrlPoints();
+        };
+    };
+    state.ctrlPoints.reserve(nrOfCPs);
+    UIntSet cpImages;
+    bool merged = false;
+    for (size_t i = 0; i < newPanos.size(); ++i)
+    {
+        if (newPanos[i] != NULL && newPanos[i]->getNrOfImages() > 0)
+        {
+            mergeImagesAndCtrlPoints(*newPanos[i], filenameIndex, cpImages);
+            merged = true;
+        };
+    };
+    if (merged)
+    {
+        // mark the images of the new control points only once as changed
+        for (UIntSet::const_iterator it = cpImages.begin(); it != cpImages.end(); ++it)
+        {
+            imageChanged(*it);
+        };
+        state.needsOptimization = true;
+        removeDuplicateCtrlPoints();
+    };
+};
+
+void Panorama::mergeImagesAndCtrlPoints(const Panorama& newPano, std::unordered_map<std::string, unsigned int>& filenameIndex, UIntSet& cpImages)
+{
+    std::vector<unsigned int> new_image_nr(newPano.getNrOfImages());
+    HuginBase::OptimizeVector optVec=getOptimizeVector();
+    HuginBase::OptimizeVector optVecNew=newPano.getOptimizeVector();
+    const size_t oldImgNumber = getNrOfImages();
+    HuginBase::UIntSet imgsAlreadyInPano;
+    HuginBase::UIntSet imgsCheckLens;
+    //add only new images
+    for(unsigned int i=0;i<newPano.getNrOfImages();i++)
+    {
+        const std::string& filename=newPano.getImage(i).getFilename();
+        std::unordered_map<std::string, unsigned int>::const_iterator foundImg = filenameIndex.find(filename);
+        if (foundImg != filenameIndex.end())
+        {
+            //image is already in panorama, we remember the image nr
+            const unsigned int j = foundImg->second;
+            new_image_nr[i]=j;
+            imgsAlreadyInPano.insert(i);
+            // now check if we have to update the masks
+            HuginBase::MaskPolygonVector masksOld=getImage(j).getMasks();
+            HuginBase::MaskPolygonVector masksNew=newPano.getImage(i).getMasks();
+            if(!masksNew.empty())
             {
-                if(getImage(j).getFilename()==filename)
+                for(unsigned int k=0;k<masksNew.size();k++)
                 {
-                    //image is already in panorama, we remember the image nr
-                    found=true;
-                    new_image_nr[i]=j;
-                    imgsAlreadyInPano.insert(i);
-                    // now check if we have to update the masks
-                    HuginBase::MaskPolygonVector masksOld=getImage(j).getMasks();
-                    HuginBase::MaskPolygonVector masksNew=newPano.getImage(i).getMasks();
-                    if(!masksNew.empty())
+                    bool usedMasks=false;
+                    unsigned int l=0;
+                    while((!usedMasks) && l<masksOld.size())
                     {
-                        for(unsigned int k=0;k<masksNew.size();k++)
-                        {
-                            bool usedMasks=false;
-                            unsigned int l=0;
-                            while((!usedMasks) && l<masksOld.size())
-                            {
-                                usedMasks=(masksNew[k]==masksOld[l]);
-                                l++;
-                            };
-                            if(!usedMasks)
-                                masksOld.push_back(masksNew[k]);
-                        };
-                        updateMasksForImage(j,masksOld);
+                        usedMasks=(masksNew[k]==masksOld[l]);
+                        l++;
                     };
-                    break;
+                    if(!usedMasks)
+                        masksOld.push_back(masksNew[k]);
                 };
+                updateMasksForImage(j,masksOld);
             };
-            if(!found)
-            {
-                //new image found, read EXIF data and add it
-                SrcPanoImage newImg(newPano.getImage(i));
-                newImg.readEXIF();
-                new_image_nr[i]=addImage(newImg);
-                imgsCheckLens.insert(i);
-                //copy also optimise vector
-                optVec.push_back(optVecNew[i]);
-            };
+        }
+        else
+        {
+            //new image found, read EXIF data and add it
+            SrcPanoImage newImg(newPano.getImage(i));
+            newImg.readEXIF();
+            new_image_nr[i]=addImage(newImg);
+            filenameIndex.emplace(filename, new_image_nr[i]);
+            imgsCheckLens.insert(i);
+            //copy also optimise vector
+            optVec.push_back(optVecNew[i]);
         };
-        setOptimizeVector(optVec);
-        // check and create lens for new added images
-        HuginBase::ConstImageVariableGroup newLenses(HuginBase::StandardImageVariableGroups::getLensVariables(), newPano);
-        HuginBase::ImageVariableGroup oldLenses(HuginBase::StandardImageVariableGroups::getLensVariables(), *this);
-        HuginBase::UIntSetVector lensImgs = newLenses.getPartsSet();
-        if (!imgsAlreadyInPano.empty())
+    };
+    setOptimizeVector(optVec);
+    // check and create lens for new added images
+    HuginBase::ConstImageVariableGroup newLenses(HuginBase::StandardImageVariableGroups::getLensVariables(), newPano);
+    HuginBase::ImageVariableGroup oldLenses(HuginBase::StandardImageVariableGroups::getLensVariables(), *this);
+    HuginBase::UIntSetVector lensImgs = newLenses.getPartsSet();
+    if (!imgsAlreadyInPano.empty())
+    {
+        for (auto img : imgsAlreadyInPano)
         {
-            for (auto img : imgsAlreadyInPano)
+            const size_t initialLensNumber = newLenses.getPartNumber(img);
+            const size_t newLensNumber = oldLenses.getPartNumber(new_image_nr[img]);
+            // create copy of UIntSet, because we can modifying the set in the for loop
+            // and this invalidates the iterators
+            const HuginBase::UIntSet imgs(imgsCheckLens);
+            for (auto j : imgs)
             {
-                const size_t initialLensNumber = newLenses.getPartNumber(img);
-                const size_t newLensNumber = oldLenses.getPartNumber(new_image_nr[img]);
-                // create copy of UIntSet, because we can modifying the set in the for loop
-                // and this invalidates the iterators
-                const HuginBase::UIntSet imgs(imgsCheckLens);
-                for (auto j : imgs)
+                if (set_contains(lensImgs[initialLensNumber], j))
                 {
-                    if (set_contains(lensImgs[initialLensNumber], j))
-                    {
-                        oldLenses.switchParts(new_image_nr[j], newLensNumber);
-                        imgsCheckLens.erase(j);
-                        lensImgs[initialLensNumber].erase(j);
-                    };
+                    oldLenses.switchParts(new_image_nr[j], newLensNumber);
+                    imgsCheckLens.erase(j);
+                    lensImgs[initialLensNumber].erase(j);
                 };
-                lensImgs[initialLensNumber].erase(img);
             };
+            lensImgs[initialLensNumber].erase(img);
         };
-        if (!imgsCheckLens.empty())
+    };
+    if (!imgsCheckLens.empty())
+    {
+        // find first lens not already handled
+        size_t i = 0;
+        while (i < lensImgs.size() && lensImgs[i].empty())
         {
-            // find first lens not already handled
-            size_t i = 0;
-            while (i < lensImgs.size() && lensImgs[i].empty())
-            {
-                i++;
-            };
-            if (i < lensImgs.size())
+            i++;
+        };
+        if (i < lensImgs.size())
+        {
+            const HuginBase::SrcPanoImage& srcImage = getImage(new_image_nr[*lensImgs[i].begin()]);
+            size_t matchingLensNumber = -1;
+            for (size_t j = 0; j < oldImgNumber; ++j)
             {
-                const HuginBase::SrcPanoImage& srcImage = getImage(new_image_nr[*lensImgs[i].begin()]);
-                size_t matchingLensNumber = -1;
-                for (size_t j = 0; j < oldImgNumber; ++j)
+                const HuginBase::SrcPanoImage& compareImage = getImage(j);
+                if (compareImage.getSize() == srcImage.getSize() &&
+                    compareImage.getExifModel() == srcImage.getExifModel() &&
+                    compareImage.getExifMake() == srcImage.getExifMake() &&
+                    compareImage.getExifFocalLength() == srcImage.getExifFocalLength())
                 {
-                    const HuginBase::SrcPanoImage& compareImage = getImage(j);
-                    if (compareImage.getSize() == srcImage.getSize() &&
-                        compareImage.getExifModel() == srcImage.getExifModel() &&
-                        compareImage.getExifMake() == srcImage.getExifMake() &&
-                        compareImage.getExifFocalLength() == srcImage.getExifFocalLength())
-                    {
-                        matchingLensNumber = oldLenses.getPartNumber(j);
-                        break;
-                    };
+                    matchingLensNumber = oldLenses.getPartNumber(j);
+                    break;
                 };
-                // we found a matching lens
-                if (matchingLensNumber >= 0)
+            };
+            // we found a matching lens
+            if (matchingLensNumber >= 0)
+            {
+                for (size_t j : lensImgs[i])
                 {
-                    for (size_t j : lensImgs[i])
-                    {
-                        oldLenses.switchParts(new_image_nr[j], matchingLensNumber);
-                    };
+                    oldLenses.switchParts(new_image_nr[j], matchingLensNumber);
                 };
             };
         };
-        // recreate links between image variables.
-        for (unsigned int i=0; i<newPano.getNrOfImages(); i++)
-        {
-            for(unsigned int j=i+1;j<newPano.getNrOfImages();j++)
-            {
-                const HuginBase::SrcPanoImage &img=newPano.getImage(i);
+    };
+    // recreate links between image variables.
+    // Links are transitive, so it is sufficient to link each image with the
+    // first image of its group instead of checking all pairs of images
 #define image_variable( name, type, default_value )\
-                if(img.name##isLinkedWith(newPano.getImage(j)))\
+    {\
+        std::vector<unsigned int> firstImages;\
+        for (unsigned int i = 0; i < newPano.getNrOfImages(); i++)\
+        {\
+            const HuginBase::SrcPanoImage& img = newPano.getImage(i);\
+            if (img.name##isLinked())\
+            {\
+                bool linked = false;\
+                for (size_t j = 0; j < firstImages.size() && !linked; ++j)\
                 {\
-                    linkImageVariable##name(new_image_nr[i],new_image_nr[j]);\
-                };
+                    if (newPano.getImage(firstImages[j]).name##isLinkedWith(img))\
+                    {\
+                        linkImageVariable##name(new_image_nr[firstImages[j]], new_image_nr[i]);\
+                        linked = true;\
+                    };\
+                };\
+                if (!linked)\
+                {\
+                    firstImages.push_back(i);\
+                };\
+            };\
+        };\
+    }
 #include "panodata/image_variables.h"
 #undef image_variable
-            }
-        }
-        //now translate cp
-        CPVector cps=newPano.getCtrlPoints();
-        const int nextLineCPOffset = getNextCPTypeLineNumber() - 3;
-        for(unsigned int i=0;i<cps.size();i++)
-        {
-            // special treatment of line control points
-            if (cps[i].mode > 2)
-            {
-                addCtrlPoint(HuginBase::ControlPoint(new_image_nr[cps[i].image1Nr], cps[i].x1, cps[i].y1,
-                    new_image_nr[cps[i].image2Nr], cps[i].x2, cps[i].y2, cps[i].mode + nextLineCPOffset));
-            }
-            else
-            {
-                // normal, horizontal and vertical cp keep their mode
-                addCtrlPoint(HuginBase::ControlPoint(new_image_nr[cps[i].image1Nr], cps[i].x1, cps[i].y1,
-                    new_image_nr[cps[i].image2Nr], cps[i].x2, cps[i].y2, cps[i].mode));
-            };
-        };
-        removeDuplicateCtrlPoints();
+    //now translate cp, append them all at once to the control point vector
+    const CPVector& cps=newPano.getCtrlPoints();
+    const int nextLineCPOffset = getNextCPTypeLineNumber() - 3;
+    for(unsigned int i=0;i<cps.size();i++)
+    {
+        // special treatment of line control points,
+        // normal, horizontal and vertical cp keep their mode
+        state.ctrlPoints.push_back(HuginBase::ControlPoint(new_image_nr[cps[i].image1Nr], cps[i].x1, cps[i].y1,
+            new_image_nr[cps[i].image2Nr], cps[i].x2, cps[i].y2,
+            cps[i].mode > 2 ? cps[i].mode + nextLineCPOffset : cps[i].mode));
+        cpImages.insert(new_image_nr[cps[i].image1Nr]);
+        cpImages.insert(new_image_nr[cps[i].image2Nr]);
     };
 };
 
@@ -2464,6 +2562,8 @@ bool PanoramaMemento::loadPTScript(std::istream &i, int & ptoVersion, const std:
 
     bool firstOptVecParse = true;
     unsigned int lineNr = 0;    
+    // tokenized i, o and c lines, reused to avoid allocations for each line
+    PTScriptParsing::ScriptLine scriptLine;
     while (i.good()) {
         std::getline(i, line);
         lineNr++;
@@ -2665,15 +2765,16 @@ bool PanoramaMemento::loadPTScript(std::istream &i, int & ptoVersion, const std:
             // read control points
             ControlPoint point;
 	    // TODO - should verify that line syntax is correct
-            PTScriptParsing::getIntParam(point.image1Nr, line, "n");
+            scriptLine.setLine(line);
+            scriptLine.getInt(point.image1Nr, "n");
             point.image1Nr += ctrlPointsImgNrOffset;
-            PTScriptParsing::getIntParam(point.image2Nr, line, "N");
+            scriptLine.getInt(point.image2Nr, "N");
             point.image2Nr += ctrlPointsImgNrOffset;
-            PTScriptParsing::getDoubleParam(point.x1, line, "x");
-            PTScriptParsing::getDoubleParam(point.x2, line, "X");
-            PTScriptParsing::getDoubleParam(point.y1, line, "y");
-            PTScriptParsing::getDoubleParam(point.y2, line, "Y");
-            if (!PTScriptParsing::getIntParam(t, line, "t")){
+            scriptLine.getDouble(point.x1, "x");
+            scriptLine.getDouble(point.x2, "X");
+            scriptLine.getDouble(point.y1, "y");
+            scriptLine.getDouble(point.y2, "Y");
+            if (!scriptLine.getInt(t, "t")){
                 t = 0;
             }
 
@@ -2687,23 +2788,27 @@ bool PanoramaMemento::loadPTScript(std::istream &i, int & ptoVersion, const std:
         // over i lines.(i lines often do not contain link information!)
         case 'i':
         {
+            scriptLine.setLine(line);
             if (PTGUILensLine) {
                 PTGUILensLine = false;
                 PTGUILensLoaded = true;
-                PTGUILens.parse(line);
+                PTGUILens.parse(scriptLine);
             } else {
-                iImgInfo.push_back(PTScriptParsing::ImgInfo(line));
+                iImgInfo.push_back(PTScriptParsing::ImgInfo());
+                iImgInfo.back().parse(scriptLine);
             }
             break;
         }
         case 'o':
         {
+            scriptLine.setLine(line);
             if (PTGUILensLine) {
                 PTGUILensLine = false;
                 PTGUILensLoaded = true;
-                PTGUILens.parse(line);
+                PTGUILens.parse(scriptLine);
             } else {
-                oImgInfo.push_back(PTScriptParsing::ImgInfo(line));
+                oImgInfo.push_back(PTScriptParsing::ImgInfo());
+                oImgInfo.back().parse(scriptLine);
             }
             break;
         }
@@ -31,6 +31,8 @@
 
 #include <hugin_shared.h>
 #include <list>
+#include <memory>
+#include <unordered_map>
 #include <appbase/DocumentData.h>
 #include <panodata/PanoramaData.h>
 
@@ -158,6 +160,12 @@ class IMPEX Panorama : public ManagedPanoramaData, public AppBase::DocumentData
          */
         Panorama();
 
+        /** copy ctor, the copy gets its own cache of transformation meshes */
+        Panorama(const Panorama& other);
+
+        /** assignment, the cache of transformation meshes is not shared */
+        Panorama& operator=(const Panorama& other);
+
         /** dtor.
          */
         ~Panorama();
@@ -229,6 +237,11 @@ class IMPEX Panorama : public ManagedPanoramaData, public AppBase::DocumentData
 
         /** merges the panorama with the given pano */
         void mergePanorama(const Panorama &newPano);
+        /** merges all given panoramas in one step into this panorama,
+         *  gives the same result as calling mergePanorama for each panorama,
+         *  but the filenames are indexed only once and the duplicate control
+         *  points are removed only once at the end */
+        void mergePanoramas(const std::vector<const Panorama*>& newPanos);
         
         /** creates an image, from filename, and a Lens, if needed */
 //        int addImageAndLens(const std::string & filename);
@@ -486,8 +499,11 @@ class IMPEX Panorama : public ManagedPanoramaData, public AppBase::DocumentData
          *  be feed into runOptimizer() and runStitcher().
          */
         void setOptions(const PanoramaOptions & opt);
-        
 
+#ifndef _HSI_IGNORE_SECTION
+        /** returns the cache of the transformation meshes of the images */
+        PTools::TransformMeshCache* getTransformMeshCache() const;
+#endif
         
     // -- script interface --
             
@@ -700,6 +716,11 @@ class IMPEX Panorama : public ManagedPanoramaData, public AppBase::DocumentData
         vigra::Rect2D centerCropImage(unsigned int imgNr);
         /** update the crop mode in dependence of crop rect and lens projection */
         void updateCropMode(unsigned int imgNr);
+        /** adds the images and control points of newPano, used by mergePanoramas
+         *  @param newPano panorama to merge
+         *  @param filenameIndex maps the filenames to the image numbers, new images are added
+         *  @param cpImages receives the image numbers of all added control points */
+        void mergeImagesAndCtrlPoints(const Panorama& newPano, std::unordered_map<std::string, unsigned int>& filenameIndex, UIntSet& cpImages);
 
         std::string imgFilePrefix;
 
@@ -714,6 +735,11 @@ class IMPEX Panorama : public ManagedPanoramaData, public AppBase::DocumentData
         bool m_forceImagesUpdate;
 
         std::set<std::string> m_ptoptimizerVarNames;
+#ifndef _HSI_IGNORE_SECTION
+        /** cached transformation meshes, each copy of the panorama has its own cache,
+         *  the meshes are checked against the image variables on each access */
+        std::shared_ptr<PTools::TransformMeshCache> m_meshCache;
+#endif
 };
 
 } // namespace
@@ -47,6 +47,10 @@
 
 namespace HuginBase {
 
+#ifndef _HSI_IGNORE_SECTION
+namespace PTools { class TransformMeshCache; }
+#endif
+
 ///
 typedef std::set<unsigned int> UIntSet;
 
@@ -343,6 +347,12 @@ public:
      *  be feed into runOptimizer() and runStitcher().
      */
     virtual void setOptions(const PanoramaOptions & opt) =0;
+
+#ifndef _HSI_IGNORE_SECTION
+    /** returns the cache of the transformation meshes of the images,
+     *  NULL if the panorama does not provide a cache */
+    virtual PTools::TransformMeshCache* getTransformMeshCache() const { return NULL; };
+#endif
     
 
     
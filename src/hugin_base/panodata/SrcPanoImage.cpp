@@ -37,6 +37,7 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <vigra/diff2d.hxx>
 #include <vigra/imageinfo.hxx>
 #include <hugin_utils/utils.h>
@@ -152,6 +153,123 @@ bool SrcPanoImage::isInside(vigra::Point2D p, bool ignoreMasks) const
         return insideCrop;
 }
 
+void SrcPanoImage::getInsideIntervals(const int y, const int width, RowIntervals& intervals, bool ignoreMasks) const
+{
+    intervals.clear();
+    int xStart = 0;
+    int xEnd = 0;
+    switch(m_CropMode.getData()) {
+        case NO_CROP:
+        case CROP_RECTANGLE:
+        {
+            const vigra::Rect2D& cropRect = m_CropRect.getData();
+            if (y >= cropRect.top() && y < cropRect.bottom())
+            {
+                xStart = std::max(0, cropRect.left());
+                xEnd = std::min(width, cropRect.right());
+            };
+            break;
+        }
+        case CROP_CIRCLE:
+        {
+            if (0 > y || y >= m_Size.getData().y) {
+                // outside image
+                break;
+            }
+            const int rowEnd = std::min(width, m_Size.getData().x);
+            hugin_utils::FDiff2D cropCenter;
+            cropCenter.x = m_CropRect.getData().left() + m_CropRect.getData().width()/2.0;
+            cropCenter.y = m_CropRect.getData().top() + m_CropRect.getData().height()/2.0;
+            double radius2 = std::min(m_CropRect.getData().width()/2.0, m_CropRect.getData().height()/2.0);
+            radius2 = radius2 * radius2;
+            // same comparison as in isInside
+            const double dy = y - cropCenter.y;
+            const double dy2 = dy * dy;
+            auto insideCircle = [&](const int x)
+            {
+                const double dx = x - cropCenter.x;
+                return radius2 > dx * dx + dy2;
+            };
+            // the distance is monotonic on both sides of the center, so find the pixel
+            // nearest to the center and search the borders by bisection
+            const int center = std::min(std::max(static_cast<int>(floor(cropCenter.x)), 0), std::max(0, rowEnd - 1));
+            int mid = -1;
+            for (int x = std::max(0, center - 1); x <= std::min(rowEnd - 1, center + 1); ++x)
+            {
+                if (insideCircle(x))
+                {
+                    mid = x;
+                    break;
+                };
+            };
+            if (mid < 0)
+            {
+                break;
+            };
+            int lo = 0;
+            int hi = mid;
+            while (lo < hi)
+            {
+                const int x = lo + (hi - lo) / 2;
+                if (insideCircle(x))
+                {
+                    hi = x;
+                }
+                else
+                {
+                    lo = x + 1;
+                };
+            };
+            xStart = lo;
+            lo = mid + 1;
+            hi = rowEnd;
+            while (lo < hi)
+            {
+                const int x = lo + (hi - lo) / 2;
+                if (insideCircle(x))
+                {
+                    lo = x + 1;
+                }
+                else
+                {
+                    hi = x;
+                };
+            };
+            xEnd = lo;
+            break;
+        }
+    }
+    if (xStart >= xEnd)
+    {
+        return;
+    };
+    if (ignoreMasks || !hasActiveMasks())
+    {
+        intervals.push_back(std::make_pair(xStart, xEnd));
+        return;
+    };
+    // subtract the area covered by the masks
+    RowIntervals masked;
+    for (size_t i = 0; i < m_ActiveMasks.getData().size(); ++i)
+    {
+        m_ActiveMasks.getData()[i].getInsideIntervals(y, width, masked);
+    };
+    std::sort(masked.begin(), masked.end());
+    int x = xStart;
+    for (size_t i = 0; i < masked.size() && x < xEnd; ++i)
+    {
+        if (masked[i].first > x)
+        {
+            intervals.push_back(std::make_pair(x, std::min(masked[i].first, xEnd)));
+        };
+        x = std::max(x, masked[i].second);
+    };
+    if (x < xEnd)
+    {
+        intervals.push_back(std::make_pair(x, xEnd));
+    };
+}
+
 bool SrcPanoImage::isCircularCrop() const
 {
     HuginBase::BaseSrcPanoImage::Projection projection=m_Projection.getData();
@@ -217,6 +217,12 @@ public:
      */
     bool isInside(vigra::Point2D p, bool ignoreMasks=false) const;
 
+    /** calculates the intervals of row y, with x in [0, width), which are inside the image,
+     *  the result is identical to calling isInside for each pixel of the row,
+     *  but the crop and the masks are evaluated only once per row
+     */
+    void getInsideIntervals(const int y, const int width, RowIntervals& intervals, bool ignoreMasks=false) const;
+
     ///
     bool horizontalWarpNeeded();
 
@@ -0,0 +1,194 @@
+// -*- c-basic-offset: 4 -*-
+/** @file panotools/TransformMesh.cpp
+ *
+ *  @brief implementation of the precomputed transformation meshes
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "TransformMesh.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace HuginBase { namespace PTools {
+
+void TransformMesh::Grid::init(const Transform& transform, const vigra::Size2D& size, const unsigned int resolution, const double tolerance)
+{
+    m_step = std::max(1.0, double(std::max(size.x, size.y)) / std::max(1u, resolution));
+    m_nodesX = static_cast<int>(ceil(size.x / m_step)) + 1;
+    m_nodesY = static_cast<int>(ceil(size.y / m_step)) + 1;
+    m_x.resize(m_nodesX * m_nodesY);
+    m_y.resize(m_nodesX * m_nodesY);
+    const float invalid = std::numeric_limits<float>::quiet_NaN();
+    // sample the transformation at the nodes
+#pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < m_nodesY; ++y)
+    {
+        for (int x = 0; x < m_nodesX; ++x)
+        {
+            const size_t index = y * m_nodesX + x;
+            double xd, yd;
+            if (transform.transformImgCoord(xd, yd, x * m_step, y * m_step))
+            {
+                m_x[index] = static_cast<float>(xd);
+                m_y[index] = static_cast<float>(yd);
+            }
+            else
+            {
+                m_x[index] = invalid;
+                m_y[index] = invalid;
+            };
+        };
+    };
+    // now check which cells can be interpolated by comparing the centre of the cell
+    m_linearCell.clear();
+    m_linearCell.resize((m_nodesX - 1) * (m_nodesY - 1), 0);
+#pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < m_nodesY - 1; ++y)
+    {
+        for (int x = 0; x < m_nodesX - 1; ++x)
+        {
+            const size_t index = y * m_nodesX + x;
+            const double xi = 0.25 * (m_x[index] + m_x[index + 1] + m_x[index + m_nodesX] + m_x[index + m_nodesX + 1]);
+            const double yi = 0.25 * (m_y[index] + m_y[index + 1] + m_y[index + m_nodesX] + m_y[index + m_nodesX + 1]);
+            // NaN of an invalid node propagates into xi and yi
+            if (std::isnan(xi) || std::isnan(yi))
+            {
+                continue;
+            };
+            double xd, yd;
+            if (transform.transformImgCoord(xd, yd, (x + 0.5) * m_step, (y + 0.5) * m_step) &&
+                fabs(xd - xi) <= tolerance && fabs(yd - yi) <= tolerance)
+            {
+                m_linearCell[y * (m_nodesX - 1) + x] = 1;
+            };
+        };
+    };
+}
+
+bool TransformMesh::Grid::interpolate(double& x_dest, double& y_dest, double x_src, double y_src) const
+{
+    const double gx = x_src / m_step;
+    const double gy = y_src / m_step;
+    if (!(gx >= 0 && gy >= 0 && gx <= m_nodesX - 1 && gy <= m_nodesY - 1))
+    {
+        return false;
+    };
+    // points on the right and lower border belong to the last cell
+    const int cx = std::min(static_cast<int>(gx), m_nodesX - 2);
+    const int cy = std::min(static_cast<int>(gy), m_nodesY - 2);
+    if (cx < 0 || cy < 0 || !m_linearCell[cy * (m_nodesX - 1) + cx])
+    {
+        return false;
+    };
+    const double fx = gx - cx;
+    const double fy = gy - cy;
+    const size_t index = cy * m_nodesX + cx;
+    x_dest = (1 - fy) * ((1 - fx) * m_x[index] + fx * m_x[index + 1]) +
+        fy * ((1 - fx) * m_x[index + m_nodesX] + fx * m_x[index + m_nodesX + 1]);
+    y_dest = (1 - fy) * ((1 - fx) * m_y[index] + fx * m_y[index + 1]) +
+        fy * ((1 - fx) * m_y[index + m_nodesX] + fx * m_y[index + m_nodesX + 1]);
+    return true;
+}
+
+TransformMesh::TransformMesh(const SrcPanoImage& image, const PanoramaOptions& opts, const unsigned int resolution, const double tolerance) :
+    m_resolution(resolution), m_image(image), m_projection(opts.getProjection()),
+    m_projectionParams(opts.getProjectionParameters()), m_hfov(opts.getHFOV()), m_panoSize(opts.getSize())
+{
+    m_transform.createTransform(image, opts);
+    m_invTransform.createInvTransform(image, opts);
+    m_forwardGrid.init(m_transform, opts.getSize(), resolution, tolerance);
+    m_inverseGrid.init(m_invTransform, image.getSize(), resolution, tolerance);
+}
+
+bool TransformMesh::transformImgCoord(double& x_dest, double& y_dest, double x_src, double y_src) const
+{
+    if (m_forwardGrid.interpolate(x_dest, y_dest, x_src, y_src))
+    {
+        return true;
+    };
+    return m_transform.transformImgCoord(x_dest, y_dest, x_src, y_src);
+}
+
+bool TransformMesh::transformImgCoordInv(double& x_dest, double& y_dest, double x_src, double y_src) const
+{
+    if (m_inverseGrid.interpolate(x_dest, y_dest, x_src, y_src))
+    {
+        return true;
+    };
+    return m_invTransform.transformImgCoord(x_dest, y_dest, x_src, y_src);
+}
+
+bool TransformMesh::isValidFor(const SrcPanoImage& image, const PanoramaOptions& opts) const
+{
+    return m_projection == opts.getProjection() && m_hfov == opts.getHFOV() &&
+        m_panoSize == opts.getSize() && m_projectionParams == opts.getProjectionParameters() &&
+        m_image == image;
+}
+
+TransformMeshCache::MeshPtr TransformMeshCache::getMesh(unsigned int imgNr, const SrcPanoImage& image, const PanoramaOptions& opts)
+{
+    unsigned int resolution;
+    {
+        hugin_omp::ScopedLock lock(m_lock);
+        if (imgNr < m_meshes.size() && m_meshes[imgNr] &&
+            m_meshes[imgNr]->getResolution() == m_resolution && m_meshes[imgNr]->isValidFor(image, opts))
+        {
+            return m_meshes[imgNr];
+        };
+        resolution = m_resolution;
+    }
+    // create the mesh without holding the lock, so other images can be processed in parallel
+    MeshPtr mesh(new TransformMesh(image, opts, resolution));
+    {
+        hugin_omp::ScopedLock lock(m_lock);
+        if (imgNr >= m_meshes.size())
+        {
+            m_meshes.resize(imgNr + 1);
+        };
+        m_meshes[imgNr] = mesh;
+    }
+    return mesh;
+}
+
+void TransformMeshCache::invalidate(unsigned int imgNr)
+{
+    hugin_omp::ScopedLock lock(m_lock);
+    if (imgNr < m_meshes.size())
+    {
+        m_meshes[imgNr].reset();
+    };
+}
+
+void TransformMeshCache::clear()
+{
+    hugin_omp::ScopedLock lock(m_lock);
+    m_meshes.clear();
+}
+
+void TransformMeshCache::setResolution(const unsigned int resolution)
+{
+    hugin_omp::ScopedLock lock(m_lock);
+    if (resolution != m_resolution)
+    {
+        m_resolution = resolution;
+        m_meshes.clear();
+    };
+}
+
+}} // namespace
@@ -0,0 +1,142 @@
+// -*- c-basic-offset: 4 -*-
+/** @file panotools/TransformMesh.h
+ *
+ *  @brief precomputed meshes of the image <-> panorama transformations
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _PANOTOOLS_TRANSFORMMESH_H
+#define _PANOTOOLS_TRANSFORMMESH_H
+
+#include <hugin_shared.h>
+#include <vector>
+#include <memory>
+#include <panotools/PanoToolsInterface.h>
+#include <hugin_utils/openmp_lock.h>
+
+namespace HuginBase { namespace PTools {
+
+/** transformation between image and panorama, which is sampled on a regular grid
+ *  and evaluated by bilinear interpolation.
+ *
+ *  The transformation is evaluated exactly at the grid nodes and at the centre of
+ *  each cell. Only cells, where the interpolated value at the centre differs less
+ *  than the tolerance from the exact value, are interpolated. For all other cells
+ *  (e.g. at the border of the valid region or at the 360 degree seam) and for
+ *  points outside of the grid the exact transformation is used.
+ *  So the results match the ones of PTools::Transform closely, but repeated
+ *  queries are much cheaper.
+ */
+class IMPEX TransformMesh
+{
+public:
+    /** creates the meshes for the given image and panorama options
+     *  @param image image for which the transformation should be calculated
+     *  @param opts options of the output panorama, only projection, size and hfov are used
+     *  @param resolution number of grid cells along the longer side of the panorama and the image
+     *  @param tolerance maximal deviation of the interpolated value in pixels */
+    TransformMesh(const SrcPanoImage& image, const PanoramaOptions& opts, const unsigned int resolution = 64, const double tolerance = 0.1);
+
+    /** transforms panorama coordinates into image coordinates,
+     *  corresponds to PTools::Transform::createTransform */
+    bool transformImgCoord(double& x_dest, double& y_dest, double x_src, double y_src) const;
+    /** transforms image coordinates into panorama coordinates,
+     *  corresponds to PTools::Transform::createInvTransform */
+    bool transformImgCoordInv(double& x_dest, double& y_dest, double x_src, double y_src) const;
+
+    /** returns true, if the mesh was created for the given image and panorama options */
+    bool isValidFor(const SrcPanoImage& image, const PanoramaOptions& opts) const;
+    /** returns the resolution used to create the mesh */
+    unsigned int getResolution() const { return m_resolution; };
+
+private:
+    // private, no copy
+    TransformMesh(const TransformMesh&);
+    TransformMesh& operator=(const TransformMesh&);
+
+    /** sampled transformation */
+    class Grid
+    {
+    public:
+        /** samples transform on a grid covering an area of the given size */
+        void init(const Transform& transform, const vigra::Size2D& size, const unsigned int resolution, const double tolerance);
+        /** interpolates the transformation at the given position
+         *  @return false, if the point can not be interpolated */
+        bool interpolate(double& x_dest, double& y_dest, double x_src, double y_src) const;
+    private:
+        int m_nodesX;
+        int m_nodesY;
+        double m_step;
+        /** transformed coordinates of the nodes, NaN for invalid nodes */
+        std::vector<float> m_x;
+        std::vector<float> m_y;
+        /** true, if the cell can be interpolated */
+        std::vector<unsigned char> m_linearCell;
+    };
+
+    Transform m_transform;
+    Transform m_invTransform;
+    Grid m_forwardGrid;
+    Grid m_inverseGrid;
+    unsigned int m_resolution;
+    // values used to create the mesh
+    SrcPanoImage m_image;
+    PanoramaOptions::ProjectionFormat m_projection;
+    std::vector<double> m_projectionParams;
+    double m_hfov;
+    vigra::Size2D m_panoSize;
+};
+
+/** cache of the transformation meshes of all images of a panorama.
+ *
+ *  The meshes are created on demand. Cached meshes are checked against the
+ *  current image and panorama options on each access, so a changed image is
+ *  never served a stale mesh. Panorama additionally drops the meshes of all
+ *  images marked with Panorama::imageChanged to free the memory early.
+ *  The cache can be accessed from several threads.
+ */
+class IMPEX TransformMeshCache
+{
+public:
+    typedef std::shared_ptr<const TransformMesh> MeshPtr;
+
+    /** constructor
+     *  @param resolution resolution of new meshes, see TransformMesh */
+    explicit TransformMeshCache(const unsigned int resolution = 64) : m_resolution(resolution) {};
+
+    /** returns the mesh for the image and panorama options, creates it if needed */
+    MeshPtr getMesh(unsigned int imgNr, const SrcPanoImage& image, const PanoramaOptions& opts);
+    /** removes the mesh of the given image */
+    void invalidate(unsigned int imgNr);
+    /** removes all meshes */
+    void clear();
+    /** sets the resolution of new meshes, the cached meshes with another resolution are removed */
+    void setResolution(const unsigned int resolution);
+
+private:
+    // private, no copy
+    TransformMeshCache(const TransformMeshCache&);
+    TransformMeshCache& operator=(const TransformMeshCache&);
+
+    std::vector<MeshPtr> m_meshes;
+    unsigned int m_resolution;
+    hugin_omp::Lock m_lock;
+};
+
+}} // namespace
+
+#endif // _PANOTOOLS_TRANSFORMMESH_H
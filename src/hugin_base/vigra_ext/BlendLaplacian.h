@@ -0,0 +1,221 @@
+// -*- c-basic-offset: 4 -*-
+
+/** @file BlendLaplacian.h
+*
+*  @brief multiresolution blending of images with Laplacian pyramids
+*
+*/
+
+/*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public
+*  License as published by the Free Software Foundation; either
+*  version 2 of the License, or (at your option) any later version.
+*
+*  This software is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public
+*  License along with this software. If not, see
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+#ifndef LAPLACIAN_BLEND_H
+#define LAPLACIAN_BLEND_H
+
+#include <vector>
+#include <algorithm>
+#include <vigra/stdimage.hxx>
+#include <vigra/numerictraits.hxx>
+#include "vigra_ext/pyramid2.h"
+#include "openmp_vigra.h"
+
+namespace vigra_ext
+{
+
+namespace laplacian
+{
+
+namespace detail
+{
+/** pixel type of the pyramids, float precision is sufficient for all image types */
+template <class PixelType>
+struct PyramidPixel
+{
+    typedef float type;
+};
+
+template <class ComponentType>
+struct PyramidPixel<vigra::RGBValue<ComponentType> >
+{
+    typedef vigra::RGBValue<float> type;
+};
+
+/** returns the number of pyramid levels for an image of the given size,
+ *  the smallest level is at least 8 pixels wide and high */
+inline int GetNumberOfLevels(vigra::Size2D size, const int maxLevels)
+{
+    int levels = 1;
+    while (levels < maxLevels && std::min(size.width(), size.height()) >= 16)
+    {
+        size = vigra::Size2D((size.width() + 1) / 2, (size.height() + 1) / 2);
+        ++levels;
+    };
+    return levels;
+}
+
+/** converts the level 0 of the pyramid into a Laplacian pyramid with the given number of levels.
+ *  The masked pixels are extrapolated from the coarser levels before the pyramid is built,
+ *  so they do not disturb the valid pixels near the image border */
+template <class PyramidImage, class MaskType>
+void BuildLaplacianPyramid(std::vector<PyramidImage>& pyramid, const MaskType& mask, const bool wrap)
+{
+    typedef typename vigra::NumericTraits<typename PyramidImage::value_type>::RealPromote SKIPSMType;
+    std::vector<vigra::BImage> masks(pyramid.size());
+    masks[0].resize(mask.size());
+    vigra::omp::copyImage(vigra::srcImageRange(mask), vigra::destImage(masks[0]));
+    // Gaussian pyramid, considers only the valid pixels
+    for (size_t level = 1; level < pyramid.size(); ++level)
+    {
+        const vigra::Size2D size((pyramid[level - 1].width() + 1) / 2, (pyramid[level - 1].height() + 1) / 2);
+        pyramid[level].resize(size);
+        masks[level].resize(size);
+        enblend::reduce<SKIPSMType, double>(wrap, vigra::srcImageRange(pyramid[level - 1]), vigra::srcImage(masks[level - 1]),
+            vigra::destImageRange(pyramid[level]), vigra::destImageRange(masks[level]));
+    };
+    // fill the masked pixels with the values of the next coarser level
+    for (int level = pyramid.size() - 2; level >= 0; --level)
+    {
+        PyramidImage expanded(pyramid[level].size());
+        enblend::expand<SKIPSMType>(true, wrap, vigra::srcImageRange(pyramid[level + 1]), vigra::destImageRange(expanded));
+        PyramidImage& image = pyramid[level];
+        const vigra::BImage& levelMask = masks[level];
+#pragma omp parallel for
+        for (int y = 0; y < image.height(); ++y)
+        {
+            for (int x = 0; x < image.width(); ++x)
+            {
+                if (levelMask(x, y) == 0)
+                {
+                    image(x, y) = expanded(x, y);
+                };
+            };
+        };
+    };
+    // subtract the expanded next level
+    for (size_t level = 0; level + 1 < pyramid.size(); ++level)
+    {
+        enblend::expand<SKIPSMType>(false, wrap, vigra::srcImageRange(pyramid[level + 1]), vigra::destImageRange(pyramid[level]));
+    };
+}
+
+/** converts the pixel of the pyramid back to the pixel type of the image */
+template <class PixelType, class PyramidPixelType>
+inline PixelType ConvertPixel(const PyramidPixelType& value)
+{
+    typedef typename vigra::NumericTraits<PixelType>::RealPromote RealPixelType;
+    return vigra::NumericTraits<PixelType>::fromRealPromote(RealPixelType(value));
+}
+
+} // namespace detail
+
+/** blends image2 into image1 with the multiresolution spline of Burt and Adelson.
+ *  The Laplacian pyramids of both images are combined with a Gaussian pyramid of
+ *  the seam mask, so the transition width adapts to the spatial frequency.
+ *  Only the area covered by image2 is processed. The number of levels is limited by
+ *  the size of the overlap, so the transition of the coarse levels stays inside the
+ *  overlap and does not reach the border of the area covered by image2.
+ *  @param image1 image, into which image2 is blended
+ *  @param mask1 mask of image1 in the area covered by image2, has the size of image2
+ *  @param image2 image to blend
+ *  @param mask2 mask of image2
+ *  @param seam nonzero for all pixels, which should be taken from image2
+ *  @param offset position of image2 inside image1
+ *  @param overlap bounding rectangle of the overlap of both images, relative to image2
+ *  @param wrap true, if image2 covers the full width of a 360 degree image
+ *  @param maxLevels maximal number of pyramid levels */
+template <class ImageType, class MaskType>
+void Blend(ImageType& image1, const vigra::BImage& mask1, const ImageType& image2, const MaskType& mask2, const vigra::BImage& seam,
+    const vigra::Point2D& offset, const vigra::Rect2D& overlap, const bool wrap, const int maxLevels = 10)
+{
+    typedef typename ImageType::value_type PixelType;
+    typedef typename detail::PyramidPixel<PixelType>::type PyramidPixelType;
+    typedef vigra::BasicImage<PyramidPixelType> PyramidImage;
+    typedef typename vigra::NumericTraits<PyramidPixelType>::RealPromote SKIPSMType;
+    const vigra::Size2D size(image2.size());
+    const int levels = detail::GetNumberOfLevels(overlap.size(), maxLevels);
+    if (levels < 2)
+    {
+        // image too small for blending, use hard seam
+        vigra::copyImageIf(vigra::srcImageRange(image2), vigra::srcImage(seam), vigra::destImage(image1, offset));
+        return;
+    };
+    // Laplacian pyramids of both images
+    std::vector<PyramidImage> pyramid1(levels);
+    pyramid1[0].resize(size);
+    vigra::omp::copyImage(vigra::srcImageRange(image1, vigra::Rect2D(offset, size)), vigra::destImage(pyramid1[0]));
+    detail::BuildLaplacianPyramid(pyramid1, mask1, wrap);
+    std::vector<PyramidImage> pyramid2(levels);
+    pyramid2[0].resize(size);
+    vigra::omp::copyImage(vigra::srcImageRange(image2), vigra::destImage(pyramid2[0]));
+    detail::BuildLaplacianPyramid(pyramid2, mask2, wrap);
+    // Gaussian pyramid of the seam mask
+    std::vector<vigra::FImage> weights(levels);
+    weights[0].resize(size);
+#pragma omp parallel for
+    for (int y = 0; y < size.height(); ++y)
+    {
+        for (int x = 0; x < size.width(); ++x)
+        {
+            weights[0](x, y) = seam(x, y) > 0 ? 1.0f : 0.0f;
+        };
+    };
+    for (int level = 1; level < levels; ++level)
+    {
+        weights[level].resize(pyramid1[level].size());
+        enblend::reduce<float>(wrap, vigra::srcImageRange(weights[level - 1]), vigra::destImageRange(weights[level]));
+    };
+    // combine the levels, the result is stored in pyramid1
+    for (int level = 0; level < levels; ++level)
+    {
+        PyramidImage& blended = pyramid1[level];
+        const PyramidImage& other = pyramid2[level];
+        const vigra::FImage& weight = weights[level];
+#pragma omp parallel for
+        for (int y = 0; y < blended.height(); ++y)
+        {
+            for (int x = 0; x < blended.width(); ++x)
+            {
+                const float w = weight(x, y);
+                blended(x, y) = blended(x, y) * (1.0f - w) + other(x, y) * w;
+            };
+        };
+    };
+    weights.clear();
+    pyramid2.clear();
+    // collapse the blended pyramid
+    for (int level = levels - 2; level >= 0; --level)
+    {
+        enblend::expand<SKIPSMType>(true, wrap, vigra::srcImageRange(pyramid1[level + 1]), vigra::destImageRange(pyramid1[level]));
+    };
+    // copy the result back into image1
+    const PyramidImage& result = pyramid1[0];
+#pragma omp parallel for
+    for (int y = 0; y < size.height(); ++y)
+    {
+        for (int x = 0; x < size.width(); ++x)
+        {
+            if (mask1(x, y) > 0 || mask2(x, y) > 0)
+            {
+                image1(offset.x + x, offset.y + y) = detail::ConvertPixel<PixelType>(result(x, y));
+            };
+        };
+    };
+}
+
+} // namespace laplacian
+} // namespace vigra_ext
+
+#endif // LAPLACIAN_BLEND_H
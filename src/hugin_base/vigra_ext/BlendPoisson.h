@@ -29,6 +29,7 @@
 #define POISSON_BLEND_H
 
 #include <iostream>
+#include <vector>
 #include <vigra/stdimage.hxx>
 #include <vigra/convolution.hxx>
 #include <vigra/stdconvolution.hxx>
@@ -43,6 +44,20 @@ namespace vigra_ext
 namespace poisson
 {
 
+/** pixel type used by the solver. The components are stored as float instead of the
+ *  double of RealPromote, this halves the memory traffic of the SOR sweeps */
+template <class PixelType>
+struct SolverPixelType
+{
+    typedef float type;
+};
+
+template <class ComponentType>
+struct SolverPixelType<vigra::RGBValue<ComponentType> >
+{
+    typedef vigra::RGBValue<float> type;
+};
+
 namespace detail
 {
 // helper functions for build gradient map
@@ -293,153 +308,203 @@ double GetRealValue(const ComponentType& val) { return val; }
 template <class ComponentType>
 double GetRealValue(const vigra::RGBValue<ComponentType>& val) { return val.magnitude(); }
 
+/** calculates the new value of a single pixel for SOR, handles all border cases
+ *  @return squared change of the pixel value */
 template <class Image, class SeamMask>
-void SOR(Image& target, const Image& gradient, const SeamMask& seams, const float omega, const float errorThreshold, const int maxIter, const bool doWrap)
+inline double SORUpdatePixel(Image& target, const Image& gradient, const SeamMask& seams, const int x, const int y, const float omega, const bool doWrap)
 {
     typedef typename Image::PixelType TargetPixelType;
     const int width = target.width();
     const int height = target.height();
-
-    // changes in last iteration
-    double oldError = 0;
-    for (int j = 0; j < maxIter; j++)
+    const bool isBorder = seams[y][x] == 2;
+    TargetPixelType sum;
+    // horizontal neighbors
+    if (x == 0)
     {
-        // changes in current iteration
-        double error = 0;
-        if (seams[0][0]>1)
+        sum = doWrap ? TargetPixelType(target[y][1] + target[y][width - 1]) : TargetPixelType(2 * target[y][1]);
+    }
+    else
+    {
+        if (x == width - 1)
         {
-            if (doWrap)
+            sum = doWrap ? TargetPixelType(target[y][width - 2] + target[y][0]) : TargetPixelType(2 * target[y][width - 2]);
+        }
+        else
+        {
+            if (y == 0 || y == height - 1 || isBorder)
             {
-                const TargetPixelType delta = omega*((gradient[0][0] + target[0][1] + 2 * target[1][0] + target[0][width - 1]) / 4.0f - target[0][0]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][0] += delta;
+                sum = detail::GetBorderValues(x, y, 1, 0, target, seams);
             }
             else
             {
-                const TargetPixelType delta = omega*((gradient[0][0] + 2 * target[0][1] + 2 * target[1][0]) / 4.0f - target[0][0]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][0] += delta;
+                sum = target[y][x - 1] + target[y][x + 1];
             };
         };
-        for (int x = 1; x < width - 1; ++x)
+    };
+    // vertical neighbors
+    if (y == 0)
+    {
+        sum += 2 * target[1][x];
+    }
+    else
+    {
+        if (y == height - 1)
         {
-            if (seams[0][x]>1)
-            {
-                const TargetPixelType delta = omega*((gradient[0][x] + detail::GetBorderValues(x, 0, 1, 0, target, seams) + 2 * target[1][x]) / 4.0f - target[0][x]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][x] += delta;
-            };
-        };
-        if (seams[0][width - 1] > 1)
+            sum += 2 * target[height - 2][x];
+        }
+        else
         {
-            if (doWrap)
+            if (x == 0 || x == width - 1 || isBorder)
             {
-                const TargetPixelType delta = omega*((gradient[0][width - 1] + target[0][width - 2] + 2 * target[1][width - 1] + target[0][0]) / 4.0f - target[0][width - 1]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][width - 1] += delta;
+                sum += detail::GetBorderValues(x, y, 0, 1, target, seams);
             }
             else
             {
-                const TargetPixelType delta = omega*((gradient[0][width - 1] + 2 * target[0][width - 2] + 2 * target[1][width - 1]) / 4.0f - target[0][width - 1]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][width - 1] += delta;
+                sum += target[y - 1][x] + target[y + 1][x];
             };
         };
-#pragma omp parallel for reduction(+: error) schedule(dynamic, 100)
-        for (int y = 1; y < height - 1; ++y)
+    };
+    const TargetPixelType delta = omega*((gradient[y][x] + sum) / 4.0f - target[y][x]);
+    target[y][x] += delta;
+    return detail::GetRealValue(delta*delta);
+}
+
+/** updates all pixels of one color of the red-black ordering in the given row
+ *  @param lastColumn if false, the last column is skipped
+ *  @return sum of squared changes */
+template <class Image, class SeamMask>
+double SORUpdateRow(Image& target, const Image& gradient, const SeamMask& seams, const int y, const int color, const float omega, const bool doWrap, const bool lastColumn)
+{
+    typedef typename Image::PixelType TargetPixelType;
+    const int width = target.width();
+    const int height = target.height();
+    const int endX = lastColumn ? width : width - 1;
+    double error = 0;
+    int x = (y + color) & 1;
+    if (x == 0)
+    {
+        if (seams[y][0] > 1)
         {
-            if (seams[y][0] > 1)
+            error += SORUpdatePixel(target, gradient, seams, 0, y, omega, doWrap);
+        };
+        x = 2;
+    };
+    if (y > 0 && y < height - 1)
+    {
+        // fast path for inner pixels, work directly on the rows
+        TargetPixelType* row = target[y];
+        const TargetPixelType* rowAbove = target[y - 1];
+        const TargetPixelType* rowBelow = target[y + 1];
+        const TargetPixelType* gradientRow = gradient[y];
+        const typename SeamMask::value_type* seamRow = seams[y];
+        for (; x < width - 1; x += 2)
+        {
+            const typename SeamMask::value_type maskValue = seamRow[x];
+            if (maskValue == 3)
             {
-                if (doWrap)
-                {
-                    const TargetPixelType delta = omega*((gradient[y][0] + detail::GetBorderValues(0, y, 0, 1, target, seams)
-                        + target[y][1] + target[y][width - 1]) / 4.0f - target[y][0]);
-                    error += detail::GetRealValue(delta*delta);
-                    target[y][0] += delta;
-                }
-                else
+                const TargetPixelType delta = omega*((gradientRow[x] + rowAbove[x] + rowBelow[x] + row[x - 1] + row[x + 1]) / 4.0f - row[x]);
+                error += detail::GetRealValue(delta*delta);
+                row[x] += delta;
+            }
+            else
+            {
+                if (maskValue == 2)
                 {
-                    const TargetPixelType delta = omega*((gradient[y][0] + detail::GetBorderValues(0, y, 0, 1, target, seams) + 2 * target[y][1]) / 4.0f - target[y][0]);
-                    error += detail::GetRealValue(delta*delta);
-                    target[y][0] += delta;
+                    error += SORUpdatePixel(target, gradient, seams, x, y, omega, doWrap);
                 };
             };
-            for (int x = 1; x < width - 1; ++x)
+        };
+    }
+    else
+    {
+        for (; x < width - 1; x += 2)
+        {
+            if (seams[y][x] > 1)
             {
-                const typename SeamMask::value_type maskValue = seams[y][x];
-                if (maskValue > 1)
-                {
-                    if (maskValue == 2)
-                    {
-                        // border pixel
-                        const TargetPixelType sum = detail::GetBorderValues(x, y, 1, 0, target, seams) + detail::GetBorderValues(x, y, 0, 1, target, seams);
-                        const TargetPixelType delta = omega*((gradient[y][x] + sum) / 4.0f - target[y][x]);
-                        error += detail::GetRealValue(delta*delta);
-                        target[y][x] += delta;
-                    }
-                    else
-                    {
-                        const TargetPixelType sum = target[y + 1][x] + target[y][x + 1] + target[y - 1][x] + target[y][x - 1];
-                        const TargetPixelType delta = omega*((gradient[y][x] + sum) / 4.0f - target[y][x]);
-                        error += detail::GetRealValue(delta*delta);
-                        target[y][x] += delta;
-                    };
-                };
+                error += SORUpdatePixel(target, gradient, seams, x, y, omega, doWrap);
             };
-            if (seams[y][width - 1] > 1)
+        };
+    };
+    if (x == width - 1 && x < endX && seams[y][x] > 1)
+    {
+        error += SORUpdatePixel(target, gradient, seams, x, y, omega, doWrap);
+    };
+    return error;
+}
+
+/** solves the Poisson equation with successive over-relaxation.
+ *  The pixels are processed in red-black order: all pixels of one color depend only on pixels
+ *  of the other color, so the rows can be processed in parallel without races.
+ *  The rows are processed in blocks. Inside a block the black pixels of a row are updated
+ *  directly after the red pixels of the following row, while the rows are still in the cache.
+ *  This gives the same result as two separate sweeps over the whole image. The changes
+ *  are summed per row and then in fixed order, so the result does not depend on the number of threads. */
+template <class Image, class SeamMask>
+void SOR(Image& target, const Image& gradient, const SeamMask& seams, const float omega, const float errorThreshold, const int maxIter, const bool doWrap)
+{
+    const int width = target.width();
+    const int height = target.height();
+    // with wrapping and odd width the first and last column have the same color and are neighbors,
+    // in this case the last column is processed separately
+    const bool separateLastColumn = doWrap && (width % 2 == 1);
+    const int blockHeight = 32;
+    const int nrBlocks = (height + blockHeight - 1) / blockHeight;
+    std::vector<double> redError(height);
+    std::vector<double> blackError(height);
+
+    // changes in last iteration
+    double oldError = 0;
+    for (int j = 0; j < maxIter; j++)
+    {
+#pragma omp parallel for schedule(static)
+        for (int block = 0; block < nrBlocks; ++block)
+        {
+            const int startY = block * blockHeight;
+            const int endY = std::min(startY + blockHeight, height);
+            for (int y = startY; y < endY; ++y)
             {
-                if (doWrap)
+                redError[y] = SORUpdateRow(target, gradient, seams, y, 0, omega, doWrap, !separateLastColumn);
+                // all red neighbors of the previous row are now updated, the first and the last row
+                // of the block have neighbors in other blocks and are processed afterwards
+                if (y - 1 > startY)
                 {
-                    const TargetPixelType delta = omega*((gradient[y][width - 1] + detail::GetBorderValues(width - 1, y, 0, 1, target, seams) + target[y][width - 2] + target[y][0]) / 4.0f - target[y][width - 1]);
-                    error += detail::GetRealValue(delta*delta);
-                    target[y][width - 1] += delta;
-                }
-                else
-                {
-                    const TargetPixelType delta = omega*((gradient[y][width - 1] + detail::GetBorderValues(width - 1, y, 0, 1, target, seams) + 2 * target[y][width - 2]) / 4.0f - target[y][width - 1]);
-                    error += detail::GetRealValue(delta*delta);
-                    target[y][width - 1] += delta;
+                    blackError[y - 1] = SORUpdateRow(target, gradient, seams, y - 1, 1, omega, doWrap, !separateLastColumn);
                 };
             };
         };
-        // last line
-        if (seams[height - 1][0] > 1)
+#pragma omp parallel for schedule(static)
+        for (int block = 0; block < nrBlocks; ++block)
         {
-            if (doWrap)
-            {
-                const TargetPixelType delta = omega*((gradient[height - 1][0] + 2 * target[height - 2][0] + target[height - 1][1] + target[height - 1][width - 1]) / 4.0f - target[height - 1][0]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][0] += delta;
-            }
-            else
+            const int startY = block * blockHeight;
+            const int endY = std::min(startY + blockHeight, height);
+            blackError[startY] = SORUpdateRow(target, gradient, seams, startY, 1, omega, doWrap, !separateLastColumn);
+            if (endY - 1 > startY)
             {
-                const TargetPixelType delta = omega*((gradient[height - 1][0] + 2 * target[height - 2][0] + 2 * target[height - 1][1]) / 4.0f - target[height - 1][0]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][0] += delta;
+                blackError[endY - 1] = SORUpdateRow(target, gradient, seams, endY - 1, 1, omega, doWrap, !separateLastColumn);
             };
         };
-        for (int x = 1; x < width - 1; ++x)
+        // changes in current iteration
+        double error = 0;
+        for (int y = 0; y < height; ++y)
         {
-            if (seams[height - 1][x] > 1)
-            {
-                const TargetPixelType delta = omega*((gradient[height - 1][x] + detail::GetBorderValues(x, height - 1, 1, 0, target, seams) + 2 * target[height - 2][x]) / 4.0f - target[height - 1][x]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][x] += delta;
-            };
+            error += redError[y];
         };
-        if (seams[height - 1][width - 1] > 1)
+        for (int y = 0; y < height; ++y)
         {
-            if (doWrap)
-            {
-                const TargetPixelType delta = omega*((gradient[height - 1][width - 1] + 2 * target[height - 2][width - 1] + target[height - 1][width - 2] + target[height - 1][0]) / 4.0f - target[height - 1][width - 1]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][width - 1] += delta;
-            }
-            else
+            error += blackError[y];
+        };
+        if (separateLastColumn)
+        {
+            // the pixels of the last column are only vertical neighbors of each other
+            for (int color = 0; color < 2; ++color)
             {
-                const TargetPixelType delta = omega*((gradient[height - 1][width - 1] + 2 * target[height - 2][width - 1] + 2 * target[height - 1][width - 2]) / 4.0f - target[height - 1][width - 1]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][width - 1] += delta;
+                for (int y = color; y < height; y += 2)
+                {
+                    if (seams[y][width - 1] > 1)
+                    {
+                        error += SORUpdatePixel(target, gradient, seams, width - 1, y, omega, doWrap);
+                    };
+                };
             };
         };
 
@@ -451,6 +516,51 @@ void SOR(Image& target, const Image& gradient, const SeamMask& seams, const floa
     }
 }
 
+/** interpolates the correction of the coarser level linearly to the size of out
+ *  (like vigra::resizeImageLinearInterpolation) and subtracts it from all pixels
+ *  which are solved (seam value 2 or 3) */
+template <class Image, class SeamMask>
+void ApplyCorrection(Image& out, const Image& correction, const SeamMask& seam)
+{
+    typedef typename Image::PixelType ImagePixelType;
+    vigra_precondition(correction.width() >= 2 && correction.height() >= 2, "ApplyCorrection: Image too small");
+    const int width = out.width();
+    const int height = out.height();
+    const double scaleX = width > 1 ? (correction.width() - 1) / static_cast<double>(width - 1) : 0.0;
+    const double scaleY = height > 1 ? (correction.height() - 1) / static_cast<double>(height - 1) : 0.0;
+    // index and weight of the left neighbor in the coarse image for each column
+    std::vector<int> coarseX(width);
+    std::vector<float> weightX(width);
+    for (int x = 0; x < width; ++x)
+    {
+        const double pos = x * scaleX;
+        coarseX[x] = std::min(static_cast<int>(pos), correction.width() - 2);
+        weightX[x] = static_cast<float>(pos - coarseX[x]);
+    };
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; ++y)
+    {
+        const double pos = y * scaleY;
+        const int y0 = std::min(static_cast<int>(pos), correction.height() - 2);
+        const float wy = static_cast<float>(pos - y0);
+        const ImagePixelType* row0 = correction[y0];
+        const ImagePixelType* row1 = correction[y0 + 1];
+        const typename SeamMask::value_type* seamRow = seam[y];
+        ImagePixelType* outRow = out[y];
+        for (int x = 0; x < width; ++x)
+        {
+            if (seamRow[x] >= 2)
+            {
+                const int x0 = coarseX[x];
+                const float wx = weightX[x];
+                const ImagePixelType top = row0[x0] + wx * (row0[x0 + 1] - row0[x0]);
+                const ImagePixelType bottom = row1[x0] + wx * (row1[x0 + 1] - row1[x0]);
+                outRow[x] -= top + wy * (bottom - top);
+            };
+        };
+    };
+}
+
 template <class Image, class SeamMask>
 void CalcResidualError(Image& error, const Image& target, const Image& gradient, const SeamMask& seam, const bool doWrap)
 {
@@ -871,11 +981,7 @@ void Multigrid(Image& out, const Image& gradient, const vigra::ImagePyramid<Seam
     Multigrid(out2, err2, seamMaskPyramid, minLen, errorThreshold, maxIter, doWrap);
     // again W cycle
     Multigrid(out2, err2, seamMaskPyramid, minLen, errorThreshold, maxIter, doWrap); 
-    vigra::resizeImageLinearInterpolation(srcImageRange(out2), destImageRange(err)); 
-    vigra::omp::combineTwoImagesIf(vigra::srcImageRange(out), vigra::srcImage(err),
-        vigra::srcImage(seamMaskPyramid[maskIndex], MaskGreaterAccessor<typename SeamMask::PixelType>(2)),
-        vigra::destImage(out),
-        vigra::functor::Arg1() - vigra::functor::Arg2());
+    detail::ApplyCorrection(out, out2, seamMaskPyramid[maskIndex]);
     // post smoothing
     detail::SOR(out, gradient, seamMaskPyramid[maskIndex], 1.95f, 2.0f * errorThreshold, maxIter, doWrap);
     return;
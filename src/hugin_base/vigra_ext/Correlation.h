@@ -27,6 +27,8 @@
 #include <hugin_shared.h>
 #include <vigra/stdimage.hxx>
 #include <vigra/inspectimage.hxx>
+#include <vector>
+#include <algorithm>
 #include <vigra/copyimage.hxx>
 #include <vigra/resizeimage.hxx>
 #include <vigra/transformimage.hxx>
@@ -43,7 +45,7 @@
 #include <vigra/fftw3.hxx>
 #include <vigra/functorexpression.hxx>
 #include <hugin_utils/openmp_lock.h>
-#include <vector>
+#include <map>
 #else
 #define VIGRA_EXT_USE_FAST_CORR
 #endif
@@ -69,10 +71,146 @@ struct CorrelationResult
     double maxAngle;
 };
 
+/** summed area tables of an image and of its squared values.
+ *
+ *  The sum and the sum of squares of the pixel values inside any rectangular
+ *  window can be read in constant time, independent of the window size.
+ *  The tables contain an additional zero row and column at the top and left
+ *  border, so no special treatment of the borders is needed.
+ */
+class WindowSumTables
+{
+public:
+    template <class SrcImage>
+    explicit WindowSumTables(const SrcImage& src) :
+        m_sum(src.width() + 1, src.height() + 1), m_sum2(src.width() + 1, src.height() + 1)
+    {
+        // use double instead of float!, otherwise there can be truncation errors
+        for (int y = 0; y < src.height(); ++y)
+        {
+            double rowSum = 0;
+            double rowSum2 = 0;
+            for (int x = 0; x < src.width(); ++x)
+            {
+                const double val = src(x, y);
+                rowSum += val;
+                rowSum2 += val * val;
+                m_sum(x + 1, y + 1) = m_sum(x + 1, y) + rowSum;
+                m_sum2(x + 1, y + 1) = m_sum2(x + 1, y) + rowSum2;
+            };
+        };
+    };
+
+    /** calculates the sum and the sum of squares of the window with the
+     *  upper left corner (x, y) and the given size */
+    void getWindowSums(const int x, const int y, const int width, const int height, double& sum, double& sum2) const
+    {
+        sum = m_sum(x + width, y + height) - m_sum(x, y + height) - m_sum(x + width, y) + m_sum(x, y);
+        sum2 = m_sum2(x + width, y + height) - m_sum2(x, y + height) - m_sum2(x + width, y) + m_sum2(x, y);
+    };
+
+private:
+    vigra::DImage m_sum;
+    vigra::DImage m_sum2;
+};
+
+/** inner product of n consecutive values.
+ *  Uses four independent partial sums, so that the compiler can vectorize the loop */
+template <class T1, class T2>
+inline double rowDotProduct(const T1* a, const T2* b, const int n)
+{
+    double sum0 = 0;
+    double sum1 = 0;
+    double sum2 = 0;
+    double sum3 = 0;
+    int i = 0;
+    for (; i + 3 < n; i += 4)
+    {
+        sum0 += a[i] * b[i];
+        sum1 += a[i + 1] * b[i + 1];
+        sum2 += a[i + 2] * b[i + 2];
+        sum3 += a[i + 3] * b[i + 3];
+    };
+    for (; i < n; ++i)
+    {
+        sum0 += a[i] * b[i];
+    };
+    return (sum0 + sum1) + (sum2 + sum3);
+};
+
 #ifdef HAVE_FFTW
 
-/** lock for correlateImageFastFFT */
-static hugin_omp::Lock fftLock;
+/** per thread cache of fftw plans.
+ *  Creating a fftw plan is not thread safe and therefore needs a global lock. Executing an
+ *  existing plan with new arrays (fftw_execute_dft) is thread safe, so each thread creates
+ *  the plans for a given size only once and reuses them for all following correlations.
+ *  The plans are created with FFTW_UNALIGNED, so they can be used with any array. */
+class FFTWPlanCache
+{
+public:
+    ~FFTWPlanCache()
+    {
+        hugin_omp::ScopedLock sl(GetLock());
+        for (PlanMap::iterator it = m_forward.begin(); it != m_forward.end(); ++it)
+        {
+            fftw_destroy_plan(it->second);
+        };
+        for (PlanMap::iterator it = m_backward.begin(); it != m_backward.end(); ++it)
+        {
+            fftw_destroy_plan(it->second);
+        };
+    };
+    /** returns the plan for an out-of-place forward transform of the given size */
+    fftw_plan GetForwardPlan(const int width, const int height)
+    {
+        return GetPlan(m_forward, width, height, FFTW_FORWARD, false);
+    };
+    /** returns the plan for an in-place backward transform of the given size */
+    fftw_plan GetBackwardPlan(const int width, const int height)
+    {
+        return GetPlan(m_backward, width, height, FFTW_BACKWARD, true);
+    };
+    /** returns the cache of the calling thread */
+    static FFTWPlanCache& Get()
+    {
+        static thread_local FFTWPlanCache cache;
+        return cache;
+    };
+private:
+    typedef std::map<std::pair<int, int>, fftw_plan> PlanMap;
+    /** lock for creating and destroying fftw plans, shared by all threads */
+    static hugin_omp::Lock& GetLock()
+    {
+        static hugin_omp::Lock lock;
+        return lock;
+    };
+    fftw_plan GetPlan(PlanMap& plans, const int width, const int height, const int sign, const bool inplace)
+    {
+        const std::pair<int, int> size(width, height);
+        PlanMap::iterator it = plans.find(size);
+        if (it != plans.end())
+        {
+            return it->second;
+        };
+        // FFTW_ESTIMATE does not touch the arrays, they are only needed to describe the layout
+        fftw_complex* in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * width * height);
+        fftw_complex* out = inplace ? in : (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * width * height);
+        fftw_plan plan;
+        {
+            hugin_omp::ScopedLock sl(GetLock());
+            plan = fftw_plan_dft_2d(height, width, in, out, sign, FFTW_ESTIMATE | FFTW_UNALIGNED);
+        };
+        if (!inplace)
+        {
+            fftw_free(out);
+        };
+        fftw_free(in);
+        plans[size] = plan;
+        return plan;
+    };
+    PlanMap m_forward;
+    PlanMap m_backward;
+};
 
 // multiplication with conjugate number in Fourier space
 template <class Value>
@@ -126,69 +264,24 @@ CorrelationResult correlateImageFastFFT(SrcImage & src, DestImage & dest, Kernel
     vigra::FFTWComplexImage FKernel(sw, sh);
     // copy kernel to complex data structure
     vigra::copyImage(srcImageRange(kernel), destImage(spatial, vigra::FFTWWriteRealAccessor<typename KernelImage::PixelType>()));
-    // now do FFT of kernel
-    fftw_plan fftwplan;
-    {
-        // creation of plan is not thread safe, so use lock
-        hugin_omp::ScopedLock sl(fftLock);
-        fftwplan = fftw_plan_dft_2d(sh, sw, (fftw_complex *)spatial.begin(), (fftw_complex *)fourier.begin(), FFTW_FORWARD, FFTW_ESTIMATE);
-    };
-    fftw_execute(fftwplan);
+    // now do FFT of kernel, the plans are cached per thread, so no lock is needed
+    FFTWPlanCache& plans = FFTWPlanCache::Get();
+    const fftw_plan forwardPlan = plans.GetForwardPlan(sw, sh);
+    fftw_execute_dft(forwardPlan, (fftw_complex*)spatial.begin(), (fftw_complex*)fourier.begin());
     vigra::copyImage(srcImageRange(fourier), destImage(FKernel));
     // now do FFT of search image, reuse fftw_plan
     vigra::copyImage(srcImageRange(src), destImage(spatial, vigra::FFTWWriteRealAccessor<typename KernelImage::PixelType>()));
-    fftw_execute(fftwplan);
+    fftw_execute_dft(forwardPlan, (fftw_complex*)spatial.begin(), (fftw_complex*)fourier.begin());
     // give now not anymore needed memory free
     spatial.resize(0, 0);
 
     // multiply SrcImage with conjugated kernel in frequency domain
     vigra::combineTwoImages(srcImageRange(fourier), srcImage(FKernel), destImage(fourier), &multiplyConjugate<vigra::FFTWComplex<typename KernelImage::PixelType> >);
     // FFT back into spatial domain (inplace)
-    fftw_plan backwardPlan;
-    {
-        // creation of plan is not thread safe, so use lock
-        hugin_omp::ScopedLock sl(fftLock);
-        backwardPlan = fftw_plan_dft_2d(sh, sw, (fftw_complex *)fourier.begin(), (fftw_complex *)fourier.begin(), FFTW_BACKWARD, FFTW_ESTIMATE);
-    };
-    fftw_execute(backwardPlan);
-    {
-        // delayed destroy to use only one lock
-        hugin_omp::ScopedLock sl(fftLock);
-        fftw_destroy_plan(fftwplan);
-        fftw_destroy_plan(backwardPlan);
-    };
+    fftw_execute_dft(plans.GetBackwardPlan(sw, sh), (fftw_complex*)fourier.begin(), (fftw_complex*)fourier.begin());
 
     // calculate look up sum tables
-    // use double instead of float!, otherwise there can be truncation errors
-    vigra::DImage s(sw, sh);
-    vigra::DImage s2(sw, sh);
-    double val = src(0, 0);
-    s(0, 0) = val;
-    s2(0, 0) = val * val;
-    // special treatment for first line
-    for (int x = 1; x < sw; ++x)
-    {
-        val = src(x, 0);
-        s(x, 0) = val + s(x - 1, 0);
-        s2(x, 0) = val * val + s2(x - 1, 0);
-    }
-    // special treatment for first column
-    for (int y = 1; y < sh; ++y)
-    {
-        val = src(0, y);
-        s(0, y) = val + s(0, y - 1);
-        s2(0, y) = val * val + s2(0, y - 1);
-    }
-    // final summation
-    for (int y = 1; y < sh; ++y)
-    {
-        for (int x = 1; x < sw; ++x)
-        {
-            val = src(x, y);
-            s(x, y) = val + s(x - 1, y) + s(x, y - 1) - s(x - 1, y - 1);
-            s2(x, y) = val * val + s2(x - 1, y) + s2(x, y - 1) - s2(x - 1, y - 1);
-        };
-    };
+    const WindowSumTables sumTables(src);
     const int yend = sh - klr.y + kul.y;
     const int xend = sw - klr.x + kul.x;
     // calculate constant part
@@ -199,23 +292,8 @@ CorrelationResult correlateImageFastFFT(SrcImage & src, DestImage & dest, Kernel
         {
             double value = fourier(xr, yr).re() * normFactor;
             // do final summation using the lookup tables
-            double sumF = s(xr + kw - 1, yr + kh - 1);
-            double sumF2 = s2(xr + kw - 1, yr + kh - 1);
-            if (xr > 0)
-            {
-                sumF -= s(xr - 1, yr + kh - 1);
-                sumF2 -= s2(xr - 1, yr + kh - 1);
-            };
-            if (yr > 0)
-            {
-                sumF -= s(xr + kw - 1, yr - 1);
-                sumF2 -= s2(xr + kw - 1, yr - 1);
-            };
-            if (xr > 0 && yr > 0)
-            {
-                sumF += s(xr - 1, yr - 1);
-                sumF2 += s2(xr - 1, yr - 1);
-            };
+            double sumF, sumF2;
+            sumTables.getWindowSums(xr, yr, kw, kh, sumF, sumF2);
 
             double den = sqrt((kw * kh * sumF2 - sumF * sumF));
             // prevent division through zero
@@ -242,12 +320,14 @@ CorrelationResult correlateImageFastFFT(SrcImage & src, DestImage & dest, Kernel
 *  This tries to be faster than the other version, because
 *  it uses the image data directly.
 *
-*  most code is taken from vigra::convoluteImage.
-*  See its documentation for further information.
+*  The mean and the variance of the image windows are read from summed area
+*  tables, so only the inner product of the zero mean template with the image
+*  window remains to be calculated for each position.
 *
 *  Correlation result already contains the maximum position
 *  and its correlation value.
-*  it should be possible to set a threshold here.
+*  Only positions, where dest is already greater or equal than the threshold
+*  are calculated.
 */
 template <class SrcImage, class DestImage, class KernelImage>
 CorrelationResult correlateImageFast(SrcImage & src,
@@ -263,105 +343,129 @@ CorrelationResult correlateImageFast(SrcImage & src,
                  "convolveImage(): coordinates of "
                  "kernel's lower right must be >= 0.");
 
-    // use traits to determine SumType as to prevent possible overflow
-    typedef typename
-        vigra::NumericTraits<typename SrcImage::value_type>::RealPromote SumType;
-    typedef typename
-        vigra::NumericTraits<typename KernelImage::value_type>::RealPromote KSumType;
     typedef
         vigra::NumericTraits<typename DestImage::value_type> DestTraits;
 
     // calculate width and height of the image
-    int w = src.width();
-    int h = src.height();
-    int wk = kernel.width();
-    int hk = kernel.height();
-
-//    DEBUG_DEBUG("correlate Image srcSize " << (slr - sul).x << "," << (slr - sul).y
-//                << " tmpl size: " << wk << "," << hk);
+    const int w = src.width();
+    const int h = src.height();
+    const int wk = kernel.width();
+    const int hk = kernel.height();
 
     vigra_precondition(w >= wk && h >= hk,
                  "convolveImage(): kernel larger than image.");
 
-    int ystart = -kul.y;
-    int yend   = h-klr.y;
-    int xstart = -kul.x;
-    int xend   = w-klr.x;
+    const int ystart = -kul.y;
+    const int yend   = h-klr.y;
+    const int xstart = -kul.x;
+    const int xend   = w-klr.x;
+    const int kernelSize = wk * hk;
 
     // mean of kernel
-    KSumType kmean=0;
-    for(int y=0; y < hk; y++) {
-        for(int x=0; x < wk; x++) {
-            kmean += kernel(x,y);
-        }
-    }
-    kmean = kmean / (hk*wk);
+    double kmean = 0;
+    for (int y = 0; y < hk; ++y)
+    {
+        for (int x = 0; x < wk; ++x)
+        {
+            kmean += kernel(x, y);
+        };
+    };
+    kmean = kmean / kernelSize;
+    // kernel with subtracted mean, stored continuously
+    // the sum of this kernel is not exactly zero because of rounding, so remember it
+    std::vector<double> zeroMeanKernel(kernelSize);
+    double div1 = 0;
+    double kernelSum = 0;
+    for (int y = 0; y < hk; ++y)
+    {
+        for (int x = 0; x < wk; ++x)
+        {
+            const double kpixel = kernel(x, y) - kmean;
+            zeroMeanKernel[y * wk + x] = kpixel;
+            div1 += kpixel * kpixel;
+            kernelSum += kpixel;
+        };
+    };
 
+    const WindowSumTables sumTables(src);
     CorrelationResult res;
-
-//    DEBUG_DEBUG("size: " << w << "," <<  h << " ystart: " << ystart <<", yend: " << yend);
-    int unifwarned=0;
-    for(int yr=ystart; yr < yend; ++yr)
+    bool unifwarned = false;
+    for (int yr = ystart; yr < yend; ++yr)
     {
-        for(int xr=xstart; xr < xend; ++xr)
+        for (int xr = xstart; xr < xend; ++xr)
         {
-            if (dest(xr,yr) < threshold) {
+            if (dest(xr, yr) < threshold)
+            {
                 continue;
             }
-            // init the sum
-            SumType numerator = 0;
-            SumType div1 = 0;
-            SumType div2 = 0;
-            SumType spixel = 0;
-            KSumType kpixel = 0;
-
-            // mean of image patch
-            KSumType mean=0;
-			int ym;
-            for(ym=yr+kul.y; ym <= yr+klr.y; ym++) {
-                for(int xm=xr+kul.x; xm <= xr+klr.x; xm++) {
-                    mean += src(xm,ym);
-                }
-            }
-            mean = mean / (hk*wk);
-
-            // perform correlation (inner loop)
-            ym=yr+kul.y;
-            int yk;
-            for(yk=0; yk < hk; yk++) {
-                int xm=xr+kul.x;
-                int xk;
-                for(xk=0; xk < wk; xk++) {
-                    spixel = src(xm,ym) - mean;
-                    kpixel = kernel(xk,yk) - kmean;
-                    numerator += kpixel * spixel;
-                    div1 += kpixel * kpixel;
-                    div2 += spixel * spixel;
-		    xm++;
+            // mean and variance of image patch
+            double sumF, sumF2;
+            sumTables.getWindowSums(xr + kul.x, yr + kul.y, wk, hk, sumF, sumF2);
+            const double mean = sumF / kernelSize;
+            const double div2 = sumF2 - sumF * mean;
+            double numerator = 0;
+            // the variance from the sum tables is not exactly zero for uniform
+            // patches because of rounding, so use a relative limit
+            if (div1 == 0 || div2 <= 1e-10 * sumF2)
+            {
+                // This happens when one of the patches is perfectly uniform
+                // Set correlation to zero since this is uninteresting
+                if (!unifwarned)
+                {
+                    DEBUG_DEBUG("Uniform patch(es) during correlation computation");
+                    unifwarned = true;
                 }
-		ym++;
             }
-	    if (div1*div2 == 0) {
-		// This happens when one of the patches is perfectly uniform
-		numerator = 0;	// Set correlation to zero since this is uninteresting
-		if (!unifwarned) {
-		    DEBUG_DEBUG("Uniform patch(es) during correlation computation");
-		    unifwarned=1;
-		}
-	    } else
-		numerator = (numerator/sqrt(div1 * div2));
-	    
-            if (numerator > res.maxi) {
+            else
+            {
+                // perform correlation (inner loop)
+                // sum((k-kmean)*(s-mean)) = sum((k-kmean)*s) - mean*sum(k-kmean)
+                numerator = -mean * kernelSum;
+                for (int yk = 0; yk < hk; ++yk)
+                {
+                    numerator += rowDotProduct(&zeroMeanKernel[yk * wk], &src(xr + kul.x, yr + kul.y + yk), wk);
+                };
+                numerator = numerator / sqrt(div1 * div2);
+            };
+
+            if (numerator > res.maxi)
+            {
                 res.maxi = numerator;
                 res.maxpos.x = xr;
                 res.maxpos.y = yr;
             }
-            dest(xr,yr) = DestTraits::fromRealPromote(numerator);
+            dest(xr, yr) = DestTraits::fromRealPromote(numerator);
         }
     }
     return res;
 }
 
+/** correlate a template with an image, selects the faster one of the direct
+ *  calculation and the FFT based calculation.
+ *
+ *  The direct calculation needs about (number of positions) * (template size)
+ *  operations, the FFT based version mainly 3 FFTs of the size of the search image.
+ *  So for small templates or small search regions the direct calculation is faster.
+ *  All positions are calculated.
+ */
+template <class SrcImage, class DestImage, class KernelImage>
+CorrelationResult correlateImageAuto(SrcImage & src, DestImage & dest, KernelImage & kernel,
+                                     vigra::Diff2D kul, vigra::Diff2D klr)
+{
+#ifdef HAVE_FFTW
+    const double positions = double(src.width() - klr.x + kul.x) * (src.height() - klr.y + kul.y);
+    const double directCost = positions * kernel.width() * kernel.height();
+    const double n = double(src.width()) * src.height();
+    // rough estimate of the costs of 3 complex FFTs including the per pixel operations
+    const double fftCost = 15.0 * n * std::max(1.0, log(n) / log(2.0));
+    if (fftCost < directCost)
+    {
+        return correlateImageFastFFT(src, dest, kernel, kul, klr);
+    };
+#endif
+    return correlateImageFast(src, dest, kernel, kul, klr, -1);
+}
+
 /** find the subpixel maxima by fitting
  *  2nd order polynoms to x and y.
  *
@@ -572,17 +676,10 @@ CorrelationResult PointFineTune(const IMAGET & templImg, ACCESSORT access_t,
     // we could use the multiresolution version as well.
     // but usually the region is quite small.
     CorrelationResult res;
-#ifdef HAVE_FFTW
+#if defined HAVE_FFTW || defined VIGRA_EXT_USE_FAST_CORR
     DEBUG_DEBUG("+++++ starting fast correlation");
-    res = correlateImageFastFFT(srcImage, dest, templateImage,
+    res = correlateImageAuto(srcImage, dest, templateImage,
         tmplUL - templPos, tmplLR - templPos - vigra::Diff2D(1, 1));
-#elif defined VIGRA_EXT_USE_FAST_CORR
-    DEBUG_DEBUG("+++++ starting fast correlation");
-    res = correlateImageFast(srcImage,
-        dest,
-        templateImage,
-        tmplUL - templPos, tmplLR - templPos - vigra::Diff2D(1, 1),
-        -1);
 #else
     DEBUG_DEBUG("+++++ starting normal correlation");
     res = correlateImage(srcImage.upperLeft(),
@@ -624,6 +721,12 @@ CorrelationResult PointFineTune(const IMAGET & templImg, ACCESSORT access_t,
  *
  *  The result in returned in @p tunedPos
  *
+ *  If \p estimateRotation is true, the rotation is estimated from the log-polar
+ *  magnitude spectra of the patches (see EstimateRotationLogPolar) and only the
+ *  estimated angles are correlated. When the estimate is not reliable, all
+ *  \p angleSteps angles are tested. The estimate requires fftw, without fftw
+ *  always all angles are tested.
+ *
  *  @return correlation value
  */
 #ifndef HAVE_FFTW
@@ -636,7 +739,8 @@ CorrelationResult PointFineTuneRotSearch(const IMAGET & templImg,
                                          int sWidth,
                                          double startAngle,
                                          double stopAngle,
-                                         int angleSteps)
+                                         int angleSteps,
+                                         bool estimateRotation = false)
 {
     DEBUG_TRACE("templPos: " << templPos << " searchPos: " << searchPos);
 
@@ -820,60 +924,33 @@ CorrelationResult PointFineTuneRotSearch(const IMAGET & templImg,
 #else
 // specialed version for FFT based correlation,
 // optimized correlation calculation to save reuseable results
+// correlates the template rotated by each of the given angles
 template <class SrcImage, class DestImage, class KernelImage>
 CorrelationResult correlateImageFastRotationFFT(SrcImage & src, DestImage & dest, KernelImage & unrotatedKernel,
     vigra::Diff2D templPos, int templWidth, vigra::Diff2D tmplSize,
-    double startAngle, double stopAngle, int angleSteps)
+    const std::vector<double>& angles)
 {
     const int sw = src.width();
     const int sh = src.height();
+    const int angleSteps = angles.size();
     std::vector<CorrelationResult> results(angleSteps);
     std::vector<DestImage> resultsImg(angleSteps, DestImage(sw, sh));
 
     vigra::FFTWComplexImage spatialSearch(sw, sh);
     vigra::FFTWComplexImage fourierSearch(sw, sh);
-    //forward FFTW plan
-    fftw_plan forwardPlan = fftw_plan_dft_2d(sh, sw, (fftw_complex *)spatialSearch.begin(), (fftw_complex *)fourierSearch.begin(), FFTW_FORWARD, FFTW_ESTIMATE);
+    //forward FFTW plan, fftw_execute_dft is thread safe, so the plans can also be used inside the parallel loop
+    FFTWPlanCache& plans = FFTWPlanCache::Get();
+    const fftw_plan forwardPlan = plans.GetForwardPlan(sw, sh);
     //FFT of search image, we need it for all angles
     vigra::copyImage(srcImageRange(src), destImage(spatialSearch, vigra::FFTWWriteRealAccessor<vigra::FImage::value_type>()));
-    fftw_execute(forwardPlan);
-    // generate backwardPlan for inplace use
-    fftw_plan backwardPlan = fftw_plan_dft_2d(sh, sw, (fftw_complex *)fourierSearch.begin(), (fftw_complex *)fourierSearch.begin(), FFTW_BACKWARD, FFTW_ESTIMATE);
+    fftw_execute_dft(forwardPlan, (fftw_complex*)spatialSearch.begin(), (fftw_complex*)fourierSearch.begin());
+    // backwardPlan for inplace use
+    const fftw_plan backwardPlan = plans.GetBackwardPlan(sw, sh);
 
     // calculate look up sum tables
     // are used by all angles
-    // use double instead of float!, otherwise there can be truncation errors
-    vigra::DImage s(sw, sh);
-    vigra::DImage s2(sw, sh);
-    double val = src(0, 0);
-    s(0, 0) = val;
-    s2(0, 0) = val * val;
-    // special treatment for first line
-    for (int x = 1; x < sw; ++x)
-    {
-        val = src(x, 0);
-        s(x, 0) = val + s(x - 1, 0);
-        s2(x, 0) = val * val + s2(x - 1, 0);
-    }
-    // special treatment for first column
-    for (int y = 1; y < sh; ++y)
-    {
-        val = src(0, y);
-        s(0, y) = val + s(0, y - 1);
-        s2(0, y) = val * val + s2(0, y - 1);
-    }
-    // final summation
-    for (int y = 1; y < sh; ++y)
-    {
-        for (int x = 1; x < sw; ++x)
-        {
-            val = src(x, y);
-            s(x, y) = val + s(x - 1, y) + s(x, y - 1) - s(x - 1, y - 1);
-            s2(x, y) = val * val + s2(x - 1, y) + s2(x, y - 1) - s2(x - 1, y - 1);
-        };
-    };
+    const WindowSumTables sumTables(src);
 
-    const double step = (stopAngle - startAngle) / (angleSteps - 1);
     const int kw = tmplSize.x;
     const int kh = tmplSize.y;
     const int yend = sh - 2 * templWidth;
@@ -886,7 +963,7 @@ CorrelationResult correlateImageFastRotationFFT(SrcImage & src, DestImage & dest
         vigra_ext::PassThroughFunctor<float> nf;
         AppBase::DummyProgressDisplay dummy;
 
-        RotateTransform t(startAngle + i * step, hugin_utils::FDiff2D(templWidth, templWidth), templPos);
+        RotateTransform t(angles[i], hugin_utils::FDiff2D(templWidth, templWidth), templPos);
         vigra_ext::transformImage(srcImageRange(unrotatedKernel, vigra::RGBToGrayAccessor<typename KernelImage::value_type>()), destImageRange(kernel),
             destImage(alpha), vigra::Diff2D(0, 0), t, nf, false, vigra_ext::INTERP_CUBIC, &dummy, true);
 
@@ -920,23 +997,8 @@ CorrelationResult correlateImageFastRotationFFT(SrcImage & src, DestImage & dest
             {
                 double value = fourierKernel(xr, yr).re() * normFactor;
                 // do final summation using the lookup tables
-                double sumF = s(xr + kw - 1, yr + kh - 1);
-                double sumF2 = s2(xr + kw - 1, yr + kh - 1);
-                if (xr > 0)
-                {
-                    sumF -= s(xr - 1, yr + kh - 1);
-                    sumF2 -= s2(xr - 1, yr + kh - 1);
-                };
-                if (yr > 0)
-                {
-                    sumF -= s(xr + kw - 1, yr - 1);
-                    sumF2 -= s2(xr + kw - 1, yr - 1);
-                };
-                if (xr > 0 && yr > 0)
-                {
-                    sumF += s(xr - 1, yr - 1);
-                    sumF2 += s2(xr - 1, yr - 1);
-                };
+                double sumF, sumF2;
+                sumTables.getWindowSums(xr, yr, kw, kh, sumF, sumF2);
 
                 double den = sqrt((kw * kh * sumF2 - sumF * sumF));
                 // prevent division through zero
@@ -954,8 +1016,6 @@ CorrelationResult correlateImageFastRotationFFT(SrcImage & src, DestImage & dest
             };
         };
     };
-    fftw_destroy_plan(forwardPlan);
-    fftw_destroy_plan(backwardPlan);
     int maxIndex = 0;
     double maxValue = 0;
     for (size_t i = 0; i < results.size(); ++i)
@@ -967,11 +1027,226 @@ CorrelationResult correlateImageFastRotationFFT(SrcImage & src, DestImage & dest
         };
     };
     CorrelationResult res(results[maxIndex]);
-    res.maxAngle = startAngle + maxIndex * step;
+    res.maxAngle = angles[maxIndex];
     dest = resultsImg[maxIndex];
     return res;
 };
 
+// correlates the template rotated in angleSteps steps from startAngle to stopAngle
+template <class SrcImage, class DestImage, class KernelImage>
+CorrelationResult correlateImageFastRotationFFT(SrcImage & src, DestImage & dest, KernelImage & unrotatedKernel,
+    vigra::Diff2D templPos, int templWidth, vigra::Diff2D tmplSize,
+    double startAngle, double stopAngle, int angleSteps)
+{
+    const double step = (stopAngle - startAngle) / (angleSteps - 1);
+    std::vector<double> angles(angleSteps);
+    for (int i = 0; i < angleSteps; ++i)
+    {
+        angles[i] = startAngle + i * step;
+    };
+    return correlateImageFastRotationFFT(src, dest, unrotatedKernel, templPos, templWidth, tmplSize, angles);
+};
+
+/** estimates the rotation between two square patches of the same size with the Fourier-Mellin transform.
+ *
+ *  The magnitude spectrum of a patch does not depend on the translation, and a rotation
+ *  of the patch rotates its spectrum by the same angle. After resampling the spectra into
+ *  log-polar coordinates the rotation is a shift along the angle axis, which is found
+ *  by cross correlation in the Fourier domain.
+ *  The magnitude spectrum is point symmetric, so the angle is only determined modulo pi.
+ *  For small patches the estimate is accurate to a few degrees.
+ *  @param templ template patch
+ *  @param search search patch, same size as templ
+ *  @param angle estimated angle in radians in the convention of RotateTransform, in [-pi/2, pi/2)
+ *  @return correlation coefficient of the log-polar spectra at the estimated angle,
+ *          a measure of the reliability of the estimate
+ */
+inline double EstimateRotationLogPolar(const vigra::FImage& templ, const vigra::FImage& search, double& angle)
+{
+    vigra_precondition(templ.size() == search.size() && templ.width() == templ.height(),
+        "EstimateRotationLogPolar(): patches must be square and of the same size.");
+    const int n = templ.width();
+    // number of samples along the angle (0..pi) and the log radius axis
+    const int nAngles = 180;
+    const int nRadii = 32;
+    FFTWPlanCache& plans = FFTWPlanCache::Get();
+    // window function, suppresses the cross in the spectrum caused by the patch borders
+    std::vector<double> window(n);
+    for (int i = 0; i < n; ++i)
+    {
+        window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / (n - 1));
+    };
+    vigra::FFTWComplexImage spatial(n, n);
+    vigra::FFTWComplexImage fourier(n, n);
+    vigra::FFTWComplexImage polarSpatial(nAngles, nRadii);
+    std::vector<vigra::FFTWComplexImage> polarFourier(2, vigra::FFTWComplexImage(nAngles, nRadii));
+    vigra::FImage magnitude(n, n);
+    const double center = n / 2;
+    // the lowest frequencies are skipped, they are sampled too coarsely by the pixel grid
+    const double minRadius = 2.0;
+    const double logBase = log((n / 2.0 - 1.0) / minRadius) / (nRadii - 1);
+    double energy[2];
+    const vigra::FImage* patches[2] = { &templ, &search };
+    for (int i = 0; i < 2; ++i)
+    {
+        const vigra::FImage& patch = *patches[i];
+        vigra::FindAverage<float> mean;
+        vigra::inspectImage(srcImageRange(patch), mean);
+        for (int y = 0; y < n; ++y)
+        {
+            for (int x = 0; x < n; ++x)
+            {
+                spatial(x, y) = (patch(x, y) - mean()) * window[x] * window[y];
+            };
+        };
+        fftw_execute_dft(plans.GetForwardPlan(n, n), (fftw_complex*)spatial.begin(), (fftw_complex*)fourier.begin());
+        // logarithm of the magnitude spectrum with the zero frequency in the center
+        for (int y = 0; y < n; ++y)
+        {
+            for (int x = 0; x < n; ++x)
+            {
+                magnitude(x, y) = log(1.0 + fourier((x + n - n / 2) % n, (y + n - n / 2) % n).magnitude());
+            };
+        };
+        // resample in log-polar coordinates with bilinear interpolation,
+        // the mean of each ring is removed, it does not depend on the rotation
+        energy[i] = 0;
+        for (int r = 0; r < nRadii; ++r)
+        {
+            const double radius = minRadius * exp(r * logBase);
+            double ringSum = 0;
+            for (int a = 0; a < nAngles; ++a)
+            {
+                const double phi = a * M_PI / nAngles;
+                const double px = center + radius * cos(phi);
+                const double py = center + radius * sin(phi);
+                const int ix = std::min<int>(floor(px), n - 2);
+                const int iy = std::min<int>(floor(py), n - 2);
+                const double dx = px - ix;
+                const double dy = py - iy;
+                const double value = (1.0 - dy) * ((1.0 - dx) * magnitude(ix, iy) + dx * magnitude(ix + 1, iy))
+                    + dy * ((1.0 - dx) * magnitude(ix, iy + 1) + dx * magnitude(ix + 1, iy + 1));
+                polarSpatial(a, r) = value;
+                ringSum += value;
+            };
+            const double ringMean = ringSum / nAngles;
+            for (int a = 0; a < nAngles; ++a)
+            {
+                const double value = polarSpatial(a, r).re() - ringMean;
+                polarSpatial(a, r) = value;
+                energy[i] += value * value;
+            };
+        };
+        fftw_execute_dft(plans.GetForwardPlan(nAngles, nRadii), (fftw_complex*)polarSpatial.begin(), (fftw_complex*)polarFourier[i].begin());
+    };
+    if (energy[0] == 0 || energy[1] == 0)
+    {
+        // uniform patch
+        angle = 0;
+        return 0;
+    };
+    // cross power spectrum, a full normalization (phase correlation) amplifies the noise too much for small patches
+    vigra::FFTWComplexImage& crossPower = polarFourier[1];
+    vigra::combineTwoImages(srcImageRange(polarFourier[1]), srcImage(polarFourier[0]), destImage(crossPower), &multiplyConjugate<vigra::FFTWComplex<double> >);
+    fftw_execute_dft(plans.GetBackwardPlan(nAngles, nRadii), (fftw_complex*)crossPower.begin(), (fftw_complex*)crossPower.begin());
+    // the patches have the same scale, so consider only peaks with a small shift along the radius axis
+    int maxX = 0;
+    double maxValue = -1;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = 0; x < nAngles; ++x)
+        {
+            const double value = crossPower(x, (y + nRadii) % nRadii).re();
+            if (value > maxValue)
+            {
+                maxValue = value;
+                maxX = x;
+            };
+        };
+    };
+    // sum the shift rows, then fit a parabola through the peak and its neighbours for the sub-sample angle
+    double peak[3] = { 0, 0, 0 };
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            peak[i] += crossPower((maxX + i - 1 + nAngles) % nAngles, (y + nRadii) % nRadii).re();
+        };
+    };
+    double shift = maxX;
+    const double den = peak[0] - 2 * peak[1] + peak[2];
+    if (den < 0)
+    {
+        shift += 0.5 * (peak[0] - peak[2]) / den;
+    };
+    if (shift >= nAngles / 2)
+    {
+        shift -= nAngles;
+    };
+    angle = shift * M_PI / nAngles;
+    return maxValue / (nAngles * nRadii * sqrt(energy[0] * energy[1]));
+};
+
+/** estimates the rotation of the search patch against the template patch with
+ *  EstimateRotationLogPolar, and returns the candidate angles inside [startAngle, stopAngle].
+ *  Returns an empty vector, if the patches are not completely inside the images or
+ *  the estimate is not reliable. */
+template <class IMAGET, class IMAGES>
+std::vector<double> EstimateRotationCandidates(const IMAGET & templImg, vigra::Diff2D templPos, int templWidth,
+    const IMAGES & searchImg, vigra::Diff2D searchPos, double startAngle, double stopAngle)
+{
+    std::vector<double> candidates;
+    // too small patches don't contain enough frequencies for a reliable estimate
+    if (templWidth < 8 ||
+        templPos.x - templWidth < 0 || templPos.y - templWidth < 0 ||
+        templPos.x + templWidth >= templImg.width() || templPos.y + templWidth >= templImg.height() ||
+        searchPos.x - templWidth < 0 || searchPos.y - templWidth < 0 ||
+        searchPos.x + templWidth >= searchImg.width() || searchPos.y + templWidth >= searchImg.height())
+    {
+        return candidates;
+    };
+    const vigra::Diff2D patchSize(2 * templWidth + 1, 2 * templWidth + 1);
+    const vigra::Diff2D halfSize(templWidth, templWidth);
+    vigra::FImage templPatch(patchSize);
+    vigra::copyImage(vigra::make_triple(templImg.upperLeft() + templPos - halfSize,
+        templImg.upperLeft() + templPos - halfSize + patchSize,
+        vigra::RGBToGrayAccessor<typename IMAGET::value_type>()),
+        destImage(templPatch));
+    vigra::FImage searchPatch(patchSize);
+    vigra::copyImage(vigra::make_triple(searchImg.upperLeft() + searchPos - halfSize,
+        searchImg.upperLeft() + searchPos - halfSize + patchSize,
+        vigra::RGBToGrayAccessor<typename IMAGES::value_type>()),
+        destImage(searchPatch));
+    double angle;
+    const double confidence = EstimateRotationLogPolar(templPatch, searchPatch, angle);
+    DEBUG_DEBUG("log-polar rotation estimate: " << RAD_TO_DEG(angle) << " confidence: " << confidence);
+    // unrelated patches give typically values below this threshold
+    if (confidence < 0.6)
+    {
+        return candidates;
+    };
+    // the estimate is ambiguous by pi, use both angles, if they are in the search range
+    // test also the neighbouring angles to compensate the limited accuracy of the estimate
+    const double refineStep = DEG_TO_RAD(3.0);
+    for (int i = 0; i < 6; ++i)
+    {
+        double candidate = angle + (i / 3) * M_PI + (i % 3 - 1) * refineStep;
+        while (candidate < startAngle)
+        {
+            candidate += 2 * M_PI;
+        };
+        while (candidate - 2 * M_PI >= startAngle)
+        {
+            candidate -= 2 * M_PI;
+        };
+        if (candidate <= stopAngle)
+        {
+            candidates.push_back(candidate);
+        };
+    };
+    return candidates;
+};
+
 template <class IMAGET, class IMAGES>
 CorrelationResult PointFineTuneRotSearch(const IMAGET & templImg,
     vigra::Diff2D templPos,
@@ -981,7 +1256,8 @@ CorrelationResult PointFineTuneRotSearch(const IMAGET & templImg,
     int sWidth,
     double startAngle,
     double stopAngle,
-    int angleSteps)
+    int angleSteps,
+    bool estimateRotation = false)
 {
     DEBUG_TRACE("templPos: " << templPos << " searchPos: " << searchPos);
 
@@ -1033,8 +1309,23 @@ CorrelationResult PointFineTuneRotSearch(const IMAGET & templImg,
         vigra::RGBToGrayAccessor<typename IMAGES::value_type>()),
         destImage(srcImage));
 
-    CorrelationResult resCorrelate=correlateImageFastRotationFFT(srcImage, dest, templImg, templPos, templWidth, tmplSize,
-        startAngle, stopAngle, angleSteps);
+    CorrelationResult resCorrelate;
+    std::vector<double> angles;
+    if (estimateRotation)
+    {
+        angles = EstimateRotationCandidates(templImg, templPos, templWidth, searchImg, searchPos, startAngle, stopAngle);
+    };
+    if (!angles.empty())
+    {
+        resCorrelate = correlateImageFastRotationFFT(srcImage, dest, templImg, templPos, templWidth, tmplSize, angles);
+        DEBUG_DEBUG("correlation with estimated rotation, max:" << resCorrelate.maxi << " angle:" << RAD_TO_DEG(resCorrelate.maxAngle));
+    };
+    // fall back to the full angle sweep, if the estimated rotation does not give a good match
+    if (angles.empty() || resCorrelate.maxi < 0.8)
+    {
+        resCorrelate = correlateImageFastRotationFFT(srcImage, dest, templImg, templPos, templWidth, tmplSize,
+            startAngle, stopAngle, angleSteps);
+    };
     CorrelationResult res;
 
     DEBUG_DEBUG("rotation search finished, max:" << resCorrelate.maxi
@@ -86,6 +86,28 @@ enum Interpolator {
     INTERP_SINC_1024
 };
 
+/** returns the size of the neighbourhood used by the interpolator */
+inline int getInterpolatorSize(const Interpolator interp)
+{
+    switch (interp)
+    {
+        case INTERP_SPLINE_36:
+            return 6;
+        case INTERP_SINC_256:
+        case INTERP_SPLINE_64:
+            return 8;
+        case INTERP_BILINEAR:
+        case INTERP_NEAREST_NEIGHBOUR:
+            return 2;
+        case INTERP_SINC_1024:
+            return 32;
+        case INTERP_CUBIC:
+        case INTERP_SPLINE_16:
+        default:
+            return 4;
+    };
+}
+
 
 /** several classes to calculate interpolator weights,
  *
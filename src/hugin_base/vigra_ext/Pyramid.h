@@ -24,6 +24,8 @@
 #ifndef VIGRA_EXT_PYRAMID_H
 #define VIGRA_EXT_PYRAMID_H
 
+#include <vector>
+#include <algorithm>
 #include <vigra/separableconvolution.hxx>
 
 #include <hugin_utils/utils.h>
@@ -35,6 +37,367 @@
 
 namespace vigra_ext {
 
+namespace detail
+{
+
+/** horizontal part of enblend::reduce without alpha channel for one line,
+ *  the border pixels are mirrored.
+ *  The result is bit-identical to the state machine in enblend::reduce, but the
+ *  output pixels are calculated independently, so the loop can be vectorized.
+ *  @param c line converted to SKIPSMImagePixelType
+ *  @param w width of the line, must be larger than 1
+ *  @param out (w+1)/2 filtered output pixels */
+template <class SKIPSMImagePixelType>
+void reduceLine(const SKIPSMImagePixelType* c, const int w, SKIPSMImagePixelType* out)
+{
+    const int dst_w = (w + 1) >> 1;
+    // pixels with the full 5 pixel kernel inside the line
+    const int inner = (w - 1) >> 1;
+    if (inner >= 1)
+    {
+        out[0] = (c[0] + c[0] * 4) + IMUL6(c[0]) + c[1] * 4 + c[2];
+    };
+    for (int j = 2; j <= inner; ++j)
+    {
+        out[j - 1] = (c[2 * j - 4] + c[2 * j - 3] * 4) + IMUL6(c[2 * j - 2]) + c[2 * j - 1] * 4 + c[2 * j];
+    };
+    // last pixel
+    const SKIPSMImagePixelType sr1 = (dst_w == 1) ? (c[0] + c[0] * 4) : (c[2 * dst_w - 4] + c[2 * dst_w - 3] * 4);
+    const SKIPSMImagePixelType sr0 = c[2 * dst_w - 2];
+    if (w % 2 == 1)
+    {
+        out[dst_w - 1] = sr1 + IMUL11(sr0);
+    }
+    else
+    {
+        const SKIPSMImagePixelType srp = c[w - 1] * 4;
+        out[dst_w - 1] = sr1 + IMUL6(sr0) + srp + (srp / 4);
+    };
+}
+
+/** horizontal part of enblend::reduce with alpha channel for one line,
+ *  pixels outside the line are treated as masked. Used for the image and the alpha line.
+ *  @param c line converted to SKIPSMImagePixelType, masked pixels are set to zero
+ *  @param w width of the line, must be larger than 1
+ *  @param out (w+1)/2 filtered output pixels */
+template <class SKIPSMImagePixelType>
+void reduceMaskedLine(const SKIPSMImagePixelType* c, const int w, SKIPSMImagePixelType* out)
+{
+    const SKIPSMImagePixelType SKIPSMImageZero(vigra::NumericTraits<SKIPSMImagePixelType>::zero());
+    const int dst_w = (w + 1) >> 1;
+    const int inner = (w - 1) >> 1;
+    if (inner >= 1)
+    {
+        out[0] = SKIPSMImageZero + IMUL6(c[0]) + c[1] * 4 + c[2];
+    };
+    for (int j = 2; j <= inner; ++j)
+    {
+        out[j - 1] = (c[2 * j - 4] + c[2 * j - 3] * 4) + IMUL6(c[2 * j - 2]) + c[2 * j - 1] * 4 + c[2 * j];
+    };
+    const SKIPSMImagePixelType sr1 = (dst_w == 1) ? SKIPSMImageZero : (c[2 * dst_w - 4] + c[2 * dst_w - 3] * 4);
+    const SKIPSMImagePixelType sr0 = c[2 * dst_w - 2];
+    if (w % 2 == 1)
+    {
+        out[dst_w - 1] = sr1 + IMUL6(sr0);
+    }
+    else
+    {
+        out[dst_w - 1] = sr1 + IMUL6(sr0) + c[w - 1] * 4;
+    };
+}
+
+/** number of output rows processed as one block by reduce */
+static const int reduceBandHeight = 32;
+
+/** The Burt & Adelson Reduce operation for images without alpha channel.
+ *  The result is bit-identical to enblend::reduce without wraparound, but the
+ *  image is processed in bands of rows in parallel. Each band restarts the
+ *  vertical state machine from the two source rows above the band, so the
+ *  result does not depend on the number of threads. */
+template <typename SKIPSMImagePixelType,
+        typename SrcImageIterator, typename SrcAccessor,
+        typename DestImageIterator, typename DestAccessor>
+void reduce(SrcImageIterator src_upperleft, SrcImageIterator src_lowerright, SrcAccessor sa,
+        DestImageIterator dest_upperleft, DestImageIterator dest_lowerright, DestAccessor da)
+{
+    typedef typename DestAccessor::value_type DestPixelType;
+    const int src_w = src_lowerright.x - src_upperleft.x;
+    const int src_h = src_lowerright.y - src_upperleft.y;
+    const int dst_w = dest_lowerright.x - dest_upperleft.x;
+    const int dst_h = dest_lowerright.y - dest_upperleft.y;
+    vigra_precondition(src_w > 1 && src_h > 1, "src image too small in reduce");
+    vigra_precondition(dst_w == (src_w + 1) / 2 && dst_h == (src_h + 1) / 2, "dest image has wrong size in reduce");
+    const int nrBands = (dst_h + reduceBandHeight - 1) / reduceBandHeight;
+#pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < nrBands; ++band)
+    {
+        std::vector<SKIPSMImagePixelType> line(src_w);
+        std::vector<SKIPSMImagePixelType> sc1(dst_w);
+        std::vector<SKIPSMImagePixelType> sc0(dst_w);
+        std::vector<SKIPSMImagePixelType> scp(dst_w);
+        std::vector<SKIPSMImagePixelType> next(dst_w);
+        // filters the given source row horizontally
+        auto filterRow = [&](const int y, std::vector<SKIPSMImagePixelType>& out)
+        {
+            typename SrcImageIterator::row_iterator sx = (src_upperleft + vigra::Diff2D(0, y)).rowIterator();
+            for (int x = 0; x < src_w; ++x, ++sx)
+            {
+                line[x] = SKIPSMImagePixelType(sa(sx));
+            };
+            reduceLine(line.data(), src_w, out.data());
+        };
+        const int startRow = band * reduceBandHeight;
+        const int endRow = std::min(dst_h, startRow + reduceBandHeight);
+        // initialize the vertical state for the first row of the band
+        filterRow(2 * startRow, sc0);
+        if (startRow == 0)
+        {
+            // mirrored border
+            for (int x = 0; x < dst_w; ++x)
+            {
+                sc1[x] = IMUL5(sc0[x]);
+            };
+        }
+        else
+        {
+            filterRow(2 * startRow - 2, sc1);
+            filterRow(2 * startRow - 1, scp);
+            for (int x = 0; x < dst_w; ++x)
+            {
+                sc1[x] = sc1[x] + scp[x] * 4;
+            };
+        };
+        for (int y = startRow; y < endRow; ++y)
+        {
+            typename DestImageIterator::row_iterator dx = (dest_upperleft + vigra::Diff2D(0, y)).rowIterator();
+            const int srcy = 2 * y;
+            if (srcy + 1 < src_h)
+            {
+                filterRow(srcy + 1, scp);
+                for (int x = 0; x < dst_w; ++x)
+                {
+                    scp[x] = scp[x] * 4;
+                };
+            };
+            if (srcy + 2 < src_h)
+            {
+                filterRow(srcy + 2, next);
+                for (int x = 0; x < dst_w; ++x, ++dx)
+                {
+                    SKIPSMImagePixelType ip = sc1[x] + IMUL6(sc0[x]) + scp[x];
+                    sc1[x] = sc0[x] + scp[x];
+                    ip += next[x];
+                    ip /= 256;
+                    da.set(DestPixelType(ip), dx);
+                };
+                sc0.swap(next);
+            }
+            else
+            {
+                // last row, mirrored border
+                if (srcy + 1 < src_h)
+                {
+                    for (int x = 0; x < dst_w; ++x, ++dx)
+                    {
+                        SKIPSMImagePixelType ip = (sc1[x] + IMUL6(sc0[x]) + scp[x] + (scp[x] / 4)) / 256;
+                        da.set(DestPixelType(ip), dx);
+                    };
+                }
+                else
+                {
+                    for (int x = 0; x < dst_w; ++x, ++dx)
+                    {
+                        SKIPSMImagePixelType ip = (sc1[x] + IMUL11(sc0[x])) / 256;
+                        da.set(DestPixelType(ip), dx);
+                    };
+                };
+            };
+        };
+    };
+}
+
+/** The Burt & Adelson Reduce operation for images with alpha channel.
+ *  The result is bit-identical to enblend::reduce without wraparound,
+ *  see the version without alpha channel for details. */
+template <typename SKIPSMImagePixelType, typename SKIPSMAlphaPixelType,
+        typename SrcImageIterator, typename SrcAccessor,
+        typename AlphaIterator, typename AlphaAccessor,
+        typename DestImageIterator, typename DestAccessor,
+        typename DestAlphaIterator, typename DestAlphaAccessor>
+void reduce(SrcImageIterator src_upperleft, SrcImageIterator src_lowerright, SrcAccessor sa,
+        AlphaIterator alpha_upperleft, AlphaAccessor aa,
+        DestImageIterator dest_upperleft, DestImageIterator dest_lowerright, DestAccessor da,
+        DestAlphaIterator dest_alpha_upperleft, DestAlphaIterator dest_alpha_lowerright, DestAlphaAccessor daa)
+{
+    typedef typename DestAccessor::value_type DestPixelType;
+    typedef typename DestAlphaAccessor::value_type DestAlphaPixelType;
+    const int src_w = src_lowerright.x - src_upperleft.x;
+    const int src_h = src_lowerright.y - src_upperleft.y;
+    const int dst_w = dest_lowerright.x - dest_upperleft.x;
+    const int dst_h = dest_lowerright.y - dest_upperleft.y;
+    vigra_precondition(src_w > 1 && src_h > 1, "src image too small in reduce");
+    vigra_precondition(dst_w == (src_w + 1) / 2 && dst_h == (src_h + 1) / 2, "dest image has wrong size in reduce");
+    vigra_precondition(dest_alpha_lowerright.x - dest_alpha_upperleft.x == dst_w &&
+        dest_alpha_lowerright.y - dest_alpha_upperleft.y == dst_h, "dest mask has wrong size in reduce");
+    const SKIPSMImagePixelType SKIPSMImageZero(vigra::NumericTraits<SKIPSMImagePixelType>::zero());
+    const SKIPSMAlphaPixelType SKIPSMAlphaZero(vigra::NumericTraits<SKIPSMAlphaPixelType>::zero());
+    const SKIPSMAlphaPixelType SKIPSMAlphaOne(vigra::NumericTraits<SKIPSMAlphaPixelType>::one());
+    const DestPixelType DestImageZero(vigra::NumericTraits<DestPixelType>::zero());
+    const DestAlphaPixelType DestAlphaZero(vigra::NumericTraits<DestAlphaPixelType>::zero());
+    const DestAlphaPixelType DestAlphaMax(vigra::NumericTraits<DestAlphaPixelType>::max());
+    const int nrBands = (dst_h + reduceBandHeight - 1) / reduceBandHeight;
+#pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < nrBands; ++band)
+    {
+        std::vector<SKIPSMImagePixelType> line(src_w);
+        std::vector<SKIPSMImagePixelType> isc1(dst_w);
+        std::vector<SKIPSMImagePixelType> isc0(dst_w);
+        std::vector<SKIPSMImagePixelType> iscp(dst_w);
+        std::vector<SKIPSMImagePixelType> inext(dst_w);
+        std::vector<SKIPSMAlphaPixelType> alphaLine(src_w);
+        std::vector<SKIPSMAlphaPixelType> asc1(dst_w);
+        std::vector<SKIPSMAlphaPixelType> asc0(dst_w);
+        std::vector<SKIPSMAlphaPixelType> ascp(dst_w);
+        std::vector<SKIPSMAlphaPixelType> anext(dst_w);
+        // filters the given source row horizontally
+        auto filterRow = [&](const int y, std::vector<SKIPSMImagePixelType>& out, std::vector<SKIPSMAlphaPixelType>& alphaOut)
+        {
+            typename SrcImageIterator::row_iterator sx = (src_upperleft + vigra::Diff2D(0, y)).rowIterator();
+            typename AlphaIterator::row_iterator ax = (alpha_upperleft + vigra::Diff2D(0, y)).rowIterator();
+            for (int x = 0; x < src_w; ++x, ++sx, ++ax)
+            {
+                if (aa(ax))
+                {
+                    alphaLine[x] = SKIPSMAlphaOne;
+                    line[x] = SKIPSMImagePixelType(sa(sx));
+                }
+                else
+                {
+                    alphaLine[x] = SKIPSMAlphaZero;
+                    line[x] = SKIPSMImageZero;
+                };
+            };
+            reduceMaskedLine(line.data(), src_w, out.data());
+            reduceMaskedLine(alphaLine.data(), src_w, alphaOut.data());
+        };
+        const int startRow = band * reduceBandHeight;
+        const int endRow = std::min(dst_h, startRow + reduceBandHeight);
+        // initialize the vertical state for the first row of the band
+        filterRow(2 * startRow, isc0, asc0);
+        if (startRow == 0)
+        {
+            std::fill(isc1.begin(), isc1.end(), SKIPSMImageZero);
+            std::fill(asc1.begin(), asc1.end(), SKIPSMAlphaZero);
+        }
+        else
+        {
+            filterRow(2 * startRow - 2, isc1, asc1);
+            filterRow(2 * startRow - 1, iscp, ascp);
+            for (int x = 0; x < dst_w; ++x)
+            {
+                isc1[x] = isc1[x] + iscp[x] * 4;
+                asc1[x] = asc1[x] + ascp[x] * 4;
+            };
+        };
+        for (int y = startRow; y < endRow; ++y)
+        {
+            typename DestImageIterator::row_iterator dx = (dest_upperleft + vigra::Diff2D(0, y)).rowIterator();
+            typename DestAlphaIterator::row_iterator dax = (dest_alpha_upperleft + vigra::Diff2D(0, y)).rowIterator();
+            const int srcy = 2 * y;
+            if (srcy + 1 < src_h)
+            {
+                filterRow(srcy + 1, iscp, ascp);
+                for (int x = 0; x < dst_w; ++x)
+                {
+                    iscp[x] = iscp[x] * 4;
+                    ascp[x] = ascp[x] * 4;
+                };
+            };
+            if (srcy + 2 < src_h)
+            {
+                filterRow(srcy + 2, inext, anext);
+                for (int x = 0; x < dst_w; ++x, ++dx, ++dax)
+                {
+                    SKIPSMAlphaPixelType ap = asc1[x] + AMUL6(asc0[x]) + ascp[x];
+                    asc1[x] = asc0[x] + ascp[x];
+                    ap += anext[x];
+                    SKIPSMImagePixelType ip = isc1[x] + IMUL6(isc0[x]) + iscp[x];
+                    isc1[x] = isc0[x] + iscp[x];
+                    if (ap)
+                    {
+                        ip += inext[x];
+                        ip /= ap;
+                        da.set(DestPixelType(ip), dx);
+                        daa.set(DestAlphaMax, dax);
+                    }
+                    else
+                    {
+                        da.set(DestImageZero, dx);
+                        daa.set(DestAlphaZero, dax);
+                    };
+                };
+                isc0.swap(inext);
+                asc0.swap(anext);
+            }
+            else
+            {
+                // last row, pixels outside the image are masked
+                for (int x = 0; x < dst_w; ++x, ++dx, ++dax)
+                {
+                    SKIPSMAlphaPixelType ap = asc1[x] + AMUL6(asc0[x]);
+                    SKIPSMImagePixelType ip = isc1[x] + IMUL6(isc0[x]);
+                    if (srcy + 1 < src_h)
+                    {
+                        ap = ap + ascp[x];
+                        ip = ip + iscp[x];
+                    };
+                    if (ap)
+                    {
+                        ip = ip / ap;
+                        da.set(DestPixelType(ip), dx);
+                        daa.set(DestAlphaMax, dax);
+                    }
+                    else
+                    {
+                        da.set(DestImageZero, dx);
+                        daa.set(DestAlphaZero, dax);
+                    };
+                };
+            };
+        };
+    };
+}
+
+// Version using argument object factories.
+template <typename SKIPSMImagePixelType,
+        typename SrcImageIterator, typename SrcAccessor,
+        typename DestImageIterator, typename DestAccessor>
+inline void reduce(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> src,
+        vigra::triple<DestImageIterator, DestImageIterator, DestAccessor> dest)
+{
+    reduce<SKIPSMImagePixelType>(src.first, src.second, src.third,
+            dest.first, dest.second, dest.third);
+}
+
+// Version using argument object factories.
+template <typename SKIPSMImagePixelType, typename SKIPSMAlphaPixelType,
+        typename SrcImageIterator, typename SrcAccessor,
+        typename AlphaIterator, typename AlphaAccessor,
+        typename DestImageIterator, typename DestAccessor,
+        typename DestAlphaIterator, typename DestAlphaAccessor>
+inline void reduce(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> src,
+        vigra::pair<AlphaIterator, AlphaAccessor> mask,
+        vigra::triple<DestImageIterator, DestImageIterator, DestAccessor> dest,
+        vigra::triple<DestAlphaIterator, DestAlphaIterator, DestAlphaAccessor> destMask)
+{
+    reduce<SKIPSMImagePixelType, SKIPSMAlphaPixelType>(src.first, src.second, src.third,
+            mask.first, mask.second,
+            dest.first, dest.second, dest.third,
+            destMask.first, destMask.second, destMask.third);
+}
+
+} // namespace detail
+
 template <class ImageIn, class Image>
 void reduceNTimes(ImageIn & in, Image & out, int n)
 {
@@ -61,13 +424,13 @@ void reduceNTimes(ImageIn & in, Image & out, int n)
         next = &temp;
     }
     curr->resize(w,h);
-    enblend::reduce<SKIPSMType>(false, srcImageRange(in), destImageRange(*curr));
+    detail::reduce<SKIPSMType>(srcImageRange(in), destImageRange(*curr));
     n--;
     w = (w + 1) >> 1;
     h = (h + 1) >> 1;
     for( ; n > 0 ; --n) {
         next->resize(w,h);
-        enblend::reduce<SKIPSMType>(false, srcImageRange(*curr), destImageRange(*next));
+        detail::reduce<SKIPSMType>(srcImageRange(*curr), destImageRange(*next));
         w = (w + 1) >> 1;
         h = (h + 1) >> 1;
         Image * t = curr;
@@ -111,7 +474,7 @@ void reduceNTimes(Image & in, ImageMask & inMask, Image & out, ImageMask & outMa
     }
     curr->resize(w,h);
     currMask->resize(w,h);
-    enblend::reduce<SKIPSMType, SKIPSMAlphaType>(false, srcImageRange(in), srcImage(inMask), 
+    detail::reduce<SKIPSMType, SKIPSMAlphaType>(srcImageRange(in), srcImage(inMask), 
                                 destImageRange(*curr), destImageRange(*currMask));
     n--;
     w = (w + 1) >> 1;
@@ -119,7 +482,7 @@ void reduceNTimes(Image & in, ImageMask & inMask, Image & out, ImageMask & outMa
     for( ; n > 0 ; --n) {
         next->resize(w,h);
         nextMask->resize(w,h);
-        enblend::reduce<SKIPSMType, SKIPSMAlphaType>(false, srcImageRange(*curr), srcImage(*currMask),
+        detail::reduce<SKIPSMType, SKIPSMAlphaType>(srcImageRange(*curr), srcImage(*currMask),
                                     destImageRange(*next), destImageRange(*nextMask));
         w = (w + 1) >> 1;
         h = (h + 1) >> 1;
@@ -144,7 +507,7 @@ void reduceToNextLevel(ImageIn & in, ImageOut & out)
     w = (w + 1) >> 1;
     h = (h + 1) >> 1;
     out.resize(w,h);
-    enblend::reduce<SKIPSMType>(false, srcImageRange(in), destImageRange(out));
+    detail::reduce<SKIPSMType>(srcImageRange(in), destImageRange(out));
 }
 
 template <class ImageIn, class ImageInMask, class ImageOut, class ImageOutMask>
@@ -162,7 +525,7 @@ void reduceToNextLevel(ImageIn & in, ImageInMask & inMask, ImageOut & out, Image
     h = (h + 1) >> 1;
     out.resize(w,h);
     outMask.resize(w, h);
-    enblend::reduce<SKIPSMType, SKIPSMAlphaType>(false, srcImageRange(in), srcImage(inMask),
+    detail::reduce<SKIPSMType, SKIPSMAlphaType>(srcImageRange(in), srcImage(inMask),
                                 destImageRange(out), destImageRange(outMask));
 }
 
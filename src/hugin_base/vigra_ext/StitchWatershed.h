@@ -27,7 +27,9 @@
  
 #include <vigra/seededregiongrowing.hxx>
 #include <vigra/convolution.hxx>
+#include <vigra/labelimage.hxx>
 #include "vigra_ext/BlendPoisson.h"
+#include "vigra_ext/BlendLaplacian.h"
 #ifdef HAVE_OPENMP
 #include <omp.h>
 #endif
@@ -113,11 +115,236 @@ namespace vigra_ext
             vigra::omp::copyImage(vigra::srcImageRange(image), vigra::destImage(newImage));
             return newImage;
         };
+
+        /** runs the seeded region growing on the whole image
+         *  @param cost cost image, pixels with low values are flooded first
+         *  @param labels seeds (1 and 2), unlabeled pixels are 0, must have same size as cost */
+        template <class CostIterator, class CostAccessor>
+        void SeededWatershed(CostIterator costUpperLeft, CostIterator costLowerRight, CostAccessor costAcc, vigra::BImage& labels)
+        {
+            vigra::ArrayOfRegionStatistics<vigra::SeedRgDirectValueFunctor<vigra::UInt8> > stats(3);
+            vigra::fastSeededRegionGrowing(costUpperLeft, costLowerRight, costAcc, labels.upperLeft(), labels.accessor(), stats, vigra::CompleteGrow, vigra::FourNeighborCode(), 255);
+        };
+
+        /** part of the unlabeled pixels, which is grown independently in ParallelSeededWatershed */
+        struct WatershedTask
+        {
+            /** number of the connected component of unlabeled pixels */
+            int component;
+            /** only the pixels inside this rectangle are written back */
+            vigra::Rect2D core;
+            /** border around core, which is grown together with the core */
+            int margin;
+        };
+
+        /** seeded watershed, which processes the connected components of unlabeled pixels in parallel.
+         *  The components are separated by seed pixels, so a component, which fits into a tile, is grown
+         *  on its own with the same result as growing the whole image at once.
+         *  Bigger components (e.g. the overlap or the seam band of an image pair, which is usually a single
+         *  component) are split into tiles. Each tile is grown together with a border of the neighboring
+         *  tiles, but only the labels inside the tile are kept. So the result differs slightly from a
+         *  global run near the tile borders, but it does not depend on the number of threads. */
+        inline void ParallelSeededWatershed(const vigra::BImage& cost, vigra::BImage& labels)
+        {
+            const int tileSize = 512;
+            const int tileMargin = 64;
+            vigra::IImage components(labels.size());
+            vigra::BImage unlabeled(labels.size());
+            vigra::omp::transformImage(vigra::srcImageRange(labels), vigra::destImage(unlabeled), vigra::functor::ifThenElse(vigra::functor::Arg1() == vigra::functor::Param(0), vigra::functor::Param(1), vigra::functor::Param(0)));
+            const int nrComponents = vigra::labelImageWithBackground(vigra::srcImageRange(unlabeled), vigra::destImage(components), false, 0);
+            unlabeled.resize(0, 0);
+            if (nrComponents == 0)
+            {
+                return;
+            };
+            vigra::ArrayOfRegionStatistics<vigra::FindBoundingRectangle> bounds(nrComponents);
+            vigra::inspectTwoImages(vigra::srcIterRange<vigra::Diff2D>(vigra::Diff2D(0, 0), components.size()), vigra::srcImage(components), bounds);
+            std::vector<WatershedTask> tasks;
+            for (int i = 1; i <= nrComponents; ++i)
+            {
+                const vigra::Rect2D rect(vigra::Point2D(bounds.regions[i].upperLeft), vigra::Point2D(bounds.regions[i].lowerRight));
+                if (rect.width() <= tileSize && rect.height() <= tileSize)
+                {
+                    // the whole component with the surrounding seeds
+                    WatershedTask task = { i, rect, 1 };
+                    tasks.push_back(task);
+                }
+                else
+                {
+                    for (int y = rect.top(); y < rect.bottom(); y += tileSize)
+                    {
+                        for (int x = rect.left(); x < rect.right(); x += tileSize)
+                        {
+                            WatershedTask task = { i, vigra::Rect2D(x, y, std::min(x + tileSize, rect.right()), std::min(y + tileSize, rect.bottom())), tileMargin };
+                            tasks.push_back(task);
+                        };
+                    };
+                };
+            };
+            if (tasks.size() == 1)
+            {
+                SeededWatershed(cost.upperLeft(), cost.lowerRight(), cost.accessor(), labels);
+                return;
+            };
+            const vigra::Rect2D imageRect(labels.size());
+#pragma omp parallel for schedule(dynamic)
+            for (int t = 0; t < static_cast<int>(tasks.size()); ++t)
+            {
+                const WatershedTask& task = tasks[t];
+                vigra::Rect2D rect(task.core);
+                rect.addBorder(task.margin);
+                rect &= imageRect;
+                // pixels of other components are marked with the dummy label 3, they never touch
+                // the current component because the components are 4-connected
+                vigra::BImage localLabels(rect.size());
+                for (int y = 0; y < rect.height(); ++y)
+                {
+                    for (int x = 0; x < rect.width(); ++x)
+                    {
+                        const int component = components(rect.left() + x, rect.top() + y);
+                        if (component == task.component)
+                        {
+                            localLabels(x, y) = 0;
+                        }
+                        else
+                        {
+                            localLabels(x, y) = (component == 0) ? labels(rect.left() + x, rect.top() + y) : 3;
+                        };
+                    };
+                };
+                SeededWatershed(cost.upperLeft() + rect.upperLeft(), cost.upperLeft() + rect.lowerRight(), cost.accessor(), localLabels);
+                // copy back only the pixels of the current component inside the core,
+                // so the threads never write the same pixel
+                for (int y = task.core.top(); y < task.core.bottom(); ++y)
+                {
+                    for (int x = task.core.left(); x < task.core.right(); ++x)
+                    {
+                        if (components(x, y) == task.component)
+                        {
+                            labels(x, y) = localLabels(x - rect.left(), y - rect.top());
+                        };
+                    };
+                };
+            };
+            // a part of a component inside a tile can be cut off from all seeds,
+            // these pixels are grown from their labeled neighbors in a final run
+            bool unresolved = false;
+            for (int y = 0; y < labels.height() && !unresolved; ++y)
+            {
+                for (int x = 0; x < labels.width(); ++x)
+                {
+                    if (labels(x, y) == 0)
+                    {
+                        unresolved = true;
+                        break;
+                    };
+                };
+            };
+            if (unresolved)
+            {
+                SeededWatershed(cost.upperLeft(), cost.lowerRight(), cost.accessor(), labels);
+            };
+        };
+
+        /** seeded watershed with multi-resolution seam search.
+         *  For big images the watershed is first calculated on a reduced cost image. At full
+         *  resolution only the pixels in a narrow band around the seams found at the reduced
+         *  resolution are processed again, all other pixels take the label of the reduced image.
+         *  @param cost cost image, pixels with low values are flooded first
+         *  @param labels seeds (1 and 2), unlabeled pixels are 0, must have same size as cost */
+        inline void MultiResolutionWatershed(const vigra::BImage& cost, vigra::BImage& labels)
+        {
+            // size of the reduced image
+            const int reducedSize = 512;
+            const int factor = (std::max(cost.width(), cost.height()) + reducedSize - 1) / reducedSize;
+            if (factor < 2)
+            {
+                ParallelSeededWatershed(cost, labels);
+                return;
+            };
+            const int width = (cost.width() + factor - 1) / factor;
+            const int height = (cost.height() + factor - 1) / factor;
+            vigra::BImage smallCost(width, height);
+            vigra::BImage smallLabels(width, height);
+            // reduce cost by averaging, a block is a seed only if it contains seeds of only one image
+#pragma omp parallel for schedule(dynamic)
+            for (int by = 0; by < height; ++by)
+            {
+                for (int bx = 0; bx < width; ++bx)
+                {
+                    const int xEnd = std::min(cost.width(), (bx + 1) * factor);
+                    const int yEnd = std::min(cost.height(), (by + 1) * factor);
+                    unsigned int sum = 0;
+                    unsigned char seeds = 0;
+                    for (int y = by * factor; y < yEnd; ++y)
+                    {
+                        for (int x = bx * factor; x < xEnd; ++x)
+                        {
+                            sum += cost(x, y);
+                            seeds |= 1 << labels(x, y);
+                        };
+                    };
+                    smallCost(bx, by) = static_cast<vigra::UInt8>(sum / ((xEnd - bx * factor) * (yEnd - by * factor)));
+                    const bool hasSeed1 = (seeds & 2) != 0;
+                    const bool hasSeed2 = (seeds & 4) != 0;
+                    smallLabels(bx, by) = hasSeed1 == hasSeed2 ? 0 : (hasSeed1 ? 1 : 2);
+                };
+            };
+            ParallelSeededWatershed(smallCost, smallLabels);
+            smallCost.resize(0, 0);
+            // blocks at the seams and unresolved blocks have to be refined at full resolution
+            vigra::BImage band(width, height);
+#pragma omp parallel for
+            for (int by = 0; by < height; ++by)
+            {
+                for (int bx = 0; bx < width; ++bx)
+                {
+                    const vigra::UInt8 label = smallLabels(bx, by);
+                    bool isBand = (label == 0);
+                    for (int dy = std::max(0, by - 1); dy <= std::min(height - 1, by + 1) && !isBand; ++dy)
+                    {
+                        for (int dx = std::max(0, bx - 1); dx <= std::min(width - 1, bx + 1); ++dx)
+                        {
+                            if (smallLabels(dx, dy) != label)
+                            {
+                                isBand = true;
+                                break;
+                            };
+                        };
+                    };
+                    band(bx, by) = isBand ? 1 : 0;
+                };
+            };
+            // take the labels outside of the band from the reduced image
+#pragma omp parallel for
+            for (int y = 0; y < labels.height(); ++y)
+            {
+                for (int x = 0; x < labels.width(); ++x)
+                {
+                    if (labels(x, y) == 0 && band(x / factor, y / factor) == 0)
+                    {
+                        labels(x, y) = smallLabels(x / factor, y / factor);
+                    };
+                };
+            };
+            // now refine the band at full resolution
+            ParallelSeededWatershed(cost, labels);
+        };
     }; // namespace detail
+
+    /** methods to blend the images at the seam */
+    enum SeamBlendMode
+    {
+        SEAM_HARD = 0,
+        SEAM_POISSON,
+        SEAM_MULTIRESOLUTION
+    };
     
     template <class ImageType, class MaskType>
-    void MergeImages(ImageType& image1, MaskType& mask1, const ImageType& image2, const MaskType& mask2, const vigra::Diff2D offset, const bool wrap, const bool hardSeam)
+    void MergeImages(ImageType& image1, MaskType& mask1, const ImageType& image2, const MaskType& mask2, const vigra::Diff2D offset, const bool wrap, const SeamBlendMode seamMode)
     {
+        // the multiresolution blending uses the seam of the hard seam mode
+        const bool hardSeam = (seamMode != SEAM_POISSON);
         const vigra::Point2D offsetPoint(offset);
         const vigra::Rect2D offsetRect(offsetPoint, mask2.size());
         //increase image size if necessary
@@ -200,7 +427,6 @@ namespace vigra_ext
         vigra::omp::transformImage(vigra::srcImageRange(diff), vigra::destImage(diffByte), vigra::functor::Param(255) - vigra::functor::Param(255.0f / diffMinMax.max)*vigra::functor::Arg1());
         diff.resize(0, 0);
         // run watershed algorithm
-        vigra::ArrayOfRegionStatistics<vigra::SeedRgDirectValueFunctor<vigra::UInt8> > stats(3);
         if (doWrap)
         {
             // handle wrapping
@@ -218,7 +444,10 @@ namespace vigra_ext
             {
                 vigra::gaussianSmoothing(vigra::srcImageRange(diffWrapped), vigra::destImage(diffWrapped), smoothRadius);
             };
-            vigra::fastSeededRegionGrowing(vigra::srcImageRange(diffWrapped), vigra::destImage(labelsWrapped, p1), stats, vigra::CompleteGrow, vigra::FourNeighborCode(), 255);
+            vigra::BImage seamLabels(diffWrapped.size());
+            vigra::omp::copyImage(labelsWrapped.upperLeft() + p1, labelsWrapped.upperLeft() + p1 + seamLabels.size(), labelsWrapped.accessor(), seamLabels.upperLeft(), seamLabels.accessor());
+            detail::MultiResolutionWatershed(diffWrapped, seamLabels);
+            vigra::omp::copyImage(vigra::srcImageRange(seamLabels), vigra::destImage(labelsWrapped, p1));
             vigra::omp::copyImage(labelsWrapped.upperLeft() + vigra::Diff2D(oldWidth / 2, 0), labelsWrapped.upperLeft() + vigra::Diff2D(oldWidth, oldHeight), labelsWrapped.accessor(),
                 labels.upperLeft() + vigra::Diff2D(oldWidth / 2, 0), labels.accessor());
             vigra::omp::copyImage(labelsWrapped.upperLeft() + vigra::Diff2D(oldWidth, 0), labelsWrapped.upperLeft() + vigra::Diff2D(oldWidth + oldWidth / 2, oldHeight), labelsWrapped.accessor(),
@@ -232,7 +461,17 @@ namespace vigra_ext
             {
                 vigra::gaussianSmoothing(vigra::srcImageRange(diffByte), vigra::destImage(diffByte), smoothRadius);
             };
-            vigra::fastSeededRegionGrowing(vigra::srcImageRange(diffByte), vigra::destImage(labels, p1), stats, vigra::CompleteGrow, vigra::FourNeighborCode(), 255);
+            vigra::BImage seamLabels(diffByte.size());
+            vigra::omp::copyImage(labels.upperLeft() + p1, labels.upperLeft() + p1 + seamLabels.size(), labels.accessor(), seamLabels.upperLeft(), seamLabels.accessor());
+            detail::MultiResolutionWatershed(diffByte, seamLabels);
+            vigra::omp::copyImage(vigra::srcImageRange(seamLabels), vigra::destImage(labels, p1));
+        };
+        // remember the mask of image 1 for the multiresolution blending
+        vigra::BImage mask1Orig;
+        if (seamMode == SEAM_MULTIRESOLUTION)
+        {
+            mask1Orig.resize(mask2.size());
+            vigra::omp::copyImage(vigra::srcImageRange(mask1, offsetRect), vigra::destImage(mask1Orig));
         };
         // now we can merge the images
         // merging the mask is straightforward
@@ -241,8 +480,17 @@ namespace vigra_ext
         {
             // the watershed algorithm could also reached area where no informations are available
             vigra::omp::combineTwoImages(vigra::srcImageRange(labels), vigra::srcImage(mask2), vigra::destImage(labels), detail::CombineMasks());
-            // now we can merge the images
-            vigra::copyImageIf(vigra::srcImageRange(image2), vigra::srcImage(labels), vigra::destImage(image1, offsetPoint));
+            if (seamMode == SEAM_MULTIRESOLUTION)
+            {
+                // blend along the seam with Laplacian pyramids
+                vigra_ext::laplacian::Blend(image1, mask1Orig, image2, mask2, labels, offsetPoint,
+                    vigra::Rect2D(vigra::Point2D(roi.regions[3].upperLeft), vigra::Point2D(roi.regions[3].lowerRight)), wrap && offsetRect.width() == image1.width());
+            }
+            else
+            {
+                // now we can merge the images
+                vigra::copyImageIf(vigra::srcImageRange(image2), vigra::srcImage(labels), vigra::destImage(image1, offsetPoint));
+            };
         }
         else
         {
@@ -258,7 +506,7 @@ namespace vigra_ext
             const int minLength = 8;
             vigra_ext::poisson::BuildSeamPyramid(labels, seams, minLength);
             // create gradient map
-            typedef typename vigra::NumericTraits<typename ImageType::PixelType>::RealPromote ImageRealPixelType;
+            typedef typename vigra_ext::poisson::SolverPixelType<typename ImageType::PixelType>::type ImageRealPixelType;
             vigra::BasicImage<ImageRealPixelType> gradient(image2.size());
             vigra::BasicImage<ImageRealPixelType> target(image2.size());
             // build gradient map with special handling of both boundary conditions
@@ -272,4 +520,10 @@ namespace vigra_ext
         };
     };
 
+    template <class ImageType, class MaskType>
+    void MergeImages(ImageType& image1, MaskType& mask1, const ImageType& image2, const MaskType& mask2, const vigra::Diff2D offset, const bool wrap, const bool hardSeam)
+    {
+        MergeImages(image1, mask1, image2, mask2, offset, wrap, hardSeam ? SEAM_HARD : SEAM_POISSON);
+    };
+
 }
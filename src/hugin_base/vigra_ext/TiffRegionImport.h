@@ -0,0 +1,336 @@
+// -*- c-basic-offset: 4 -*-
+/** @file TiffRegionImport.h
+ *
+ *  Functions to import only a rectangular part of a tiff image.
+ *  Only the tiles or strips which intersect the rectangle are decoded.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _TIFFREGIONIMPORT_H
+#define _TIFFREGIONIMPORT_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <vigra/imageinfo.hxx>
+#include <vigra/stdimage.hxx>
+#include <vigra/utilities.hxx>
+#include <vigra_ext/impexalpha.hxx>
+
+#include <tiffio.h>
+
+namespace vigra_ext {
+
+namespace detail {
+
+/** opens a tiff file for reading and closes it again in the destructor */
+class TiffReadFile
+{
+public:
+    explicit TiffReadFile(const char* filename) : m_tiff(TIFFOpen(filename, "r"))
+    {
+    };
+    ~TiffReadFile()
+    {
+        if (m_tiff)
+        {
+            TIFFClose(m_tiff);
+        };
+    };
+    TIFF* get() { return m_tiff; };
+private:
+    // private, file can't be copied
+    TiffReadFile(const TiffReadFile&);
+    TiffReadFile& operator=(const TiffReadFile&);
+
+    TIFF* m_tiff;
+};
+
+/** returns true, if the pixels of the tiff file can be read directly into the image */
+inline bool isSupportedTiffLayout(TIFF* tiff, const vigra::ImageImportInfo& info)
+{
+    uint16 planarConfig, photometric, bitsPerSample, sampleFormat, samplesPerPixel, orientation;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_ORIENTATION, &orientation);
+    if (!TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric))
+    {
+        return false;
+    };
+    // palette, inverted grayscale, YCbCr and similar need a conversion of the pixel values,
+    // they are handled by the full import
+    if (photometric != PHOTOMETRIC_MINISBLACK && photometric != PHOTOMETRIC_RGB)
+    {
+        return false;
+    };
+    if (planarConfig != PLANARCONFIG_CONTIG || orientation != ORIENTATION_TOPLEFT)
+    {
+        return false;
+    };
+    if (sampleFormat == SAMPLEFORMAT_IEEEFP)
+    {
+        if (bitsPerSample != 32 && bitsPerSample != 64)
+        {
+            return false;
+        };
+    }
+    else
+    {
+        if (sampleFormat != SAMPLEFORMAT_UINT && sampleFormat != SAMPLEFORMAT_INT)
+        {
+            return false;
+        };
+        if (bitsPerSample != 8 && bitsPerSample != 16 && bitsPerSample != 32)
+        {
+            return false;
+        };
+    };
+    return samplesPerPixel == info.numBands();
+};
+
+/** returns the number of bands of the image, scalar version */
+template <class ImageIterator, class ImageAccessor>
+inline int getTiffImageBands(const ImageIterator& i, const ImageAccessor& a, vigra::VigraTrueType)
+{
+    return 1;
+};
+
+/** returns the number of bands of the image, vector version */
+template <class ImageIterator, class ImageAccessor>
+inline int getTiffImageBands(const ImageIterator& i, const ImageAccessor& a, vigra::VigraFalseType)
+{
+    return a.size(i);
+};
+
+/** sets band of the pixel, scalar version */
+template <class ImageIterator, class ImageAccessor, class T>
+inline void setTiffBand(ImageIterator& i, ImageAccessor& a, const T value, const int band, vigra::VigraTrueType)
+{
+    a.set(value, i);
+};
+
+/** sets band of the pixel, vector version */
+template <class ImageIterator, class ImageAccessor, class T>
+inline void setTiffBand(ImageIterator& i, ImageAccessor& a, const T value, const int band, vigra::VigraFalseType)
+{
+    a.setComponent(value, i, band);
+};
+
+/** copies the pixels of a decoded block (tile or strip) into the image
+ *  @param buffer decoded pixels, block starts at blockUL in the full image
+ *  @param blockWidth number of pixels in each row of the block
+ *  @param copyRect part of the block which should be copied, in coordinates of the full image
+ */
+template <class T, class ImageIterator, class ImageAccessor, class AlphaIterator, class AlphaAccessor, class AlphaScaler>
+void copyTiffBlock(const T* buffer, const vigra::Point2D& blockUL, const int blockWidth, const vigra::Rect2D& copyRect,
+    const vigra::Rect2D& region, const int samplesPerPixel, const int colorBands,
+    ImageIterator image, ImageAccessor ia, AlphaIterator alpha, AlphaAccessor aa, const AlphaScaler& alphaScaler, const bool withAlpha)
+{
+    typedef typename vigra::NumericTraits<typename ImageAccessor::value_type>::isScalar isScalar;
+    for (int y = copyRect.top(); y < copyRect.bottom(); ++y)
+    {
+        const T* src = buffer + ((y - blockUL.y) * blockWidth + (copyRect.left() - blockUL.x)) * samplesPerPixel;
+        const vigra::Diff2D offset(copyRect.left() - region.left(), y - region.top());
+        ImageIterator xd(image + offset);
+        AlphaIterator xa(alpha);
+        if (withAlpha)
+        {
+            xa += offset;
+        };
+        for (int x = copyRect.left(); x < copyRect.right(); ++x, ++xd.x)
+        {
+            for (int band = 0; band < colorBands; ++band)
+            {
+                setTiffBand(xd, ia, src[band], band, isScalar());
+            };
+            if (withAlpha)
+            {
+                aa.set(alphaScaler(src[colorBands]), xa);
+                ++xa.x;
+            };
+            src += samplesPerPixel;
+        };
+    };
+};
+
+/** reads all tiles or strips which intersect the region and copies the region into the image */
+template <class T, class ImageIterator, class ImageAccessor, class AlphaIterator, class AlphaAccessor, class AlphaScaler>
+void readTiffRegion(TIFF* tiff, const vigra::Rect2D& region, const int samplesPerPixel, const int colorBands,
+    ImageIterator image, ImageAccessor ia, AlphaIterator alpha, AlphaAccessor aa, const AlphaScaler& alphaScaler, const bool withAlpha)
+{
+    uint32 width, height;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+    const vigra::Rect2D imageRect(0, 0, width, height);
+    if (TIFFIsTiled(tiff))
+    {
+        uint32 tileWidth, tileHeight;
+        TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth);
+        TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileHeight);
+        std::vector<T> buffer(TIFFTileSize(tiff) / sizeof(T) + 1);
+        for (int ty = (region.top() / tileHeight) * tileHeight; ty < region.bottom(); ty += tileHeight)
+        {
+            for (int tx = (region.left() / tileWidth) * tileWidth; tx < region.right(); tx += tileWidth)
+            {
+                if (TIFFReadTile(tiff, &buffer[0], tx, ty, 0, 0) < 0)
+                {
+                    vigra_fail("importTiffRegion: error reading tile.");
+                };
+                const vigra::Rect2D copyRect = vigra::Rect2D(tx, ty, tx + tileWidth, ty + tileHeight) & region & imageRect;
+                copyTiffBlock(&buffer[0], vigra::Point2D(tx, ty), tileWidth, copyRect, region, samplesPerPixel, colorBands,
+                    image, ia, alpha, aa, alphaScaler, withAlpha);
+            };
+        };
+    }
+    else
+    {
+        uint32 rowsPerStrip;
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+        rowsPerStrip = std::min(rowsPerStrip, height);
+        std::vector<T> buffer(TIFFStripSize(tiff) / sizeof(T) + 1);
+        for (int sy = (region.top() / rowsPerStrip) * rowsPerStrip; sy < region.bottom(); sy += rowsPerStrip)
+        {
+            if (TIFFReadEncodedStrip(tiff, TIFFComputeStrip(tiff, sy, 0), &buffer[0], -1) < 0)
+            {
+                vigra_fail("importTiffRegion: error reading strip.");
+            };
+            const vigra::Rect2D copyRect = vigra::Rect2D(0, sy, width, sy + rowsPerStrip) & region & imageRect;
+            copyTiffBlock(&buffer[0], vigra::Point2D(0, sy), width, copyRect, region, samplesPerPixel, colorBands,
+                image, ia, alpha, aa, alphaScaler, withAlpha);
+        };
+    };
+};
+
+/** selects the sample type and reads the region */
+template <class ImageIterator, class ImageAccessor, class AlphaIterator, class AlphaAccessor>
+void importTiffRegionIntern(const vigra::ImageImportInfo& info, const vigra::Rect2D& region,
+    ImageIterator image, ImageAccessor ia, AlphaIterator alpha, AlphaAccessor aa, const bool withAlpha)
+{
+    typedef typename ImageAccessor::value_type ImageValueType;
+    typedef typename AlphaAccessor::value_type AlphaValueType;
+    vigra_precondition(region.width() > 0 && region.height() > 0 && (region & vigra::Rect2D(info.size())) == region,
+        "importTiffRegion: region must be inside the image.");
+    TiffReadFile file(info.getFileName());
+    TIFF* tiff = file.get();
+    vigra_precondition(tiff != NULL && isSupportedTiffLayout(tiff, info),
+        "importTiffRegion: unsupported tiff file.");
+    const int colorBands = info.numBands() - info.numExtraBands();
+    vigra_precondition(colorBands == getTiffImageBands(image, ia, typename vigra::NumericTraits<ImageValueType>::isScalar()),
+        "importTiffRegion: number of channels and image accessor do not match.");
+    // threshold the alpha channel as importImageAlpha does
+    const vigra::detail::range_t alphaSourceRange(LUTTraits<ImageValueType>::min(), LUTTraits<ImageValueType>::max());
+    const vigra::detail::range_t maskDestinationRange(LUTTraits<AlphaValueType>::min(), LUTTraits<AlphaValueType>::max());
+    const vigra::detail::threshold_alpha_transform alphaScaler(alphaSourceRange, maskDestinationRange);
+    const int spp = info.numBands();
+    uint16 bitsPerSample, sampleFormat;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+    if (sampleFormat == SAMPLEFORMAT_IEEEFP)
+    {
+        if (bitsPerSample == 32)
+        {
+            readTiffRegion<float>(tiff, region, spp, colorBands, image, ia, alpha, aa, alphaScaler, withAlpha);
+        }
+        else
+        {
+            readTiffRegion<double>(tiff, region, spp, colorBands, image, ia, alpha, aa, alphaScaler, withAlpha);
+        };
+    }
+    else
+    {
+        const bool isSigned = sampleFormat == SAMPLEFORMAT_INT;
+        switch (bitsPerSample)
+        {
+            case 8:
+                if (isSigned)
+                {
+                    readTiffRegion<vigra::Int8>(tiff, region, spp, colorBands, image, ia, alpha, aa, alphaScaler, withAlpha);
+                }
+                else
+                {
+                    readTiffRegion<vigra::UInt8>(tiff, region, spp, colorBands, image, ia, alpha, aa, alphaScaler, withAlpha);
+                };
+                break;
+            case 16:
+                if (isSigned)
+                {
+                    readTiffRegion<vigra::Int16>(tiff, region, spp, colorBands, image, ia, alpha, aa, alphaScaler, withAlpha);
+                }
+                else
+                {
+                    readTiffRegion<vigra::UInt16>(tiff, region, spp, colorBands, image, ia, alpha, aa, alphaScaler, withAlpha);
+                };
+                break;
+            default:
+                if (isSigned)
+                {
+                    readTiffRegion<vigra::Int32>(tiff, region, spp, colorBands, image, ia, alpha, aa, alphaScaler, withAlpha);
+                }
+                else
+                {
+                    readTiffRegion<vigra::UInt32>(tiff, region, spp, colorBands, image, ia, alpha, aa, alphaScaler, withAlpha);
+                };
+                break;
+        };
+    };
+};
+
+} // namespace detail
+
+/** returns true, if importTiffRegion can read the given image.
+ *  Supported are the first directory of uncompressed or compressed, tiled or striped tiff files
+ *  with interleaved grayscale or RGB pixels, optionally with one alpha channel.
+ */
+inline bool canImportTiffRegion(const vigra::ImageImportInfo& info)
+{
+    if (std::string(info.getFileType()) != "TIFF" || info.getImageIndex() != 0 || info.numExtraBands() > 1)
+    {
+        return false;
+    };
+    detail::TiffReadFile file(info.getFileName());
+    return file.get() != NULL && detail::isSupportedTiffLayout(file.get(), info);
+};
+
+/** imports the rectangle region of the image into image, the image has to be at least as big as region.
+ *  Only the tiles or strips of the file which intersect the region are decoded, so this is
+ *  much faster than importImage for small parts of big images.
+ *  The pixel values are converted in the same way as importImage does. */
+template <class ImageIterator, class ImageAccessor>
+void importTiffRegion(const vigra::ImageImportInfo& info, const vigra::Rect2D& region,
+    std::pair<ImageIterator, ImageAccessor> image)
+{
+    vigra::BImage dummyAlpha(1, 1);
+    detail::importTiffRegionIntern(info, region, image.first, image.second,
+        dummyAlpha.upperLeft(), dummyAlpha.accessor(), false);
+};
+
+/** imports the rectangle region of the image and the alpha channel, the alpha channel is
+ *  thresholded as importImageAlpha does */
+template <class ImageIterator, class ImageAccessor, class AlphaIterator, class AlphaAccessor>
+void importTiffRegionAlpha(const vigra::ImageImportInfo& info, const vigra::Rect2D& region,
+    std::pair<ImageIterator, ImageAccessor> image, std::pair<AlphaIterator, AlphaAccessor> alpha)
+{
+    vigra_precondition(info.numExtraBands() == 1, "importTiffRegionAlpha: image has no alpha channel.");
+    detail::importTiffRegionIntern(info, region, image.first, image.second, alpha.first, alpha.second, true);
+};
+
+} // namespace
+
+#endif // _TIFFREGIONIMPORT_H
@@ -89,6 +89,10 @@ public:
 	 * @param desiredProbabilityForNoOutliers The probability that at least one of the selected subsets doesn't contains an
 	 *                                        outlier.
 	 * @param maximalOutlierPercentage The maximal expected percentage of outliers.
+	 * @param parallel Evaluate the hypotheses in parallel. The subsets are still drawn in
+	 *                 the same order and ties are resolved by the first hypothesis, so the
+	 *                 result is the same as in the serial case. estimate and agree of the
+	 *                 paramEstimator must be reentrant in this case.
 	 * @return Array with inliers
 	 */
         template<class Estimator, class S, class T>
@@ -97,7 +101,8 @@ public:
 					     const Estimator & paramEstimator ,
 					     const std::vector<T> &data, 
 					     double desiredProbabilityForNoOutliers,
-					     double maximalOutlierPercentage);
+					     double maximalOutlierPercentage,
+					     const bool parallel = false);
 
 
 	/**
@@ -177,7 +182,8 @@ std::vector<const T *> Ransac::compute(S &parameters,
 				       const Estimator & paramEstimator,
 				       const std::vector<T> &data,
 				       double desiredProbabilityForNoOutliers,
-				       double maximalOutlierPercentage)
+				       double maximalOutlierPercentage,
+				       const bool parallel)
 {
     unsigned int numDataObjects = (int) data.size();
     unsigned int numForEstimate = paramEstimator.numForEstimate();
@@ -186,12 +192,8 @@ std::vector<const T *> Ransac::compute(S &parameters,
     if(numDataObjects < numForEstimate || maximalOutlierPercentage>=1.0) 
         return std::vector<const T*>();
 
-    std::vector<const T *> exactEstimateData;
     std::vector<const T *> leastSquaresEstimateData;
-    S exactEstimateParameters;
-    int i, j, k, l, numVotesForBest, numVotesForCur, maxIndex, numTries;
-    short *bestVotes = new short[numDataObjects]; //one if data[i] agrees with the best model, otherwise zero
-    short *curVotes = new short[numDataObjects];  //one if data[i] agrees with the current model, otherwise zero
+    int i, j, k, l, maxIndex, numTries;
     short *notChosen = new short[numDataObjects]; //not zero if data[i] is NOT chosen for computing the exact fit, otherwise zero
     SubSetIndexComparator subSetIndexComparator(numForEstimate);
     std::set<int *, SubSetIndexComparator > chosenSubSets(subSetIndexComparator);
@@ -203,9 +205,6 @@ std::vector<const T *> Ransac::compute(S &parameters,
 
     //parameters.clear();
 
-
-    numVotesForBest = 0; //initalize with 0 so that the first computation which gives any type of fit will be set to best
-    
     // intialize random generator
     maxIndex = numDataObjects - 1;
     std::mt19937 rng(static_cast<unsigned int>(std::time(0)));
@@ -218,12 +217,16 @@ std::vector<const T *> Ransac::compute(S &parameters,
     //there are cases when the probablistic number of tries is greater than all possible sub-sets
     numTries = numTries<allTries ? numTries : allTries;
 
+    // first draw all subsets, the random generator is only used here, so the
+    // hypotheses do not depend on the order of the evaluation
+    std::vector<std::vector<const T *> > exactEstimateData;
+    exactEstimateData.reserve(numTries);
     for(i=0; i<numTries; i++) {
         //randomly select data for exact model fit ('numForEstimate' objects).
         memset(notChosen,'1',numDataObjects*sizeof(short));
         curSubSetIndexes = new int[numForEstimate];
 
-        exactEstimateData.clear();
+        std::vector<const T *> subSet;
 
         maxIndex = numDataObjects-1; 
         for(l=0; l<(int)numForEstimate; l++) {
@@ -235,7 +238,7 @@ std::vector<const T *> Ransac::compute(S &parameters,
                     j++;
             }
             k--;
-            exactEstimateData.push_back(&(data[k]));
+            subSet.push_back(&(data[k]));
             notChosen[k] = 0;
             maxIndex--;
         }
@@ -252,44 +255,7 @@ std::vector<const T *> Ransac::compute(S &parameters,
         std::pair< std::set<int *, SubSetIndexComparator >::iterator, bool > res = chosenSubSets.insert(curSubSetIndexes);
 
         if(res.second == true) { //first time we chose this sub set
-		                 //use the selected data for an exact model parameter fit
-            if (!paramEstimator.estimate(exactEstimateData,exactEstimateParameters))
-                //selected data is a singular configuration (e.g. three colinear points for 
-                //a circle fit)
-                continue;
-            //see how many agree on this estimate
-            numVotesForCur = 0;
-            memset(curVotes,'\0',numDataObjects*sizeof(short));
-            for(j=0; j<(int)numDataObjects; j++) {
-                if(paramEstimator.agree(exactEstimateParameters, data[j])) {
-                    curVotes[j] = 1;
-                    numVotesForCur++;
-                }
-            }
-	    // debug output
-	    #ifdef DEBUG_RANSAC
-	    std::cerr << "RANSAC iter " << i << ": inliers: " << numVotesForCur << " parameters:";
-	    for (int jj=0; jj < exactEstimateParameters.size(); jj++)
-		std::cerr << " " << exactEstimateParameters[jj];
-	    std::cerr << std::endl;
-	    #endif
-
-            if(numVotesForCur > numVotesForBest) {
-                numVotesForBest = numVotesForCur;
-                memcpy(bestVotes,curVotes, numDataObjects*sizeof(short));
-		parameters = exactEstimateParameters;
-            }
-	    /*
-            //update the estimate of outliers and the number of iterations we need
-            outlierPercentage = 1 - (double)numVotesForCur/(double)numDataObjects;
-            if(outlierPercentage < maximalOutlierPercentage) {
-                maximalOutlierPercentage = outlierPercentage;
-                denominator = log(1- pow((double)(1.0-maximalOutlierPercentage), (double)(numForEstimate)));
-                numTries = (int)(numerator/denominator + 0.5);
-                //there are cases when the probablistic number of tries is greater than all possible sub-sets
-                numTries = numTries<allTries ? numTries : allTries;
-            }
-	    */
+            exactEstimateData.push_back(subSet);
         }
         else {  //this sub set already appeared, don't count this iteration
             delete [] curSubSetIndexes;
@@ -305,20 +271,57 @@ std::vector<const T *> Ransac::compute(S &parameters,
         it++;
     }
     chosenSubSets.clear();
+    delete [] notChosen;
+
+    // now evaluate all hypotheses
+    const int numHypotheses = exactEstimateData.size();
+    std::vector<S> exactEstimateParameters(numHypotheses);
+    std::vector<int> numVotes(numHypotheses, 0);
+#pragma omp parallel for schedule(dynamic) if(parallel)
+    for(int h=0; h<numHypotheses; h++) {
+        //use the selected data for an exact model parameter fit
+        if (!paramEstimator.estimate(exactEstimateData[h],exactEstimateParameters[h]))
+            //selected data is a singular configuration (e.g. three colinear points for 
+            //a circle fit)
+            continue;
+        //see how many agree on this estimate
+        int numVotesForCur = 0;
+        for(unsigned int n=0; n<numDataObjects; n++) {
+            if(paramEstimator.agree(exactEstimateParameters[h], data[n])) {
+                numVotesForCur++;
+            }
+        }
+        numVotes[h] = numVotesForCur;
+    }
+
+    // the first hypothesis with the most votes wins
+    int bestHypothesis = -1;
+    int numVotesForBest = 0; //initalize with 0 so that the first computation which gives any type of fit will be set to best
+    for(int h=0; h<numHypotheses; h++) {
+	// debug output
+	#ifdef DEBUG_RANSAC
+	std::cerr << "RANSAC iter " << h << ": inliers: " << numVotes[h] << " parameters:";
+	for (int jj=0; jj < exactEstimateParameters[h].size(); jj++)
+	    std::cerr << " " << exactEstimateParameters[h][jj];
+	std::cerr << std::endl;
+	#endif
+        if(numVotes[h] > numVotesForBest) {
+            numVotesForBest = numVotes[h];
+            bestHypothesis = h;
+        }
+    }
 
     //compute the least squares estimate using the largest sub set
     if(numVotesForBest > 0) {
+        parameters = exactEstimateParameters[bestHypothesis];
         for(j=0; j<(int)numDataObjects; j++) {
-            if(bestVotes[j]) {
+            if(paramEstimator.agree(parameters, data[j])) {
                 leastSquaresEstimateData.push_back(&(data[j]));
 		inliers.push_back(j);
 	    }
         }
         paramEstimator.leastSquaresEstimate(leastSquaresEstimateData,parameters);
     }
-    delete [] bestVotes;
-    delete [] curVotes;
-    delete [] notChosen;
 
     return leastSquaresEstimateData;
 }
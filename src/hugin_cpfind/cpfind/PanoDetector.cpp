@@ -107,7 +107,8 @@ PanoDetector::PanoDetector() :
     _matchingStrategy(ALLPAIRS), _linearMatchLen(1),
     _test(false), _cores(0), _downscale(true), _cache(false), _cleanup(false),
     _celeste(false), _celesteThreshold(0.5), _celesteRadius(20), 
-    _keypath(""), _outputFile("default.pto"), _outputGiven(false), svmModel(NULL)
+    _keypath(""), _outputFile("default.pto"), _outputGiven(false),
+    _panoramaGiven(false), _keypointStore(NULL), svmModel(NULL)
 {
     _panoramaInfo = new HuginBase::Panorama();
 }
@@ -357,6 +358,26 @@ private:
     PanoDetector::ImgData&		_imgData;
 };
 
+// definition of a runnable class for keypoints kept in memory
+class StoredKeypointsRunnable : public Runnable
+{
+public:
+    StoredKeypointsRunnable(PanoDetector::ImgData& iImageData, const PanoDetector& iPanoDetector) :
+        _panoDetector(iPanoDetector), _imgData(iImageData) {};
+
+    virtual void run()
+    {
+        if (PanoDetector::LoadStoredKeypoints(_imgData, _panoDetector))
+        {
+            PanoDetector::BuildKDTreesInImage(_imgData, _panoDetector);
+        };
+    }
+
+private:
+    const PanoDetector&			_panoDetector;
+    PanoDetector::ImgData&		_imgData;
+};
+
 // definition of a runnable class for MatchData
 class MatchDataRunnable : public Runnable
 {
@@ -422,7 +443,7 @@ void RunQueue(std::vector<Runnable*>& queue)
     };
 };
 
-void PanoDetector::run()
+bool PanoDetector::run()
 {
     // init the random time generator
     srandom((unsigned int)time(NULL));
@@ -430,7 +451,7 @@ void PanoDetector::run()
     // Load the input project file
     if(!loadProject())
     {
-        return;
+        return false;
     };
     if(_writeAllKeyPoints)
     {
@@ -443,7 +464,7 @@ void PanoDetector::run()
     if(_cleanup)
     {
         CleanupKeyfiles();
-        return;
+        return true;
     };
 
     //checking, if memory allows running desired number of threads
@@ -451,7 +472,7 @@ void PanoDetector::run()
     bool withRemap=false;
     for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
     {
-        if(!aB->second._hasakeyfile)
+        if(!aB->second._hasakeyfile && !aB->second._hasStoredKeypoints)
         {
             maxImageSize=std::max<unsigned long>(aB->second._detectWidth*aB->second._detectHeight,maxImageSize);
             if(aB->second.NeedsRemapping())
@@ -545,7 +566,11 @@ void PanoDetector::run()
             }
             for (HuginBase::UIntSet::const_iterator it = imagesToAnalyse.begin(); it != imagesToAnalyse.end(); ++it)
             {
-                if (_filesData[*it]._hasakeyfile)
+                if (_filesData[*it]._hasStoredKeypoints)
+                {
+                    queue.push_back(new StoredKeypointsRunnable(_filesData[*it], *this));
+                }
+                else if (_filesData[*it]._hasakeyfile)
                 {
                     queue.push_back(new LoadKeypointsDataRunnable(_filesData[*it], *this));
                 }
@@ -559,7 +584,11 @@ void PanoDetector::run()
         {
             for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
             {
-                if (aB->second._hasakeyfile)
+                if (aB->second._hasStoredKeypoints)
+                {
+                    queue.push_back(new StoredKeypointsRunnable(aB->second, *this));
+                }
+                else if (aB->second._hasakeyfile)
                 {
                     queue.push_back(new LoadKeypointsDataRunnable(aB->second, *this));
                 }
@@ -581,7 +610,7 @@ void PanoDetector::run()
     if (!checkLoadSuccess())
     {
         TRACE_INFO("One or more images failed to load. Exiting.");
-        return;
+        return false;
     }
 
     if(_cache)
@@ -597,6 +626,20 @@ void PanoDetector::run()
         };
     };
 
+    if (_keypointStore != NULL)
+    {
+        // keep keypoints in memory for the next run, skip images which were not analysed
+        for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
+        {
+            if (!aB->second._hasStoredKeypoints && !aB->second._kp.empty())
+            {
+                StoredKeypoints& stored = (*_keypointStore)[aB->second._name];
+                stored._kp = aB->second._kp;
+                stored._descLength = aB->second._descLength;
+            };
+        };
+    };
+
     // Detect matches if writeKeyPoints wasn't set
     if(_keyPointsIdx.empty())
     {
@@ -608,14 +651,14 @@ void PanoDetector::run()
                     std::vector<HuginBase::UIntSet> imgPairs(_panoramaInfo->getNrOfImages());
                     if(!match(imgPairs))
                     {
-                        return;
+                        return false;
                     };
                 };
                 break;
             case MULTIROW:
                 if(!matchMultiRow())
                 {
-                    return;
+                    return false;
                 };
                 break;
             case PREALIGNED:
@@ -640,7 +683,7 @@ void PanoDetector::run()
                     //and the final matching step
                     if(!matchPrealigned(_panoramaInfo, connectedImages, imgMap))
                     {
-                        return;
+                        return false;
                     };
                 }
                 break;
@@ -666,11 +709,20 @@ void PanoDetector::run()
     }
     else
     {
-        /// Write output project
-        TRACE_INFO(std::endl<< "--- Write Project output ---" << std::endl);
-        writeOutput();
-        TRACE_INFO("Written output to " << _outputFile << std::endl << std::endl);
+        if (_panoramaGiven)
+        {
+            // the caller takes the control points from the panorama
+            _panoramaInfo->removeDuplicateCtrlPoints();
+        }
+        else
+        {
+            /// Write output project
+            TRACE_INFO(std::endl<< "--- Write Project output ---" << std::endl);
+            writeOutput();
+            TRACE_INFO("Written output to " << _outputFile << std::endl << std::endl);
+        };
     };
+    return true;
 }
 
 bool PanoDetector::match(std::vector<HuginBase::UIntSet> &checkedPairs)
@@ -736,36 +788,49 @@ bool PanoDetector::match(std::vector<HuginBase::UIntSet> &checkedPairs)
     return true;
 };
 
+void PanoDetector::setPanorama(const HuginBase::Panorama& pano)
+{
+    *_panoramaInfo = pano.duplicate();
+    _panoramaGiven = true;
+}
+
 bool PanoDetector::loadProject()
 {
-    std::ifstream ptoFile(_inputFile.c_str());
-    if (ptoFile.bad())
+    if (_panoramaGiven)
     {
-        std::cerr << "ERROR: could not open file: '" << _inputFile << "'!" << std::endl;
-        return false;
+        _prefix = _panoramaInfo->getFilePrefix();
     }
-    _prefix=hugin_utils::getPathPrefix(_inputFile);
-    if(_prefix.empty())
+    else
     {
-        // Get the current working directory:
-        char* buffer;
+        std::ifstream ptoFile(_inputFile.c_str());
+        if (ptoFile.bad())
+        {
+            std::cerr << "ERROR: could not open file: '" << _inputFile << "'!" << std::endl;
+            return false;
+        }
+        _prefix=hugin_utils::getPathPrefix(_inputFile);
+        if(_prefix.empty())
+        {
+            // Get the current working directory:
+            char* buffer;
 #ifdef _WIN32
 #define getcwd _getcwd
 #endif
-        if((buffer=getcwd(NULL,0))!=NULL)
+            if((buffer=getcwd(NULL,0))!=NULL)
+            {
+                _prefix.append(buffer);
+                free(buffer);
+                _prefix=includeTrailingPathSep(_prefix);
+            }
+        };
+        _panoramaInfo->setFilePrefix(_prefix);
+        AppBase::DocumentData::ReadWriteError err = _panoramaInfo->readData(ptoFile);
+        if (err != AppBase::DocumentData::SUCCESSFUL)
         {
-            _prefix.append(buffer);
-            free(buffer);
-            _prefix=includeTrailingPathSep(_prefix);
+            std::cerr << "ERROR: couldn't parse panos tool script: '" << _inputFile << "'!" << std::endl;
+            return false;
         }
     };
-    _panoramaInfo->setFilePrefix(_prefix);
-    AppBase::DocumentData::ReadWriteError err = _panoramaInfo->readData(ptoFile);
-    if (err != AppBase::DocumentData::SUCCESSFUL)
-    {
-        std::cerr << "ERROR: couldn't parse panos tool script: '" << _inputFile << "'!" << std::endl;
-        return false;
-    }
 
     // Create a copy of panoramaInfo that will be used to define
     // image options
@@ -858,8 +923,16 @@ bool PanoDetector::loadProject()
         // Specify if the image has an associated keypoint file
 
         aImgData._keyfilename = getKeyfilenameFor(_keypath,aImgData._name);
-        aImgData._hasakeyfile = hugin_utils::FileExists(aImgData._keyfilename);
-        if(aImgData._hasakeyfile)
+        if (_keypointStore != NULL && _keypointStore->find(aImgData._name) != _keypointStore->end())
+        {
+            // keypoints are already in memory
+            aImgData._hasStoredKeypoints = true;
+        }
+        else
+        {
+            aImgData._hasakeyfile = hugin_utils::FileExists(aImgData._keyfilename);
+        };
+        if(aImgData._hasakeyfile || aImgData._hasStoredKeypoints)
         {
             imgWithKeyfile++;
         };
@@ -62,6 +62,15 @@ public:
         PREALIGNED
     };
 
+    /** keypoints of one image, which are kept in memory between several runs */
+    struct StoredKeypoints
+    {
+        lfeat::KeyPointVect_t _kp;
+        int _descLength;
+    };
+    /** keypoints of several images, indexed by the image filename */
+    typedef std::map<std::string, StoredKeypoints> KeypointStore;
+
     PanoDetector();
     ~PanoDetector();
 
@@ -69,7 +78,8 @@ public:
     void printDetails();
     void printFilenames();
     void printHelp();
-    void run();
+    /** runs the detection, returns false if the project or the images could not be loaded */
+    bool run();
     bool match(std::vector<HuginBase::UIntSet> &checkedPairs);
     bool matchMultiRow();
     /** does only matches image pairs which overlaps and don't have control points
@@ -309,6 +319,15 @@ public:
     {
         _cores = iCores;
     }
+    /** uses the given panorama instead of loading the input file, the found control points
+        are added to the panorama returned by getPanoramaInfo(), no output file is written */
+    void setPanorama(const HuginBase::Panorama& pano);
+    /** the keypoints of images found in the store are used instead of analysing the images,
+        the keypoints of all other images are added to the store */
+    inline void setKeypointStore(KeypointStore* keypointStore)
+    {
+        _keypointStore = keypointStore;
+    }
 
     // predeclaration
     struct ImgData;
@@ -365,6 +384,8 @@ private:
 
     // Store panorama information
     HuginBase::Panorama*			_panoramaInfo;
+    bool _panoramaGiven;
+    KeypointStore* _keypointStore;
     HuginBase::Panorama				_panoramaInfoCopy;
 
     /** search for image layer and image stacks for the multirow matching step */
@@ -401,6 +422,7 @@ public:
 
         bool 					_hasakeyfile;
         std::string _keyfilename;
+        bool _hasStoredKeypoints;
 
         lfeat::KeyPointVect_t	_kp;
         int					_descLength;
@@ -418,6 +440,7 @@ public:
             _detectHeight = 0;
             m_sizeMode = FULLSIZE;
             _hasakeyfile = false;
+            _hasStoredKeypoints = false;
             _descLength = 0;
             _flann_index = NULL;
         }
@@ -456,6 +479,7 @@ public:
 
     // actions
     static bool				LoadKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
+    static bool				LoadStoredKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
 
     static bool				AnalyzeImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
     static bool				FindKeyPointsInImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
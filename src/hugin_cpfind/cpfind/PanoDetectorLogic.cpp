@@ -118,26 +118,49 @@ bool PanoDetector::LoadKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDe
     return true;
 }
 
+bool PanoDetector::LoadStoredKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDetector)
+{
+    TRACE_IMG("Using stored keypoints...");
+
+    KeypointStore::const_iterator it = iPanoDetector._keypointStore->find(ioImgInfo._name);
+    ioImgInfo._loadFail = (it == iPanoDetector._keypointStore->end());
+    if (!ioImgInfo._loadFail)
+    {
+        ioImgInfo._kp = it->second._kp;
+        ioImgInfo._descLength = it->second._descLength;
+    };
+    return !ioImgInfo._loadFail;
+}
+
 /** apply the mask and the crop of the given SrcImg to given mask image */ 
 template <class SrcImageIterator, class SrcAccessor>
 void applyMaskAndCrop(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> img, const HuginBase::SrcPanoImage& SrcImg)
 {
     vigra::Diff2D imgSize = img.second - img.first;
 
-    // create dest y iterator
-    SrcImageIterator yd(img.first);
-    // loop over the image and transform
-    for(int y=0; y < imgSize.y; ++y, ++yd.y)
+    // loop over the image rows, only the pixels outside of the inside intervals are set to 0
+#pragma omp parallel for schedule(dynamic)
+    for(int y=0; y < imgSize.y; ++y)
     {
+        HuginBase::RowIntervals intervals;
+        SrcImg.getInsideIntervals(y, imgSize.x, intervals);
         // create x iterators
-        SrcImageIterator xd(yd);
-        for(int x=0; x < imgSize.x; ++x, ++xd.x)
+        SrcImageIterator xd(img.first);
+        xd.y += y;
+        int x = 0;
+        for (size_t i = 0; i <= intervals.size(); ++i)
         {
-            if(!SrcImg.isInside(vigra::Point2D(x,y)))
+            const int end = (i < intervals.size()) ? intervals[i].first : imgSize.x;
+            for (; x < end; ++x, ++xd.x)
             {
-                *xd=0;
+                *xd = 0;
             };
-        }
+            if (i < intervals.size())
+            {
+                xd.x += intervals[i].second - x;
+                x = intervals[i].second;
+            };
+        };
     }
 }
 
@@ -977,6 +1000,22 @@ bool PanoDetector::RansacMatchesInPair(MatchData& ioMatchData, const PanoDetecto
     }
 }
 
+/** runs the RANSAC on the control points between both images with the panorama model */
+static std::vector<int> FindInliersInPair(const HuginBase::Panorama& pano, const HuginBase::UIntSet& imgs,
+    const HuginBase::CPVector& controlPoints, int pano_local_i1, int pano_local_i2,
+    HuginBase::RANSACOptimizer::Mode rmode, double distanceThreshold)
+{
+    HuginBase::PanoramaData* panoSubset = pano.getNewSubset(imgs);
+    panoSubset->setCtrlPoints(controlPoints);
+    // the RANSAC uses the distance in the image for determination of valid parameter
+    // so make the threshold depending on the image size, use the given pixel distance relative to a 12 MPix image with 4000x3000 pixel
+    const double threshold = distanceThreshold / 5000.0 * hypot(panoSubset->getImage(pano_local_i2).getWidth(), panoSubset->getImage(pano_local_i2).getHeight());
+    std::vector<int> inliers = HuginBase::RANSACOptimizer::findInliers(*panoSubset, pano_local_i1, pano_local_i2,
+        threshold, rmode);
+    delete panoSubset;
+    return inliers;
+}
+
 // new code with fisheye aware ransac
 bool PanoDetector::RansacMatchesInPairCam(MatchData& ioMatchData, const PanoDetector& iPanoDetector)
 {
@@ -1010,40 +1049,41 @@ bool PanoDetector::RansacMatchesInPairCam(MatchData& ioMatchData, const PanoDete
         pano_local_i2 = 0;
     }
 
-    // perform ransac matching.
-    // ARGH the panotools optimizer uses global variables is not reentrant
-    std::vector<int> inliers;
-#pragma omp critical
+    // create control point vector
+    HuginBase::CPVector controlPoints(ioMatchData._matches.size());
+    for (size_t i = 0; i < ioMatchData._matches.size(); ++i)
     {
-        HuginBase::PanoramaData* panoSubset = iPanoDetector._panoramaInfo->getNewSubset(imgs);
-
-        // create control point vector
-        HuginBase::CPVector controlPoints(ioMatchData._matches.size());
-        for (size_t i = 0; i < ioMatchData._matches.size(); ++i)
-        {
-            lfeat::PointMatchPtr& aM=ioMatchData._matches[i];
-            controlPoints[i] = HuginBase::ControlPoint(pano_local_i1, aM->_img1_x, aM->_img1_y,
-                                            pano_local_i2, aM->_img2_x, aM->_img2_y);
-        }
-        panoSubset->setCtrlPoints(controlPoints);
-
+        lfeat::PointMatchPtr& aM=ioMatchData._matches[i];
+        controlPoints[i] = HuginBase::ControlPoint(pano_local_i1, aM->_img1_x, aM->_img1_y,
+                                        pano_local_i2, aM->_img2_x, aM->_img2_y);
+    }
 
-        PT_setProgressFcn(ptProgress);
-        PT_setInfoDlgFcn(ptinfoDlg);
+    HuginBase::RANSACOptimizer::Mode rmode = iPanoDetector._ransacMode;
+    if (rmode == HuginBase::RANSACOptimizer::AUTO)
+    {
+        rmode = HuginBase::RANSACOptimizer::RPY;
+    }
 
-        HuginBase::RANSACOptimizer::Mode rmode = iPanoDetector._ransacMode;
-        if (rmode == HuginBase::RANSACOptimizer::AUTO)
+    // perform ransac matching.
+    std::vector<int> inliers;
+    if (HuginBase::RANSACOptimizer::isReentrant(*iPanoDetector._panoramaInfo, pano_i1, pano_i2, rmode))
+    {
+        // the rotation is estimated in closed form, so the pairs can be processed in parallel
+        inliers = FindInliersInPair(*iPanoDetector._panoramaInfo, imgs, controlPoints, pano_local_i1, pano_local_i2,
+            rmode, iPanoDetector.getRansacDistanceThreshold());
+    }
+    else
+    {
+        // ARGH the panotools optimizer uses global variables is not reentrant
+#pragma omp critical
         {
-            rmode = HuginBase::RANSACOptimizer::RPY;
+            PT_setProgressFcn(ptProgress);
+            PT_setInfoDlgFcn(ptinfoDlg);
+            inliers = FindInliersInPair(*iPanoDetector._panoramaInfo, imgs, controlPoints, pano_local_i1, pano_local_i2,
+                rmode, iPanoDetector.getRansacDistanceThreshold());
+            PT_setProgressFcn(NULL);
+            PT_setInfoDlgFcn(NULL);
         }
-        // the RANSAC uses the distance in the image for determination of valid parameter
-        // so make the threshold depending on the image size, use the given pixel distance relative to a 12 MPix image with 4000x3000 pixel
-        const double threshold = iPanoDetector.getRansacDistanceThreshold() / 5000.0 * hypot(panoSubset->getImage(pano_local_i2).getWidth(), panoSubset->getImage(pano_local_i2).getHeight());
-        inliers = HuginBase::RANSACOptimizer::findInliers(*panoSubset, pano_local_i1, pano_local_i2,
-                  threshold, rmode);
-        PT_setProgressFcn(NULL);
-        PT_setInfoDlgFcn(NULL);
-        delete panoSubset;
     }
 
     TRACE_PAIR("Removed " << ioMatchData._matches.size() - inliers.size() << " matches. " << inliers.size() << " remaining.");
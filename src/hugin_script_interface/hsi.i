@@ -272,3 +272,397 @@ using namespace HuginBase;
 %include <algorithms/optimizer/PTOptimizer.h>
 %include <algorithms/optimizer/PhotometricOptimizer.h>
 %include <algorithms/point_sampler/PointSampler.h>
+
+// bulk access to control points, image variables and coordinate
+// transformations. Crossing the SWIG boundary for each single object
+// is slow, these functions read and write whole arrays at once.
+// The arrays are passed with the Python buffer protocol, so numpy
+// arrays (and array.array) are accessed in place without copying.
+// The GIL is released while the data are processed. The functions
+// without 'fill' in the name in the %pythoncode section below allocate
+// the numpy arrays and are more convenient to use.
+
+%{
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <hugin_utils/stl_utils.h>
+
+namespace hsi_bulk
+{
+
+/** RAII access to a C contiguous buffer of a Python object */
+class Buffer
+{
+public:
+    Buffer() : m_acquired(false) {};
+    ~Buffer()
+    {
+        if (m_acquired)
+        {
+            PyBuffer_Release(&m_view);
+        };
+    };
+    /** gets the buffer of obj, which must contain values of type T,
+     *  the number of values must be a multiple of columns
+     *  @return false and sets the Python exception on failure */
+    template <class T>
+    bool acquire(PyObject* obj, const bool writable, const Py_ssize_t columns, const char* name)
+    {
+        int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+        if (writable)
+        {
+            flags |= PyBUF_WRITABLE;
+        };
+        if (PyObject_GetBuffer(obj, &m_view, flags) != 0)
+        {
+            return false;
+        };
+        m_acquired = true;
+        if (m_view.itemsize != sizeof(T) || !checkFormat<T>(m_view.format))
+        {
+            PyErr_Format(PyExc_TypeError, "%s: wrong element type, expected %s", name, expectedType<T>());
+            return false;
+        };
+        if (length() % columns != 0)
+        {
+            PyErr_Format(PyExc_ValueError, "%s: array must have %d columns", name, static_cast<int>(columns));
+            return false;
+        };
+        return true;
+    };
+    /** number of values in the buffer */
+    Py_ssize_t length() const { return m_view.len / m_view.itemsize; };
+    template <class T>
+    T* data() const { return static_cast<T*>(m_view.buf); };
+private:
+    template <class T>
+    static bool checkFormat(const char* format);
+    template <class T>
+    static const char* expectedType();
+
+    Py_buffer m_view;
+    bool m_acquired;
+};
+
+template <>
+bool Buffer::checkFormat<double>(const char* format)
+{
+    // native or explicit little endian double, as used by numpy.float64
+    return format == NULL || strcmp(format, "d") == 0 || strcmp(format, "@d") == 0 || strcmp(format, "=d") == 0 || strcmp(format, "<d") == 0;
+}
+
+template <>
+const char* Buffer::expectedType<double>()
+{
+    return "float64";
+}
+
+template <>
+bool Buffer::checkFormat<unsigned char>(const char* format)
+{
+    return format == NULL || strcmp(format, "B") == 0 || strcmp(format, "?") == 0 || strcmp(format, "b") == 0;
+}
+
+template <>
+const char* Buffer::expectedType<unsigned char>()
+{
+    return "bool or uint8";
+}
+
+/** converts a sequence of Python strings into a vector of variable names,
+ *  all names must be known image variables
+ *  @return false and sets the Python exception on failure */
+bool GetVariableNames(PyObject* names, std::vector<std::string>& varNames)
+{
+    PyObject* seq = PySequence_Fast(names, "variable names must be a sequence of strings");
+    if (seq == NULL)
+    {
+        return false;
+    };
+    const HuginBase::VariableMap knownVars = HuginBase::SrcPanoImage().getVariableMap();
+    const Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < n; ++i)
+    {
+        PyObject* item = PySequence_Fast_GET_ITEM(seq, i);
+#if PY_MAJOR_VERSION>=3
+        const char* name = PyUnicode_Check(item) ? PyUnicode_AsUTF8(item) : NULL;
+#else
+        const char* name = PyString_Check(item) ? PyString_AsString(item) : NULL;
+#endif
+        if (name == NULL)
+        {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_TypeError, "variable names must be a sequence of strings");
+            return false;
+        };
+        if (knownVars.find(name) == knownVars.end())
+        {
+            Py_DECREF(seq);
+            PyErr_Format(PyExc_ValueError, "unknown image variable '%s'", name);
+            return false;
+        };
+        varNames.push_back(name);
+    };
+    Py_DECREF(seq);
+    return true;
+}
+
+/** returns true if value is a finite whole number, NaN and infinity
+ *  must be rejected before the value is cast to an integer type */
+inline bool IsIntegral(const double value)
+{
+    return std::isfinite(value) && std::floor(value) == value;
+}
+
+} // namespace hsi_bulk
+%}
+
+%inline %{
+
+/** writes all control points of the panorama into out, which needs
+ *  getNrOfCtrlPoints() rows of 8 doubles:
+ *  image1Nr, x1, y1, image2Nr, x2, y2, mode, error */
+PyObject* fillCtrlPointArray(const HuginBase::Panorama& pano, PyObject* out)
+{
+    hsi_bulk::Buffer buffer;
+    if (!buffer.acquire<double>(out, true, 8, "fillCtrlPointArray"))
+    {
+        return NULL;
+    };
+    const HuginBase::CPVector& cps = pano.getCtrlPoints();
+    if (buffer.length() != static_cast<Py_ssize_t>(8 * cps.size()))
+    {
+        PyErr_SetString(PyExc_ValueError, "fillCtrlPointArray: array must have one row per control point");
+        return NULL;
+    };
+    double* data = buffer.data<double>();
+    Py_BEGIN_ALLOW_THREADS
+    for (size_t i = 0; i < cps.size(); ++i, data += 8)
+    {
+        const HuginBase::ControlPoint& cp = cps[i];
+        data[0] = cp.image1Nr;
+        data[1] = cp.x1;
+        data[2] = cp.y1;
+        data[3] = cp.image2Nr;
+        data[4] = cp.x2;
+        data[5] = cp.y2;
+        data[6] = cp.mode;
+        data[7] = cp.error;
+    };
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+/** replaces all control points of the panorama with the control points in cps,
+ *  which has the layout of fillCtrlPointArray, the error column is ignored */
+PyObject* setCtrlPointArray(HuginBase::Panorama& pano, PyObject* cps)
+{
+    hsi_bulk::Buffer buffer;
+    if (!buffer.acquire<double>(cps, false, 8, "setCtrlPointArray"))
+    {
+        return NULL;
+    };
+    const double* data = buffer.data<double>();
+    const size_t nrCPs = buffer.length() / 8;
+    const double nrImages = pano.getNrOfImages();
+    PyObject* errorType = NULL;
+    const char* errorMsg = NULL;
+    HuginBase::CPVector newCPs;
+    Py_BEGIN_ALLOW_THREADS
+    newCPs.reserve(nrCPs);
+    for (size_t i = 0; i < nrCPs; ++i, data += 8)
+    {
+        if (!hsi_bulk::IsIntegral(data[0]) || !hsi_bulk::IsIntegral(data[3]) || !hsi_bulk::IsIntegral(data[6]))
+        {
+            errorType = PyExc_ValueError;
+            errorMsg = "setCtrlPointArray: image numbers and mode must be finite whole numbers";
+            break;
+        };
+        if (data[0] < 0 || data[0] >= nrImages || data[3] < 0 || data[3] >= nrImages)
+        {
+            errorType = PyExc_IndexError;
+            errorMsg = "setCtrlPointArray: image number out of range";
+            break;
+        };
+        if (data[6] < 0 || data[6] > INT_MAX)
+        {
+            errorType = PyExc_ValueError;
+            errorMsg = "setCtrlPointArray: invalid control point mode";
+            break;
+        };
+        newCPs.push_back(HuginBase::ControlPoint(static_cast<unsigned int>(data[0]), data[1], data[2],
+            static_cast<unsigned int>(data[3]), data[4], data[5], static_cast<int>(data[6])));
+    };
+    Py_END_ALLOW_THREADS
+    if (errorType != NULL)
+    {
+        PyErr_SetString(errorType, errorMsg);
+        return NULL;
+    };
+    pano.setCtrlPoints(newCPs);
+    Py_RETURN_NONE;
+}
+
+/** writes the given image variables of all images into out, which needs
+ *  getNrOfImages() rows with one column for each name */
+PyObject* fillImageVariableArray(const HuginBase::Panorama& pano, PyObject* names, PyObject* out)
+{
+    std::vector<std::string> varNames;
+    if (!hsi_bulk::GetVariableNames(names, varNames))
+    {
+        return NULL;
+    };
+    hsi_bulk::Buffer buffer;
+    if (!buffer.acquire<double>(out, true, std::max<size_t>(varNames.size(), 1), "fillImageVariableArray"))
+    {
+        return NULL;
+    };
+    const size_t nrImages = pano.getNrOfImages();
+    if (buffer.length() != static_cast<Py_ssize_t>(varNames.size() * nrImages))
+    {
+        PyErr_SetString(PyExc_ValueError, "fillImageVariableArray: array must have one row per image");
+        return NULL;
+    };
+    double* data = buffer.data<double>();
+    Py_BEGIN_ALLOW_THREADS
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        const HuginBase::SrcPanoImage& img = pano.getImage(i);
+        for (size_t j = 0; j < varNames.size(); ++j, ++data)
+        {
+            *data = img.getVar(varNames[j]);
+        };
+    };
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+/** sets the given image variables of all images from values, which has
+ *  the layout of fillImageVariableArray. Linked variables are updated
+ *  in the order of the images, so the last image of a link group wins */
+PyObject* setImageVariableArray(HuginBase::Panorama& pano, PyObject* names, PyObject* values)
+{
+    std::vector<std::string> varNames;
+    if (!hsi_bulk::GetVariableNames(names, varNames))
+    {
+        return NULL;
+    };
+    hsi_bulk::Buffer buffer;
+    if (!buffer.acquire<double>(values, false, std::max<size_t>(varNames.size(), 1), "setImageVariableArray"))
+    {
+        return NULL;
+    };
+    const size_t nrImages = pano.getNrOfImages();
+    if (buffer.length() != static_cast<Py_ssize_t>(varNames.size() * nrImages))
+    {
+        PyErr_SetString(PyExc_ValueError, "setImageVariableArray: array must have one row per image");
+        return NULL;
+    };
+    const double* data = buffer.data<double>();
+    HuginBase::VariableMapVector vars(nrImages);
+    Py_BEGIN_ALLOW_THREADS
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        vars[i] = pano.getImageVariables(i);
+        for (size_t j = 0; j < varNames.size(); ++j, ++data)
+        {
+            HuginBase::map_get(vars[i], varNames[j]).setValue(*data);
+        };
+    };
+    Py_END_ALLOW_THREADS
+    pano.updateVariables(vars);
+    Py_RETURN_NONE;
+}
+
+/** transforms the coordinates in coords (rows of x, y) with transform
+ *  and writes the result into out, which has the same size.
+ *  If valid is not None, it receives for each point the result of
+ *  transformImgCoord as bool or uint8.
+ *  @return number of successfully transformed points */
+PyObject* fillTransformedCoords(const HuginBase::PTools::Transform& transform, PyObject* coords, PyObject* out, PyObject* valid)
+{
+    hsi_bulk::Buffer inBuffer;
+    if (!inBuffer.acquire<double>(coords, false, 2, "fillTransformedCoords"))
+    {
+        return NULL;
+    };
+    hsi_bulk::Buffer outBuffer;
+    if (!outBuffer.acquire<double>(out, true, 2, "fillTransformedCoords"))
+    {
+        return NULL;
+    };
+    const Py_ssize_t nrPoints = inBuffer.length() / 2;
+    if (outBuffer.length() != inBuffer.length())
+    {
+        PyErr_SetString(PyExc_ValueError, "fillTransformedCoords: output array must have the size of the input array");
+        return NULL;
+    };
+    hsi_bulk::Buffer validBuffer;
+    unsigned char* validData = NULL;
+    if (valid != Py_None)
+    {
+        if (!validBuffer.acquire<unsigned char>(valid, true, 1, "fillTransformedCoords"))
+        {
+            return NULL;
+        };
+        if (validBuffer.length() != nrPoints)
+        {
+            PyErr_SetString(PyExc_ValueError, "fillTransformedCoords: valid array must have one entry per point");
+            return NULL;
+        };
+        validData = validBuffer.data<unsigned char>();
+    };
+    const double* in = inBuffer.data<double>();
+    double* dest = outBuffer.data<double>();
+    long nrValid = 0;
+    Py_BEGIN_ALLOW_THREADS
+#pragma omp parallel for reduction(+:nrValid)
+    for (Py_ssize_t i = 0; i < nrPoints; ++i)
+    {
+        const bool ok = transform.transformImgCoord(dest[2 * i], dest[2 * i + 1], in[2 * i], in[2 * i + 1]);
+        if (ok)
+        {
+            ++nrValid;
+        };
+        if (validData != NULL)
+        {
+            validData[i] = ok ? 1 : 0;
+        };
+    };
+    Py_END_ALLOW_THREADS
+    return PyLong_FromLong(nrValid);
+}
+
+%}
+
+%pythoncode %{
+
+def getCtrlPointArray(pano):
+    """returns all control points of pano as numpy array with one
+    row per control point: image1Nr, x1, y1, image2Nr, x2, y2, mode, error"""
+    import numpy
+    cps = numpy.empty((pano.getNrOfCtrlPoints(), 8))
+    fillCtrlPointArray(pano, cps)
+    return cps
+
+def getImageVariableArray(pano, names):
+    """returns the image variables with the given names (e.g. ['y', 'p', 'r', 'v'])
+    of all images as numpy array with one row per image"""
+    import numpy
+    values = numpy.empty((pano.getNrOfImages(), len(names)))
+    fillImageVariableArray(pano, names, values)
+    return values
+
+def transformImgCoords(transform, coords):
+    """transforms an array of coordinates with shape (n, 2) with the
+    PTools.Transform transform, returns the transformed coordinates and
+    a boolean array which indicates the successfully transformed points"""
+    import numpy
+    coords = numpy.ascontiguousarray(coords, dtype=numpy.float64)
+    out = numpy.empty_like(coords)
+    valid = numpy.empty(coords.shape[:-1], dtype=bool)
+    fillTransformedCoords(transform, coords, out, valid)
+    return out, valid
+
+%}
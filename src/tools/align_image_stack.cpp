@@ -49,8 +49,13 @@
 
 #include <getopt.h>
 
-#include <hugin_utils/openmp_lock.h>
 #include <tiff.h>
+#include <map>
+#include <memory>
+#include <exception>
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
 
 #ifdef __APPLE__
 #include <hugin_config.h>
@@ -109,13 +114,17 @@ static void usage(const char* name)
          << "                     consecutive." << std::endl
          << "                     This implies also the --use-given-order option" << std::endl
          << "  --dont-remap-ref   Don't output the remapped reference image" << std::endl
+         << "  --stream  Align a sequence of frames (e.g. video or timelapse)" << std::endl
+         << "             incrementally to the first frame. Each frame starts" << std::endl
+         << "             with the solution of the previous frame and its" << std::endl
+         << "             parameters are printed as soon as it is aligned." << std::endl
+         << "             This implies also the --align-to-first option." << std::endl
          << "  --gpu     Use GPU for remapping" << std::endl
          << "  -h        Display help (this text)" << std::endl
          << std::endl;
 }
 
 typedef std::multimap<double, vigra::Diff2D> MapPoints;
-static hugin_omp::Lock lock;
 
 namespace detail
 {
@@ -140,11 +149,41 @@ namespace detail
             searchPos, searchWidth);
     };
 }
+/** predicts the position of a point of the reference image (image 0) in image 1,
+ *  using the current parameters of both images */
+class PositionPredictor
+{
+public:
+    explicit PositionPredictor(const HuginBase::Panorama& pano)
+    {
+        m_refToPano.createInvTransform(pano.getImage(0), pano.getOptions());
+        m_panoToImg.createTransform(pano.getImage(1), pano.getOptions());
+    };
+    /** returns the predicted position, both points are in the coordinates of the
+     *  pyramid level with the given scale factor */
+    vigra::Diff2D operator()(const vigra::Diff2D& p, const double scaleFactor) const
+    {
+        double xPano, yPano, x, y;
+        if (m_refToPano.transformImgCoord(xPano, yPano, p.x * scaleFactor, p.y * scaleFactor) &&
+            m_panoToImg.transformImgCoord(x, y, xPano, yPano))
+        {
+            return vigra::Diff2D(hugin_utils::roundi(x / scaleFactor), hugin_utils::roundi(y / scaleFactor));
+        };
+        return p;
+    };
+private:
+    HuginBase::PTools::Transform m_refToPano;
+    HuginBase::PTools::Transform m_panoToImg;
+};
+
+/** fine tunes the given interest points and adds all good matches to cps
+ *  the function does not access any shared data, so it can be called from several threads */
 template <class ImageType>
-void FineTuneInterestPoints(HuginBase::Panorama& pano,
+void FineTuneInterestPoints(HuginBase::CPVector& cps,
                             int img1, const ImageType& leftImg, const ImageType& leftImgOrig,
                             int img2, const ImageType& rightImg, const ImageType& rightImgOrig,
-                            const MapPoints& points, unsigned nPoints, int pyrLevel, int templWidth, int sWidth, double scaleFactor, double corrThresh, bool stereo)
+                            const MapPoints& points, unsigned nPoints, int pyrLevel, int templWidth, int sWidth, double scaleFactor, double corrThresh, bool stereo,
+                            const PositionPredictor* predictor = nullptr)
 {
     typedef typename ImageType::value_type ImageValueType;
     typedef typename vigra::NumericTraits<ImageValueType>::isScalar is_scalar;
@@ -159,8 +198,10 @@ void FineTuneInterestPoints(HuginBase::Panorama& pano,
             break;
         }
 
+        // search around the predicted position, if known
+        const vigra::Diff2D searchPos = predictor ? (*predictor)(it->second, scaleFactor) : it->second;
         vigra_ext::CorrelationResult res = detail::FineTunePoint(leftImg, it->second, templWidth,
-            rightImg, it->second, sWidth, is_scalar());
+            rightImg, searchPos, sWidth, is_scalar());
         if (g_verbose > 2)
         {
             std::ostringstream buf;
@@ -203,10 +244,7 @@ void FineTuneInterestPoints(HuginBase::Panorama& pano,
                        img2, res.maxpos.x,
                        res.maxpos.y,
                        stereo ? HuginBase::ControlPoint::Y : HuginBase::ControlPoint::X_Y);
-        {
-            hugin_omp::ScopedLock sl(lock);
-            pano.addCtrlPoint(p);
-        };
+        cps.push_back(p);
     }
     if (g_verbose > 0)
     {
@@ -234,27 +272,14 @@ namespace detail
     };
 };
 
+/** find interest points in each cell of a grid x grid partition of the image */
 template <class ImageType>
-void createCtrlPoints(HuginBase::Panorama& pano, int img1, const ImageType& leftImg, const ImageType& leftImgOrig, int img2, const ImageType& rightImg, const ImageType& rightImgOrig, int pyrLevel, double scale, unsigned nPoints, unsigned grid, double corrThresh = 0.9, bool stereo = false)
+std::vector<MapPoints> FindInterestPointsInGrid(const ImageType& image, double scale, unsigned nPoints, unsigned grid)
 {
     typedef typename ImageType::value_type ImageValueType;
     typedef typename vigra::NumericTraits<ImageValueType>::isScalar is_scalar;
 
-    //////////////////////////////////////////////////
-    // find interesting corners using harris corner detector
-    if (stereo)
-    {
-        // add one vertical control point to keep the images aligned vertically
-        HuginBase::ControlPoint p(img1, 0, 0, img2, 0, 0, HuginBase::ControlPoint::X);
-        pano.addCtrlPoint(p);
-    }
-
-    if (g_verbose > 0)
-    {
-        std::cout << "Trying to find " << nPoints << " corners... " << std::endl;
-    }
-
-    vigra::Size2D size(leftImg.width(), leftImg.height());
+    vigra::Size2D size(image.width(), image.height());
     std::vector<vigra::Rect2D> rects;
     for (unsigned party = 0; party < grid; party++)
     {
@@ -271,65 +296,38 @@ void createCtrlPoints(HuginBase::Panorama& pano, int img1, const ImageType& left
         };
     };
 
-    const double scaleFactor = 1 << pyrLevel;
-    const long templWidth = 20;
-    const long sWidth = 100;
-
+    std::vector<MapPoints> points(rects.size());
     #pragma omp parallel for schedule(dynamic)
     for (int i = 0; i < rects.size(); ++i)
     {
-        MapPoints points;
-        vigra::Rect2D rect(rects[i]);
-        detail::FindInterestPointsPartial(leftImg, rect, scale, 5 * nPoints, points, is_scalar());
-        FineTuneInterestPoints(pano, img1, leftImg, leftImgOrig, img2, rightImg, rightImgOrig, points, nPoints, pyrLevel, templWidth, sWidth, scaleFactor, corrThresh, stereo);
+        detail::FindInterestPointsPartial(image, rects[i], scale, 5 * nPoints, points[i], is_scalar());
     };
+    return points;
+};
 
-    if (stereo)
-    {
-        // add some additional control points around image edges
-        // this is useful for better results - images are more distorted around edges
-        // and also for stereoscopic window adjustment - it must be alligned according to
-        // the nearest object which crosses the edge and these control points helps to find it.
-        MapPoints up;
-        MapPoints down;
-        MapPoints left;
-        MapPoints right;
-        int xstep = leftImg.size().x / (nPoints + 1);
-        int ystep = leftImg.size().y / (nPoints + 1);
-        for (int k = 6; k >= 0; --k)
+/** returns additional points around image edges for stereo images (up, down, left, right)
+ *  this is useful for better results - images are more distorted around edges
+ *  and also for stereoscopic window adjustment - it must be alligned according to
+ *  the nearest object which crosses the edge and these control points helps to find it. */
+std::vector<MapPoints> GetStereoEdgePoints(const vigra::Size2D& size, unsigned nPoints)
+{
+    std::vector<MapPoints> points(4);
+    int xstep = size.x / (nPoints + 1);
+    int ystep = size.y / (nPoints + 1);
+    for (int k = 6; k >= 0; --k)
+    {
+        for (int j = 0; j < 2; ++j)
         {
-            for (int j = 0; j < 2; ++j)
+            for (unsigned int i = 0; i < nPoints; ++i)
             {
-                for (unsigned int i = 0; i < nPoints; ++i)
-                {
-                    up.insert(std::make_pair(0, vigra::Diff2D(j * xstep / 2 + i * xstep, 1 + k * 10)));
-                    down.insert(std::make_pair(0, vigra::Diff2D(j * xstep / 2 + i * xstep, leftImg.size().y - 2 - k * 10)));
-                    left.insert(std::make_pair(0, vigra::Diff2D(1 + k * 10, j * ystep / 2 + i * ystep)));
-                    right.insert(std::make_pair(0, vigra::Diff2D(leftImg.size().x - 2 - k * 10, j * ystep / 2 + i * ystep)));
-                };
+                points[0].insert(std::make_pair(0, vigra::Diff2D(j * xstep / 2 + i * xstep, 1 + k * 10)));
+                points[1].insert(std::make_pair(0, vigra::Diff2D(j * xstep / 2 + i * xstep, size.y - 2 - k * 10)));
+                points[2].insert(std::make_pair(0, vigra::Diff2D(1 + k * 10, j * ystep / 2 + i * ystep)));
+                points[3].insert(std::make_pair(0, vigra::Diff2D(size.x - 2 - k * 10, j * ystep / 2 + i * ystep)));
             };
         };
-        // execute parallel
-        #pragma omp parallel sections
-        {
-            #pragma omp section
-            {
-                FineTuneInterestPoints(pano, img1, leftImg, leftImgOrig, img2, rightImg, rightImgOrig, up, nPoints, pyrLevel, templWidth, sWidth, corrThresh, scaleFactor, stereo);
-            }
-            #pragma omp section
-            {
-                FineTuneInterestPoints(pano, img1, leftImg, leftImgOrig, img2, rightImg, rightImgOrig, down, nPoints, pyrLevel, templWidth, sWidth, corrThresh, scaleFactor, stereo);
-            }
-            #pragma omp section
-            {
-                FineTuneInterestPoints(pano, img1, leftImg, leftImgOrig, img2, rightImg, rightImgOrig, left, nPoints, pyrLevel, templWidth, sWidth, corrThresh, scaleFactor, stereo);
-            }
-            #pragma omp section
-            {
-                FineTuneInterestPoints(pano, img1, leftImg, leftImgOrig, img2, rightImg, rightImgOrig, right, nPoints, pyrLevel, templWidth, sWidth, corrThresh, scaleFactor, stereo);
-            }
-        }
-    }
+    };
+    return points;
 };
 
 void alignStereoWindow(HuginBase::Panorama& pano, bool pop_out)
@@ -482,6 +480,7 @@ struct Parameters
         sortImagesByEv = true;
         alignToFirst = false;
         dontRemapRef = false;
+        stream = false;
     }
 
     double cpErrorThreshold;
@@ -506,6 +505,7 @@ struct Parameters
     bool sortImagesByEv;
     bool alignToFirst;
     bool dontRemapRef;
+    bool stream;
     int pyrLevel;
     std::string alignedPrefix;
     std::string ptoFile;
@@ -535,97 +535,531 @@ private:
     const HuginBase::Panorama* m_pano;
 };
 
-template <class PixelType>
-int main2(std::vector<std::string> files, Parameters param)
+/** reads the information of the first image, which is the reference image */
+bool ReadFirstImage(HuginBase::SrcPanoImage& srcImg, const std::string& filename, Parameters& param)
 {
-    typedef vigra::BasicImage<PixelType> ImageType;
-    try
+    srcImg.setFilename(filename);
+
+    if (param.fisheye)
     {
-        HuginBase::Panorama pano;
-        HuginBase::Lens l;
+        srcImg.setProjection(HuginBase::SrcPanoImage::FULL_FRAME_FISHEYE);
+    }
+    srcImg.readEXIF();
+    srcImg.applyEXIFValues();
+    if (param.sortImagesByEv)
+    {
+        if (fabs(srcImg.getExposureValue()) < 1E-6)
+        {
+            // no exposure values found in file, don't sort images
+            param.sortImagesByEv = false;
+        }
+    };
+    // disable autorotate
+    srcImg.setRoll(0);
+    if (srcImg.getSize().x == 0 || srcImg.getSize().y == 0)
+    {
+        std::cerr << "Could not decode image: " << filename << "Unsupported image file format" << std::endl;
+        return false;
+    }
 
-        // add the first image.to the panorama object
-        HuginBase::SrcPanoImage srcImg;
-        srcImg.setFilename(files[0]);
+    if(param.loadDistortion)
+    {
+        if(srcImg.readDistortionFromDB())
+        {
+            std::cout << "\tRead distortion data from lens database." << std::endl;
+        }
+        else
+        {
+            std::cout << "\tNo valid distortion data found in lens database." << std::endl;
+        }
+    }
 
-        if (param.fisheye)
+    // use hfov specified by user.
+    if (param.hfov > 0)
+    {
+        srcImg.setHFOV(param.hfov);
+    }
+    else if (srcImg.getCropFactor() == 0)
+    {
+        // could not read HFOV, assuming default: 50
+        srcImg.setHFOV(50);
+    }
+
+    if (param.linear)
+    {
+        srcImg.setResponseType(HuginBase::SrcPanoImage::RESPONSE_LINEAR);
+        if (g_verbose>0)
         {
-            srcImg.setProjection(HuginBase::SrcPanoImage::FULL_FRAME_FISHEYE);
+            std::cout << "Using linear response" << std::endl;
         }
-        srcImg.readEXIF();
-        srcImg.applyEXIFValues();
-        if (param.sortImagesByEv)
+    }
+
+    return true;
+}
+
+/** setup output to be exactly similar to input image */
+HuginBase::PanoramaOptions GetOutputOptions(const HuginBase::SrcPanoImage& srcImg, const Parameters& param)
+{
+    HuginBase::PanoramaOptions opts;
+
+    if (param.fisheye)
+    {
+        opts.setProjection(HuginBase::PanoramaOptions::FULL_FRAME_FISHEYE);
+    }
+    else
+    {
+        opts.setProjection(HuginBase::PanoramaOptions::RECTILINEAR);
+    }
+    opts.setHFOV(srcImg.getHFOV(), false);
+    opts.setWidth(srcImg.getSize().x, false);
+    opts.setHeight(srcImg.getSize().y);
+    // output to tiff format
+    opts.outputFormat = HuginBase::PanoramaOptions::TIFF_m;
+    opts.tiff_saveROI = false;
+    // m estimator, to be more robust against points on moving objects
+    opts.huberSigma = 2;
+    // save also exposure value of first image
+    opts.outputExposureValue = srcImg.getExposureValue();
+    return opts;
+}
+
+/** returns the variables which should be optimized for all images except the first */
+std::set<std::string> GetOptimizeVars(const Parameters& param)
+{
+    // optimize yaw, roll, pitch
+    std::set<std::string> vars;
+    vars.insert("y");
+    vars.insert("p");
+    vars.insert("r");
+    if (param.optHFOV)
+    {
+        vars.insert("v");
+    }
+    if (param.optDistortion)
+    {
+        vars.insert("a");
+        vars.insert("b");
+        vars.insert("c");
+    }
+    if (param.optCenter)
+    {
+        vars.insert("d");
+        vars.insert("e");
+    }
+    if (param.optX)
+    {
+        vars.insert("TrX");
+    }
+    if (param.optY)
+    {
+        vars.insert("TrY");
+    }
+    if (param.optZ)
+    {
+        vars.insert("TrZ");
+    }
+    return vars;
+}
+
+/** adds an image to the stack, the image shares the lens with the first image,
+ *  only the variables which should be optimized are unlinked */
+unsigned int AddStackImage(HuginBase::Panorama& pano, HuginBase::StandardImageVariableGroups& variable_groups,
+    const HuginBase::SrcPanoImage& srcImg, const Parameters& param)
+{
+    const unsigned int imgNr = pano.addImage(srcImg);
+    variable_groups.update();
+    // each image shares the same lens.
+    variable_groups.getLenses().switchParts(imgNr, 0);
+    // unlink HFOV?
+    if (param.optHFOV)
+    {
+        pano.unlinkImageVariableHFOV(0);
+    }
+    if (param.optDistortion)
+    {
+        pano.unlinkImageVariableRadialDistortion(0);
+    }
+    if (param.optCenter)
+    {
+        pano.unlinkImageVariableRadialDistortionCenterShift(0);
+    }
+    // All images are in the same stack: Link the stack variable.
+    pano.linkImageVariableStack(0, imgNr);
+    return imgNr;
+}
+
+/** links the lens and stack variables of the image with the first image like AddStackImage,
+ *  but without updating the variable groups, so the cost does not depend on the number of images.
+ *  The variables which should be optimized stay unlinked. */
+void LinkStackImage(HuginBase::Panorama& pano, const unsigned int imgNr, const Parameters& param)
+{
+    typedef HuginBase::ConstImageVariableGroup::ImageVariableEnum ImageVariableEnum;
+    const std::set<ImageVariableEnum>& lensVars = HuginBase::StandardImageVariableGroups::getLensVariables();
+    for (std::set<ImageVariableEnum>::const_iterator it = lensVars.begin(); it != lensVars.end(); ++it)
+    {
+        if ((param.optHFOV && *it == HuginBase::ConstImageVariableGroup::IVE_HFOV) ||
+            (param.optDistortion && *it == HuginBase::ConstImageVariableGroup::IVE_RadialDistortion) ||
+            (param.optCenter && *it == HuginBase::ConstImageVariableGroup::IVE_RadialDistortionCenterShift))
         {
-            if (fabs(srcImg.getExposureValue()) < 1E-6)
-            {
-                // no exposure values found in file, don't sort images
-                param.sortImagesByEv = false;
-            }
+            continue;
         };
-        // disable autorotate
-        srcImg.setRoll(0);
-        if (srcImg.getSize().x == 0 || srcImg.getSize().y == 0)
+        switch (*it)
         {
-            std::cerr << "Could not decode image: " << files[0] << "Unsupported image file format" << std::endl;
-            return 1;
-        }
+#define image_variable( name, type, default_value ) \
+            case HuginBase::ConstImageVariableGroup::IVE_##name: \
+                pano.linkImageVariable##name(0, imgNr); \
+                break;
+#include "panodata/image_variables.h"
+#undef image_variable
+        };
+    };
+    // All images are in the same stack: Link the stack variable.
+    pano.linkImageVariableStack(0, imgNr);
+}
 
-        if(param.loadDistortion)
+/** load an image and create a reduced version of it */
+template <class ImageType>
+void LoadAndReduceImage(const vigra::ImageImportInfo& info, ImageType& imgOrig, ImageType& img, int pyrLevel)
+{
+    if (info.numExtraBands() == 1)
+    {
+        vigra::BImage alpha(info.size());
+        vigra::importImageAlpha(info, destImage(imgOrig), destImage(alpha));
+    }
+    else if (info.numExtraBands() == 0)
+    {
+        vigra::importImage(info, destImage(imgOrig));
+    }
+    else
+    {
+        vigra_fail("Images with multiple extra (alpha) channels not supported");
+    }
+    vigra_ext::reduceNTimes(imgOrig, img, pyrLevel);
+}
+
+/** crops the panorama if requested and writes all requested output */
+int WriteOutput(HuginBase::Panorama& pano, const HuginBase::OptimizeVector& optvars, const Parameters& param, bool optimizeError)
+{
+    if (param.crop)
+    {
+        autoCrop(pano);
+    }
+    // deactivate ref image if requested
+    if (param.dontRemapRef)
+    {
+        pano.activateImage(0, false);
+    };
+
+    HuginBase::UIntSet imgs = pano.getActiveImages();
+    if (optimizeError)
+    {
+        if (!param.ptoFile.empty())
         {
-            if(srcImg.readDistortionFromDB())
-            {
-                std::cout << "\tRead distortion data from lens database." << std::endl;
-            }
-            else
-            {
-                std::cout << "\tNo valid distortion data found in lens database." << std::endl;
-            }
+            std::ofstream script(param.ptoFile.c_str());
+            pano.printPanoramaScript(script, optvars, pano.getOptions(), imgs, false, "");
         }
+        std::cerr << "An error occurred during optimization." << std::endl;
+        std::cerr << "Try adding \"-p debug.pto\" and checking output." << std::endl;
+        std::cerr << "Exiting..." << std::endl;
+        return 1;
+    }
+
+    if (param.hdrFile.size())
+    {
+        // TODO: photometric alignment (HDR, fixed white balance)
+        //utils::StreamProgressReporter progress(2.0);
+        //loadImgsAndExtractPoints(pano, nPoints, pyrLevel, randomPoints, progress, points);
+        //smartOptimizePhotometric
+
+        // switch to HDR output mode
+        HuginBase::PanoramaOptions opts = pano.getOptions();
+        opts.outputFormat = HuginBase::PanoramaOptions::HDR;
+        opts.outputPixelType = "FLOAT";
+        opts.outputMode = HuginBase::PanoramaOptions::OUTPUT_HDR;
+        pano.setOptions(opts);
 
-        // use hfov specified by user.
-        if (param.hfov > 0)
+        // remap all images
+        AppBase::ProgressDisplay* progress;
+        if(g_verbose > 0)
         {
-            srcImg.setHFOV(param.hfov);
+            progress = new AppBase::StreamProgressDisplay(std::cout);
         }
-        else if (srcImg.getCropFactor() == 0)
+        else
         {
-            // could not read HFOV, assuming default: 50
-            srcImg.setHFOV(50);
+            progress = new AppBase::DummyProgressDisplay();
+        };
+        HuginBase::Nona::stitchPanorama(pano, pano.getOptions(),
+                       progress, param.hdrFile, imgs);
+        std::cout << "Written HDR output to " << param.hdrFile << std::endl;
+        delete progress;
+    }
+    if (param.alignedPrefix.size())
+    {
+        // disable all exposure compensation stuff.
+        HuginBase::PanoramaOptions opts = pano.getOptions();
+        opts.outputMode = HuginBase::PanoramaOptions::OUTPUT_LDR;
+        opts.outputFormat = HuginBase::PanoramaOptions::TIFF_m;
+        opts.outputPixelType = "";
+        opts.remapUsingGPU = param.gpu;
+        pano.setOptions(opts);
+        // remap all images
+        AppBase::ProgressDisplay* progress;
+        if(g_verbose > 0)
+        {
+            progress = new AppBase::StreamProgressDisplay(std::cout);
         }
+        else
+        {
+            progress = new AppBase::DummyProgressDisplay();
+        };
+        // pass option to ignore exposure to stitcher
+        HuginBase::Nona::AdvancedOptions advOpts;
+        HuginBase::Nona::SetAdvancedOption(advOpts, "ignoreExposure", true);
+        HuginBase::Nona::stitchPanorama(pano, pano.getOptions(),
+                       progress, param.alignedPrefix, imgs, advOpts);
+        delete progress;
+        std::cout << "Written aligned images to files with prefix \"" << param.alignedPrefix << "\"" << std::endl;
+    }
+
+    // At this point we have panorama options set according to the output
+    if (!param.ptoFile.empty())
+    {
+        std::ofstream script(param.ptoFile.c_str());
+        pano.printPanoramaScript(script, optvars, pano.getOptions(), imgs, false, "");
+        std::cout << "Written project file " << param.ptoFile << std::endl;
+    }
+    return 0;
+}
 
-        if (param.linear)
+/** removes all control points with an error higher than the threshold, keeps the
+ *  vertical control points for stereo alignment, returns the number of remaining points */
+size_t PruneCtrlPoints(HuginBase::Panorama& pano, const double threshold)
+{
+    const HuginBase::CPVector& cps = pano.getCtrlPoints();
+    HuginBase::CPVector newCPs;
+    for (size_t i = 0; i < cps.size(); i++)
+    {
+        if (cps[i].error < threshold ||
+            cps[i].mode == HuginBase::ControlPoint::X)   // preserve the vertical control point for stereo alignment
         {
-            srcImg.setResponseType(HuginBase::SrcPanoImage::RESPONSE_LINEAR);
-            if (g_verbose>0)
-            {
-                std::cout << "Using linear response" << std::endl;
-            }
+            newCPs.push_back(cps[i]);
         }
+    }
+    if (g_verbose > 0)
+    {
+        std::cout << "Ctrl points before pruning: " << cps.size() << ", after: " << newCPs.size() << std::endl;
+    }
+    pano.setCtrlPoints(newCPs);
+    return newCPs.size();
+}
 
-        pano.addImage(srcImg);
+/** aligns a sequence of frames (e.g. from a video or a timelapse) incrementally to the first frame.
+ *  The reference frame is loaded and its interest points are detected only once. Each frame
+ *  is initialized with the solution of the previous frame, which is also used to predict the
+ *  position of the points in the new frame. Only the reference frame and the current frame are
+ *  kept in the panorama used for the alignment. The parameters of each frame are printed as
+ *  soon as the frame is solved. The solutions are collected and the output files are written
+ *  at the end, because the aligned images, the HDR and the project file need all frames. */
+template <class PixelType>
+int StreamAlign(const std::vector<std::string>& files, Parameters param)
+{
+    typedef vigra::BasicImage<PixelType> ImageType;
+    HuginBase::SrcPanoImage srcImg;
+    if (!ReadFirstImage(srcImg, files[0], param))
+    {
+        return 1;
+    };
+    const HuginBase::PanoramaOptions opts = GetOutputOptions(srcImg, param);
+
+    // panorama with the reference frame and the current frame
+    HuginBase::Panorama framePano;
+    framePano.addImage(srcImg);
+    framePano.setOptions(opts);
+    HuginBase::StandardImageVariableGroups frameGroups(framePano);
+    AddStackImage(framePano, frameGroups, srcImg, param);
+    HuginBase::OptimizeVector frameOptvars(2);
+    frameOptvars[1] = GetOptimizeVars(param);
+    framePano.setOptimizeVector(frameOptvars);
+
+    // solution of all frames, used for the final output
+    std::vector<HuginBase::SrcPanoImage> results;
+    results.reserve(files.size() - 1);
+
+    // load reference frame and find the interest points
+    vigra::ImageImportInfo firstImgInfo(files[0].c_str());
+    ImageType leftImgOrig(firstImgInfo.size());
+    ImageType leftImg;
+    LoadAndReduceImage(firstImgInfo, leftImgOrig, leftImg, param.pyrLevel);
+    if (g_verbose > 0)
+    {
+        std::cout << "Trying to find " << param.nPoints << " corners... " << std::endl;
+    }
+    const std::vector<MapPoints> points = FindInterestPointsInGrid(leftImg, 2, param.nPoints, param.grid);
+    const double scaleFactor = 1 << param.pyrLevel;
+    ImageType rightImgOrig(firstImgInfo.size());
+    ImageType rightImg;
 
-        // setup output to be exactly similar to input image
-        HuginBase::PanoramaOptions opts;
+    // disable optimizer progress messages if -v not given
+    if (g_verbose == 0)
+    {
+        PT_setProgressFcn(ptProgress);
+        PT_setInfoDlgFcn(ptinfoDlg);
+    };
 
-        if (param.fisheye)
+    // the previous solution is the start value for the next frame
+    HuginBase::SrcPanoImage seed = framePano.getSrcImage(1);
+    for (size_t i = 1; i < files.size(); ++i)
+    {
+        vigra::ImageImportInfo nextImgInfo(files[i].c_str());
+        if (nextImgInfo.size() != firstImgInfo.size())
         {
-            opts.setProjection(HuginBase::PanoramaOptions::FULL_FRAME_FISHEYE);
+            std::cerr << "Images have different sizes." << std::endl
+                << files[0] << " has " << firstImgInfo.size() << " pixel, while " << std::endl
+                << files[i] << " has " << nextImgInfo.size() << " pixel." << std::endl
+                << "This is not supported. Align_image_stack works only with images of the same size." << std::endl;
+            return 1;
+        };
+        HuginBase::SrcPanoImage frame(seed);
+        frame.setFilename(files[i]);
+        {
+            // only the exposure is taken from the file, all other values from the previous frame
+            HuginBase::SrcPanoImage exifImg;
+            exifImg.setFilename(files[i]);
+            exifImg.readEXIF();
+            exifImg.applyEXIFValues();
+            frame.setExposureValue(exifImg.getExposureValue());
         }
-        else
+        framePano.setSrcImage(1, frame);
+        framePano.setCtrlPoints(HuginBase::CPVector());
+        LoadAndReduceImage(nextImgInfo, rightImgOrig, rightImg, param.pyrLevel);
+
+        if (g_verbose > 0)
         {
-            opts.setProjection(HuginBase::PanoramaOptions::RECTILINEAR);
+            std::cout << "Creating control points between " << files[0] << " and " << files[i] << std::endl;
         }
-        opts.setHFOV(srcImg.getHFOV(), false);
-        opts.setWidth(srcImg.getSize().x, false);
-        opts.setHeight(srcImg.getSize().y);
-        // output to tiff format
-        opts.outputFormat = HuginBase::PanoramaOptions::TIFF_m;
-        opts.tiff_saveROI = false;
-        // m estimator, to be more robust against points on moving objects
-        opts.huberSigma = 2;
-        // save also exposure value of first image
-        opts.outputExposureValue = srcImg.getExposureValue();
-        pano.setOptions(opts);
+        const PositionPredictor predictor(framePano);
+        std::vector<HuginBase::CPVector> cps(points.size());
+        #pragma omp parallel for schedule(dynamic)
+        for (int j = 0; j < points.size(); ++j)
+        {
+            FineTuneInterestPoints(cps[j], 0, leftImg, leftImgOrig, 1, rightImg, rightImgOrig, points[j], param.nPoints,
+                param.pyrLevel, 20, 100, scaleFactor, param.corrThresh, false, &predictor);
+        };
+        for (size_t j = 0; j < cps.size(); ++j)
+        {
+            for (size_t k = 0; k < cps[j].size(); ++k)
+            {
+                framePano.addCtrlPoint(cps[j][k]);
+            };
+        };
+
+        bool optimizeError = framePano.getNrOfCtrlPoints() == 0 || (HuginBase::PTools::optimize(framePano) > 0);
+        if (!optimizeError && param.cpErrorThreshold > 0)
+        {
+            optimizeError = PruneCtrlPoints(framePano, param.cpErrorThreshold) == 0 ||
+                (HuginBase::PTools::optimize(framePano) > 0);
+        };
+        if (optimizeError)
+        {
+            std::cerr << "WARNING: Could not align " << files[i] << ", using parameters of previous frame." << std::endl;
+            framePano.setSrcImage(1, frame);
+        }
+        else
+        {
+            seed = framePano.getSrcImage(1);
+        };
+
+        // remember solution for the output and report it
+        const HuginBase::SrcPanoImage& result = framePano.getImage(1);
+        results.push_back(result);
+        std::cout << "Frame " << i << " " << files[i] << ": y=" << result.getYaw()
+            << " p=" << result.getPitch() << " r=" << result.getRoll();
+        if (param.optHFOV)
+        {
+            std::cout << " v=" << result.getHFOV();
+        };
+        if (param.optX || param.optY || param.optZ)
+        {
+            std::cout << " TrX=" << result.getX() << " TrY=" << result.getY() << " TrZ=" << result.getZ();
+        };
+        std::cout << " cps=" << framePano.getNrOfCtrlPoints() << std::endl;
+    };
+
+    // panorama with the solution of all frames, the images are linked directly with the
+    // reference frame, this avoids updating the variable groups for each frame
+    HuginBase::Panorama pano;
+    pano.addImage(srcImg);
+    pano.setOptions(opts);
+    HuginBase::OptimizeVector optvars(1);
+    optvars.reserve(files.size());
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const unsigned int imgNr = pano.addImage(results[i]);
+        LinkStackImage(pano, imgNr, param);
+        pano.setSrcImage(imgNr, results[i]);
+        optvars.push_back(GetOptimizeVars(param));
+    };
+    return WriteOutput(pano, optvars, param, false);
+}
+
+/** an image of the stack in original and reduced size, the interest points are
+ *  only searched when the image is the left image of a pair */
+template <class ImageType>
+struct StackImage
+{
+    StackImage() : hasPoints(false) {};
+    ImageType orig;
+    ImageType reduced;
+    std::vector<MapPoints> points;
+    bool hasPoints;
+};
+
+/** a set of points which should be fine tuned between the images of a pair */
+template <class ImageType>
+struct FineTuneTask
+{
+    size_t pair;
+    const StackImage<ImageType>* left;
+    const StackImage<ImageType>* right;
+    const MapPoints* points;
+};
+
+/** returns the number of image pairs which should be processed together,
+ *  so that there are enough tasks for all threads */
+size_t GetPairBatchSize(const Parameters& param)
+{
+#ifdef HAVE_OPENMP
+    const size_t tasksPerPair = param.grid * param.grid + (param.stereo ? 4 : 0);
+    const size_t threads = omp_get_max_threads();
+    return std::max<size_t>(1, (2 * threads + tasksPerPair - 1) / tasksPerPair);
+#else
+    return 1;
+#endif
+}
+
+template <class PixelType>
+int main2(std::vector<std::string> files, Parameters param)
+{
+    typedef vigra::BasicImage<PixelType> ImageType;
+    try
+    {
+        if (param.stream)
+        {
+            return StreamAlign<PixelType>(files, param);
+        };
+        HuginBase::Panorama pano;
+        HuginBase::Lens l;
+
+        // add the first image.to the panorama object
+        HuginBase::SrcPanoImage srcImg;
+        if (!ReadFirstImage(srcImg, files[0], param))
+        {
+            return 1;
+        };
+        pano.addImage(srcImg);
+
+        // setup output to be exactly similar to input image
+        pano.setOptions(GetOutputOptions(srcImg, param));
 
         // variables that should be optimized
         // optimize nothing in the first image
@@ -680,59 +1114,9 @@ int main2(std::vector<std::string> files, Parameters param)
                 srcImg.setHFOV(50);
             }
 
-            int imgNr = pano.addImage(srcImg);
-            variable_groups.update();
-            // each image shares the same lens.
-            variable_groups.getLenses().switchParts(imgNr, 0);
-            // unlink HFOV?
-            if (param.optHFOV)
-            {
-                pano.unlinkImageVariableHFOV(0);
-            }
-            if (param.optDistortion)
-            {
-                pano.unlinkImageVariableRadialDistortion(0);
-            }
-            if (param.optCenter)
-            {
-                pano.unlinkImageVariableRadialDistortionCenterShift(0);
-            }
-            // All images are in the same stack: Link the stack variable.
-            pano.linkImageVariableStack(0, imgNr);
+            AddStackImage(pano, variable_groups, srcImg, param);
             images.push_back(i);
-            // optimize yaw, roll, pitch
-            std::set<std::string> vars;
-            vars.insert("y");
-            vars.insert("p");
-            vars.insert("r");
-            if (param.optHFOV)
-            {
-                vars.insert("v");
-            }
-            if (param.optDistortion)
-            {
-                vars.insert("a");
-                vars.insert("b");
-                vars.insert("c");
-            }
-            if (param.optCenter)
-            {
-                vars.insert("d");
-                vars.insert("e");
-            }
-            if (param.optX)
-            {
-                vars.insert("TrX");
-            }
-            if (param.optY)
-            {
-                vars.insert("TrY");
-            }
-            if (param.optZ)
-            {
-                vars.insert("TrZ");
-            }
-            optvars.push_back(vars);
+            optvars.push_back(GetOptimizeVars(param));
 
         };
 
@@ -742,96 +1126,142 @@ int main2(std::vector<std::string> files, Parameters param)
             std::sort(images.begin(), images.end(), SortImageVectorEV(&pano));
         };
 
-        // load first image
-        vigra::ImageImportInfo firstImgInfo(pano.getSrcImage(images[0]).getFilename().c_str());
-
-        // original size
-        ImageType* leftImgOrig = new ImageType(firstImgInfo.size());
-        // rescale image
-        ImageType* leftImg = new ImageType();
+        // the image pairs are processed in batches: the images of a batch are loaded in parallel
+        // and all points of all pairs of the batch are fine tuned in one parallel loop,
+        // so that also stacks with few images or a small grid keep all threads busy
+        const size_t batchSize = GetPairBatchSize(param);
+        const double scaleFactor = 1 << param.pyrLevel;
+        // currently loaded images, index into images
+        std::map<size_t, std::shared_ptr<StackImage<ImageType> > > loaded;
+        std::vector<MapPoints> edgePoints;
+        for (size_t batchStart = 1; batchStart < images.size(); batchStart += batchSize)
         {
-            if(firstImgInfo.numExtraBands() == 1)
+            const size_t batchEnd = std::min(images.size(), batchStart + batchSize);
+            // image pairs of this batch, index into images
+            std::vector<std::pair<size_t, size_t> > pairs;
+            for (size_t i = batchStart; i < batchEnd; ++i)
             {
-                vigra::BImage alpha(firstImgInfo.size());
-                vigra::importImageAlpha(firstImgInfo, destImage(*leftImgOrig), destImage(alpha));
-            }
-            else if (firstImgInfo.numExtraBands() == 0)
-            {
-                vigra::importImage(firstImgInfo, destImage(*leftImgOrig));
-            }
-            else
+                pairs.push_back(std::make_pair(param.alignToFirst ? 0 : i - 1, i));
+            };
+            // release the images which are not needed anymore and load the missing ones
+            std::set<size_t> needed;
+            for (size_t i = 0; i < pairs.size(); ++i)
             {
-                vigra_fail("Images with multiple extra (alpha) channels not supported");
-            }
-            vigra_ext::reduceNTimes(*leftImgOrig, *leftImg, param.pyrLevel);
-        }
-
-
-        ImageType* rightImg = new ImageType(leftImg->size());
-        ImageType* rightImgOrig = new ImageType(leftImgOrig->size());
-        // loop to add control points between them.
-        for (int i = 1; i < (int) images.size(); i++)
-        {
-            if (g_verbose > 0)
+                needed.insert(pairs[i].first);
+                needed.insert(pairs[i].second);
+            };
+            for (auto it = loaded.begin(); it != loaded.end();)
             {
-                if (param.alignToFirst)
+                if (needed.find(it->first) == needed.end())
                 {
-                    std::cout << "Creating control points between " << pano.getSrcImage(images[0]).getFilename().c_str() << " and " <<
-                        pano.getSrcImage(images[i]).getFilename().c_str() << std::endl;
+                    it = loaded.erase(it);
                 }
                 else
                 {
-                    std::cout << "Creating control points between " << pano.getSrcImage(images[i - 1]).getFilename().c_str() << " and " <<
-                        pano.getSrcImage(images[i]).getFilename().c_str() << std::endl;
+                    ++it;
                 };
-            }
-
-            // load the actual image data of the next image
-            vigra::ImageImportInfo nextImgInfo(pano.getSrcImage(images[i]).getFilename().c_str());
-            assert(nextImgInfo.size() == firstImgInfo.size());
+            };
+            std::vector<std::pair<std::string, StackImage<ImageType>*> > toLoad;
+            for (std::set<size_t>::const_iterator it = needed.begin(); it != needed.end(); ++it)
             {
-                if (nextImgInfo.numExtraBands() == 1)
+                if (loaded.find(*it) == loaded.end())
                 {
-                    vigra::BImage alpha(nextImgInfo.size());
-                    vigra::importImageAlpha(nextImgInfo, destImage(*rightImgOrig), destImage(alpha));
-                }
-                else if (nextImgInfo.numExtraBands() == 0)
+                    loaded[*it] = std::make_shared<StackImage<ImageType> >();
+                    toLoad.push_back(std::make_pair(pano.getImage(images[*it]).getFilename(), loaded[*it].get()));
+                };
+            };
+            std::vector<std::exception_ptr> loadErrors(toLoad.size());
+            #pragma omp parallel for schedule(dynamic)
+            for (int i = 0; i < toLoad.size(); ++i)
+            {
+                // exceptions can't leave the parallel region, rethrow them afterwards
+                try
                 {
-                    vigra::importImage(nextImgInfo, destImage(*rightImgOrig));
+                    vigra::ImageImportInfo info(toLoad[i].first.c_str());
+                    toLoad[i].second->orig.resize(info.size());
+                    LoadAndReduceImage(info, toLoad[i].second->orig, toLoad[i].second->reduced, param.pyrLevel);
                 }
-                else
+                catch (...)
+                {
+                    loadErrors[i] = std::current_exception();
+                };
+            };
+            for (size_t i = 0; i < loadErrors.size(); ++i)
+            {
+                if (loadErrors[i])
+                {
+                    std::rethrow_exception(loadErrors[i]);
+                };
+            };
+            if (param.stereo && edgePoints.empty())
+            {
+                edgePoints = GetStereoEdgePoints(loaded[pairs[0].first]->reduced.size(), param.nPoints);
+            };
+
+            // collect the points to fine tune of all pairs
+            std::vector<FineTuneTask<ImageType> > tasks;
+            for (size_t i = 0; i < pairs.size(); ++i)
+            {
+                StackImage<ImageType>& left = *loaded[pairs[i].first];
+                if (g_verbose > 0)
                 {
-                    vigra_fail("Images with multiple extra (alpha) channels not supported");
+                    std::cout << "Creating control points between " << pano.getImage(images[pairs[i].first]).getFilename() << " and " <<
+                        pano.getImage(images[pairs[i].second]).getFilename() << std::endl;
                 }
-                vigra_ext::reduceNTimes(*rightImgOrig, *rightImg, param.pyrLevel);
-            }
+                // find interesting corners using harris corner detector,
+                // only once for each image
+                if (!left.hasPoints)
+                {
+                    if (g_verbose > 0)
+                    {
+                        std::cout << "Trying to find " << param.nPoints << " corners... " << std::endl;
+                    }
+                    left.points = FindInterestPointsInGrid(left.reduced, 2, param.nPoints, param.grid);
+                    left.hasPoints = true;
+                };
+                FineTuneTask<ImageType> task;
+                task.pair = i;
+                task.left = &left;
+                task.right = loaded[pairs[i].second].get();
+                for (size_t j = 0; j < left.points.size(); ++j)
+                {
+                    task.points = &left.points[j];
+                    tasks.push_back(task);
+                };
+                for (size_t j = 0; j < edgePoints.size(); ++j)
+                {
+                    task.points = &edgePoints[j];
+                    tasks.push_back(task);
+                };
+            };
 
-            // add control points.
-            // work on smaller images
-            // TODO: or use a fast interest point operator.
-            if (param.alignToFirst)
+            // fine tune all points, each task has its own result buffer
+            std::vector<HuginBase::CPVector> cps(tasks.size());
+            #pragma omp parallel for schedule(dynamic)
+            for (int i = 0; i < tasks.size(); ++i)
             {
-                createCtrlPoints(pano, 0, *leftImg, *leftImgOrig, images[i], *rightImg, *rightImgOrig, param.pyrLevel, 2, param.nPoints, param.grid, param.corrThresh, param.stereo);
-                vigra::initImage(vigra::destImageRange(*rightImg), vigra::NumericTraits<PixelType>::zero());
-                vigra::initImage(vigra::destImageRange(*rightImgOrig), vigra::NumericTraits<PixelType>::zero());
-            }
-            else
+                const FineTuneTask<ImageType>& task = tasks[i];
+                FineTuneInterestPoints(cps[i], images[pairs[task.pair].first], task.left->reduced, task.left->orig,
+                    images[pairs[task.pair].second], task.right->reduced, task.right->orig, *task.points, param.nPoints,
+                    param.pyrLevel, 20, 100, scaleFactor, param.corrThresh, param.stereo);
+            };
+
+            // merge the results in the order of the pairs
+            for (size_t i = 0; i < tasks.size(); ++i)
             {
-                createCtrlPoints(pano, images[i - 1], *leftImg, *leftImgOrig, images[i], *rightImg, *rightImgOrig, param.pyrLevel, 2, param.nPoints, param.grid, param.corrThresh, param.stereo);
-
-                // swap images;
-                delete leftImg;
-                delete leftImgOrig;
-                leftImg = rightImg;
-                leftImgOrig = rightImgOrig;
-                rightImg = new ImageType(leftImg->size());
-                rightImgOrig = new ImageType(leftImgOrig->size());
+                if (param.stereo && (i == 0 || tasks[i].pair != tasks[i - 1].pair))
+                {
+                    // add one vertical control point to keep the images aligned vertically
+                    pano.addCtrlPoint(HuginBase::ControlPoint(images[pairs[tasks[i].pair].first], 0, 0,
+                        images[pairs[tasks[i].pair].second], 0, 0, HuginBase::ControlPoint::X));
+                };
+                for (size_t j = 0; j < cps[i].size(); ++j)
+                {
+                    pano.addCtrlPoint(cps[i][j]);
+                };
             };
-        }
-        delete leftImg;
-        delete rightImg;
-        delete leftImgOrig;
-        delete rightImgOrig;
+        };
+        loaded.clear();
 
         // optimize everything.
         pano.setOptimizeVector(optvars);
@@ -847,21 +1277,7 @@ int main2(std::vector<std::string> files, Parameters param)
         // remove all points with error higher than a specified threshold
         if (param.cpErrorThreshold > 0)
         {
-            HuginBase::CPVector cps = pano.getCtrlPoints();
-            HuginBase::CPVector newCPs;
-            for (int i=0; i < (int)cps.size(); i++)
-            {
-                if (cps[i].error < param.cpErrorThreshold ||
-                    cps[i].mode == HuginBase::ControlPoint::X)   // preserve the vertical control point for stereo alignment
-                {
-                    newCPs.push_back(cps[i]);
-                }
-            }
-            if (g_verbose > 0)
-            {
-                std::cout << "Ctrl points before pruning: " << cps.size() << ", after: " << newCPs.size() << std::endl;
-            }
-            pano.setCtrlPoints(newCPs);
+            PruneCtrlPoints(pano, param.cpErrorThreshold);
             if (param.stereo_window)
             {
                 alignStereoWindow(pano, param.pop_out);
@@ -885,103 +1301,13 @@ int main2(std::vector<std::string> files, Parameters param)
             optimizeError = (HuginBase::PTools::optimize(pano) > 0);
         }
 
-        if (param.crop)
-        {
-            autoCrop(pano);
-        }
-        // deactivate ref image if requested
-        if (param.dontRemapRef)
-        {
-            pano.activateImage(0, false);
-        };
-
-        HuginBase::UIntSet imgs = pano.getActiveImages();
-        if (optimizeError)
-        {
-            if (!param.ptoFile.empty())
-            {
-                std::ofstream script(param.ptoFile.c_str());
-                pano.printPanoramaScript(script, optvars, pano.getOptions(), imgs, false, "");
-            }
-            std::cerr << "An error occurred during optimization." << std::endl;
-            std::cerr << "Try adding \"-p debug.pto\" and checking output." << std::endl;
-            std::cerr << "Exiting..." << std::endl;
-            return 1;
-        }
-
-        if (param.hdrFile.size())
-        {
-            // TODO: photometric alignment (HDR, fixed white balance)
-            //utils::StreamProgressReporter progress(2.0);
-            //loadImgsAndExtractPoints(pano, nPoints, pyrLevel, randomPoints, progress, points);
-            //smartOptimizePhotometric
-
-            // switch to HDR output mode
-            HuginBase::PanoramaOptions opts = pano.getOptions();
-            opts.outputFormat = HuginBase::PanoramaOptions::HDR;
-            opts.outputPixelType = "FLOAT";
-            opts.outputMode = HuginBase::PanoramaOptions::OUTPUT_HDR;
-            pano.setOptions(opts);
-
-            // remap all images
-            AppBase::ProgressDisplay* progress;
-            if(g_verbose > 0)
-            {
-                progress = new AppBase::StreamProgressDisplay(std::cout);
-            }
-            else
-            {
-                progress = new AppBase::DummyProgressDisplay();
-            };
-            HuginBase::Nona::stitchPanorama(pano, pano.getOptions(),
-                           progress, param.hdrFile, imgs);
-            std::cout << "Written HDR output to " << param.hdrFile << std::endl;
-            delete progress;
-        }
-        if (param.alignedPrefix.size())
-        {
-            // disable all exposure compensation stuff.
-            HuginBase::PanoramaOptions opts = pano.getOptions();
-            opts.outputMode = HuginBase::PanoramaOptions::OUTPUT_LDR;
-            opts.outputFormat = HuginBase::PanoramaOptions::TIFF_m;
-            opts.outputPixelType = "";
-            opts.remapUsingGPU = param.gpu;
-            pano.setOptions(opts);
-            // remap all images
-            AppBase::ProgressDisplay* progress;
-            if(g_verbose > 0)
-            {
-                progress = new AppBase::StreamProgressDisplay(std::cout);
-            }
-            else
-            {
-                progress = new AppBase::DummyProgressDisplay();
-            };
-            // pass option to ignore exposure to stitcher
-            HuginBase::Nona::AdvancedOptions advOpts;
-            HuginBase::Nona::SetAdvancedOption(advOpts, "ignoreExposure", true);
-            HuginBase::Nona::stitchPanorama(pano, pano.getOptions(),
-                           progress, param.alignedPrefix, imgs, advOpts);
-            delete progress;
-            std::cout << "Written aligned images to files with prefix \"" << param.alignedPrefix << "\"" << std::endl;
-        }
-
-        // At this point we have panorama options set according to the output
-        if (!param.ptoFile.empty())
-        {
-            std::ofstream script(param.ptoFile.c_str());
-            pano.printPanoramaScript(script, optvars, pano.getOptions(), imgs, false, "");
-            std::cout << "Written project file " << param.ptoFile << std::endl;
-        }
-
-
+        return WriteOutput(pano, optvars, param, optimizeError);
     }
     catch (std::exception& e)
     {
         std::cerr << "ERROR: caught exception: " << e.what() << std::endl;
         return 1;
     }
-    return 0;
 }
 
 int main(int argc, char* argv[])
@@ -1002,6 +1328,7 @@ int main(int argc, char* argv[])
         USEGIVENORDER,
         ALIGNTOFIRST,
         DONTREMAPREF,
+        STREAM,
     };
 
     static struct option longOptions[] =
@@ -1014,6 +1341,7 @@ int main(int argc, char* argv[])
         {"use-given-order", no_argument, NULL, USEGIVENORDER },
         {"align-to-first", no_argument, NULL, ALIGNTOFIRST},
         {"dont-remap-ref", no_argument, NULL, DONTREMAPREF},
+        {"stream", no_argument, NULL, STREAM},
         {"help", no_argument, NULL, 'h' },
         0
     };
@@ -1142,6 +1470,11 @@ int main(int argc, char* argv[])
             case DONTREMAPREF:
                 param.dontRemapRef = true;
                 break;
+            case STREAM:
+                param.stream = true;
+                param.alignToFirst = true;
+                param.sortImagesByEv = false;
+                break;
             case ':':
             case '?':
                 // missing argument or invalid switch
@@ -1156,6 +1489,11 @@ int main(int argc, char* argv[])
     // use always given image order for stereo options
     if (param.stereo)
     {
+        if (param.stream)
+        {
+            std::cerr << hugin_utils::stripPath(argv[0]) << ": Stereo options (-S, -A, -P) can't be used together with --stream." << std::endl;
+            return 1;
+        };
         param.sortImagesByEv = false;
     };
     unsigned nFiles = argc - optind;
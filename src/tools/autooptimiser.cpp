@@ -29,6 +29,9 @@
 
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <iomanip>
+#include <cmath>
 #include <getopt.h>
 
 #include <hugin_basic.h>
@@ -40,11 +43,63 @@
 #include <algorithms/basic/CalculateMeanExposure.h>
 #include <algorithms/nona/FitPanorama.h>
 #include <algorithms/basic/CalculateOptimalScale.h>
+#include <algorithms/basic/CalculateCPStatistics.h>
 #include <algorithms/optimizer/PhotometricOptimizer.h>
 #include <panodata/ImageVariableGroup.h>
 #include <panodata/StandardImageVariableGroups.h>
 #include "ExtractPoints.h"
 
+/** optimises the variables of the project with the panotools optimizer and the
+ *  sparse optimizer and prints the control point errors of both results
+ *  @return true, if the sparse optimizer reaches the mean error of panotools */
+static bool CompareSparseOptimizer(const HuginBase::Panorama& pano)
+{
+    if (!HuginBase::SparseOptimizer::canOptimize(pano))
+    {
+        std::cerr << "The sparse optimizer can not optimise this project." << std::endl
+            << "Only yaw, pitch and roll may be optimised and the project must not contain" << std::endl
+            << "translation parameters or line control points." << std::endl;
+        return false;
+    };
+    HuginBase::Panorama ptPano(pano);
+    HuginBase::Panorama sparsePano(pano);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    HuginBase::PTools::optimize(ptPano);
+    const double ptTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    HuginBase::SparseOptimizer::optimize(sparsePano);
+    const double sparseTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double ptMin, ptMax, ptMean, ptVar;
+    HuginBase::CalculateCPStatisticsError::calcCtrlPntsErrorStats(ptPano, ptMin, ptMax, ptMean, ptVar);
+    double sparseMin, sparseMax, sparseMean, sparseVar;
+    HuginBase::CalculateCPStatisticsError::calcCtrlPntsErrorStats(sparsePano, sparseMin, sparseMax, sparseMean, sparseVar);
+    // largest difference of the image orientations
+    double maxDiff = 0;
+    const char* angles[] = { "y", "p", "r" };
+    for (unsigned int i = 0; i < pano.getNrOfImages(); ++i)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            double diff = std::abs(ptPano.getImage(i).getVar(angles[j]) - sparsePano.getImage(i).getVar(angles[j]));
+            diff = std::fmod(diff, 360.0);
+            maxDiff = std::max(maxDiff, std::min(diff, 360.0 - diff));
+        };
+    };
+    std::cout << "Optimizer   mean error   max error   time" << std::endl
+        << "panotools   " << std::setw(10) << ptMean << "   " << std::setw(9) << ptMax << "   " << ptTime << " s" << std::endl
+        << "sparse      " << std::setw(10) << sparseMean << "   " << std::setw(9) << sparseMax << "   " << sparseTime << " s" << std::endl
+        << "Largest difference of yaw, pitch and roll: " << maxDiff << " deg" << std::endl;
+    // both optimizers minimise the same error, allow a small tolerance
+    // for the different stopping criteria
+    const bool similar = sparseMean <= ptMean * 1.01 + 0.01;
+    if (!similar)
+    {
+        std::cout << "The sparse optimizer did not reach the error of the panotools optimizer." << std::endl;
+    };
+    return similar;
+}
+
 static void usage(const char* name)
 {
     std::cout << name << ": optimize image positions" << std::endl
@@ -63,6 +118,12 @@ static void usage(const char* name)
          << "              first image" << std::endl
          << "     -m       Optimise photometric parameters" << std::endl
          << "     -n       Optimize parameters specified in script file (like PTOptimizer)" << std::endl
+         << "     --sparse use the sparse optimizer for the image positions, faster" << std::endl
+         << "              for projects with many images. It is only used for the" << std::endl
+         << "              optimisation steps which optimise only yaw, pitch and roll," << std::endl
+         << "              all other steps use the panotools optimizer" << std::endl
+         << "     --check-sparse  optimise the variables of the project with the panotools" << std::endl
+         << "              and the sparse optimizer, compare both results and exit" << std::endl
          << std::endl
          << "    Postprocessing options:" << std::endl
          << "     -l       level horizon (works best for horizontal panos)" << std::endl
@@ -82,11 +143,18 @@ int main(int argc, char* argv[])
 {
     // parse arguments
     const char* optstring = "alho:npqsv:m";
+    enum
+    {
+        SPARSE = 1000,
+        CHECK_SPARSE
+    };
     int c;
     static struct option longOptions[] =
     {
         { "output", required_argument, NULL, 'o'},
         { "help", no_argument, NULL, 'h' },
+        { "sparse", no_argument, NULL, SPARSE },
+        { "check-sparse", no_argument, NULL, CHECK_SPARSE },
         0
     };
     std::string output;
@@ -97,7 +165,9 @@ int main(int argc, char* argv[])
     bool chooseProj = false;
     bool quiet = false;
     bool doPhotometric = false;
+    bool checkSparse = false;
     double hfov = 0.0;
+    HuginBase::OptimizerBackend backend = HuginBase::OPTIMIZER_PANOTOOLS;
     while ((c = getopt_long(argc, argv, optstring, longOptions, nullptr)) != -1)
     {
         switch (c)
@@ -132,6 +202,12 @@ int main(int argc, char* argv[])
             case 'm':
                 doPhotometric = true;
                 break;
+            case SPARSE:
+                backend = HuginBase::OPTIMIZER_SPARSE;
+                break;
+            case CHECK_SPARSE:
+                checkSparse = true;
+                break;
             case ':':
             case '?':
                 // missing argument or invalid switch
@@ -220,22 +296,26 @@ int main(int argc, char* argv[])
         }
     }
 
-    if(pano.getNrOfCtrlPoints()==0 && (doPairwise || doAutoOpt || doNormalOpt))
+    if(pano.getNrOfCtrlPoints()==0 && (doPairwise || doAutoOpt || doNormalOpt || checkSparse))
     {
         std::cerr << "Panorama have to have control points to optimise positions" << std::endl;
         return 1;
     };
+    if (checkSparse)
+    {
+        return CompareSparseOptimizer(pano) ? 0 : 1;
+    };
     if (doPairwise && ! doAutoOpt)
     {
         // do pairwise optimisation
-        HuginBase::AutoOptimise::autoOptimise(pano);
+        HuginBase::AutoOptimise::autoOptimise(pano, true, backend);
 
         // do global optimisation
         if (!quiet)
         {
             std::cerr << "*** Pairwise position optimisation" << std::endl;
         }
-        HuginBase::PTools::optimize(pano);
+        HuginBase::OptimizeGeometric(pano, backend);
     }
     else if (doAutoOpt)
     {
@@ -243,7 +323,7 @@ int main(int argc, char* argv[])
         {
             std::cerr << "*** Adaptive geometric optimisation" << std::endl;
         }
-        HuginBase::SmartOptimise::smartOptimize(pano);
+        HuginBase::SmartOptimise::smartOptimize(pano, backend);
     }
     else if (doNormalOpt)
     {
@@ -251,7 +331,16 @@ int main(int argc, char* argv[])
         {
             std::cerr << "*** Optimising parameters specified in PTO file" << std::endl;
         }
-        HuginBase::PTools::optimize(pano);
+        if (backend == HuginBase::OPTIMIZER_SPARSE && !HuginBase::SparseOptimizer::optimizesPositionsOnly(pano.getOptimizeVector()))
+        {
+            // the sparse optimizer is only offered for position only runs
+            if (!quiet)
+            {
+                std::cerr << "PTO file optimises other variables than yaw, pitch and roll, using panotools optimizer" << std::endl;
+            };
+            backend = HuginBase::OPTIMIZER_PANOTOOLS;
+        };
+        HuginBase::OptimizeGeometric(pano, backend);
     }
     else
     {
@@ -384,7 +473,6 @@ int main(int argc, char* argv[])
     if(doPhotometric)
     {
         // photometric estimation
-        HuginBase::PanoramaOptions opts = pano.getOptions();
         int nPoints = 200;
         nPoints = nPoints * pano.getNrOfImages();
 
@@ -420,51 +508,7 @@ int main(int argc, char* argv[])
         }
 
         progressDisplay->setMessage("Photometric Optimization");
-        // first, ensure that vignetting and response coefficients are linked
-        const HuginBase::ImageVariableGroup::ImageVariableEnum vars[] =
-        {
-            HuginBase::ImageVariableGroup::IVE_EMoRParams,
-            HuginBase::ImageVariableGroup::IVE_ResponseType,
-            HuginBase::ImageVariableGroup::IVE_VigCorrMode,
-            HuginBase::ImageVariableGroup::IVE_RadialVigCorrCoeff,
-            HuginBase::ImageVariableGroup::IVE_RadialVigCorrCenterShift
-        };
-        HuginBase::StandardImageVariableGroups variable_groups(pano);
-        HuginBase::ImageVariableGroup& lenses = variable_groups.getLenses();
-        for (size_t i = 0; i < lenses.getNumberOfParts(); i++)
-        {
-            std::set<HuginBase::ImageVariableGroup::ImageVariableEnum> links_needed;
-            links_needed.clear();
-            for (int v = 0; v < 5; v++)
-            {
-                if (!lenses.getVarLinkedInPart(vars[v], i))
-                {
-                    links_needed.insert(vars[v]);
-                }
-            };
-            if (!links_needed.empty())
-            {
-                std::set<HuginBase::ImageVariableGroup::ImageVariableEnum>::iterator it;
-                for (it = links_needed.begin(); it != links_needed.end(); ++it)
-                {
-                    lenses.linkVariablePart(*it, i);
-                }
-            }
-        }
-
-        HuginBase::SmartPhotometricOptimizer::PhotometricOptimizeMode optmode =
-            HuginBase::SmartPhotometricOptimizer::OPT_PHOTOMETRIC_LDR_WB;
-        if (opts.outputMode == HuginBase::PanoramaOptions::OUTPUT_HDR || variable_groups.getStacks().getNumberOfParts() < pano.getNrOfImages())
-        {
-            // use HDR algorithm is HDR mode is selected or the project contains stacks
-            optmode = HuginBase::SmartPhotometricOptimizer::OPT_PHOTOMETRIC_HDR;
-        }
-        HuginBase::SmartPhotometricOptimizer photoOpt(pano, progressDisplay, pano.getOptimizeVector(), points, imageStepSize, optmode);
-        photoOpt.run();
-
-        // calculate the mean exposure.
-        opts.outputExposureValue = HuginBase::CalculateMeanExposure::calcMeanExposure(pano);
-        pano.setOptions(opts);
+        HuginBase::SmartPhotometricOptimizer::optimizeProjectPhotometric(pano, points, imageStepSize, progressDisplay);
         progressDisplay->taskFinished();
         delete progressDisplay;
     };
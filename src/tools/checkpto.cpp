@@ -28,6 +28,8 @@
 #include <hugin_config.h>
 
 #include <fstream>
+#include <iomanip>
+#include <cmath>
 #include <sstream>
 #include <getopt.h>
 
@@ -37,6 +39,7 @@
 #include "hugin_base/panodata/StandardImageVariableGroups.h"
 #include "algorithms/basic/CalculateCPStatistics.h"
 #include "algorithms/basic/LayerStacks.h"
+#include "algorithms/basic/CalculateOverlap.h"
 
 static void usage(const char* name)
 {
@@ -53,6 +56,9 @@ static void usage(const char* name)
          << "  --print-lens-info       Print more information about lenses" << std::endl
          << "  --print-stack-info      Print more information about assigned stacks" << std::endl
          << "                          spaceholders will be replaced with real values" << std::endl
+         << "  --check-overlap         Check also which images are connected by" << std::endl
+         << "                          their overlap" << std::endl
+         << "  --json                  Print the report in JSON format" << std::endl
          << std::endl
          << name << " is used by the assistant and by the stitching makefiles" << std::endl
          << std::endl;
@@ -86,6 +92,77 @@ void printImageGroup(const std::vector<HuginBase::UIntSet>& imageGroup, const st
     }
 };
 
+/** escapes the string for the use in JSON output */
+std::string EscapeJSON(const std::string& s)
+{
+    std::ostringstream out;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        const unsigned char c = s[i];
+        switch (c)
+        {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            case '\n':
+                out << "\\n";
+                break;
+            case '\r':
+                out << "\\r";
+                break;
+            case '\t':
+                out << "\\t";
+                break;
+            default:
+                if (c < 0x20)
+                {
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec << std::setfill(' ');
+                }
+                else
+                {
+                    out << c;
+                };
+        };
+    };
+    return out.str();
+};
+
+/** prints the image groups as JSON array of arrays */
+void printImageGroupJSON(const std::vector<HuginBase::UIntSet>& imageGroup)
+{
+    std::cout << "[";
+    for (size_t i = 0; i < imageGroup.size(); i++)
+    {
+        std::cout << (i == 0 ? "[" : ", [");
+        for (HuginBase::UIntSet::const_iterator it = imageGroup[i].begin(); it != imageGroup[i].end(); ++it)
+        {
+            if (it != imageGroup[i].begin())
+            {
+                std::cout << ", ";
+            };
+            std::cout << *it;
+        };
+        std::cout << "]";
+    };
+    std::cout << "]";
+};
+
+/** prints the number in JSON format, JSON does not know NaN or infinity */
+void printNumberJSON(const double value)
+{
+    if (std::isfinite(value))
+    {
+        std::cout << value;
+    }
+    else
+    {
+        std::cout << "null";
+    };
+};
+
 int main(int argc, char* argv[])
 {
     // parse arguments
@@ -95,12 +172,16 @@ int main(int argc, char* argv[])
         PRINT_OUTPUT_INFO=1000,
         PRINT_LENS_INFO=1004,
         PRINT_STACK_INFO=1005,
+        CHECK_OVERLAP=1006,
+        PRINT_JSON=1007,
     };
     static struct option longOptions[] =
     {
         { "print-output-info", no_argument, NULL, PRINT_OUTPUT_INFO },
         { "print-lens-info", no_argument, NULL, PRINT_LENS_INFO },
         { "print-stack-info", no_argument, NULL, PRINT_STACK_INFO },
+        { "check-overlap", no_argument, NULL, CHECK_OVERLAP },
+        { "json", no_argument, NULL, PRINT_JSON },
         { "help", no_argument, NULL, 'h' },
         0
     };
@@ -109,6 +190,8 @@ int main(int argc, char* argv[])
     bool printOutputInfo=false;
     bool printLensInfo = false;
     bool printStackInfo = false;
+    bool checkOverlap = false;
+    bool printJSON = false;
     int optionIndex = 0;
     while ((c = getopt_long (argc, argv, optstring, longOptions,nullptr)) != -1)
     {
@@ -126,6 +209,12 @@ int main(int argc, char* argv[])
             case PRINT_STACK_INFO:
                 printStackInfo = true;
                 break;
+            case CHECK_OVERLAP:
+                checkOverlap = true;
+                break;
+            case PRINT_JSON:
+                printJSON = true;
+                break;
             case '?':
             case ':':
                 // missing argument or invalid switch
@@ -170,6 +259,77 @@ int main(int argc, char* argv[])
     }
 
     HuginBase::ConstStandardImageVariableGroups variable_groups(pano);
+    //cp statistics
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double var = 0;
+    if(pano.getNrOfCtrlPoints()>0)
+    {
+        HuginBase::PTools::calcCtrlPointErrors(pano);
+        HuginBase::CalculateCPStatisticsError::calcCtrlPntsErrorStats(pano, min, max, mean, var);
+    };
+    // the components are calculated with a union-find structure,
+    // this is much faster for big projects than the search in the image graph
+    const HuginGraph::ImageGraph::Components comps = HuginGraph::ImageGraph::GetComponents(pano);
+    HuginGraph::ImageGraph::Components overlapComps;
+    if (checkOverlap && pano.getNrOfImages() > 0)
+    {
+        HuginBase::CalculateImageOverlap overlap(&pano);
+        overlap.calculate(10);  // we are testing 10*10=100 points
+        overlapComps = HuginGraph::ImageGraph::GetComponents(overlap);
+    };
+    // return value must be 0 if all images are connected, otherwise the assistant does not continue
+    int returnValue = (comps.size() == 1) ? 0 : comps.size();
+    if (printJSON)
+    {
+        std::cout << "{" << std::endl
+            << "  \"project\": \"" << EscapeJSON(input) << "\"," << std::endl
+            << "  \"images\": " << pano.getNrOfImages() << "," << std::endl
+            << "  \"lenses\": " << variable_groups.getLenses().getNumberOfParts() << "," << std::endl
+            << "  \"stacks\": " << variable_groups.getStacks().getNumberOfParts() << "," << std::endl
+            << "  \"controlPoints\": " << pano.getNrOfCtrlPoints() << "," << std::endl;
+        if (max > 0)
+        {
+            std::cout << "  \"controlPointStatistics\": { \"mean\": ";
+            printNumberJSON(mean);
+            std::cout << ", \"standardDeviation\": ";
+            printNumberJSON(sqrt(var));
+            std::cout << ", \"minimum\": ";
+            printNumberJSON(min);
+            std::cout << ", \"maximum\": ";
+            printNumberJSON(max);
+            std::cout << " }," << std::endl;
+        };
+        std::cout << "  \"connected\": " << (comps.size() == 1 ? "true" : "false") << "," << std::endl
+            << "  \"imageGroups\": ";
+        printImageGroupJSON(comps);
+        if (checkOverlap)
+        {
+            std::cout << "," << std::endl << "  \"overlapGroups\": ";
+            printImageGroupJSON(overlapComps);
+        };
+        if (printLensInfo)
+        {
+            std::cout << "," << std::endl << "  \"lensGroups\": ";
+            printImageGroupJSON(variable_groups.getLenses().getPartsSet());
+        };
+        if (printStackInfo)
+        {
+            std::cout << "," << std::endl << "  \"stackGroups\": ";
+            printImageGroupJSON(variable_groups.getStacks().getPartsSet());
+        };
+        if (printOutputInfo)
+        {
+            HuginBase::UIntSet outputImages = HuginBase::getImagesinROI(pano, pano.getActiveImages());
+            std::cout << "," << std::endl << "  \"outputStacks\": ";
+            printImageGroupJSON(HuginBase::getHDRStacks(pano, outputImages, pano.getOptions()));
+            std::cout << "," << std::endl << "  \"outputLayers\": ";
+            printImageGroupJSON(HuginBase::getExposureLayers(pano, outputImages, pano.getOptions()));
+        };
+        std::cout << std::endl << "}" << std::endl;
+        return returnValue;
+    };
     std::cout << std::endl
               << "Opened project " << input << std::endl << std::endl
               << "Project contains" << std::endl
@@ -177,33 +337,18 @@ int main(int argc, char* argv[])
               << variable_groups.getLenses().getNumberOfParts() << " lenses" << std::endl
               << variable_groups.getStacks().getNumberOfParts() << " stacks" << std::endl
               << pano.getNrOfCtrlPoints() << " control points" << std::endl << std::endl;
-    //cp statistics
-    if(pano.getNrOfCtrlPoints()>0)
+    if(max>0)
     {
-        double min;
-        double max;
-        double mean;
-        double var;
-        HuginBase::PTools::calcCtrlPointErrors(pano);
-        HuginBase::CalculateCPStatisticsError::calcCtrlPntsErrorStats(pano, min, max, mean, var);
-        if(max>0)
-        {
-            std::cout << "Control points statistics" << std::endl
-                      << std::fixed << std::setprecision(2)
-                      << "\tMean error        : " << mean << std::endl
-                      << "\tStandard deviation: " << sqrt(var) << std::endl
-                      << "\tMinimum           : " << min << std::endl
-                      << "\tMaximum           : " << max << std::endl;
-        };
+        std::cout << "Control points statistics" << std::endl
+                  << std::fixed << std::setprecision(2)
+                  << "\tMean error        : " << mean << std::endl
+                  << "\tStandard deviation: " << sqrt(var) << std::endl
+                  << "\tMinimum           : " << min << std::endl
+                  << "\tMaximum           : " << max << std::endl;
     };
-    HuginGraph::ImageGraph graph(pano);
-    const HuginGraph::ImageGraph::Components comps = graph.GetComponents();
-    int returnValue=0;
     if(comps.size()==1)
     {
         std::cout << "All images are connected." << std::endl;
-        // return value must be 0, otherwise the assistant does not continue
-        returnValue=0;
     }
     else
     {
@@ -231,9 +376,20 @@ int main(int argc, char* argv[])
                 std::cout << ", " << std::endl;
             }
         }
-        returnValue=comps.size();
     };
     std::cout << std::endl;
+    if (checkOverlap)
+    {
+        if (overlapComps.size() == 1)
+        {
+            std::cout << std::endl << "All images are connected by their overlap." << std::endl;
+        }
+        else
+        {
+            std::cout << std::endl << "There are " << overlapComps.size() << " image groups by overlap:" << std::endl;
+            printImageGroup(overlapComps);
+        };
+    };
     if (printLensInfo)
     {
         std::cout << std::endl << "Lenses:" << std::endl;
@@ -33,7 +33,6 @@
 #include <getopt.h>
 
 #include <algorithms/optimizer/PTOptimizer.h>
-#include <algorithms/optimizer/ImageGraph.h>
 #include <algorithms/control_points/CleanCP.h>
 #include "panotools/PanoToolsInterface.h"
 
@@ -205,43 +204,13 @@ int main(int argc, char* argv[])
         PT_setInfoDlgFcn(ptinfoDlg);
     };
 
-    size_t cpremoved1 = 0;
-    HuginBase::UIntSet CPtoRemove;
-    // step 1 with pairwise optimisation
-    if(!wholePano)
+    if (!onlyPair && skipOptimisation)
     {
-        AppBase::DummyProgressDisplay dummy;
-        CPtoRemove=getCPoutsideLimit_pair(pano, dummy, n);
-        if (!CPtoRemove.empty())
-            for (HuginBase::UIntSet::reverse_iterator it = CPtoRemove.rbegin(); it != CPtoRemove.rend(); ++it)
-            {
-                pano.removeCtrlPoint(*it);
-            }
-        cpremoved1=CPtoRemove.size();
-    };
-
-    // step 2 with optimisation of whole panorama
-    bool unconnected=false;
-    if(!onlyPair)
-    {
-        //check for unconnected images
-        HuginGraph::ImageGraph graph(pano);
-        unconnected = !graph.IsConnected();
-        if (!unconnected)
-        {
-            CPtoRemove.clear();
-            if(skipOptimisation)
-            {
-                std::cout << std::endl << "Skipping optimisation, current image positions will be used." << std::endl;
-            };
-            CPtoRemove=getCPoutsideLimit(pano, n, skipOptimisation, includeLineCp);
-            if (!CPtoRemove.empty())
-                for (HuginBase::UIntSet::reverse_iterator it = CPtoRemove.rbegin(); it != CPtoRemove.rend(); ++it)
-                {
-                    pano.removeCtrlPoint(*it);
-                }
-        };
+        std::cout << std::endl << "Skipping optimisation, current image positions will be used." << std::endl;
     };
+    size_t cpremoved1 = 0;
+    size_t cpremoved2 = 0;
+    const bool connected = HuginBase::CleanControlPoints(pano, n, !wholePano, !onlyPair, skipOptimisation, includeLineCp, cpremoved1, cpremoved2);
 
     std::cout << std::endl;
     if(!wholePano)
@@ -250,13 +219,13 @@ int main(int argc, char* argv[])
     }
     if (!onlyPair)
     {
-        if (unconnected)
+        if (!connected)
         {
             std::cout << "Skipped step 2 because of unconnected image pairs" << std::endl;
         }
         else
         {
-            std::cout << "Removed " << CPtoRemove.size() << " control points in step 2" << std::endl;
+            std::cout << "Removed " << cpremoved2 << " control points in step 2" << std::endl;
         };
     };
 
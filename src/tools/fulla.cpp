@@ -27,6 +27,8 @@
 #include <hugin_config.h>
 #include <fstream>
 #include <sstream>
+#include <future>
+#include <memory>
 
 #include <vigra/error.hxx>
 #include <vigra/impex.hxx>
@@ -58,7 +60,8 @@ void correctImage(SrcImgType& srcImg,
 
 template <class PIXELTYPE>
 void correctRGB(HuginBase::SrcPanoImage& src, vigra::ImageImportInfo& info, const char* outfile,
-                bool crop, const std::string& compression, AppBase::ProgressDisplay* progress);
+                bool crop, const std::string& compression, AppBase::ProgressDisplay* progress,
+                std::future<void>& pendingSave);
 
 static void usage(const char* name)
 {
@@ -397,6 +400,9 @@ int main(int argc, char* argv[])
     };
 
     HuginBase::LensDB::LensDB& lensDB = HuginBase::LensDB::LensDB::GetSingleton();
+    // the saving of the corrected image runs in the background, while the next
+    // image is loaded and corrected
+    std::future<void> pendingSave;
     try
     {
         std::vector<std::string>::iterator outIt = outFiles.begin();
@@ -520,27 +526,27 @@ int main(int argc, char* argv[])
                 // TODO: add more cases
                 if (strcmp(pixelType, "UINT8") == 0)
                 {
-                    correctRGB<vigra::RGBValue<vigra::UInt8> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp);
+                    correctRGB<vigra::RGBValue<vigra::UInt8> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp, pendingSave);
                 }
                 else if (strcmp(pixelType, "UINT16") == 0)
                 {
-                    correctRGB<vigra::RGBValue<vigra::UInt16> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp);
+                    correctRGB<vigra::RGBValue<vigra::UInt16> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp, pendingSave);
                 }
                 else if (strcmp(pixelType, "INT16") == 0)
                 {
-                    correctRGB<vigra::RGBValue<vigra::Int16> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp);
+                    correctRGB<vigra::RGBValue<vigra::Int16> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp, pendingSave);
                 }
                 else if (strcmp(pixelType, "UINT32") == 0)
                 {
-                    correctRGB<vigra::RGBValue<vigra::UInt32> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp);
+                    correctRGB<vigra::RGBValue<vigra::UInt32> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp, pendingSave);
                 }
                 else if (strcmp(pixelType, "FLOAT") == 0)
                 {
-                    correctRGB<vigra::RGBValue<float> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp);
+                    correctRGB<vigra::RGBValue<float> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp, pendingSave);
                 }
                 else if (strcmp(pixelType, "DOUBLE") == 0)
                 {
-                    correctRGB<vigra::RGBValue<double> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp);
+                    correctRGB<vigra::RGBValue<double> >(currentImg, info, outIt->c_str(), doCropBorders, compression, pdisp, pendingSave);
                 }
             }
             else
@@ -552,6 +558,11 @@ int main(int argc, char* argv[])
                 return 1;
             }
         }
+        // wait for the last image
+        if (pendingSave.valid())
+        {
+            pendingSave.get();
+        };
     }
     catch (std::exception& e)
     {
@@ -577,6 +588,81 @@ public:
 };
 
 
+/** remap the 3 channels of a RGB image with individual transforms in a single pass
+ *
+ *  The coordinates of all channels are calculated and sampled together for each
+ *  output pixel, so the image is traversed only once. Channels with an identity
+ *  transform are copied. The output alpha channel is the combination of the
+ *  alpha channels of all 3 channels.
+ */
+template <class SrcImgType, class AlphaImgType, class DestImgType>
+void transformImageRGBAlpha(SrcImgType& srcImg,
+                            const AlphaImgType& srcAlpha,
+                            DestImgType& destImg,
+                            AlphaImgType& destAlpha,
+                            vigra::Diff2D destUL,
+                            std::vector<HuginBase::Nona::SpaceTransform>& transforms)
+{
+    typedef typename SrcImgType::value_type SrcPixelType;
+    typedef typename DestImgType::value_type DestPixelType;
+    typedef typename AlphaImgType::value_type AlphaType;
+    typedef vigra::VectorElementAccessor<vigra::VectorAccessor<SrcPixelType> > SrcChannelAccessor;
+    typedef vigra::VectorElementAccessor<vigra::VectorAccessor<DestPixelType> > DestChannelAccessor;
+    typedef vigra_ext::ImageMaskInterpolator<typename SrcImgType::traverser, SrcChannelAccessor,
+        typename AlphaImgType::const_traverser, typename AlphaImgType::ConstAccessor,
+        vigra_ext::interp_spline16> ChannelInterpolator;
+
+    vigra_ext::interp_spline16 interp;
+    std::vector<ChannelInterpolator> interpolators;
+    std::vector<bool> isIdentity(3);
+    for (int channel = 0; channel < 3; ++channel)
+    {
+        interpolators.push_back(ChannelInterpolator(
+            srcIterRange(srcImg.upperLeft(), srcImg.lowerRight(), SrcChannelAccessor(channel)),
+            srcImage(srcAlpha), interp, false));
+        isIdentity[channel] = transforms[channel].isIdentity();
+    };
+    const int width = destImg.width();
+    const int height = destImg.height();
+
+    // loop over the image and transform
+#pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < height; ++y)
+    {
+        typename DestImgType::traverser xd(destImg.upperLeft() + vigra::Diff2D(0, y));
+        typename AlphaImgType::traverser xdm(destAlpha.upperLeft() + vigra::Diff2D(0, y));
+        for (int x = 0; x < width; ++x, ++xd.x, ++xdm.x)
+        {
+            AlphaType alpha = 255;
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                AlphaType channelAlpha = 0;
+                if (isIdentity[channel])
+                {
+                    DestChannelAccessor(channel).set(srcImg(x, y)[channel], xd);
+                    channelAlpha = srcAlpha(x, y);
+                }
+                else
+                {
+                    double sx, sy;
+                    typename SrcChannelAccessor::value_type value;
+                    if (transforms[channel].transformImgCoord(sx, sy, x + destUL.x, y + destUL.y)
+                        && interpolators[channel](sx, sy, value, channelAlpha))
+                    {
+                        DestChannelAccessor(channel).set(vigra_ext::zeroNegative(value), xd);
+                    }
+                    else
+                    {
+                        channelAlpha = 0;
+                    };
+                };
+                alpha &= channelAlpha;
+            };
+            *xdm = alpha;
+        };
+    };
+}
+
 /** remap a single image
  *
  *  Be careful, might modify srcImg (vignetting and brightness correction)
@@ -656,78 +742,13 @@ void correctImage(SrcImgType& srcImg,
                 << "g: " << radGreen[0] << " " << radGreen[1] << " " << radGreen[2] << " " << radGreen[3] << endl
                 << "b: " << radBlue[0] << " " << radBlue[1] << " " << radBlue[2] << " " << radBlue[3] << endl);
         */
-        // remap individual channels
-        HuginBase::Nona::SpaceTransform transfr;
-        transfr.InitRadialCorrect(src, 0);
-        AlphaImgType redAlpha(destAlpha.size());
-        if (transfr.isIdentity())
-        {
-            vigra::copyImage(srcIterRange(srcImg.upperLeft(), srcImg.lowerRight(), vigra::RedAccessor<SrcPixelType>()),
-                             destIter(destImg.upperLeft(), vigra::RedAccessor<DestPixelType>()));
-            vigra::copyImage(srcImageRange(srcAlpha), destImage(redAlpha));
-        }
-        else
-        {
-            vigra_ext::transformImageAlpha(srcIterRange(srcImg.upperLeft(), srcImg.lowerRight(), vigra::RedAccessor<SrcPixelType>()),
-                                      srcImage(srcAlpha),
-                                      destIterRange(destImg.upperLeft(), destImg.lowerRight(), vigra::RedAccessor<DestPixelType>()),
-                                      destImage(redAlpha),
-                                      shiftXY,
-                                      transfr,
-                                      ptf,
-                                      false,
-                                      vigra_ext::INTERP_SPLINE_16,
-                                      progress);
-        }
-
-        HuginBase::Nona::SpaceTransform transfg;
-        transfg.InitRadialCorrect(src, 1);
-        AlphaImgType greenAlpha(destAlpha.size());
-        if (transfg.isIdentity())
-        {
-            vigra::copyImage(srcIterRange(srcImg.upperLeft(), srcImg.lowerRight(), vigra::GreenAccessor<SrcPixelType>()),
-                             destIter(destImg.upperLeft(), vigra::GreenAccessor<DestPixelType>()));
-            vigra::copyImage(srcImageRange(srcAlpha), destImage(greenAlpha));
-        }
-        else
-        {
-            transformImageAlpha(srcIterRange(srcImg.upperLeft(), srcImg.lowerRight(), vigra::GreenAccessor<SrcPixelType>()),
-                           srcImage(srcAlpha),
-                           destIterRange(destImg.upperLeft(), destImg.lowerRight(), vigra::GreenAccessor<DestPixelType>()),
-                           destImage(greenAlpha),
-                           shiftXY,
-                           transfg,
-                           ptf,
-                           false,
-                           vigra_ext::INTERP_SPLINE_16,
-                           progress);
-        }
-
-        HuginBase::Nona::SpaceTransform transfb;
-        transfb.InitRadialCorrect(src, 2);
-        AlphaImgType blueAlpha(destAlpha.size());
-        if (transfb.isIdentity())
-        {
-            vigra::copyImage(srcIterRange(srcImg.upperLeft(), srcImg.lowerRight(), vigra::BlueAccessor<SrcPixelType>()),
-                             destIter(destImg.upperLeft(), vigra::BlueAccessor<DestPixelType>()));
-            vigra::copyImage(srcImageRange(srcAlpha), destImage(blueAlpha));
-
-        }
-        else
+        // remap all channels in one pass, each channel with its own transform
+        std::vector<HuginBase::Nona::SpaceTransform> transforms(3);
+        for (int channel = 0; channel < 3; ++channel)
         {
-            transformImageAlpha(srcIterRange(srcImg.upperLeft(), srcImg.lowerRight(), vigra::BlueAccessor<SrcPixelType>()),
-                           srcImage(srcAlpha),
-                           destIterRange(destImg.upperLeft(), destImg.lowerRight(), vigra::BlueAccessor<DestPixelType>()),
-                           destImage(blueAlpha),
-                           shiftXY,
-                           transfb,
-                           ptf,
-                           false,
-                           vigra_ext::INTERP_SPLINE_16,
-                           progress);
-        }
-        vigra::combineThreeImages(srcImageRange(redAlpha), srcImage(greenAlpha), srcImage(blueAlpha), destImage(destAlpha),
-            vigra::functor::Arg1() & vigra::functor::Arg2() & vigra::functor::Arg3());
+            transforms[channel].InitRadialCorrect(src, channel);
+        };
+        transformImageRGBAlpha(srcImg, srcAlpha, destImg, destAlpha, shiftXY, transforms);
     }
     else
     {
@@ -762,12 +783,14 @@ void correctImage(SrcImgType& srcImg,
 //void correctRGB(SrcImageInfo & src, ImageImportInfo & info, const char * outfile)
 template <class PIXELTYPE>
 void correctRGB(HuginBase::SrcPanoImage& src, vigra::ImageImportInfo& info, const char* outfile,
-                bool crop, const std::string& compression, AppBase::ProgressDisplay* progress)
+                bool crop, const std::string& compression, AppBase::ProgressDisplay* progress,
+                std::future<void>& pendingSave)
 {
+    typedef vigra::BasicImage<PIXELTYPE> OutputImageType;
     vigra::BasicImage<vigra::RGBValue<double> > srcImg(info.size());
-    vigra::BasicImage<PIXELTYPE> output(info.size());
+    std::shared_ptr<OutputImageType> output = std::make_shared<OutputImageType>(info.size());
     vigra::BImage alpha(info.size(), 255);
-    vigra::BImage outputAlpha(output.size());
+    std::shared_ptr<vigra::BImage> outputAlpha = std::make_shared<vigra::BImage>(output->size());
     if (info.numBands() == 3)
     {
         vigra::importImage(info, destImage(srcImg));
@@ -784,7 +807,7 @@ void correctRGB(HuginBase::SrcPanoImage& src, vigra::ImageImportInfo& info, cons
         vigra::importImage(finfo, destImage(flatfield));
     }
     correctImage(srcImg, alpha, flatfield, src, vigra_ext::INTERP_SPLINE_16, vigra_ext::getMaxValForPixelType(info.getPixelType()),
-        output, outputAlpha, crop, progress);
+        *output, *outputAlpha, crop, progress);
     vigra::ImageExportInfo outInfo(outfile);
     outInfo.setICCProfile(info.getICCProfile());
     outInfo.setPixelType(info.getPixelType());
@@ -793,11 +816,16 @@ void correctRGB(HuginBase::SrcPanoImage& src, vigra::ImageImportInfo& info, cons
         outInfo.setCompression(compression.c_str());
     }
     const std::string filetype(vigra::getEncoder(outInfo.getFileName())->getFileType());
-    if (vigra::isBandNumberSupported(filetype, 4))
+    const bool withAlpha = vigra::isBandNumberSupported(filetype, 4);
+    // only one image should wait for saving
+    if (pendingSave.valid())
+    {
+        pendingSave.get();
+    };
+    if (withAlpha)
     {
         // image format supports alpha channel
         std::cout << "Saving " << outInfo.getFileName() << std::endl;
-        vigra::exportImageAlpha(srcImageRange(output), srcImage(outputAlpha), outInfo);
     }
     else
     {
@@ -805,6 +833,16 @@ void correctRGB(HuginBase::SrcPanoImage& src, vigra::ImageImportInfo& info, cons
         std::cout << "Saving " << outInfo.getFileName() << " without alpha channel" << std::endl
             << "because the fileformat " << filetype << " does not support" << std::endl
             << "an alpha channel." << std::endl;
-        exportImage(srcImageRange(output), outInfo);
     };
+    pendingSave = std::async(std::launch::async, [output, outputAlpha, outInfo, withAlpha]()
+    {
+        if (withAlpha)
+        {
+            vigra::exportImageAlpha(srcImageRange(*output), srcImage(*outputAlpha), outInfo);
+        }
+        else
+        {
+            vigra::exportImage(srcImageRange(*output), outInfo);
+        };
+    });
 }
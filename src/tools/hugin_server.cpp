@@ -0,0 +1,919 @@
+// -*- c-basic-offset: 4 -*-
+
+/** @file hugin_server.cpp
+ *
+ *  @brief resident worker, which runs the steps of the command line tools
+ *         on a project kept in memory
+ *
+ */
+
+/*  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <hugin_config.h>
+
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <getopt.h>
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include <hugin_basic.h>
+#include <hugin_utils/stl_utils.h>
+#include <appbase/ProgressDisplay.h>
+#include <algorithms/optimizer/PTOptimizer.h>
+#include <algorithms/control_points/CleanCP.h>
+#include <algorithms/nona/CenterHorizontally.h>
+#include <algorithms/basic/StraightenPanorama.h>
+#include <algorithms/basic/LayerStacks.h>
+#include <algorithms/basic/ModifyPanoramaOptions.h>
+#include <algorithms/optimizer/PhotometricOptimizer.h>
+#include <algorithms/nona/NonaFileStitcher.h>
+#include <panodata/StandardImageVariableGroups.h>
+#include <huginapp/ImageCache.h>
+#include <lines/FindLines.h>
+#include "panotools/PanoToolsInterface.h"
+#include "ExtractPoints.h"
+// also defines the dummy panotools progress functions
+#include <cpfind/PanoDetector.h>
+
+static void usage(const char* name)
+{
+    std::cout << name << ": execute processing steps on a resident project" << std::endl
+        << "hugin_server version " << hugin_utils::GetHuginVersion() << std::endl
+        << std::endl
+        << "Usage:  " << name << " [options] [input.pto]" << std::endl
+        << std::endl
+        << "  hugin_server keeps the project in memory and reads commands from stdin," << std::endl
+        << "  one command per line. cpfind keeps the keypoints and" << std::endl
+        << "  linefind the decoded images in memory for the next run, photometric" << std::endl
+        << "  and stitch read the images from disk on each call." << std::endl
+        << "  Each command is answered with a single line on stdout, starting with" << std::endl
+        << "  OK or ERROR. All other messages are written to stderr." << std::endl
+        << std::endl
+        << "  Options:" << std::endl
+        << "     -q|--quiet               no progress is reported" << std::endl
+        << "     -h|--help                shows this help" << std::endl
+        << std::endl
+        << "  Commands:" << std::endl
+        << "     load FILE                load project file" << std::endl
+        << "     save [FILE]              save project file, default is the loaded file" << std::endl
+        << "     info                     report number of images and control points" << std::endl
+        << "     optimise MODE [sparse]   optimise image positions, MODE is one of" << std::endl
+        << "                              positions (like autooptimiser -n)," << std::endl
+        << "                              pairwise (-p) or auto (-a)" << std::endl
+        << "     photometric              optimise photometric parameters (-m)" << std::endl
+        << "     cpfind [STRATEGY]        find control points like cpfind, STRATEGY is one" << std::endl
+        << "                              of allpairs (default), linear, multirow or" << std::endl
+        << "                              prealigned" << std::endl
+        << "     cpclean [N]              remove control points with an error bigger" << std::endl
+        << "                              than mean+N*sigma (default N: 2)" << std::endl
+        << "     linefind [LINES]         search vertical lines (default: 5 lines)" << std::endl
+        << "     straighten               straighten and center panorama" << std::endl
+        << "     center                   center panorama horizontally" << std::endl
+        << "     projection NUMBER        set output projection" << std::endl
+        << "     fov AUTO|HFOV[xVFOV]     set field of view" << std::endl
+        << "     canvas AUTO|num%|WIDTHxHEIGHT  set output canvas size" << std::endl
+        << "     crop AUTO|AUTOHDR|left,right,top,bottom  set crop rectangle" << std::endl
+        << "     stitch PREFIX [FORMAT]   remap images like nona, FORMAT is one of" << std::endl
+        << "                              TIFF_m (default), TIFF, TIFF_multilayer," << std::endl
+        << "                              JPEG, JPEG_m, PNG, PNG_m, EXR, EXR_m" << std::endl
+        << "     release                  release images cached by linefind and" << std::endl
+        << "                              keypoints kept by cpfind" << std::endl
+        << "     quit                     exit server" << std::endl
+        << std::endl
+        << "  Filenames containing spaces have to be enclosed in double quotes." << std::endl
+        << std::endl;
+}
+
+/** splits a command line into words, words in double quotes can contain spaces */
+static std::vector<std::string> SplitCommand(const std::string& line)
+{
+    std::vector<std::string> words;
+    std::string word;
+    bool inWord = false;
+    bool inQuotes = false;
+    for (size_t i = 0; i < line.length(); ++i)
+    {
+        const char c = line[i];
+        if (c == '"')
+        {
+            inQuotes = !inQuotes;
+            inWord = true;
+        }
+        else
+        {
+            if (!inQuotes && isspace(c))
+            {
+                if (inWord)
+                {
+                    words.push_back(word);
+                    word.clear();
+                    inWord = false;
+                };
+            }
+            else
+            {
+                word.push_back(c);
+                inWord = true;
+            };
+        };
+    };
+    if (inWord)
+    {
+        words.push_back(word);
+    };
+    return words;
+}
+
+/** executes the commands on the resident project */
+class ProjectServer
+{
+public:
+    explicit ProjectServer(bool quiet) : m_quiet(quiet) {};
+    /** executes a single command line, writes the answer to stdout
+     *  @return false, if the server should exit */
+    bool Execute(const std::string& line);
+
+private:
+    /** all commands return true on success, on failure the error message is stored in m_error */
+    bool Load(const std::vector<std::string>& args);
+    bool Save(const std::vector<std::string>& args);
+    bool Info(const std::vector<std::string>& args);
+    bool Optimise(const std::vector<std::string>& args);
+    bool Photometric(const std::vector<std::string>& args);
+    bool Cpfind(const std::vector<std::string>& args);
+    bool CPClean(const std::vector<std::string>& args);
+    bool LineFind(const std::vector<std::string>& args);
+    bool Straighten(const std::vector<std::string>& args);
+    bool Center(const std::vector<std::string>& args);
+    bool Projection(const std::vector<std::string>& args);
+    bool FieldOfView(const std::vector<std::string>& args);
+    bool Canvas(const std::vector<std::string>& args);
+    bool Crop(const std::vector<std::string>& args);
+    bool Stitch(const std::vector<std::string>& args);
+    bool Release(const std::vector<std::string>& args);
+    /** checks that a project with images is loaded */
+    bool CheckProject();
+    /** returns a new progress display, depending on the quiet setting */
+    AppBase::ProgressDisplay* GetProgressDisplay() const;
+
+    HuginBase::Panorama m_pano;
+    std::string m_filename;
+    bool m_quiet;
+    /** error message of last command */
+    std::string m_error;
+    /** message send with the OK answer */
+    std::string m_message;
+    /** keypoints found by cpfind, reused by the next cpfind run */
+    PanoDetector::KeypointStore m_keypoints;
+};
+
+bool ProjectServer::Execute(const std::string& line)
+{
+    const std::vector<std::string> words = SplitCommand(line);
+    if (words.empty() || words[0][0] == '#')
+    {
+        // ignore empty lines and comments
+        return true;
+    };
+    const std::string command = hugin_utils::tolower(words[0]);
+    const std::vector<std::string> args(words.begin() + 1, words.end());
+    if (command == "quit" || command == "exit")
+    {
+        std::cout << "OK" << std::endl;
+        return false;
+    };
+    typedef bool (ProjectServer::*CommandFunction)(const std::vector<std::string>&);
+    static const struct
+    {
+        const char* name;
+        CommandFunction function;
+    } commands[] =
+    {
+        { "load", &ProjectServer::Load },
+        { "save", &ProjectServer::Save },
+        { "info", &ProjectServer::Info },
+        { "optimise", &ProjectServer::Optimise },
+        { "optimize", &ProjectServer::Optimise },
+        { "photometric", &ProjectServer::Photometric },
+        { "cpfind", &ProjectServer::Cpfind },
+        { "cpclean", &ProjectServer::CPClean },
+        { "linefind", &ProjectServer::LineFind },
+        { "straighten", &ProjectServer::Straighten },
+        { "center", &ProjectServer::Center },
+        { "projection", &ProjectServer::Projection },
+        { "fov", &ProjectServer::FieldOfView },
+        { "canvas", &ProjectServer::Canvas },
+        { "crop", &ProjectServer::Crop },
+        { "stitch", &ProjectServer::Stitch },
+        { "release", &ProjectServer::Release }
+    };
+    m_error.clear();
+    m_message.clear();
+    bool found = false;
+    bool success = false;
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i)
+    {
+        if (command == commands[i].name)
+        {
+            found = true;
+            try
+            {
+                success = (this->*commands[i].function)(args);
+            }
+            catch (std::exception& e)
+            {
+                m_error = std::string("caught exception: ") + e.what();
+                success = false;
+            };
+            break;
+        };
+    };
+    if (!found)
+    {
+        m_error = "unknown command " + words[0];
+    };
+    if (success)
+    {
+        std::cout << "OK";
+        if (!m_message.empty())
+        {
+            std::cout << " " << m_message;
+        };
+    }
+    else
+    {
+        std::cout << "ERROR " << m_error;
+    };
+    std::cout << std::endl;
+    return true;
+}
+
+bool ProjectServer::CheckProject()
+{
+    if (m_pano.getNrOfImages() == 0)
+    {
+        m_error = "no project with images loaded";
+        return false;
+    };
+    return true;
+}
+
+AppBase::ProgressDisplay* ProjectServer::GetProgressDisplay() const
+{
+    if (m_quiet)
+    {
+        return new AppBase::DummyProgressDisplay();
+    };
+    return new AppBase::StreamProgressDisplay(std::cerr);
+}
+
+bool ProjectServer::Load(const std::vector<std::string>& args)
+{
+    if (args.size() != 1)
+    {
+        m_error = "load expects exactly one filename";
+        return false;
+    };
+    std::ifstream prjfile(args[0].c_str());
+    if (!prjfile.good())
+    {
+        m_error = "could not open script " + args[0];
+        return false;
+    };
+    HuginBase::Panorama newPano;
+    newPano.setFilePrefix(hugin_utils::getPathPrefix(args[0]));
+    AppBase::DocumentData::ReadWriteError err = newPano.readData(prjfile);
+    if (err != AppBase::DocumentData::SUCCESSFUL)
+    {
+        std::ostringstream buf;
+        buf << "error while parsing panos tool script " << args[0] << ", DocumentData::ReadWriteError code: " << err;
+        m_error = buf.str();
+        return false;
+    };
+    // use setMemento, so the resident panorama object and its caches are kept
+    m_pano.setMemento(newPano.getMemento());
+    m_keypoints.clear();
+    m_pano.setFilePrefix(hugin_utils::getPathPrefix(args[0]));
+    m_filename = args[0];
+    std::ostringstream buf;
+    buf << m_pano.getNrOfImages() << " images, " << m_pano.getNrOfCtrlPoints() << " control points";
+    m_message = buf.str();
+    return true;
+}
+
+bool ProjectServer::Save(const std::vector<std::string>& args)
+{
+    if (args.size() > 1)
+    {
+        m_error = "save expects at most one filename";
+        return false;
+    };
+    const std::string filename = args.empty() ? m_filename : args[0];
+    if (filename.empty())
+    {
+        m_error = "no filename given";
+        return false;
+    };
+    std::ofstream of(filename.c_str());
+    if (!of.good())
+    {
+        m_error = "could not write " + filename;
+        return false;
+    };
+    HuginBase::UIntSet imgs;
+    if (m_pano.getNrOfImages() > 0)
+    {
+        fill_set(imgs, 0, m_pano.getNrOfImages() - 1);
+    };
+    m_pano.printPanoramaScript(of, m_pano.getOptimizeVector(), m_pano.getOptions(), imgs, false, hugin_utils::getPathPrefix(filename));
+    m_message = filename;
+    return true;
+}
+
+bool ProjectServer::Info(const std::vector<std::string>& args)
+{
+    std::ostringstream buf;
+    buf << m_pano.getNrOfImages() << " images, " << m_pano.getNrOfCtrlPoints() << " control points, "
+        << "canvas " << m_pano.getOptions().getWidth() << "x" << m_pano.getOptions().getHeight();
+    m_message = buf.str();
+    return true;
+}
+
+bool ProjectServer::Optimise(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    if (args.empty() || args.size() > 2)
+    {
+        m_error = "usage: optimise positions|pairwise|auto [sparse]";
+        return false;
+    };
+    HuginBase::OptimizerBackend backend = HuginBase::OPTIMIZER_PANOTOOLS;
+    if (args.size() == 2)
+    {
+        if (hugin_utils::tolower(args[1]) != "sparse")
+        {
+            m_error = "unknown optimiser backend " + args[1];
+            return false;
+        };
+        backend = HuginBase::OPTIMIZER_SPARSE;
+    };
+    if (m_pano.getNrOfCtrlPoints() == 0)
+    {
+        m_error = "Panorama have to have control points to optimise positions";
+        return false;
+    };
+    const std::string mode = hugin_utils::tolower(args[0]);
+    if (mode == "pairwise")
+    {
+        HuginBase::AutoOptimise::autoOptimise(m_pano, true, backend);
+        HuginBase::OptimizeGeometric(m_pano, backend);
+    }
+    else
+    {
+        if (mode == "auto")
+        {
+            HuginBase::SmartOptimise::smartOptimize(m_pano, backend);
+        }
+        else
+        {
+            if (mode == "positions")
+            {
+                HuginBase::OptimizeGeometric(m_pano, backend);
+            }
+            else
+            {
+                m_error = "unknown optimisation mode " + args[0];
+                return false;
+            };
+        };
+    };
+    m_pano.changeFinished();
+    return true;
+}
+
+bool ProjectServer::Photometric(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    // same steps as autooptimiser -m
+    const int nPoints = 200 * m_pano.getNrOfImages();
+    std::vector<vigra_ext::PointPairRGB> points;
+    std::unique_ptr<AppBase::ProgressDisplay> progressDisplay(GetProgressDisplay());
+    float imageStepSize;
+    loadImgsAndExtractPoints(m_pano, nPoints, 3, true, *progressDisplay, points, !m_quiet, imageStepSize);
+    if (points.empty())
+    {
+        m_error = "no overlapping points found";
+        return false;
+    };
+    progressDisplay->setMessage("Photometric Optimization");
+    HuginBase::SmartPhotometricOptimizer::optimizeProjectPhotometric(m_pano, points, imageStepSize, progressDisplay.get());
+    progressDisplay->taskFinished();
+    m_pano.changeFinished();
+    return true;
+}
+
+/** redirects a stream to another stream buffer, or discards the output for NULL,
+ *  until it goes out of scope */
+class StreamRedirector
+{
+public:
+    StreamRedirector(std::ostream& stream, std::streambuf* buffer) : m_stream(stream)
+    {
+        m_oldBuffer = m_stream.rdbuf(buffer);
+    };
+    ~StreamRedirector()
+    {
+        m_stream.rdbuf(m_oldBuffer);
+        // writing to a NULL buffer sets the badbit
+        m_stream.clear();
+    };
+private:
+    std::ostream& m_stream;
+    std::streambuf* m_oldBuffer;
+};
+
+bool ProjectServer::Cpfind(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    PanoDetector::MatchingStrategy strategy = PanoDetector::ALLPAIRS;
+    if (args.size() > 1)
+    {
+        m_error = "usage: cpfind [allpairs|linear|multirow|prealigned]";
+        return false;
+    };
+    if (!args.empty())
+    {
+        const std::string mode = hugin_utils::tolower(args[0]);
+        if (mode == "allpairs")
+        {
+            strategy = PanoDetector::ALLPAIRS;
+        }
+        else
+        {
+            if (mode == "linear")
+            {
+                strategy = PanoDetector::LINEAR;
+            }
+            else
+            {
+                if (mode == "multirow")
+                {
+                    strategy = PanoDetector::MULTIROW;
+                }
+                else
+                {
+                    if (mode == "prealigned")
+                    {
+                        strategy = PanoDetector::PREALIGNED;
+                    }
+                    else
+                    {
+                        m_error = "unknown matching strategy " + args[0];
+                        return false;
+                    };
+                };
+            };
+        };
+    };
+    PanoDetector detector;
+    detector.setMatchingStrategy(strategy);
+    detector.setVerbose(m_quiet ? 0 : 1);
+    detector.setPanorama(m_pano);
+    // images with keypoints from an earlier run are not analysed again
+    detector.setKeypointStore(&m_keypoints);
+    bool success;
+    {
+        // cpfind reports on stdout, which is reserved for the answers
+        StreamRedirector redirect(std::cout, m_quiet ? NULL : std::cerr.rdbuf());
+#ifdef HAVE_OPENMP
+        // cpfind limits the number of threads depending on the available memory
+        const int threads = omp_get_max_threads();
+        success = detector.run();
+        omp_set_num_threads(threads);
+#else
+        success = detector.run();
+#endif
+    }
+    if (!success)
+    {
+        m_error = "one or more images failed to load";
+        return false;
+    };
+    const size_t oldCount = m_pano.getNrOfCtrlPoints();
+    m_pano.setCtrlPoints(detector.getPanoramaInfo()->getCtrlPoints());
+    m_pano.changeFinished();
+    const size_t newCount = m_pano.getNrOfCtrlPoints();
+    std::ostringstream buf;
+    buf << "found " << (newCount > oldCount ? newCount - oldCount : 0) << " new control points";
+    m_message = buf.str();
+    return true;
+}
+
+bool ProjectServer::CPClean(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    double n = 2.0;
+    if (!args.empty())
+    {
+        if (args.size() > 1 || !hugin_utils::stringToDouble(args[0], n) || n <= 0)
+        {
+            m_error = "usage: cpclean [N]";
+            return false;
+        };
+    };
+    // both steps, step 2 is skipped for unconnected panoramas
+    size_t removedPair = 0;
+    size_t removedWhole = 0;
+    HuginBase::CleanControlPoints(m_pano, n, true, true, false, false, removedPair, removedWhole);
+    const size_t removed = removedPair + removedWhole;
+    m_pano.changeFinished();
+    std::ostringstream buf;
+    buf << "removed " << removed << " control points";
+    m_message = buf.str();
+    return true;
+}
+
+bool ProjectServer::LineFind(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    int nrLines = 5;
+    if (!args.empty())
+    {
+        if (args.size() > 1 || !hugin_utils::stringToInt(args[0], nrLines) || nrLines < 1)
+        {
+            m_error = "usage: linefind [LINES]";
+            return false;
+        };
+    };
+    // process one image of each stack, take image with median exposure
+    std::vector<size_t> imagesToProcess;
+    HuginBase::ConstStandardImageVariableGroups variable_groups(m_pano);
+    HuginBase::UIntSetVector imageGroups = variable_groups.getStacks().getPartsSet();
+    for (size_t imgGroup = 0; imgGroup < imageGroups.size(); ++imgGroup)
+    {
+        HuginBase::UIntVector stackImages(imageGroups[imgGroup].begin(), imageGroups[imgGroup].end());
+        if (m_pano.getImage(stackImages[0]).YawisLinked())
+        {
+            std::sort(stackImages.begin(), stackImages.end(), [this](const unsigned int a, const unsigned int b)
+            {
+                return m_pano.getImage(a).getExposureValue() < m_pano.getImage(b).getExposureValue();
+            });
+            imagesToProcess.push_back(stackImages[stackImages.size() / 2]);
+        }
+        else
+        {
+            std::copy(stackImages.begin(), stackImages.end(), std::back_inserter(imagesToProcess));
+        };
+    };
+    // the images are loaded through the image cache, so they stay in memory for the next run
+    // the cache is not thread safe, so load and convert all images first
+    // images with the same filename share the entry and the converted image
+    std::vector<HuginBase::ImageCache::EntryPtr> images(imagesToProcess.size());
+    std::vector<HuginBase::ImageCache::ImageCacheRGB8Ptr> images8(imagesToProcess.size());
+    std::map<std::string, HuginBase::ImageCache::ImageCacheRGB8Ptr> convertedImages;
+    for (size_t i = 0; i < imagesToProcess.size(); ++i)
+    {
+        const std::string& filename = m_pano.getImage(imagesToProcess[i]).getFilename();
+        images[i] = HuginBase::ImageCache::getInstance().getImage(filename);
+        std::map<std::string, HuginBase::ImageCache::ImageCacheRGB8Ptr>::const_iterator it = convertedImages.find(filename);
+        if (it != convertedImages.end())
+        {
+            images8[i] = it->second;
+            continue;
+        };
+        const HuginBase::ImageCache::EntryPtr& entry = images[i];
+        if (entry->image8->width() > 0)
+        {
+            images8[i] = entry->image8;
+        }
+        else
+        {
+            // same conversion as linefind, the entry itself is not modified
+            images8[i] = HuginBase::ImageCache::ImageCacheRGB8Ptr(new vigra::UInt8RGBImage);
+            if (entry->image16->width() > 0)
+            {
+                HuginLines::convertToUInt8(*(entry->image16), entry->origType, *images8[i]);
+            }
+            else
+            {
+                if (entry->imageFloat->width() > 0)
+                {
+                    HuginLines::convertToUInt8(*(entry->imageFloat), entry->origType, *images8[i]);
+                };
+            };
+        };
+        convertedImages[filename] = images8[i];
+    };
+    std::vector<HuginBase::CPVector> foundLines(imagesToProcess.size());
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(imagesToProcess.size()); ++i)
+    {
+        vigra::UInt8RGBImage& image = *images8[i];
+        if (image.width() > 0 && image.height() > 0)
+        {
+            vigra::BImage mask(*(images[i]->mask));
+            foundLines[i] = HuginLines::GetVerticalLines(m_pano, imagesToProcess[i], image, mask, nrLines);
+        };
+    };
+    size_t nrFound = 0;
+    for (size_t i = 0; i < foundLines.size(); ++i)
+    {
+        for (HuginBase::CPVector::const_iterator cpIt = foundLines[i].begin(); cpIt != foundLines[i].end(); ++cpIt)
+        {
+            m_pano.addCtrlPoint(*cpIt);
+        };
+        nrFound += foundLines[i].size();
+    };
+    m_pano.changeFinished();
+    std::ostringstream buf;
+    buf << "found " << nrFound << " vertical lines";
+    m_message = buf.str();
+    return true;
+}
+
+bool ProjectServer::Straighten(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    HuginBase::StraightenPanorama(m_pano).run();
+    HuginBase::CenterHorizontally(m_pano).run();
+    m_pano.changeFinished();
+    return true;
+}
+
+bool ProjectServer::Center(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    HuginBase::CenterHorizontally(m_pano).run();
+    m_pano.changeFinished();
+    return true;
+}
+
+bool ProjectServer::Projection(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    int projection;
+    if (args.size() != 1 || !hugin_utils::stringToInt(args[0], projection))
+    {
+        m_error = "usage: projection NUMBER";
+        return false;
+    };
+    if (projection < 0 || projection >= panoProjectionFormatCount())
+    {
+        m_error = "projection " + args[0] + " is an invalid projection number";
+        return false;
+    };
+    HuginBase::PanoramaOptions opt = m_pano.getOptions();
+    opt.setProjection(static_cast<HuginBase::PanoramaOptions::ProjectionFormat>(projection));
+    m_pano.setOptions(opt);
+    m_pano.changeFinished();
+    return true;
+}
+
+bool ProjectServer::FieldOfView(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    if (args.size() != 1)
+    {
+        m_error = "usage: fov AUTO|HFOV[xVFOV]";
+        return false;
+    };
+    HuginBase::FieldOfViewSetting fov;
+    if (!HuginBase::ParseFieldOfView(args[0], fov, m_error))
+    {
+        return false;
+    };
+    HuginBase::ApplyFieldOfView(m_pano, fov);
+    m_pano.changeFinished();
+    std::ostringstream buf;
+    buf << m_pano.getOptions().getHFOV() << "x" << m_pano.getOptions().getVFOV();
+    m_message = buf.str();
+    return true;
+}
+
+bool ProjectServer::Canvas(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    if (args.size() != 1)
+    {
+        m_error = "usage: canvas AUTO|num%|WIDTHxHEIGHT";
+        return false;
+    };
+    HuginBase::CanvasSetting canvas;
+    if (!HuginBase::ParseCanvasSize(args[0], canvas, m_error))
+    {
+        return false;
+    };
+    HuginBase::ApplyCanvasSize(m_pano, canvas);
+    m_pano.changeFinished();
+    std::ostringstream buf;
+    buf << m_pano.getOptions().getWidth() << "x" << m_pano.getOptions().getHeight();
+    m_message = buf.str();
+    return true;
+}
+
+bool ProjectServer::Crop(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    if (args.size() != 1)
+    {
+        m_error = "usage: crop AUTO|AUTOHDR|left,right,top,bottom";
+        return false;
+    };
+    HuginBase::CropSetting crop;
+    if (!HuginBase::ParseCrop(args[0], crop, m_error))
+    {
+        return false;
+    };
+    // the autocrop uses the transformation meshes cached in the panorama
+    if (!HuginBase::ApplyCrop(m_pano, crop))
+    {
+        m_error = "could not find best crop rectangle";
+        return false;
+    };
+    m_pano.changeFinished();
+    const vigra::Rect2D roi = m_pano.getOptions().getROI();
+    std::ostringstream buf;
+    buf << roi.left() << "," << roi.right() << "," << roi.top() << "," << roi.bottom();
+    m_message = buf.str();
+    return true;
+}
+
+bool ProjectServer::Stitch(const std::vector<std::string>& args)
+{
+    if (!CheckProject())
+    {
+        return false;
+    };
+    if (args.empty() || args.size() > 2)
+    {
+        m_error = "usage: stitch PREFIX [FORMAT]";
+        return false;
+    };
+    HuginBase::PanoramaOptions opts = m_pano.getOptions();
+    // same output formats as nona
+    const std::string format = args.size() > 1 ? args[1] : "TIFF_m";
+    static const struct
+    {
+        const char* name;
+        HuginBase::PanoramaOptions::FileFormat format;
+        const char* extension;
+        bool saveROI;
+    } formats[] =
+    {
+        { "TIFF_m", HuginBase::PanoramaOptions::TIFF_m, "tif", true },
+        { "TIFF", HuginBase::PanoramaOptions::TIFF, "tif", true },
+        { "TIFF_multilayer", HuginBase::PanoramaOptions::TIFF_multilayer, "tif", true },
+        { "JPEG_m", HuginBase::PanoramaOptions::JPEG_m, "jpg", false },
+        { "JPEG", HuginBase::PanoramaOptions::JPEG, "jpg", false },
+        { "PNG_m", HuginBase::PanoramaOptions::PNG_m, "png", false },
+        { "PNG", HuginBase::PanoramaOptions::PNG, "png", false },
+        { "EXR_m", HuginBase::PanoramaOptions::EXR_m, "exr", true },
+        { "EXR", HuginBase::PanoramaOptions::EXR, "exr", true }
+    };
+    bool found = false;
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i)
+    {
+        if (format == formats[i].name)
+        {
+            opts.outputFormat = formats[i].format;
+            opts.outputImageType = formats[i].extension;
+            if (!formats[i].saveROI)
+            {
+                opts.tiff_saveROI = false;
+            };
+            found = true;
+            break;
+        };
+    };
+    if (!found)
+    {
+        m_error = "unknown output format " + format;
+        return false;
+    };
+    const HuginBase::UIntSet outputImages = HuginBase::getImagesinROI(m_pano, m_pano.getActiveImages());
+    if (outputImages.empty())
+    {
+        m_error = "project does not contain active images";
+        return false;
+    };
+    std::unique_ptr<AppBase::ProgressDisplay> progressDisplay(GetProgressDisplay());
+    HuginBase::Nona::AdvancedOptions advOptions;
+    HuginBase::NonaFileOutputStitcher(m_pano, progressDisplay.get(), opts, outputImages, args[0], advOptions).run();
+    m_message = args[0];
+    return true;
+}
+
+bool ProjectServer::Release(const std::vector<std::string>& args)
+{
+    HuginBase::ImageCache::getInstance().flush();
+    m_keypoints.clear();
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    // parse arguments
+    const char* optstring = "hq";
+    static struct option longOptions[] =
+    {
+        { "help", no_argument, NULL, 'h' },
+        { "quiet", no_argument, NULL, 'q' },
+        0
+    };
+    bool quiet = false;
+    int c;
+    while ((c = getopt_long(argc, argv, optstring, longOptions, nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 'h':
+                usage(hugin_utils::stripPath(argv[0]).c_str());
+                return 0;
+            case 'q':
+                quiet = true;
+                break;
+            case ':':
+            case '?':
+                // missing argument or invalid switch
+                return 1;
+                break;
+            default:
+                // this should not happen
+                abort();
+        }
+    }
+    if (argc - optind > 1)
+    {
+        std::cerr << hugin_utils::stripPath(argv[0]) << ": Only one project file expected." << std::endl;
+        return 1;
+    };
+
+    // disable progress messages from libpano optimizer, they would mix with the answers
+    PT_setProgressFcn(ptProgress);
+    PT_setInfoDlgFcn(ptinfoDlg);
+
+    ProjectServer server(quiet);
+    if (argc - optind == 1)
+    {
+        server.Execute(std::string("load \"") + argv[optind] + "\"");
+    };
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        if (!server.Execute(line))
+        {
+            break;
+        };
+    };
+    return 0;
+}
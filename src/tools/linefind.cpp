@@ -67,63 +67,6 @@ static int ptinfoDlg( int command, char* argument )
     return 1;
 }
 
-/** converts the given image to UInt8RGBImage
- *  only this image is correctly processed by linefind
- *  @param src input image
- *  @param origType pixel type of input image
- *  @param dest converted image
- */
-// 2 versions: one for color images, the other for gray images
-template <class SrcIMG>
-void convertToUInt8(SrcIMG& src, const std::string& origType, vigra::UInt8RGBImage& dest)
-{
-    dest.resize(src.size());
-    long newMax=vigra_ext::getMaxValForPixelType("UINT8");
-    // float needs to be from min ... max.
-    if (origType == "FLOAT" || origType == "DOUBLE")
-    {
-        /** @TODO this convert routine scale the input values range into the full scale of UInt16
-         *  this is not fully correct
-         */
-        vigra::RGBToGrayAccessor<vigra::RGBValue<float> > ga;
-        vigra::FindMinMax<float> minmax;   // init functor
-        vigra::inspectImage(srcImageRange(src, ga),
-                            minmax);
-        double minVal = minmax.min;
-        double maxVal = minmax.max;
-        vigra_ext::applyMapping(srcImageRange(src), destImage(dest), minVal, maxVal, 0);
-    }
-    else
-    {
-        vigra::transformImage(srcImageRange(src), destImage(dest),
-                              vigra::functor::Arg1()*vigra::functor::Param( newMax/ vigra_ext::getMaxValForPixelType(origType)));
-    };
-}
-
-template <class SrcIMG>
-void convertGrayToUInt8(SrcIMG& src, const std::string& origType, vigra::BImage& dest)
-{
-    dest.resize(src.size());
-    long newMax=vigra_ext::getMaxValForPixelType("UINT8");
-    // float needs to be from min ... max.
-    if (origType == "FLOAT" || origType == "DOUBLE")
-    {
-        /** @TODO this convert routine scale the input values range into the full scale of UInt16
-         *  this is not fully correct
-         */
-        vigra::FindMinMax<float> minmax;   // init functor
-        vigra::inspectImage(srcImageRange(src), minmax);
-        double minVal = minmax.min;
-        double maxVal = minmax.max;
-        vigra_ext::applyMapping(srcImageRange(src), destImage(dest), minVal, maxVal, 0);
-    }
-    else
-    {
-        vigra::transformImage(srcImageRange(src), destImage(dest),
-                              vigra::functor::Arg1()*vigra::functor::Param( newMax/ vigra_ext::getMaxValForPixelType(origType)));
-    };
-}
-
 template <class SrcIMG>
 vigra::BImage LoadGrayImageAndConvert(vigra::ImageImportInfo& info, vigra::BImage& mask)
 {
@@ -138,7 +81,7 @@ vigra::BImage LoadGrayImageAndConvert(vigra::ImageImportInfo& info, vigra::BImag
     {
         importImage(info,destImage(imageIn));
     };
-    convertGrayToUInt8(imageIn,info.getPixelType(),image);
+    HuginLines::convertGrayToUInt8(imageIn,info.getPixelType(),image);
     imageIn.resize(0,0);
     return image;
 };
@@ -157,7 +100,7 @@ vigra::UInt8RGBImage LoadImageAndConvert(vigra::ImageImportInfo& info, vigra::BI
     {
         importImage(info,destImage(imageIn));
     };
-    convertToUInt8(imageIn,info.getPixelType(),image);
+    HuginLines::convertToUInt8(imageIn,info.getPixelType(),image);
     imageIn.resize(0,0);
     return image;
 };
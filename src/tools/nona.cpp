@@ -107,7 +107,8 @@ static void usage(const char* name)
          << "                   optionally you can specify the limits for the" << std::endl
          << "                   lower and upper cutoff (specify in range 0...1," << std::endl
          << "                   relative the full range)" << std::endl
-         << "      --seam=hard|blend   select the blend mode for the seam" << std::endl
+         << "      --seam=hard|blend|pyramid   select the blend mode for the seam" << std::endl
+         << "                   pyramid blends the hard seam with Laplacian pyramids" << std::endl
          << std::endl;
 }
 
@@ -278,8 +279,15 @@ int main(int argc, char* argv[])
                         }
                         else
                         {
-                            std::cerr << hugin_utils::stripPath(argv[0]) << ": String \"" << text << "\" is not a recognized seam blend mode." << std::endl;
-                            return 1;
+                            if (text == "pyramid")
+                            {
+                                HuginBase::Nona::SetAdvancedOption(advOptions, "multiResolutionSeam", true);
+                            }
+                            else
+                            {
+                                std::cerr << hugin_utils::stripPath(argv[0]) << ": String \"" << text << "\" is not a recognized seam blend mode." << std::endl;
+                                return 1;
+                            };
                         };
                     };
                 };
@@ -35,10 +35,7 @@
 #include <algorithms/basic/StraightenPanorama.h>
 #include <algorithms/basic/RotatePanorama.h>
 #include <algorithms/basic/TranslatePanorama.h>
-#include <algorithms/nona/FitPanorama.h>
-#include <algorithms/basic/CalculateOptimalScale.h>
-#include <algorithms/basic/CalculateOptimalROI.h>
-#include <algorithms/basic/LayerStacks.h>
+#include <algorithms/basic/ModifyPanoramaOptions.h>
 #include <algorithms/basic/CalculateMeanExposure.h>
 #include "hugin_utils/utils.h"
 
@@ -170,19 +167,12 @@ int main(int argc, char* argv[])
 
     int projection=-1;
     std::vector<double> projParameter;
-    double newHFOV=-1;
-    double newVFOV=-1;
-    int scale=100;
-    int newWidth=-1;
-    int newHeight=-1;
+    HuginBase::FieldOfViewSetting fov;
+    HuginBase::CanvasSetting canvas;
+    HuginBase::CropSetting crop;
     int outputCroppedTiff=-1;
-    vigra::Rect2D newROI(0,0,0,0);
-    bool doFit=false;
     bool doStraighten=false;
     bool doCenter=false;
-    bool doOptimalSize=false;
-    bool doAutocrop=false;
-    bool autocropHDR=false;
     int c;
     double yaw = 0;
     double pitch = 0;
@@ -253,49 +243,10 @@ int main(int argc, char* argv[])
                 break;
             case SWITCH_FOV:
                 //field of view
-                param=optarg;
-                param=hugin_utils::toupper(param);
-                if(param=="AUTO")
+                if (!HuginBase::ParseFieldOfView(optarg, fov, param))
                 {
-                    doFit=true;
-                }
-                else
-                {
-                    double hfov, vfov;
-                    int n=sscanf(optarg, "%lfx%lf", &hfov, &vfov);
-                    if(n==1)
-                    {
-                        if(hfov>0)
-                        {
-                            newHFOV=hfov;
-                        }
-                        else
-                        {
-                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid field of view" << std::endl;
-                            return 1;
-                        };
-                    }
-                    else
-                    {
-                        if (n==2)
-                        {
-                            if(hfov>0 && vfov>0)
-                            {
-                                newHFOV=hfov;
-                                newVFOV=vfov;
-                            }
-                            else
-                            {
-                                std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid field of view" << std::endl;
-                                return 1;
-                            };
-                        }
-                        else
-                        {
-                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Could not parse field of view" << std::endl;
-                            return 1;
-                        };
-                    };
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": " << param << std::endl;
+                    return 1;
                 };
                 break;
             case 's':
@@ -306,85 +257,18 @@ int main(int argc, char* argv[])
                 break;
             case SWITCH_CANVAS:
                 //canvas size
-                param=optarg;
-                param=hugin_utils::toupper(param);
-                if(param=="AUTO")
+                if (!HuginBase::ParseCanvasSize(optarg, canvas, param))
                 {
-                    doOptimalSize=true;
-                }
-                else
-                {
-                    int pos=param.find("%");
-                    if(pos!=std::string::npos)
-                    {
-                        param=param.substr(0,pos);
-                        scale=atoi(param.c_str());
-                        if(scale==0)
-                        {
-                            std::cerr << hugin_utils::stripPath(argv[0]) << ": No valid scale factor given." << std::endl;
-                            return 1;
-                        };
-                        doOptimalSize=true;
-                    }
-                    else
-                    {
-                        int width, height;
-                        int n=sscanf(optarg, "%dx%d", &width, &height);
-                        if (n==2)
-                        {
-                            if(width>0 && height>0)
-                            {
-                                newWidth=width;
-                                newHeight=height;
-                            }
-                            else
-                            {
-                                std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid canvas size" << std::endl;
-                                return 1;
-                            };
-                        }
-                        else
-                        {
-                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Could not parse canvas size" << std::endl;
-                            return 1;
-                        };
-                    };
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": " << param << std::endl;
+                    return 1;
                 };
                 break;
             case SWITCH_CROP:
                 //crop
-                param=optarg;
-                param=hugin_utils::toupper(param);
-                if(param=="AUTO" || param=="AUTOHDR")
-                {
-                    doAutocrop=true;
-                    if(param=="AUTOHDR")
-                    {
-                        autocropHDR=true;
-                    };
-                }
-                else
+                if (!HuginBase::ParseCrop(optarg, crop, param))
                 {
-                    int left, right, top, bottom;
-                    int n=sscanf(optarg, "%d,%d,%d,%d", &left, &right, &top, &bottom);
-                    if (n==4)
-                    {
-                        if(right>left && bottom>top && left>=0 && top>=0)
-                        {
-                            newROI.setUpperLeft(vigra::Point2D(left,top));
-                            newROI.setLowerRight(vigra::Point2D(right,bottom));
-                        }
-                        else
-                        {
-                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid crop area" << std::endl;
-                            return 1;
-                        };
-                    }
-                    else
-                    {
-                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Could not parse crop values" << std::endl;
-                        return 1;
-                    };
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": " << param << std::endl;
+                    return 1;
                 };
                 break;
             case SWITCH_CROPPED_TIFF:
@@ -528,11 +412,11 @@ int main(int argc, char* argv[])
     if(doStraighten)
     {
         doCenter=false;
-        doFit=true;
+        fov.fit=true;
     };
     if(doCenter)
     {
-        doFit=true;
+        fov.fit=true;
     };
 
     std::string input=argv[optind];
@@ -952,82 +836,42 @@ int main(int argc, char* argv[])
         std::cout << "Center panorama" << std::endl;
         HuginBase::CenterHorizontally(pano).run();
     }
-    //fit fov
-    if(doFit)
+    //fit and/or set field of view
+    if (fov.fit)
     {
         std::cout << "Fit panorama field of view to best size" << std::endl;
-        HuginBase::PanoramaOptions opt = pano.getOptions();
-        HuginBase::CalculateFitPanorama fitPano(pano);
-        fitPano.run();
-        opt.setHFOV(fitPano.getResultHorizontalFOV());
-        opt.setHeight(hugin_utils::roundi(fitPano.getResultHeight()));
-        std::cout << "Setting field of view to " << opt.getHFOV() << " x " << opt.getVFOV() << std::endl;
-        pano.setOptions(opt);
     };
-    //set field of view manually
-    if(newHFOV>0)
+    if (fov.fit || fov.hfov > 0)
     {
-        HuginBase::PanoramaOptions opt = pano.getOptions();
-        opt.setHFOV(newHFOV);
-        if(opt.fovCalcSupported(opt.getProjection()) && newVFOV>0)
-        {
-            opt.setVFOV(newVFOV);
-        }
-        std::cout << "Setting field of view to " << opt.getHFOV() << " x " << opt.getVFOV() << std::endl;
-        pano.setOptions(opt);
+        HuginBase::ApplyFieldOfView(pano, fov);
+        std::cout << "Setting field of view to " << pano.getOptions().getHFOV() << " x " << pano.getOptions().getVFOV() << std::endl;
     };
-    // calc optimal size
-    if(doOptimalSize)
+    // calc optimal size and/or set canvas size
+    if (canvas.optimalSize)
     {
         std::cout << "Calculate optimal size of panorama" << std::endl;
-        double s = HuginBase::CalculateOptimalScale::calcOptimalScale(pano);
-        HuginBase::PanoramaOptions opt = pano.getOptions();
-        opt.setWidth(hugin_utils::roundi(opt.getWidth()*s*scale/100), true);
-        std::cout << "Setting canvas size to " << opt.getWidth() << " x " << opt.getHeight() << std::endl;
-        pano.setOptions(opt);
     };
-    // set canvas size
-    if(newWidth>0 && newHeight>0)
+    if (canvas.optimalSize || (canvas.width > 0 && canvas.height > 0))
     {
-        HuginBase::PanoramaOptions opt = pano.getOptions();
-        opt.setWidth(newWidth);
-        opt.setHeight(newHeight);
-        std::cout << "Setting canvas size to " << opt.getWidth() << " x " << opt.getHeight() << std::endl;
-        pano.setOptions(opt);
+        HuginBase::ApplyCanvasSize(pano, canvas);
+        std::cout << "Setting canvas size to " << pano.getOptions().getWidth() << " x " << pano.getOptions().getHeight() << std::endl;
     };
-    // auto crop
-    if(doAutocrop)
+    // auto crop and/or set crop rectangle
+    if (crop.autocrop)
     {
         std::cout << "Searching for best crop rectangle" << std::endl;
-        AppBase::DummyProgressDisplay dummy;
-        HuginBase::CalculateOptimalROI cropPano(pano, &dummy);
-        if(autocropHDR)
-        {
-            cropPano.setStacks(getHDRStacks(pano,pano.getActiveImages(), pano.getOptions()));
-        }
-        cropPano.run();
-
-        vigra::Rect2D roi=cropPano.getResultOptimalROI();
-        HuginBase::PanoramaOptions opt = pano.getOptions();
-        //set the ROI - fail if the right/bottom is zero, meaning all zero
-        if(!roi.isEmpty())
+    };
+    if (crop.autocrop || (crop.roi.right() != 0 && crop.roi.bottom() != 0))
+    {
+        if (HuginBase::ApplyCrop(pano, crop))
         {
-            opt.setROI(roi);
-            std::cout << "Set crop size to " << roi.left() << "," << roi.top() << "," << roi.right() << "," << roi.bottom() << std::endl;
-            pano.setOptions(opt);
+            const vigra::Rect2D roi = pano.getOptions().getROI();
+            std::cout << "Set crop size to " << roi.left() << "," << roi.right() << "," << roi.top() << "," << roi.bottom() << std::endl;
         }
         else
         {
             std::cout << "Could not find best crop rectangle" << std::endl;
-        }
-    };
-    //setting crop rectangle manually
-    if(newROI.right() != 0 && newROI.bottom() != 0)
-    {
-        HuginBase::PanoramaOptions opt = pano.getOptions();
-        opt.setROI(newROI);
-        std::cout << "Set crop size to " << newROI.left() << "," << newROI.right() << "," << newROI.top() << "," << newROI.bottom() << std::endl;
-        pano.setOptions(opt);
+        };
     };
     //setting interpolation method
     if (interpolation>=0)
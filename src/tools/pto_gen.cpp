@@ -32,6 +32,7 @@
 #include <vigra/imageinfo.hxx>
 #include <panodata/Panorama.h>
 #include <panodata/StandardImageVariableGroups.h>
+#include <panodata/MetadataScanner.h>
 #include <panodata/OptimizerSwitches.h>
 #include <algorithms/basic/CalculateMeanExposure.h>
 #include "hugin_utils/alphanum.h"
@@ -64,6 +65,8 @@ static void usage(const char* name)
          << "                            lens database" << std::endl
          << "     --vignetting           Try to load vignetting information from" << std::endl
          << "                            lens database" << std::endl
+         << "     --metadata-cache       Cache the EXIF data of the images in the" << std::endl
+         << "                            user data directory" << std::endl
          << "     -h, --help             Shows this help" << std::endl
          << std::endl;
 }
@@ -83,6 +86,7 @@ int main(int argc, char* argv[])
         {"linkstacks", no_argument, NULL, 'l' },
         {"distortion", no_argument, NULL, 300 },
         {"vignetting", no_argument, NULL, 301 },
+        {"metadata-cache", no_argument, NULL, 302 },
         {"help", no_argument, NULL, 'h' },
 
         0
@@ -97,6 +101,7 @@ int main(int argc, char* argv[])
     vigra::Rect2D cropRect(0,0,0,0);
     bool loadDistortion=false;
     bool loadVignetting=false;
+    bool useMetadataCache=false;
     while ((c = getopt_long (argc, argv, optstring, longOptions,nullptr)) != -1)
     {
         switch (c)
@@ -175,6 +180,9 @@ int main(int argc, char* argv[])
             case 301:
                 loadVignetting=true;
                 break;
+            case 302:
+                useMetadataCache=true;
+                break;
             case ':':
             case '?':
                 // missing argument or invalid switch
@@ -255,48 +263,46 @@ int main(int argc, char* argv[])
     HuginBase::Panorama pano;
     double redBalanceAnchor = 1.0;
     double blueBalanceAnchor = 1.0;
+    // read image size and EXIF data of all images in parallel,
+    // this is limited by the latency of the file access and not by the cpu
+    std::vector<HuginBase::SrcPanoImage> srcImages(filelist.size());
+    for (size_t i = 0; i < filelist.size(); ++i)
+    {
+        srcImages[i].setFilename(filelist[i]);
+    };
+    {
+        HuginBase::MetadataScanner scanner(useMetadataCache ? HuginBase::MetadataScanner::GetDefaultCacheFilename() : std::string());
+        scanner.readEXIF(srcImages);
+    }
     for(size_t i=0; i<filelist.size(); i++)
     {
-        HuginBase::SrcPanoImage srcImage;
+        HuginBase::SrcPanoImage& srcImage = srcImages[i];
         std::cout << "Reading " << filelist[i] << "..." << std::endl;
-        srcImage.setFilename(filelist[i]);
-        try
+        if(srcImage.getWidth()==0 || srcImage.getHeight()==0)
         {
-            vigra::ImageImportInfo info(filelist[i].c_str());
-            if(info.width()==0 || info.height()==0)
-            {
-                std::cerr << "ERROR: Could not decode image " << filelist[i] << std::endl
-                     << "Skipping this image." << std::endl << std::endl;
-                continue;
-            }
-            srcImage.setSize(info.size());
-            // check for black/white images
-            const std::string pixelType=info.getPixelType();
-            if (pixelType == "BILEVEL")
-            {
-                std::cerr << "ERROR: Image " << filelist[i] << " is a black/white images." << std::endl
-                    << "       This is not supported. Convert to grayscale image and try again." << std::endl
-                    << "       Skipping this image." << std::endl;
-                continue;
-            }
-            if((pixelType=="UINT8") || (pixelType=="UINT16") || (pixelType=="INT16"))
-            {
-                srcImage.setResponseType(HuginBase::SrcPanoImage::RESPONSE_EMOR);
-            }
-            else
-            {
-                srcImage.setResponseType(HuginBase::SrcPanoImage::RESPONSE_LINEAR);
-            };
+            std::cerr << "ERROR: Could not decode image " << filelist[i] << std::endl
+                 << "Skipping this image." << std::endl << std::endl;
+            continue;
         }
-        catch(std::exception& e)
+        // check for black/white images
+        const HuginBase::FileMetaData& metadata = srcImage.getFileMetadata();
+        HuginBase::FileMetaData::const_iterator pixelTypeIt = metadata.find("pixeltype");
+        const std::string pixelType = (pixelTypeIt != metadata.end()) ? pixelTypeIt->second : std::string();
+        if (pixelType == "BILEVEL")
         {
-            std::cerr << "ERROR: caught exception: " << e.what() << std::endl;
-            std::cerr << "Could not read image information for file " << filelist[i] << std::endl;
-            std::cerr << "Skipping this image." << std::endl << std::endl;
+            std::cerr << "ERROR: Image " << filelist[i] << " is a black/white images." << std::endl
+                << "       This is not supported. Convert to grayscale image and try again." << std::endl
+                << "       Skipping this image." << std::endl;
             continue;
+        }
+        if((pixelType=="UINT8") || (pixelType=="UINT16") || (pixelType=="INT16"))
+        {
+            srcImage.setResponseType(HuginBase::SrcPanoImage::RESPONSE_EMOR);
+        }
+        else
+        {
+            srcImage.setResponseType(HuginBase::SrcPanoImage::RESPONSE_LINEAR);
         };
-
-        srcImage.readEXIF();
         bool fovOk=srcImage.applyEXIFValues();
         if(projection>=0)
         {
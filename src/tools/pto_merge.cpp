@@ -104,10 +104,21 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    // read EXIF data, needed for lens detection in merged pano
+    for (size_t i = 0; i < pano.getNrOfImages(); ++i)
+    {
+        HuginBase::SrcPanoImage srcImg(pano.getImage(i));
+        srcImg.readEXIF();
+        pano.setSrcImage(i, srcImg);
+    };
+
+    // read all projects first and merge them in one step
+    std::vector<HuginBase::Panorama> panos(argc - optind - 1);
+    std::vector<const HuginBase::Panorama*> panosToMerge;
     optind++;
     while(optind<argc)
     {
-        HuginBase::Panorama pano2;
+        HuginBase::Panorama& pano2 = panos[panosToMerge.size()];
         std::string input2=argv[optind];
         std::ifstream prjfile2(input2.c_str());
         if (!prjfile2.good())
@@ -123,16 +134,10 @@ int main(int argc, char* argv[])
             std::cerr << "AppBase::DocumentData::ReadWriteError code: " << err << std::endl;
             return 1;
         }
-        // read EXIF data, needed for lens detection in merged pano
-        for (size_t i = 0; i < pano.getNrOfImages(); ++i)
-        {
-            HuginBase::SrcPanoImage srcImg(pano.getImage(i));
-            srcImg.readEXIF();
-            pano.setSrcImage(i, srcImg);
-        };
-        pano.mergePanorama(pano2);
+        panosToMerge.push_back(&pano2);
         optind++;
     };
+    pano.mergePanoramas(panosToMerge);
 
     //write output
     HuginBase::OptimizeVector optvec = pano.getOptimizeVector();
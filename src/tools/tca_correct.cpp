@@ -52,7 +52,6 @@
 #include <algorithms/optimizer/PTOptimizer.h>
 #include <nona/Stitcher.h>
 #include <foreign/levmar/levmar.h>
-#include <hugin_utils/openmp_lock.h>
 #include <lensdb/LensDB.h>
 
 #include <getopt.h>
@@ -104,23 +103,46 @@ struct Parameters
 Parameters g_param;
 
 // Optimiser code
+/** control point for the tca optimizer, the coordinates are copied from the
+ *  panorama, so that the error and jacobian functions don't need to access
+ *  the panorama and can process the points in parallel */
+struct TCAPoint
+{
+    // position in the green (reference) image
+    double xRef, yRef;
+    // position in the red or blue image
+    double x, y;
+    // image number of the red or blue image
+    unsigned int channel;
+    // index of the control point in the panorama
+    unsigned int cpIndex;
+};
+
 struct OptimData
 {
     HuginBase::PanoramaData& m_pano;
     double huberSigma;
     const HuginBase::OptimizeVector& m_optvars;
+    // images, whose parameters are optimized
+    HuginBase::UIntSet m_channels;
 
     double m_dist[3][3]; // a,b,c for all imgs
     double m_shift[2];   // x,y shift
     double m_hfov[3];
     double m_center[2];  // center of image (without shift)
     std::vector<double*> m_mapping;
+    // index of the mapped variable in the gradient array, see optGetJacobian
+    std::vector<int> m_paramIndex;
+
+    std::vector<TCAPoint> m_points;
+    // unweighted error of each point at the last evaluation
+    std::vector<double> m_errors;
 
     int m_maxIter;
 
     OptimData(HuginBase::PanoramaData& pano, const HuginBase::OptimizeVector& optvars,
-        double mEstimatorSigma, int maxIter)
-        : m_pano(pano), huberSigma(mEstimatorSigma), m_optvars(optvars), m_maxIter(maxIter)
+        double mEstimatorSigma, int maxIter, const HuginBase::UIntSet& channels)
+        : m_pano(pano), huberSigma(mEstimatorSigma), m_optvars(optvars), m_channels(channels), m_maxIter(maxIter)
     {
         assert(m_pano.getNrOfImages() == m_optvars.size());
         assert(m_pano.getNrOfImages() == 3);
@@ -128,6 +150,10 @@ struct OptimData
 
         for (unsigned int i = 0; i<3; i++)
         {
+            if (i != 1 && !set_contains(m_channels, i))
+            {
+                continue;
+            };
             const std::set<std::string> vars = m_optvars[i];
             for (std::set<std::string>::const_iterator it = vars.begin(); it != vars.end(); ++it)
             {
@@ -135,14 +161,17 @@ struct OptimData
                 if ((var >= 'a') && (var <= 'c'))
                 {
                     m_mapping.push_back(&(m_dist[i][var - 'a']));
+                    m_paramIndex.push_back(3 * i + var - 'a');
                 }
                 else if ((var == 'd') || (var == 'e'))
                 {
                     m_mapping.push_back(&(m_shift[var - 'd']));
+                    m_paramIndex.push_back(9 + var - 'd');
                 }
                 else if (var == 'v')
                 {
                     m_mapping.push_back(&(m_hfov[i]));
+                    m_paramIndex.push_back(11 + i);
                 }
                 else
                 {
@@ -150,6 +179,37 @@ struct OptimData
                 }
             }
         }
+
+        // the green image is the reference, the other image of the control point
+        // is the channel that is corrected
+        const HuginBase::CPVector& cps = m_pano.getCtrlPoints();
+        for (unsigned int i = 0; i < cps.size(); ++i)
+        {
+            const HuginBase::ControlPoint& cp = cps[i];
+            TCAPoint point;
+            if (cp.image1Nr == 1)
+            {
+                point.xRef = cp.x1;
+                point.yRef = cp.y1;
+                point.x = cp.x2;
+                point.y = cp.y2;
+                point.channel = cp.image2Nr;
+            }
+            else
+            {
+                point.xRef = cp.x2;
+                point.yRef = cp.y2;
+                point.x = cp.x1;
+                point.y = cp.y1;
+                point.channel = cp.image1Nr;
+            };
+            point.cpIndex = i;
+            if (set_contains(m_channels, point.channel))
+            {
+                m_points.push_back(point);
+            };
+        };
+        m_errors.resize(m_points.size(), 0.0);
     }
 
     /// copy internal optimization variables into x
@@ -188,22 +248,38 @@ struct OptimData
             }
         }
     };
+    /** saves the parameters of the optimized channels into the panorama,
+     *  must not be called concurrently */
     void SaveToImgs()
     {
         for (unsigned int i = 0; i < 3; i++)
         {
             HuginBase::SrcPanoImage img = m_pano.getSrcImage(i);
-            img.setHFOV(m_hfov[i]);
-            std::vector<double> radialDist(4);
-            radialDist[0] = m_dist[i][0];
-            radialDist[1] = m_dist[i][1];
-            radialDist[2] = m_dist[i][2];
-            radialDist[3] = 1 - radialDist[0] - radialDist[1] - radialDist[2];
-            img.setRadialDistortion(radialDist);
+            if (set_contains(m_channels, i))
+            {
+                img.setHFOV(m_hfov[i]);
+                std::vector<double> radialDist(4);
+                radialDist[0] = m_dist[i][0];
+                radialDist[1] = m_dist[i][1];
+                radialDist[2] = m_dist[i][2];
+                radialDist[3] = 1 - radialDist[0] - radialDist[1] - radialDist[2];
+                img.setRadialDistortion(radialDist);
+            };
             img.setRadialDistortionCenterShift(hugin_utils::FDiff2D(m_shift[0], m_shift[1]));
             m_pano.setSrcImage(i, img);
         }
     };
+    /** saves the errors of the last evaluation into the control points,
+     *  must not be called concurrently */
+    void SaveErrors()
+    {
+        HuginBase::CPVector cps = m_pano.getCtrlPoints();
+        for (size_t i = 0; i < m_points.size(); ++i)
+        {
+            cps[m_points[i].cpIndex].error = m_errors[i];
+        };
+        m_pano.updateCtrlPointErrors(cps);
+    };
 };
 
 void get_optvars(HuginBase::OptimizeVector& _retval)
@@ -257,13 +333,9 @@ inline double weightHuber(double x, double sigma)
     return x;
 }
 
-void optGetError(double* p, double* x, int m, int n, void* data)
+/** compute new a,b,c,d from a,b,c,v */
+void calcPolynomials(const OptimData* dat, double dist[3][4])
 {
-    OptimData* dat = static_cast<OptimData*>(data);
-    dat->FromX(p);
-
-    /* compute new a,b,c,d from a,b,c,v */
-    double dist[3][4];
     for (unsigned int i = 0; i<3; i++)
     {
         double scale = dat->m_hfov[1] / dat->m_hfov[i];
@@ -273,82 +345,128 @@ void optGetError(double* p, double* x, int m, int n, void* data)
         }
         dist[i][3] = scale*(1 - dat->m_dist[i][0] - dat->m_dist[i][1] - dat->m_dist[i][2]);
     }
+}
 
-    double center[2];
-    center[0] = dat->m_center[0] + dat->m_shift[0];
-    center[1] = dat->m_center[1] + dat->m_shift[1];
+void optGetError(double* p, double* x, int m, int n, void* data)
+{
+    OptimData* dat = static_cast<OptimData*>(data);
+    dat->FromX(p);
 
-    double base_size = std::min(dat->m_center[0], dat->m_center[1]);
+    double dist[3][4];
+    calcPolynomials(dat, dist);
 
-    HuginBase::CPVector newCPs;
+    const double center[2] = { dat->m_center[0] + dat->m_shift[0], dat->m_center[1] + dat->m_shift[1] };
+    const double base_size = std::min(dat->m_center[0], dat->m_center[1]);
+    const double huberSigma = dat->huberSigma;
 
-    unsigned int noPts = dat->m_pano.getNrOfCtrlPoints();
     // loop over all points to calculate the error
-    for (unsigned int ptIdx = 0; ptIdx < noPts; ptIdx++)
+#pragma omp parallel for schedule(static)
+    for (int ptIdx = 0; ptIdx < n; ptIdx++)
     {
-        const HuginBase::ControlPoint& cp = dat->m_pano.getCtrlPoint(ptIdx);
+        const TCAPoint& pt = dat->m_points[ptIdx];
+        const double* d = dist[pt.channel];
 
-        double dist_p1 = vigra::hypot(cp.x1 - center[0], cp.y1 - center[1]);
-        double dist_p2 = vigra::hypot(cp.x2 - center[0], cp.y2 - center[1]);
+        const double dist_ref = vigra::hypot(pt.xRef - center[0], pt.yRef - center[1]);
+        const double dist_p = vigra::hypot(pt.x - center[0], pt.y - center[1]);
 
-        if (cp.image1Nr == 1)
-        {
-            double base_dist = dist_p1 / base_size;
-            double corr_dist_p1 = dist[cp.image2Nr][0] * pow(base_dist, 4) +
-                dist[cp.image2Nr][1] * pow(base_dist, 3) +
-                dist[cp.image2Nr][2] * pow(base_dist, 2) +
-                dist[cp.image2Nr][3] * base_dist;
-            corr_dist_p1 *= base_size;
-            x[ptIdx] = corr_dist_p1 - dist_p2;
-        }
-        else
-        {
-            double base_dist = dist_p2 / base_size;
-            double corr_dist_p2 = dist[cp.image1Nr][0] * pow(base_dist, 4) +
-                dist[cp.image1Nr][1] * pow(base_dist, 3) +
-                dist[cp.image1Nr][2] * pow(base_dist, 2) +
-                dist[cp.image1Nr][3] * base_dist;
-            corr_dist_p2 *= base_size;
-            x[ptIdx] = corr_dist_p2 - dist_p1;
-        }
-
-        HuginBase::ControlPoint newcp = cp;
-        newcp.error = fabs(x[ptIdx]);
-        newCPs.push_back(newcp);
+        const double base_dist = dist_ref / base_size;
+        const double corr_dist = base_size * (((d[0] * base_dist + d[1]) * base_dist + d[2]) * base_dist + d[3]) * base_dist;
+        x[ptIdx] = corr_dist - dist_p;
+        dat->m_errors[ptIdx] = fabs(x[ptIdx]);
 
-        dat->m_pano.getCtrlPoint(ptIdx);
         // use huber robust estimator
-        if (dat->huberSigma > 0)
+        if (huberSigma > 0)
         {
-            x[ptIdx] = weightHuber(x[ptIdx], dat->huberSigma);
+            x[ptIdx] = weightHuber(x[ptIdx], huberSigma);
         }
     }
-
-    dat->m_pano.updateCtrlPointErrors(newCPs);
 }
 
-int optVis(double* p, double* x, int m, int n, int iter, double sqerror, void* data)
+/** analytic jacobian of optGetError
+ *
+ *  The derivatives are calculated for all 14 variables (a,b,c of each image,
+ *  x and y shift, hfov of each image) and then mapped to the optimized variables.
+ *  The hfov of the green image is never optimized (see get_optvars).
+ */
+void optGetJacobian(double* p, double* jac, int m, int n, void* data)
 {
-    return 1;
-    /*    OptimData * dat = (OptimData *) data;
-    char tmp[200];
-    tmp[199] = 0;
-    double error = sqrt(sqerror/n)*255;
-    snprintf(tmp,199, "Iteration: %d, error: %f", iter, error);
-    return dat->m_progress.increaseProgress(0.0, tmp) ? 1 : 0 ; */
-}
+    OptimData* dat = static_cast<OptimData*>(data);
+    dat->FromX(p);
 
-// Method 1: minimize only the center distance difference (sagittal distance) of the points
-//   the tangential distance is not of interest for TCA correction, 
-//   and is caused by the limited accuracy of the fine tune function, especially close the the edge of the fisheye image
-void optimize_new(HuginBase::PanoramaData& pano)
-{
-    HuginBase::OptimizeVector optvars;
-    get_optvars(optvars);
+    double dist[3][4];
+    calcPolynomials(dat, dist);
 
-    int nMaxIter = 1000;
-    OptimData data(pano, optvars, 0.5, nMaxIter);
+    const double center[2] = { dat->m_center[0] + dat->m_shift[0], dat->m_center[1] + dat->m_shift[1] };
+    const double base_size = std::min(dat->m_center[0], dat->m_center[1]);
+    const double huberSigma = dat->huberSigma;
 
+#pragma omp parallel for schedule(static)
+    for (int ptIdx = 0; ptIdx < n; ptIdx++)
+    {
+        const TCAPoint& pt = dat->m_points[ptIdx];
+        const unsigned int c = pt.channel;
+        const double* d = dist[c];
+        const double* a = dat->m_dist[c];
+        const double scale = dat->m_hfov[1] / dat->m_hfov[c];
+
+        const double dxRef = pt.xRef - center[0];
+        const double dyRef = pt.yRef - center[1];
+        const double dx = pt.x - center[0];
+        const double dy = pt.y - center[1];
+        const double dist_ref = vigra::hypot(dxRef, dyRef);
+        const double dist_p = vigra::hypot(dx, dy);
+        const double t = dist_ref / base_size;
+        const double t2 = t * t;
+        const double t3 = t2 * t;
+        const double t4 = t3 * t;
+
+        double grad[14] = { 0 };
+        // derivatives of a, b, c
+        grad[3 * c] = base_size * (pow(scale, 4) * t4 - scale * t);
+        grad[3 * c + 1] = base_size * (pow(scale, 3) * t3 - scale * t);
+        grad[3 * c + 2] = base_size * (scale * scale * t2 - scale * t);
+        // derivative of hfov, scale = hfov_green / hfov
+        const double dPolyScale = 4 * a[0] * pow(scale, 3) * t4 + 3 * a[1] * scale * scale * t3 + 2 * a[2] * scale * t2 + (1 - a[0] - a[1] - a[2]) * t;
+        grad[11 + c] = -base_size * dPolyScale * scale / dat->m_hfov[c];
+        // derivative of center shift
+        const double dPoly = 4 * d[0] * t3 + 3 * d[1] * t2 + 2 * d[2] * t + d[3];
+        if (dist_ref > 0)
+        {
+            grad[9] -= dPoly * dxRef / dist_ref;
+            grad[10] -= dPoly * dyRef / dist_ref;
+        };
+        if (dist_p > 0)
+        {
+            grad[9] += dx / dist_p;
+            grad[10] += dy / dist_p;
+        };
+
+        // chain rule for huber robust estimator
+        double weight = 1.0;
+        if (huberSigma > 0)
+        {
+            const double error = base_size * (((d[0] * t + d[1]) * t + d[2]) * t + d[3]) * t - dist_p;
+            if (fabs(error) > huberSigma)
+            {
+                weight = huberSigma / sqrt(huberSigma * (2.0 * fabs(error) - huberSigma));
+                if (error < 0)
+                {
+                    weight = -weight;
+                };
+            };
+        };
+        double* row = jac + ptIdx * m;
+        for (int i = 0; i < m; ++i)
+        {
+            row[i] = weight * grad[dat->m_paramIndex[i]];
+        };
+    }
+}
+
+/** optimizes the given data with levenberg-marquardt and analytic jacobian,
+ *  does not access the panorama, so it can run concurrently for different data */
+void runOptimizer(OptimData& data, const char* name)
+{
     int ret;
     double info[LM_INFO_SZ];
 
@@ -357,13 +475,18 @@ void optimize_new(HuginBase::PanoramaData& pano)
     vigra::ArrayVector<double> p(m, 0.0);
 
     // vector for errors
-    int n = pano.getNrOfCtrlPoints();
+    int n = data.m_points.size();
+    if (m == 0 || n < m)
+    {
+        fprintf(stderr, "%s: not enough control points for optimization.\n", name);
+        return;
+    };
     vigra::ArrayVector<double> x(n, 0.0);
 
     data.ToX(p.begin());
     if (g_param.verbose > 0)
     {
-        fprintf(stderr, "Parameters before optimization: ");
+        fprintf(stderr, "%s: Parameters before optimization: ", name);
         for (int i = 0; i<m; ++i)
         {
             fprintf(stderr, "%.7g ", p[i]);
@@ -371,22 +494,15 @@ void optimize_new(HuginBase::PanoramaData& pano)
         fprintf(stderr, "\n");
     }
 
-    ret = dlevmar_dif(&optGetError, &optVis, &(p[0]), &(x[0]), m, n, nMaxIter, NULL, info, NULL, NULL, &data);  // no jacobian
-    // copy to source images (data.m_imgs)
-    data.SaveToImgs();
+    ret = dlevmar_der(&optGetError, &optGetJacobian, &(p[0]), &(x[0]), m, n, data.m_maxIter, NULL, info, NULL, NULL, &data);
+    data.FromX(&(p[0]));
     // calculate error at solution
     data.huberSigma = 0;
     optGetError(&(p[0]), &(x[0]), m, n, &data);
-    double error = 0;
-    for (int i = 0; i<n; i++)
-    {
-        error += x[i] * x[i];
-    }
-    error = sqrt(error / n);
 
     if (g_param.verbose > 0)
     {
-        fprintf(stderr, "Levenberg-Marquardt returned %d in %g iter, reason %g\nSolution: ", ret, info[5], info[6]);
+        fprintf(stderr, "%s: Levenberg-Marquardt returned %d in %g iter, reason %g\nSolution: ", name, ret, info[5], info[6]);
         for (int i = 0; i<m; ++i)
         {
             fprintf(stderr, "%.7g ", p[i]);
@@ -400,6 +516,51 @@ void optimize_new(HuginBase::PanoramaData& pano)
     }
 }
 
+// Method 1: minimize only the center distance difference (sagittal distance) of the points
+//   the tangential distance is not of interest for TCA correction, 
+//   and is caused by the limited accuracy of the fine tune function, especially close the the edge of the fisheye image
+void optimize_new(HuginBase::PanoramaData& pano)
+{
+    HuginBase::OptimizeVector optvars;
+    get_optvars(optvars);
+
+    int nMaxIter = 1000;
+    if (set_contains(optvars[0], "d") || set_contains(optvars[0], "e"))
+    {
+        // the center shift is shared by the red and blue channel,
+        // so both channels needs to be optimized together
+        HuginBase::UIntSet channels;
+        channels.insert(0);
+        channels.insert(2);
+        OptimData data(pano, optvars, 0.5, nMaxIter, channels);
+        runOptimizer(data, "red+blue");
+        data.SaveToImgs();
+        data.SaveErrors();
+    }
+    else
+    {
+        // red and blue channel are independent, optimize them concurrently
+        // sharing the same control points
+        HuginBase::UIntSet redChannel;
+        redChannel.insert(0);
+        HuginBase::UIntSet blueChannel;
+        blueChannel.insert(2);
+        OptimData redData(pano, optvars, 0.5, nMaxIter, redChannel);
+        OptimData blueData(pano, optvars, 0.5, nMaxIter, blueChannel);
+#pragma omp parallel sections
+        {
+#pragma omp section
+            runOptimizer(redData, "red");
+#pragma omp section
+            runOptimizer(blueData, "blue");
+        }
+        redData.SaveToImgs();
+        blueData.SaveToImgs();
+        redData.SaveErrors();
+        blueData.SaveErrors();
+    };
+}
+
 static void usage(const char* name)
 {
     std::cout << name << ": Parameter estimation of transverse chromatic abberations" << std::endl
@@ -436,7 +597,6 @@ static void usage(const char* name)
          << "    commandline arguments for fulla" << std::endl;
 }
 
-static hugin_omp::Lock lock;
 typedef std::multimap<double, vigra::Diff2D> MapPoints;
 
 template <class ImageType>
@@ -479,6 +639,9 @@ void createCtrlPoints(HuginBase::Panorama& pano, const ImageType& img, int imgRe
         };
     };
 
+    // each grid cell gets its own result buffer, the points are added after
+    // the parallel loop in a deterministic order
+    std::vector<HuginBase::CPVector> cellCps(rects.size());
     #pragma omp parallel for schedule(dynamic)
     for (int i = 0; i < rects.size(); ++i)
     {
@@ -487,7 +650,7 @@ void createCtrlPoints(HuginBase::Panorama& pano, const ImageType& img, int imgRe
         vigra_ext::findInterestPointsPartial(vigra::srcImageRange(img8, vigra::GreenAccessor<vigra::RGBValue<vigra::UInt8> >()), rect, scale, 5 * nPoints, points);
 
         // loop over all points, starting with the highest corner score
-        HuginBase::CPVector cps;
+        HuginBase::CPVector& cps = cellCps[i];
         size_t nBad = 0;
         for (MapPoints::const_reverse_iterator it = points.rbegin(); it != points.rend(); ++it)
         {
@@ -551,13 +714,12 @@ void createCtrlPoints(HuginBase::Panorama& pano, const ImageType& img, int imgRe
             buf << "Number of good matches: " << cps.size() << ", bad matches: " << nBad << std::endl;
             std::cout << buf.str();
         }
-        if (!cps.empty())
+    };
+    for (size_t i = 0; i < cellCps.size(); ++i)
+    {
+        for (HuginBase::CPVector::const_iterator it = cellCps[i].begin(); it != cellCps[i].end(); ++it)
         {
-            hugin_omp::ScopedLock sl(lock);
-            for (HuginBase::CPVector::const_iterator it = cps.begin(); it != cps.end(); ++it)
-            {
-                pano.addCtrlPoint(*it);
-            };
+            pano.addCtrlPoint(*it);
         };
     };
 };
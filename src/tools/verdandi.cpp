@@ -134,7 +134,7 @@ void SetCompression(vigra::ImageExportInfo& output, const std::string& compressi
 
 /** loads image one by one and merge with all previouly loaded images, saves the final results */
 template <class ImageType>
-bool LoadAndMergeImages(std::vector<vigra::ImageImportInfo> imageInfos, const std::string& filename, const std::string& compression, const bool wrap, const bool hardSeam, const bool useBigTiff)
+bool LoadAndMergeImages(std::vector<vigra::ImageImportInfo> imageInfos, const std::string& filename, const std::string& compression, const bool wrap, const vigra_ext::SeamBlendMode seamMode, const bool useBigTiff)
 {
     if (imageInfos.empty())
     {
@@ -164,7 +164,7 @@ bool LoadAndMergeImages(std::vector<vigra::ImageImportInfo> imageInfos, const st
         std::cout << "Loaded " << imageInfos[i].getFileName() << std::endl;
         roi |= vigra::Rect2D(vigra::Point2D(imageInfos[i].getPosition()), imageInfos[i].size());
 
-        vigra_ext::MergeImages(image, mask, image2, mask2, imageInfos[i].getPosition(), wrap, hardSeam);
+        vigra_ext::MergeImages(image, mask, image2, mask2, imageInfos[i].getPosition(), wrap, seamMode);
     };
     // save output
     {
@@ -192,7 +192,9 @@ static void usage(const char* name)
         << "                            For jpeg output: 0-100" << std::endl
         << "                            For tiff output: PACKBITS, DEFLATE, LZW" << std::endl
         << "     -w, --wrap          Wraparound 360 deg border." << std::endl
-        << "     --seam=hard|blend   Select the blend mode for the seam" << std::endl
+        << "     --seam=hard|blend|pyramid   Select the blend mode for the seam" << std::endl
+        << "                         pyramid blends the hard seam with" << std::endl
+        << "                         Laplacian pyramids" << std::endl
         << "     --bigtiff           Write output in BigTIFF format" << std::endl
         << "                         (only with TIFF output)" << std::endl
         << "     -h, --help          Shows this help" << std::endl
@@ -258,7 +260,7 @@ int main(int argc, char* argv[])
     std::string output;
     std::string compression;
     bool wraparound = false;
-    bool hardSeam = true;
+    vigra_ext::SeamBlendMode seamMode = vigra_ext::SEAM_HARD;
     bool useBigTIFF = false;
     while ((c = getopt_long(argc, argv, optstring, longOptions, nullptr)) != -1)
     {
@@ -280,18 +282,25 @@ int main(int argc, char* argv[])
                 text = hugin_utils::tolower(text);
                 if (text == "hard")
                 {
-                    hardSeam = true;
+                    seamMode = vigra_ext::SEAM_HARD;
                 }
                 else
                 {
                     if (text == "blend")
                     {
-                        hardSeam = false;
+                        seamMode = vigra_ext::SEAM_POISSON;
                     }
                     else
                     {
-                        std::cerr << hugin_utils::stripPath(argv[0]) << ": String \"" << text << "\" is not a recognized seam blend mode." << std::endl;
-                        return 1;
+                        if (text == "pyramid")
+                        {
+                            seamMode = vigra_ext::SEAM_MULTIRESOLUTION;
+                        }
+                        else
+                        {
+                            std::cerr << hugin_utils::stripPath(argv[0]) << ": String \"" << text << "\" is not a recognized seam blend mode." << std::endl;
+                            return 1;
+                        };
                     };
                 };
             };
@@ -469,31 +478,31 @@ int main(int argc, char* argv[])
         {
             if (pixeltype == "UINT8")
             {
-                success = LoadAndMergeImages<vigra::BRGBImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::BRGBImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "INT16")
             {
-                success = LoadAndMergeImages<vigra::Int16RGBImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::Int16RGBImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "UINT16")
             {
-                success = LoadAndMergeImages<vigra::UInt16RGBImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::UInt16RGBImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "INT32")
             {
-                success = LoadAndMergeImages<vigra::Int32RGBImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::Int32RGBImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "UINT32")
             {
-                success = LoadAndMergeImages<vigra::UInt32RGBImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::UInt32RGBImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "FLOAT")
             {
-                success = LoadAndMergeImages<vigra::FRGBImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::FRGBImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "DOUBLE")
             {
-                success = LoadAndMergeImages<vigra::DRGBImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::DRGBImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else
             {
@@ -505,31 +514,31 @@ int main(int argc, char* argv[])
             //grayscale images
             if (pixeltype == "UINT8")
             {
-                success = LoadAndMergeImages<vigra::BImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::BImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "INT16")
             {
-                success = LoadAndMergeImages<vigra::Int16Image>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::Int16Image>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "UINT16")
             {
-                success = LoadAndMergeImages<vigra::UInt16Image>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::UInt16Image>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "INT32")
             {
-                success = LoadAndMergeImages<vigra::Int32Image>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::Int32Image>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "UINT32")
             {
-                success = LoadAndMergeImages<vigra::UInt32Image>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::UInt32Image>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "FLOAT")
             {
-                success = LoadAndMergeImages<vigra::FImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::FImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else if (pixeltype == "DOUBLE")
             {
-                success = LoadAndMergeImages<vigra::DImage>(imageInfos, output, compression, wraparound, hardSeam, useBigTIFF);
+                success = LoadAndMergeImages<vigra::DImage>(imageInfos, output, compression, wraparound, seamMode, useBigTIFF);
             }
             else
             {